@@ -1,13 +1,42 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <string.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <ftw.h>
+
+// io_uring é usado via syscalls diretas, sem depender da liburing
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define TEM_IO_URING 1
+#endif
+#endif
 
 // Definir CLOCK_MONOTONIC
 #ifndef CLOCK_MONOTONIC
@@ -22,14 +51,164 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+// Identificação do arquivo de origem de uma imagem (para o índice incremental)
+typedef struct {
+    uint64_t tamanho;      // Tamanho em bytes
+    int64_t mtime_ns;      // Data de modificação em nanossegundos
+    uint64_t hash_conteudo; // Hash do conteúdo (0 se não calculado)
+} OrigemArquivo;
+
+// Operações de imagem que podem ser pedidas ao modo servidor
+#define OP_CINZA 1
+#define OP_INVERTER 2
+#define OP_BRILHO 3
+#define OP_CONTRASTE 4
+#define OP_MINIATURA 5     // Reduz a imagem para caber em um quadrado (parâmetro: lado em pixels)
+#define OP_RECORTE 6       // Mantém só uma região da imagem (campos x, y, largura, altura)
+#define LIMITE_RECORTE (1u << 30) // Maior coordenada ou tamanho aceito em um recorte
+#define LIMITE_FATOR 64.0f         // Maior fator de brilho ou contraste aceito
+#define LIMITE_MINIATURA 65536     // Maior lado de miniatura aceito
+#define MAX_OPERACOES 16
+
+typedef struct {
+    uint32_t codigo;       // OP_*
+    float parametro;       // Fator (brilho/contraste), lado (miniatura); ignorado pelas demais
+    uint32_t x;            // Recorte: canto superior esquerdo
+    uint32_t y;
+    uint32_t largura;      // Recorte: tamanho da região (0 nas demais operações)
+    uint32_t altura;
+} OperacaoProtocolo;
+
+// Plano de execução: uma lista de operações compilada em etapas. Operações
+// pontuais vizinhas (inverter, brilho, contraste) viram uma única tabela de
+// 256 valores; a conversão para cinza absorve as tabelas vizinhas e faz
+// tudo em uma passada; depois dela, se ainda houver etapas, a imagem segue
+// com um canal só e volta a RGB no fim. Tabelas identidade são eliminadas.
+// Recortes não custam uma passada: viram uma vista sobre os pixels e sobem
+// para o início do trecho entre miniaturas, antes das operações pontuais.
+#define ETAPA_TABELA 1     // Tabela aplicada a todos os bytes
+#define ETAPA_CINZA 2      // Tabela de entrada, conversão para cinza e tabela de saída
+#define ETAPA_MINIATURA 3  // Redução pela média das áreas
+#define ETAPA_EXPANDIR 4   // Cinza de um canal volta a RGB
+#define ETAPA_RECORTE 5    // Vista sobre uma região (sem cópia)
+
+typedef struct {
+    int tipo;              // ETAPA_*
+    int canais_saida;      // ETAPA_CINZA: 1 (compacta a imagem) ou 3
+    int usa_tabela_entrada; // ETAPA_CINZA: tabela_entrada não é a identidade
+    int lado;              // ETAPA_MINIATURA
+    int x, y, largura, altura; // ETAPA_RECORTE (relativos à imagem na entrada da etapa)
+    unsigned char tabela_entrada[256];
+    unsigned char tabela[256];
+} EtapaPlano;
+
+typedef struct {
+    EtapaPlano etapas[MAX_OPERACOES + 1];
+    int num_etapas;
+    int num_operacoes;     // Operações que originaram o plano
+    int altera_dimensoes;  // O plano contém miniaturas ou recortes
+} PlanoExecucao;
+
+// Variante de saída (--variante): cada imagem decodificada alimenta todas
+// as variantes, cada uma com suas operações, formato e subdiretório
+#define MAX_VARIANTES 8
+
+typedef struct {
+    char nome[64];         // Subdiretório da variante dentro da saída
+    OperacaoProtocolo operacoes[MAX_OPERACOES];
+    int num_operacoes;
+    char extensao[8];      // Formato da saída (ex: ".jpg"), ou vazio para manter o da entrada
+} Variante;
+
+// Protocolo binário do modo servidor (socket Unix, ordem de bytes do host).
+// Cada requisição é um RequisicaoProtocolo seguido de tamanho_carga bytes:
+// a imagem codificada (CARGA_BYTES) ou um caminho no servidor (CARGA_CAMINHO).
+// Cada resposta é um RespostaProtocolo seguido de tamanho bytes da imagem
+// resultante. Requisições de uma conexão são respondidas em ordem.
+#define PROTOCOLO_MAGICO 0x474D4950u  // "PIMG"
+#define PROTOCOLO_VERSAO 2
+#define CARGA_BYTES 0
+#define CARGA_CAMINHO 1
+#define MAX_CARGA_SERVIDOR (256u * 1024 * 1024)
+
+typedef struct {
+    uint32_t magico;       // PROTOCOLO_MAGICO
+    uint16_t versao;       // PROTOCOLO_VERSAO
+    uint8_t tipo_carga;    // CARGA_BYTES ou CARGA_CAMINHO
+    uint8_t num_operacoes; // Operações válidas em operacoes[]
+    uint32_t id;           // Devolvido na resposta
+    uint32_t reservado;
+    uint64_t tamanho_carga;
+    char formato[8];       // Formato da saída: "png", "jpg", "bmp" ou "tga"
+    OperacaoProtocolo operacoes[MAX_OPERACOES];
+} RequisicaoProtocolo;
+
+typedef struct {
+    uint32_t magico;       // PROTOCOLO_MAGICO
+    uint32_t id;           // Mesmo id da requisição
+    int32_t status;        // 0 ou um código errno
+    uint32_t reservado;
+    uint64_t tamanho;      // Bytes da imagem que seguem a resposta
+} RespostaProtocolo;
+
+struct TrabalhoServidor;
+struct FluxoQuadros;
+
+// Interface de quadros em memória compartilhada (shm_open + futex).
+// O segmento começa com um CabecalhoSegmento, seguido de num_quadros
+// CabecalhoQuadro e das áreas de pixels (RGB, 3 canais por pixel), cada uma
+// alinhada a 4096 bytes. Cada quadro circula LIVRE -> PREENCHIDO (escritor)
+// -> PROCESSANDO -> CONCLUIDO (pipeline) -> LIVRE (escritor, depois de ler o
+// resultado). Os pixels são transformados no próprio segmento, sem cópias.
+#define SEGMENTO_MAGICO 0x51444D53u  // "SMDQ"
+#define SEGMENTO_VERSAO 1
+#define QUADRO_LIVRE 0
+#define QUADRO_PREENCHIDO 1
+#define QUADRO_PROCESSANDO 2
+#define QUADRO_CONCLUIDO 3
+
+typedef struct CabecalhoQuadro {
+    uint32_t estado;           // QUADRO_* (também é a palavra do futex do quadro)
+    int32_t status;            // 0 ou código errno, definido ao concluir
+    uint32_t largura;
+    uint32_t altura;
+    uint64_t sequencia;        // Livre para o escritor (ex: número do quadro)
+    uint64_t deslocamento;     // Início dos pixels a partir do início do segmento
+} CabecalhoQuadro;
+
+typedef struct {
+    uint32_t magico;           // SEGMENTO_MAGICO
+    uint32_t versao;           // SEGMENTO_VERSAO
+    uint32_t num_quadros;
+    uint32_t encerrado;        // 1 quando o pipeline deixou de atender o segmento
+    uint64_t bytes_por_quadro; // Capacidade de pixels de cada quadro
+    uint64_t tamanho_total;    // Tamanho do segmento em bytes
+    uint32_t preenchidos;      // Futex: incrementado pelo escritor a cada quadro entregue
+    uint32_t reservado[7];
+} CabecalhoSegmento;
+
 // Declarações das estruturas
 typedef struct {
-    char nome[256];        // Nome do arquivo
+    char nome[PATH_MAX];   // Nome do arquivo
     int largura;          // Largura da imagem
     int altura;           // Altura da imagem
     int canais;           // Número de canais
     unsigned char* dados; // Dados da imagem
     int produtor_id;      // ID do produtor que inseriu a imagem
+    OrigemArquivo origem; // Arquivo de origem, como visto pela varredura
+    struct TrabalhoServidor* trabalho; // Job do modo servidor (NULL para arquivos da varredura)
+    CabecalhoQuadro* quadro; // Quadro da memória compartilhada (pixels emprestados) ou NULL
+    struct FluxoQuadros* fluxo; // Modo fluxo: quadro de stdin a escrever em ordem (ou NULL)
+    unsigned long long sequencia; // Ordem de chegada (modo fluxo)
+    struct DecodificacaoCompartilhada* compartilhada; // Variantes: pixels decodificados compartilhados (ou NULL)
+    int variante;          // Variantes: índice em config.variantes
+    const unsigned char* fonte; // Pixels a ler, quando não são dados: somente leitura ou vista dentro de dados
+    size_t passo;          // Bytes entre as linhas de fonte (0: largura * canais)
+    OperacaoProtocolo pendentes[MAX_OPERACOES]; // Operações adiadas até a materialização
+    int num_pendentes;
+    double custo_previsto; // Custo estimado da transformação e codificação em ns (0: não estimado)
+    size_t reserva;        // Bytes do orçamento de memória que acompanham os pixels
+    double chegada;        // Instante (CLOCK_MONOTONIC, em s) em que o produtor começou a ler o arquivo (0: não medido)
 } Imagem;
 
 // Estrutura para Future
@@ -40,29 +219,417 @@ typedef struct {
     pthread_cond_t cond;
 } Future;
 
+// Tamanho da linha de cache: campos escritos por threads diferentes ficam em
+// linhas separadas, para que uma escrita não invalide a linha da outra
+#define LINHA_CACHE 64
+
 typedef struct {
     Imagem* imagens;      // Array de imagens
     Future** futures;     // Array de futures
     int capacidade;       // Tamanho máximo da fila
-    int inicio;          // Índice do início da fila
-    int fim;             // Índice do fim da fila
-    int tamanho;         // Número atual de imagens na fila
     
-    pthread_mutex_t mutex;    // Mutex para proteger a fila
-    sem_t vazio;             // Semáforo para controlar slots vazios
-    sem_t cheio;             // Semáforo para controlar slots ocupados
+    _Alignas(LINHA_CACHE) pthread_mutex_t mutex;    // Mutex para proteger a fila
+    int tamanho;         // Número atual de imagens na fila
+    _Alignas(LINHA_CACHE) int inicio;   // Índice do início da fila (consumidores)
+    _Alignas(LINHA_CACHE) int fim;      // Índice do fim da fila (produtores)
+    _Alignas(LINHA_CACHE) sem_t vazio;  // Semáforo para controlar slots vazios
+    _Alignas(LINHA_CACHE) sem_t cheio;  // Semáforo para controlar slots ocupados
 } FilaImagens;
 
+// Arquivo encontrado pela varredura do diretório de entrada
+typedef struct {
+    char* caminho;         // Caminho completo do arquivo (alocado; quem retira a entrada libera)
+    OrigemArquivo origem;  // Tamanho e data de modificação (do stat da varredura)
+    unsigned long long sequencia; // Ordem em que a varredura encontrou o arquivo
+    double custo;          // Custo estimado em ns (só com --agendamento=lpt)
+    int pre_carregada;     // O pré-carregador já pediu o readahead do arquivo
+} EntradaArquivo;
+
+// Lista de varredura: buffer circular de arquivos a carregar, em ordem de
+// varredura (com --agendamento=lpt, as pendentes ficam em ordem de custo)
+typedef struct {
+    EntradaArquivo* entradas;       // Buffer circular de entradas
+    int capacidade;                 // Número máximo de entradas pendentes
+    unsigned long long escritos;    // Posição da próxima entrada a ser adicionada
+    unsigned long long lidos;       // Posição da próxima entrada a ser retirada
+    int concluida;                  // 1 quando a varredura terminou
+    int liberada;                   // LPT: os produtores já começaram a retirar entradas
+    
+    pthread_mutex_t mutex;          // Mutex para proteger a lista
+    pthread_cond_t nao_vazia;       // Sinalizada quando há entradas ou a varredura termina
+    pthread_cond_t nao_cheia;       // Sinalizada quando há espaço livre
+} ListaVarredura;
+
+// Diretório aguardando para ser percorrido pela varredura
+typedef struct DiretorioPendente {
+    char* caminho;
+    struct DiretorioPendente* proximo;
+} DiretorioPendente;
+
+// Identificador único de um diretório ou arquivo (ciclos de links simbólicos e caminhos ignorados)
+typedef struct {
+    dev_t dispositivo;
+    ino_t inode;
+} IdentificadorDiretorio;
+
+// Vigilância do diretório de entrada com inotify (modo daemon)
+typedef struct {
+    int fd;                  // Descritor do inotify
+    char** diretorios;       // Caminho de cada diretório, indexado pelo watch descriptor
+    int capacidade;
+    pthread_mutex_t mutex;
+    // Estatísticas
+    long eventos;            // Eventos de arquivo recebidos
+    long coalescidos;        // Eventos repetidos absorvidos em uma rajada
+    long enfileirados;       // Arquivos entregues à lista de varredura
+    long transbordamentos;   // IN_Q_OVERFLOW (a árvore é varrida de novo)
+} Vigilancia;
+
+// Máximo de caminhos gerados pelo programa que a varredura ignora
+#define MAX_IGNORADOS 4
+
+// Varredura recursiva e paralela da árvore de entrada
+typedef struct {
+    ListaVarredura* lista;              // Destino dos arquivos encontrados
+    const char* raiz;                   // Diretório de entrada
+    DiretorioPendente* pendentes;       // Pilha de diretórios a percorrer (profundidade primeiro)
+    int ativos;                         // Varredores percorrendo um diretório agora
+    int concluida;                      // 1 quando não há mais diretórios a percorrer
+    int manter_aberta;                  // Modo daemon: varredores aguardam novos diretórios
+    Vigilancia* vigilancia;             // Registra cada diretório percorrido no inotify (ou NULL)
+    IdentificadorDiretorio* visitados;  // Tabela hash de diretórios já percorridos
+    size_t capacidade_visitados;
+    size_t num_visitados;
+    IdentificadorDiretorio ignorados[MAX_IGNORADOS]; // Saída, cache e índice (não são percorridos)
+    int num_ignorados;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // Estatísticas
+    long arquivos;
+    long diretorios;
+    long filtrados;
+    long ciclos;
+    long erros;
+} Varredura;
+
 typedef struct {
     FilaImagens* fila;
-    char* diretorio_entrada;
-    char* diretorio_saida;
+    ListaVarredura* lista;
+    const char* diretorio_entrada;
+    const char* diretorio_saida;
     int thread_id;
+    int fragmento;        // Fragmento da fila da thread (com a fila fragmentada)
 } ThreadArgs;
 
+// Tipos de requisição do motor de E/S
+#define ES_LEITURA 0
+#define ES_ESCRITA 1
+
+// Maior trecho de uma leitura ou escrita do io_uring (sqe->len tem 32 bits);
+// arquivos maiores seguem em trechos, como uma transferência parcial
+#define ES_MAX_TRECHO (1u << 30)
+
+// Modos do motor de E/S
+#define MODO_ES_SINCRONO 0  // open/read/close em cada thread (comportamento original)
+#define MODO_ES_AUTO     1  // io_uring se disponível, senão pool de pread
+#define MODO_ES_IO_URING 2  // Somente io_uring
+#define MODO_ES_PREAD    3  // Pool de threads com pread/pwrite
+
+// Requisição de leitura ou escrita de um arquivo inteiro
+typedef struct RequisicaoES {
+    int tipo;                    // ES_LEITURA ou ES_ESCRITA
+    char caminho[PATH_MAX];      // Caminho do arquivo
+    unsigned char* buffer;       // Leitura: alocado pelo motor; escrita: entregue ao motor
+    size_t tamanho;              // Tamanho esperado (leitura) ou a escrever (escrita)
+    size_t transferidos;         // Bytes efetivamente transferidos
+    int erro;                    // 0 em caso de sucesso, errno em caso de falha
+    int descartar;               // Se 1, o motor libera a requisição ao concluir
+    int fd;                      // Descritor em uso (interno ao motor)
+    Future* future;              // Sinalizado quando a requisição termina
+    struct ConclusaoSaida* conclusao; // Escrita: recebe o resultado quando ela termina (ou NULL)
+    struct RequisicaoES* proxima;
+} RequisicaoES;
+
+#ifdef TEM_IO_URING
+// Anel do io_uring mapeado a partir do kernel
+typedef struct {
+    int fd;
+    unsigned entradas_sq;
+    unsigned entradas_cq;
+    void* sq_ptr;
+    size_t sq_tamanho;
+    void* cq_ptr;
+    size_t cq_tamanho;
+    unsigned* sq_cabeca;
+    unsigned* sq_cauda;
+    unsigned* sq_mascara;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_cabeca;
+    unsigned* cq_cauda;
+    unsigned* cq_mascara;
+    struct io_uring_cqe* cqes;
+} AnelIoUring;
+#endif
+
+// Motor de E/S que agrupa aberturas, leituras e escritas em lotes
+typedef struct {
+    int usa_io_uring;            // 1 se o backend é io_uring, 0 se é o pool de pread
+    int profundidade;            // Máximo de requisições por lote
+    RequisicaoES* pendentes_inicio;
+    RequisicaoES* pendentes_fim;
+    int num_pendentes;
+    int encerrando;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t* threads;
+    int num_threads;
+#ifdef TEM_IO_URING
+    AnelIoUring anel;
+#endif
+    // Estatísticas
+    long leituras;
+    long escritas;
+    long lotes;
+    long chamadas_sistema;
+    size_t bytes_lidos;
+    size_t bytes_escritos;
+} MotorES;
+
+// Índice incremental persistente (arquivo memory-mappable)
+#define INDICE_MAGICO 0x58444950u  // "PIDX"
+#define INDICE_VERSAO 1
+
+// Cabeçalho do arquivo de índice
+typedef struct {
+    uint32_t magico;
+    uint32_t versao;
+    uint64_t hash_pipeline;  // Hash da configuração do pipeline que gerou as saídas
+    uint64_t num_registros;
+    uint64_t reservado;
+} CabecalhoIndice;
+
+// Registro de um arquivo já processado (ordenado por hash_caminho no arquivo)
+typedef struct {
+    uint64_t hash_caminho;   // Hash do caminho relativo ao diretório de entrada
+    uint64_t tamanho;
+    int64_t mtime_ns;
+    uint64_t hash_conteudo;  // 0 se não calculado
+} RegistroIndice;
+
+// Índice carregado: registros antigos mapeados + registros da execução atual
+typedef struct {
+    char caminho[PATH_MAX];          // Arquivo do índice
+    void* mapa;                      // Mapeamento do arquivo antigo (ou NULL)
+    size_t tamanho_mapa;
+    const RegistroIndice* antigos;   // Registros da execução anterior
+    size_t num_antigos;
+    RegistroIndice* novos;           // Registros a gravar ao final desta execução
+    size_t num_novos;
+    size_t capacidade_novos;
+    uint64_t hash_pipeline;
+    int usar_conteudo;               // Compara também o hash do conteúdo
+    pthread_mutex_t mutex;
+    // Estatísticas
+    long inalterados;
+    long verificados_por_conteudo;
+    long registrados;
+} IndiceIncremental;
+
+// Máximo de padrões de inclusão/exclusão
+#define MAX_PADROES 32
+
+// Modos de execução do programa
+#define MODO_PROCESSAR 0  // Processa o diretório de entrada (e atende o socket, se --servidor)
+#define MODO_CLIENTE   1  // Envia uma imagem a um servidor e grava o resultado
+#define MODO_CARGA     2  // Gerador de carga para medir a latência do servidor
+#define MODO_QUADROS   3  // Escritor de quadros na memória compartilhada (teste e medição)
+#define MODO_BANCADA_FILA 4 // Microbenchmark de contenção: fila única contra fila fragmentada
+#define MODO_GERAR_CORPUS 5 // Gera um corpus sintético reproduzível
+#define MODO_BANCADA      6 // Executa o pipeline em uma matriz de threads e filas e grava um relatório JSON
+#define MODO_COMPARAR     7 // Compara dois relatórios da bancada
+
+// Configuração de execução (preenchida pelo arquivo de --config e pela linha de comando)
+typedef struct {
+    const char* diretorio_entrada; // Diretório das imagens de entrada
+    const char* diretorio_saida;   // Diretório das imagens processadas
+    int num_produtores;   // Threads produtoras (leitura e decodificação; 0: pelas CPUs)
+    int num_consumidores; // Threads consumidoras (transformação e gravação; 0: pelas CPUs)
+    int capacidade_fila;  // Imagens decodificadas aguardando um consumidor (0: pelos consumidores)
+    OperacaoProtocolo pipeline[MAX_OPERACOES]; // Operações aplicadas às imagens (--pipeline)
+    int num_pipeline;
+    int modo_es;          // Motor de E/S (MODO_ES_*)
+    int profundidade_es;  // Profundidade da fila de submissão do motor de E/S
+    int prefetch_max;     // Máximo de arquivos pré-carregados à frente (0 desativa)
+    int recursivo;        // Percorre subdiretórios da entrada
+    int seguir_links;     // Segue links simbólicos para arquivos e diretórios
+    int threads_varredura; // Threads da varredura paralela (0: pelas CPUs)
+    const char* incluir[MAX_PADROES]; // Padrões glob de arquivos a incluir
+    int num_incluir;
+    const char* excluir[MAX_PADROES]; // Padrões glob de arquivos/diretórios a excluir
+    int num_excluir;
+    int incremental;      // Pula arquivos já processados (índice persistente)
+    const char* caminho_indice; // Arquivo do índice (NULL: dentro do diretório de saída)
+    int indice_conteudo;  // Compara também o hash do conteúdo no modo incremental
+    int vigiar;           // Modo daemon: continua rodando e processa arquivos novos (inotify)
+    int janela_rajada_ms; // Espera após o último evento antes de entregar uma rajada
+    int modo_execucao;    // MODO_PROCESSAR, MODO_CLIENTE ou MODO_CARGA
+    const char* socket_servidor; // Socket do modo servidor (NULL desativa)
+    const char* socket_cliente;  // Socket usado pelo cliente e pelo gerador de carga
+    OperacaoProtocolo operacoes[MAX_OPERACOES]; // Operações pedidas pelo cliente
+    int num_operacoes;
+    const char* formato;  // Formato da saída pedido pelo cliente
+    int enviar_caminho;   // Cliente envia o caminho em vez do conteúdo
+    int conexoes;         // Conexões simultâneas do gerador de carga
+    int requisicoes;      // Total de requisições do gerador de carga
+    const char* nome_memoria; // Segmento de memória compartilhada (NULL desativa)
+    int num_quadros;      // Quadros no segmento
+    int largura_max_quadro; // Dimensões máximas de um quadro
+    int altura_max_quadro;
+    int fluxo;            // Modo fluxo: formato dos quadros de stdin (FLUXO_*)
+    int quadros_em_voo;   // Modo fluxo: quadros lidos e ainda não escritos
+    int ordenado;         // Grava as imagens na ordem da varredura
+    int janela_reordenacao; // Saída ordenada: imagens entre a varredura e a gravação
+    const char* diretorio_cache; // Cache de resultados por conteúdo (NULL desativa)
+    long cache_max_mb;    // Tamanho máximo do cache
+    int cache_alvo;       // Percentual do máximo mantido ao remover entradas antigas
+    int deduplicar;       // Processa uma única vez arquivos de conteúdo idêntico
+    int quase_duplicatas; // QUASE_*: o que fazer com imagens quase idênticas a uma já vista
+    int hash_perceptual;  // HASH_*
+    int distancia_hamming; // Distância máxima entre os hashes de quase duplicatas
+    Variante variantes[MAX_VARIANTES]; // Variantes geradas de cada imagem (sem nenhuma: pipeline padrão)
+    int num_variantes;
+    int agendamento;      // AGENDAMENTO_*: ordem em que os arquivos vão para os produtores
+    long memoria_max_mb;  // Orçamento de bytes em voo entre as etapas (0: sem limite; -1: pelo cgroup)
+    int cpus;             // CPUs usadas no dimensionamento (0: detectadas)
+    int autoajuste;       // AUTOAJUSTE_*: redistribuição de threads entre produtores e consumidores
+    int numa;             // Posiciona produtores e consumidores por nó NUMA, com uma fila por nó
+    int fragmentos;       // Fragmentos da fila (0: um por nó NUMA)
+    long itens_bancada;   // Itens do microbenchmark da fila
+    int lote;             // Máximo de imagens por inserção ou retirada na fila
+    int execucao_completa; // Cada thread leva o arquivo da leitura à gravação, sem a fila
+    const char* relatorio_json; // Relatório JSON da execução (na bancada, o relatório final; NULL: stdout)
+    const char* diretorio_corpus; // Corpus de --gerar-corpus e de --bancada
+    const char* relatorio_base;   // --comparar: relatório de referência
+    unsigned long long semente;   // Semente do corpus sintético
+    int corpus_imagens;   // Imagens do corpus sintético
+    int corpus_max_mp;    // Megapixels da maior imagem do corpus
+    const char* bancada_threads; // Combinações PxC de produtores e consumidores da bancada
+    const char* bancada_filas;   // Capacidades da fila da bancada
+    char** argumentos;    // Argumentos posicionais (arquivos do cliente)
+    int num_argumentos;
+} Configuracao;
+
+Configuracao config = {
+    .diretorio_entrada = "imagens/entrada",
+    .diretorio_saida = "imagens/saida",
+    .num_produtores = 0,
+    .num_consumidores = 0,
+    .capacidade_fila = 0,
+    .pipeline = {
+        { OP_CINZA, 0.0f },
+        { OP_INVERTER, 0.0f },
+        { OP_BRILHO, 1.2f },
+        { OP_CONTRASTE, 1.3f },
+    },
+    .num_pipeline = 4,
+    .modo_es = MODO_ES_AUTO,
+    .profundidade_es = 32,
+    .prefetch_max = 64,
+    .recursivo = 0,
+    .seguir_links = 0,
+    .threads_varredura = 0,
+    .incremental = 0,
+    .caminho_indice = NULL,
+    .indice_conteudo = 0,
+    .vigiar = 0,
+    .janela_rajada_ms = 50,
+    .modo_execucao = MODO_PROCESSAR,
+    .socket_servidor = NULL,
+    .operacoes = {
+        { OP_CINZA, 0.0f },
+        { OP_INVERTER, 0.0f },
+        { OP_BRILHO, 1.2f },
+        { OP_CONTRASTE, 1.3f },
+    },
+    .num_operacoes = 4,
+    .formato = "png",
+    .enviar_caminho = 0,
+    .conexoes = 4,
+    .requisicoes = 1000,
+    .nome_memoria = NULL,
+    .num_quadros = 8,
+    .largura_max_quadro = 1920,
+    .altura_max_quadro = 1080,
+    .fluxo = 0,
+    .quadros_em_voo = 8,
+    .ordenado = 0,
+    .janela_reordenacao = 32,
+    .diretorio_cache = NULL,
+    .cache_max_mb = 1024,
+    .cache_alvo = 90,
+    .deduplicar = 0,
+    .quase_duplicatas = 0,
+    .hash_perceptual = 0,
+    .distancia_hamming = 5,
+    .memoria_max_mb = -1,
+    .cpus = 0,
+    .numa = 1,
+    .fragmentos = 0,
+    .itens_bancada = 0,
+    .lote = 1,
+    .execucao_completa = 0,
+    .relatorio_json = NULL,
+    .semente = 1,
+    .corpus_imagens = 40,
+    .corpus_max_mp = 100,
+    .bancada_threads = "1x1,2x2,4x4",
+    .bancada_filas = "4,64",
+};
+
+// Latência máxima de uma rajada contínua de eventos do inotify
+#define RAJADA_MAX_MS 500
+
+// Fatores de brilho e contraste quando a operação não traz "=fator"
+#define FATOR_BRILHO 1.2f
+#define FATOR_CONTRASTE 1.3f
+#define QUALIDADE_JPG 90
+
+// Nome padrão do índice incremental dentro do diretório de saída
+#define NOME_INDICE ".indice_incremental"
+
+// Capacidade da lista de varredura
+#define CAPACIDADE_VARREDURA 1024
+
+// Parâmetros do pré-carregador (readahead)
+#define PREFETCH_MIN 4                          // Janela mínima em arquivos
+#define PREFETCH_HORIZONTE 0.5                  // Segundos de decodificação mantidos à frente
+#define PREFETCH_MAX_BYTES (256UL * 1024 * 1024) // Limite de bytes pedidos ao page cache à frente
+
+// Bytes pedidos ao page cache à frente, reduzido sob um limite de memória do
+// cgroup (que também conta o page cache)
+size_t limite_prefetch_bytes = PREFETCH_MAX_BYTES;
+
+// Estatísticas do pré-carregador
+typedef struct {
+    long arquivos;        // Arquivos com readahead solicitado
+    size_t bytes;         // Bytes solicitados
+    int janela_atual;     // Janela (em arquivos) usada na última rodada
+    int janela_maxima;    // Maior janela usada
+    double taxa;          // Última taxa de decodificação observada (arquivos/s)
+} MetricasPrefetch;
+
+MetricasPrefetch metricas_prefetch = {0};
+
+// Motor de E/S compartilhado (NULL no modo síncrono)
+MotorES* motor_es = NULL;
+
+// Índice do modo incremental (NULL quando desativado)
+IndiceIncremental* indice_incremental = NULL;
+
 // Adicionar após as declarações globais
-#define NUM_PRODUTORES 5
-#define NUM_CONSUMIDORES 5
+#define MAX_PRODUTORES 64   // Limite de --produtores
+#define MAX_CONSUMIDORES 64 // Limite de --consumidores
 #define NUM_MONITORES 1
 
 // Estrutura para métricas
@@ -70,11 +637,12 @@ typedef struct {
     int imagens_processadas;
     double tempo_total;
     int ordem_finalizacao;  // Nova variável para rastrear a ordem de finalização
+    double ultimo_termino;  // Instante (CLOCK_MONOTONIC, em s) em que terminou a última imagem
 } Metricas;
 
 // Variáveis globais para métricas
-Metricas metricas_produtores[NUM_PRODUTORES];
-Metricas metricas_consumidores[NUM_CONSUMIDORES];
+Metricas metricas_produtores[MAX_PRODUTORES];
+Metricas metricas_consumidores[MAX_CONSUMIDORES];
 pthread_mutex_t mutex_metricas = PTHREAD_MUTEX_INITIALIZER;
 
 // Variáveis para rastrear a ordem de finalização
@@ -84,6 +652,7 @@ pthread_mutex_t mutex_ordem = PTHREAD_MUTEX_INITIALIZER;
 
 // Variáveis globais para controle
 int executando = 1;  // Flag para controlar a execução das threads
+volatile sig_atomic_t encerramento_solicitado = 0;  // SIGINT/SIGTERM no modo daemon
 
 // Estrutura para argumentos do monitor
 typedef struct {
@@ -98,10 +667,20 @@ void* monitor(void* arg) {
     
     // Array para rastrear o estado anterior de cada posição
     int* estado_anterior = (int*)calloc(args->fila->capacidade, sizeof(int));
+    int tamanho_anterior = -1;
     
     while (executando) {
         // Verifica todas as posições da fila
         pthread_mutex_lock(&args->fila->mutex);
+
+        // No modo daemon, a fila ociosa não é impressa a cada 100ms
+        if ((config.vigiar || config.socket_servidor || config.nome_memoria) && args->fila->tamanho == 0 && tamanho_anterior == 0) {
+            pthread_mutex_unlock(&args->fila->mutex);
+            usleep(100000);
+            continue;
+        }
+        tamanho_anterior = args->fila->tamanho;
+
         printf("\033[1;36m[MONITOR %d] Estado atual da fila:\033[0m\n", args->thread_id);
         printf("\033[1;36m[MONITOR %d] - Tamanho: %d/%d\033[0m\n", 
                args->thread_id, args->fila->tamanho, args->fila->capacidade);
@@ -157,9 +736,21 @@ FilaImagens* criar_fila(int capacidade);
 void destruir_fila(FilaImagens* fila);
 int inserir_imagem_na_fila(FilaImagens* fila, Imagem* img);
 int remover_imagem_da_fila(FilaImagens* fila, Imagem* img);
+int inserir_imagens_na_fila(FilaImagens* fila, Imagem* imgs, int n);
+int retirar_lote_da_fila(FilaImagens* fila, Imagem* imgs, Future** futures, int max, size_t bytes_max);
 void liberar_imagem_da_memoria(Imagem* img);
+void motor_es_destruir(MotorES* motor);
 void* produtor(void* arg);
 void* consumidor(void* arg);
+void deduplicacao_concluir(const char* nome, const OrigemArquivo* origem, const char* caminho_saida);
+struct ConclusaoSaida* criar_conclusao_saida(const char* nome, const char* diretorio_entrada,
+                                             const OrigemArquivo* origem, int saidas);
+void conclusao_saida_registrar(struct ConclusaoSaida* conclusao, const char* caminho_saida, int sucesso);
+void saida_gravada(const char* nome, const char* relativo, const OrigemArquivo* origem, const char* caminho_saida);
+int materializar_imagem(Imagem* img);
+int compactar_imagem(Imagem* img);
+int ler_linha_arquivo(const char* caminho, char* destino, size_t tamanho);
+void consumir_imagem(ThreadArgs* args, Imagem* img, Future* future);
 
 /**
  * @brief Cria um novo Future para acompanhar o processamento de uma imagem
@@ -249,611 +840,10239 @@ Imagem* obter_resultado_future(Future* future) {
     return resultado;
 }
 
+// Orçamento de memória (--memoria-max): limita os bytes em voo entre as
+// etapas, e não só o número de vagas da fila. Contam as leituras do motor de
+// E/S, os pixels decodificados (da reserva do produtor até o consumidor
+// terminar a imagem) e as saídas codificadas à espera do motor de E/S. Só
+// os produtores esperam; consumidores e o motor de E/S apenas devolvem
+// bytes. Uma reserva que não cabe espera pelos bytes a jusante; sem nada a
+// jusante, ela passa do limite em vez de travar a execução (uma imagem
+// maior que o orçamento, ou produtores que só seguram as próprias
+// leituras), mas só uma por vez: as demais esperam até o excesso ser
+// absorvido, e o pico fica no limite mais uma imagem.
+typedef struct {
+    size_t limite;          // Bytes (0: sem limite, só contabiliza)
+    size_t produtores;      // Reservados pelos produtores (leituras e imagens ainda fora da fila)
+    size_t a_jusante;       // Na fila, nos consumidores e nas escritas pendentes
+    size_t pico;            // Maior total em voo observado
+    long esperas;           // Reservas que precisaram esperar
+    double tempo_espera;    // Segundos de espera, somados entre os produtores
+    int excedente;          // Uma reserva passou do limite e o excesso ainda não foi absorvido
+    pthread_t dono_excedente; // Produtor que a fez
+    pthread_mutex_t mutex;
+    pthread_cond_t liberado;
+} OrcamentoMemoria;
+
+OrcamentoMemoria orcamento_memoria = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .liberado = PTHREAD_COND_INITIALIZER,
+};
+
+// Bytes reservados pela thread produtora corrente e ainda não repassados
+static __thread size_t orcamento_proprio;
+
 /**
- * @brief Carrega uma imagem do disco para a memória
- * @param caminho Caminho do arquivo de imagem a ser carregado
- * @param produtor_id ID do produtor que está carregando a imagem (para logs)
- * @return Ponteiro para a estrutura Imagem carregada, ou NULL em caso de erro
- * 
- * Esta função utiliza a biblioteca stb_image para carregar imagens em vários formatos
- * (PNG, JPG, BMP, etc). A imagem é carregada em memória e suas dimensões e número
- * de canais são detectados automaticamente.
+ * @brief Atualiza o pico de bytes em voo (com orcamento_memoria.mutex travado)
+ */
+void orcamento_atualizar_pico(void) {
+    size_t total = orcamento_memoria.produtores + orcamento_memoria.a_jusante;
+    if (total > orcamento_memoria.pico) orcamento_memoria.pico = total;
+}
+
+/**
+ * @brief Indica se uma reserva que não cabe deve esperar (com o mutex travado)
+ * @return 1 se há bytes a jusante a devolver ou outro produtor já passou do limite
+ */
+int orcamento_deve_esperar(void) {
+    OrcamentoMemoria* o = &orcamento_memoria;
+    return o->a_jusante > 0 || (o->excedente && !pthread_equal(o->dono_excedente, pthread_self()));
+}
+
+/**
+ * @brief Encerra o excesso em andamento, se já foi absorvido (com o mutex travado)
  * 
- * A função aloca memória para a estrutura Imagem e seus dados. É responsabilidade
- * do chamador liberar esta memória usando liberar_imagem_da_memoria().
+ * O excesso termina quando o total volta ao limite ou quando seu dono não
+ * segura mais nenhum byte (repassou ou devolveu tudo).
  */
-Imagem* carregar_imagem_do_disco(const char* caminho, int produtor_id) {
-    Imagem* img = (Imagem*)malloc(sizeof(Imagem));
-    if (!img) {
-        perror("Erro ao alocar estrutura de imagem");
-        return NULL;
+void orcamento_verificar_excedente(void) {
+    OrcamentoMemoria* o = &orcamento_memoria;
+    if (!o->excedente) return;
+    if (o->produtores + o->a_jusante <= o->limite ||
+        (pthread_equal(o->dono_excedente, pthread_self()) && orcamento_proprio == 0)) {
+        o->excedente = 0;
+        pthread_cond_broadcast(&o->liberado);
     }
+}
 
-    // Copia o nome do arquivo
-    strncpy(img->nome, caminho, sizeof(img->nome) - 1);
-    img->nome[sizeof(img->nome) - 1] = '\0';
-
-    // Carrega a imagem usando stb_image, forçando 3 canais (RGB)
-    img->dados = stbi_load(caminho, &img->largura, &img->altura, &img->canais, 3);
-    
-    if (!img->dados) {
-        printf("Erro ao carregar imagem %s: %s\n", caminho, stbi_failure_reason());
-        free(img);
-        return NULL;
+/**
+ * @brief Reserva bytes para um produtor
+ * @param bytes Bytes a reservar
+ * 
+ * Se a reserva não couber, espera pelos bytes a jusante. Sem nada a
+ * jusante, ela é feita mesmo passando do limite, já que o que está em voo
+ * é só dos produtores (inclusive as leituras do próprio chamador); mas só
+ * um produtor passa do limite por vez.
+ */
+void orcamento_reservar(size_t bytes) {
+    OrcamentoMemoria* o = &orcamento_memoria;
+    pthread_mutex_lock(&o->mutex);
+    if (o->limite && o->produtores + o->a_jusante + bytes > o->limite && orcamento_deve_esperar()) {
+        struct timespec inicio, fim;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        o->esperas++;
+        while (executando && o->produtores + o->a_jusante + bytes > o->limite && orcamento_deve_esperar()) {
+            pthread_cond_wait(&o->liberado, &o->mutex);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        o->tempo_espera += (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+    }
+    if (o->limite && o->produtores + o->a_jusante + bytes > o->limite && !o->excedente) {
+        o->excedente = 1;
+        o->dono_excedente = pthread_self();
     }
+    o->produtores += bytes;
+    orcamento_proprio += bytes;
+    orcamento_atualizar_pico();
+    pthread_mutex_unlock(&o->mutex);
+}
 
-    // Força 3 canais
-    img->canais = 3;
+/**
+ * @brief Troca uma reserva de produtor pelo tamanho real (0 a devolve)
+ * @param reservado Bytes reservados antes
+ * @param real Bytes que passam a ser reservados
+ */
+void orcamento_ajustar(size_t reservado, size_t real) {
+    if (reservado == real) return;
+    OrcamentoMemoria* o = &orcamento_memoria;
+    pthread_mutex_lock(&o->mutex);
+    o->produtores = o->produtores - reservado + real;
+    orcamento_proprio = (orcamento_proprio > reservado ? orcamento_proprio - reservado : 0) + real;
+    orcamento_atualizar_pico();
+    if (real < reservado) pthread_cond_broadcast(&o->liberado);
+    orcamento_verificar_excedente();
+    pthread_mutex_unlock(&o->mutex);
+}
 
-    printf("Produtor %d: Carregou imagem %s (%dx%d, %d canais)\n", 
-           produtor_id, caminho, img->largura, img->altura, img->canais);
+/**
+ * @brief Passa uma reserva do produtor para a etapa seguinte (ao entrar na fila)
+ * @param bytes Bytes repassados
+ */
+void orcamento_repassar(size_t bytes) {
+    if (!bytes) return;
+    OrcamentoMemoria* o = &orcamento_memoria;
+    pthread_mutex_lock(&o->mutex);
+    o->produtores -= bytes;
+    o->a_jusante += bytes;
+    orcamento_proprio = orcamento_proprio > bytes ? orcamento_proprio - bytes : 0;
+    orcamento_verificar_excedente();
+    pthread_mutex_unlock(&o->mutex);
+}
 
-    return img;
+/**
+ * @brief Contabiliza bytes criados a jusante dos produtores, sem esperar
+ * @param bytes Bytes acrescentados (ex: saída codificada à espera de escrita)
+ */
+void orcamento_acrescentar(size_t bytes) {
+    OrcamentoMemoria* o = &orcamento_memoria;
+    pthread_mutex_lock(&o->mutex);
+    o->a_jusante += bytes;
+    orcamento_atualizar_pico();
+    pthread_mutex_unlock(&o->mutex);
 }
 
 /**
- * @brief Libera a memória alocada para uma imagem
- * @param img Ponteiro para a estrutura Imagem a ser liberada
- * 
- * Esta função libera tanto a estrutura Imagem quanto os dados da imagem em si.
- * É segura para chamar com NULL.
+ * @brief Devolve bytes a jusante ao orçamento e acorda os produtores
+ * @param bytes Bytes devolvidos
  */
-void liberar_imagem_da_memoria(Imagem* img) {
-    if (img) {
-        if (img->dados) {
-            stbi_image_free(img->dados);
-        }
-        free(img);
-    }
+void orcamento_liberar(size_t bytes) {
+    if (!bytes) return;
+    OrcamentoMemoria* o = &orcamento_memoria;
+    pthread_mutex_lock(&o->mutex);
+    o->a_jusante -= bytes;
+    pthread_cond_broadcast(&o->liberado);
+    orcamento_verificar_excedente();
+    pthread_mutex_unlock(&o->mutex);
 }
 
 /**
- * @brief Salva uma imagem processada no disco
- * @param img Ponteiro para a estrutura Imagem a ser salva
- * @param diretorio_saida Diretório onde a imagem será salva
- * @param consumidor_id ID do consumidor que processou a imagem
+ * @brief Indica se o orçamento de memória está esgotado
+ * @return 1 se os bytes em voo atingiram o limite
+ */
+int orcamento_esgotado(void) {
+    OrcamentoMemoria* o = &orcamento_memoria;
+    pthread_mutex_lock(&o->mutex);
+    int esgotado = o->limite && o->produtores + o->a_jusante >= o->limite;
+    pthread_mutex_unlock(&o->mutex);
+    return esgotado;
+}
+
+#ifdef TEM_IO_URING
+/**
+ * @brief Inicializa um anel io_uring usando as syscalls diretamente
+ * @param anel Estrutura do anel a ser preenchida
+ * @param entradas Número de entradas desejado na fila de submissão
+ * @return 0 em caso de sucesso, -1 se o io_uring não estiver disponível
  * 
- * A função detecta automaticamente o formato original da imagem e salva no mesmo formato.
- * Se o formato não for reconhecido, salva como PNG.
- * Utiliza a biblioteca stb_image_write para salvar a imagem.
- * O nome do arquivo de saída inclui o ID do consumidor para evitar conflitos.
+ * Mapeia os anéis de submissão e conclusão e o array de SQEs.
+ * O kernel arredonda o número de entradas para a próxima potência de 2.
  */
-void salvar_imagem_no_disco(Imagem* img, const char* diretorio_saida, int consumidor_id) {
-    if (!img || !img->dados) {
-        printf("Erro: Imagem inválida para salvar.\n");
-        return;
-    }
+int anel_iniciar(AnelIoUring* anel, unsigned entradas) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(anel, 0, sizeof(*anel));
 
-    // Garante que o diretório de saída existe
-    struct stat st = {0};
-    if (stat(diretorio_saida, &st) == -1) {
-        mkdir(diretorio_saida, 0700);
+    anel->fd = (int)syscall(__NR_io_uring_setup, entradas, &params);
+    if (anel->fd < 0) {
+        return -1;
     }
 
-    // Extrair apenas o nome do arquivo do caminho completo
-    const char* nome_arquivo = strrchr(img->nome, '/');
-    if (nome_arquivo) {
-        nome_arquivo++; // Pula a barra
-    } else {
-        nome_arquivo = img->nome;
-    }
+    anel->entradas_sq = params.sq_entries;
+    anel->entradas_cq = params.cq_entries;
+    anel->sq_tamanho = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    anel->cq_tamanho = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
 
-    // Construir o caminho de saída com o ID do consumidor
-    char caminho_saida[512];
-    char nome_base[256];
-    char extensao[32] = "";
-    
-    // Separar nome base e extensão
-    const char* ponto = strrchr(nome_arquivo, '.');
-    if (ponto) {
-        int pos = ponto - nome_arquivo;
-        strncpy(nome_base, nome_arquivo, pos);
-        nome_base[pos] = '\0';
-        strcpy(extensao, ponto);
-    } else {
-        strcpy(nome_base, nome_arquivo);
+    // Com IORING_FEAT_SINGLE_MMAP os dois anéis compartilham o mesmo mapeamento
+    int mapeamento_unico = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (mapeamento_unico) {
+        if (anel->cq_tamanho > anel->sq_tamanho) anel->sq_tamanho = anel->cq_tamanho;
+        anel->cq_tamanho = anel->sq_tamanho;
     }
-    
-    // Construir novo nome com ID do consumidor
-    snprintf(caminho_saida, sizeof(caminho_saida), "%s/cons-%d-%s%s", 
-             diretorio_saida, consumidor_id, nome_base, extensao);
 
-    printf("Tentando salvar imagem em: %s\n", caminho_saida);
-    printf("Dimensões: %dx%d, Canais: %d\n", img->largura, img->altura, img->canais);
+    anel->sq_ptr = mmap(NULL, anel->sq_tamanho, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, anel->fd, IORING_OFF_SQ_RING);
+    if (anel->sq_ptr == MAP_FAILED) {
+        close(anel->fd);
+        return -1;
+    }
 
-    // Detectar extensão do arquivo original
-    const char* extensao_original = strrchr(nome_arquivo, '.');
-    int sucesso = 0;
-    if (extensao_original) {
-        if (strcasecmp(extensao_original, ".png") == 0) {
-            sucesso = stbi_write_png(caminho_saida, img->largura, img->altura, img->canais, img->dados, img->largura * img->canais);
-        } else if (strcasecmp(extensao_original, ".jpg") == 0 || strcasecmp(extensao_original, ".jpeg") == 0) {
-            sucesso = stbi_write_jpg(caminho_saida, img->largura, img->altura, img->canais, img->dados, 90); // Qualidade 90
-        } else if (strcasecmp(extensao_original, ".bmp") == 0) {
-            sucesso = stbi_write_bmp(caminho_saida, img->largura, img->altura, img->canais, img->dados);
-        } else if (strcasecmp(extensao_original, ".tga") == 0) {
-            sucesso = stbi_write_tga(caminho_saida, img->largura, img->altura, img->canais, img->dados);
-        } else {
-            // Se extensão não reconhecida, salva como PNG
-            sucesso = stbi_write_png(caminho_saida, img->largura, img->altura, img->canais, img->dados, img->largura * img->canais);
-        }
+    if (mapeamento_unico) {
+        anel->cq_ptr = anel->sq_ptr;
     } else {
-        // Se não tem extensão, salva como PNG
-        sucesso = stbi_write_png(caminho_saida, img->largura, img->altura, img->canais, img->dados, img->largura * img->canais);
+        anel->cq_ptr = mmap(NULL, anel->cq_tamanho, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, anel->fd, IORING_OFF_CQ_RING);
+        if (anel->cq_ptr == MAP_FAILED) {
+            munmap(anel->sq_ptr, anel->sq_tamanho);
+            close(anel->fd);
+            return -1;
+        }
     }
 
-    if (!sucesso) {
-        printf("Erro ao salvar imagem: %s\n", caminho_saida);
-    } else {
-        printf("Imagem salva com sucesso: %s\n", caminho_saida);
+    anel->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, anel->fd, IORING_OFF_SQES);
+    if (anel->sqes == MAP_FAILED) {
+        if (!mapeamento_unico) munmap(anel->cq_ptr, anel->cq_tamanho);
+        munmap(anel->sq_ptr, anel->sq_tamanho);
+        close(anel->fd);
+        return -1;
     }
+
+    char* sq = (char*)anel->sq_ptr;
+    char* cq = (char*)anel->cq_ptr;
+    anel->sq_cabeca = (unsigned*)(sq + params.sq_off.head);
+    anel->sq_cauda = (unsigned*)(sq + params.sq_off.tail);
+    anel->sq_mascara = (unsigned*)(sq + params.sq_off.ring_mask);
+    anel->sq_array = (unsigned*)(sq + params.sq_off.array);
+    anel->cq_cabeca = (unsigned*)(cq + params.cq_off.head);
+    anel->cq_cauda = (unsigned*)(cq + params.cq_off.tail);
+    anel->cq_mascara = (unsigned*)(cq + params.cq_off.ring_mask);
+    anel->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return 0;
 }
 
 /**
- * @brief Converte uma imagem colorida para escala de cinza
- * @param img Ponteiro para a estrutura Imagem a ser convertida
- * 
- * A função aplica a fórmula padrão de conversão para escala de cinza:
- * cinza = 0.299R + 0.587G + 0.114B
+ * @brief Verifica se o kernel suporta as operações usadas pelo motor
+ * @param anel Anel já iniciado
+ * @return 1 se openat, read, write e close são suportados
  * 
- * A conversão é feita in-place, modificando os dados originais da imagem.
- * Requer que a imagem tenha pelo menos 3 canais (RGB).
+ * Os kernels 5.1 a 5.5 criam o anel, mas só têm as operações vetoriais;
+ * openat, read e close chegaram no 5.6, junto com IORING_REGISTER_PROBE.
+ * Sem a sonda, o kernel é anterior a elas.
  */
-void converter_para_cinza(Imagem* img) {
-    if (!img || !img->dados || img->canais < 3) return;
-    
-    for (int i = 0; i < img->largura * img->altura; i++) {
-        unsigned char* pixel = &img->dados[i * img->canais];
-        unsigned char cinza = (unsigned char)(0.299f * pixel[0] + 0.587f * pixel[1] + 0.114f * pixel[2]);
-        pixel[0] = pixel[1] = pixel[2] = cinza;
+int anel_suporta_operacoes(AnelIoUring* anel) {
+    static const int necessarias[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE };
+    size_t tamanho = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* sonda = (struct io_uring_probe*)calloc(1, tamanho);
+    if (!sonda) return 0;
+
+    int suportadas = syscall(__NR_io_uring_register, anel->fd, IORING_REGISTER_PROBE, sonda, 256) == 0;
+    for (size_t i = 0; suportadas && i < sizeof(necessarias) / sizeof(necessarias[0]); i++) {
+        int op = necessarias[i];
+        suportadas = op <= sonda->last_op && (sonda->ops[op].flags & IO_URING_OP_SUPPORTED);
     }
+    free(sonda);
+    return suportadas;
 }
 
 /**
- * @brief Inverte as cores de uma imagem
- * @param img Ponteiro para a estrutura Imagem a ser invertida
+ * @brief Desfaz os mapeamentos e fecha o anel io_uring
+ * @param anel Anel a ser finalizado
+ */
+void anel_finalizar(AnelIoUring* anel) {
+    munmap(anel->sqes, anel->entradas_sq * sizeof(struct io_uring_sqe));
+    if (anel->cq_ptr != anel->sq_ptr) munmap(anel->cq_ptr, anel->cq_tamanho);
+    munmap(anel->sq_ptr, anel->sq_tamanho);
+    close(anel->fd);
+}
+
+/**
+ * @brief Reserva a próxima SQE livre do anel
+ * @param anel Anel io_uring
+ * @return Ponteiro para a SQE zerada, ou NULL se o anel estiver cheio
  * 
- * A função inverte cada canal da imagem subtraindo seu valor de 255.
- * A inversão é feita in-place, modificando os dados originais da imagem.
+ * A SQE só é visível ao kernel depois de anel_submeter().
  */
-void inverter_cores(Imagem* img) {
-    if (!img || !img->dados) return;
-    
-    for (int i = 0; i < img->largura * img->altura * img->canais; i++) {
-        img->dados[i] = 255 - img->dados[i];
-    }
+struct io_uring_sqe* anel_obter_sqe(AnelIoUring* anel) {
+    unsigned cauda = *anel->sq_cauda;
+    unsigned cabeca = __atomic_load_n(anel->sq_cabeca, __ATOMIC_ACQUIRE);
+    if (cauda - cabeca >= anel->entradas_sq) return NULL;
+
+    unsigned indice = cauda & *anel->sq_mascara;
+    struct io_uring_sqe* sqe = &anel->sqes[indice];
+    memset(sqe, 0, sizeof(*sqe));
+    anel->sq_array[indice] = indice;
+    __atomic_store_n(anel->sq_cauda, cauda + 1, __ATOMIC_RELEASE);
+    return sqe;
 }
 
 /**
- * @brief Ajusta o brilho de uma imagem
- * @param img Ponteiro para a estrutura Imagem a ser ajustada
- * @param fator Fator de multiplicação do brilho (1.0 = brilho original)
+ * @brief Submete as SQEs pendentes e espera por conclusões
+ * @param motor Motor de E/S (para estatísticas)
+ * @param submeter Número de SQEs preparadas e ainda não consumidas pelo kernel
+ * @param esperar Número mínimo de CQEs a aguardar
+ * @return Número de SQEs consumidas pelo kernel, ou -errno em caso de erro
  * 
- * A função multiplica cada canal da imagem pelo fator especificado.
- * Valores são limitados ao intervalo [0, 255].
- * O ajuste é feito in-place, modificando os dados originais da imagem.
+ * Uma única chamada a io_uring_enter cobre o lote inteiro. O kernel pode
+ * consumir menos SQEs do que o pedido (e então não espera): as restantes
+ * continuam no anel, e cabe ao chamador submetê-las de novo.
  */
-void ajustar_brilho(Imagem* img, float fator) {
-    if (!img || !img->dados) return;
-    
-    for (int i = 0; i < img->largura * img->altura * img->canais; i++) {
-        int novo_valor = (int)(img->dados[i] * fator);
-        img->dados[i] = (unsigned char)(novo_valor > 255 ? 255 : (novo_valor < 0 ? 0 : novo_valor));
+int anel_submeter(MotorES* motor, unsigned submeter, unsigned esperar) {
+    while (1) {
+        motor->chamadas_sistema++;
+        int ret = (int)syscall(__NR_io_uring_enter, motor->anel.fd, submeter, esperar,
+                               esperar ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) return ret;
+        // Interrompido antes de consumir qualquer SQE: basta repetir
+        if (errno != EINTR) return -errno;
     }
 }
 
 /**
- * @brief Ajusta o contraste de uma imagem
- * @param img Ponteiro para a estrutura Imagem a ser ajustada
- * @param fator Fator de multiplicação do contraste (1.0 = contraste original)
+ * @brief Retira do anel as SQEs que o kernel não consumiu
+ * @param anel Anel io_uring
+ * @param quantidade Número de SQEs no fim do anel ainda não consumidas
+ * @param resultados Resultado de cada requisição (indexado pelo user_data)
+ * @param erro Resultado atribuído às requisições retiradas (-errno)
  * 
- * A função ajusta o contraste subtraindo 128 de cada valor,
- * multiplicando pelo fator e adicionando 128 novamente.
- * Valores são limitados ao intervalo [0, 255].
- * O ajuste é feito in-place, modificando os dados originais da imagem.
+ * Sem isso, elas seriam submetidas junto com a próxima fase, com um
+ * user_data que já não corresponde ao lote.
  */
-void ajustar_contraste(Imagem* img, float fator) {
-    if (!img || !img->dados) return;
-    
-    for (int i = 0; i < img->largura * img->altura * img->canais; i++) {
-        int novo_valor = (int)((img->dados[i] - 128) * fator + 128);
-        img->dados[i] = (unsigned char)(novo_valor > 255 ? 255 : (novo_valor < 0 ? 0 : novo_valor));
+void anel_devolver_sqes(AnelIoUring* anel, unsigned quantidade, int* resultados, int erro) {
+    unsigned cauda = *anel->sq_cauda;
+    for (unsigned k = 1; k <= quantidade; k++) {
+        struct io_uring_sqe* sqe = &anel->sqes[anel->sq_array[(cauda - k) & *anel->sq_mascara]];
+        resultados[sqe->user_data] = erro;
     }
+    __atomic_store_n(anel->sq_cauda, cauda - quantidade, __ATOMIC_RELEASE);
 }
 
 /**
- * @brief Atualiza as métricas de desempenho de uma thread
- * @param thread_id ID da thread
- * @param tipo_thread 0 para produtor, 1 para consumidor
- * @param tempo_processamento Tempo gasto no processamento atual
- * 
- * Atualiza o número de imagens processadas e o tempo total
- * de processamento para a thread especificada.
+ * @brief Colhe uma CQE do anel de conclusão
+ * @param anel Anel io_uring
+ * @param dados_usuario Recebe o user_data associado à requisição
+ * @param resultado Recebe o resultado da operação (>= 0 ou -errno)
+ * @return 1 se uma CQE foi colhida, 0 se o anel estava vazio
  */
-void atualizar_metricas(int thread_id, int tipo_thread, double tempo_processamento) {
-    pthread_mutex_lock(&mutex_metricas);
-    if (tipo_thread == 0) { // Produtor
-        metricas_produtores[thread_id].imagens_processadas++;
-        metricas_produtores[thread_id].tempo_total += tempo_processamento;
-    } else { // Consumidor
-        metricas_consumidores[thread_id].imagens_processadas++;
-        metricas_consumidores[thread_id].tempo_total += tempo_processamento;
-    }
-    pthread_mutex_unlock(&mutex_metricas);
+int anel_colher(AnelIoUring* anel, unsigned long long* dados_usuario, int* resultado) {
+    unsigned cabeca = *anel->cq_cabeca;
+    if (cabeca == __atomic_load_n(anel->cq_cauda, __ATOMIC_ACQUIRE)) return 0;
+
+    struct io_uring_cqe* cqe = &anel->cqes[cabeca & *anel->cq_mascara];
+    *dados_usuario = cqe->user_data;
+    *resultado = cqe->res;
+    __atomic_store_n(anel->cq_cabeca, cabeca + 1, __ATOMIC_RELEASE);
+    return 1;
 }
 
+// Marcadores de resultado enquanto uma fase do lote está em andamento
+#define RESULTADO_NAO_SUBMETIDA INT32_MIN
+#define RESULTADO_PENDENTE (INT32_MIN + 1)
+
 /**
- * @brief Registra a ordem de finalização de uma thread
- * @param thread_id ID da thread
- * @param tipo_thread 0 para produtor, 1 para consumidor
+ * @brief Executa uma fase do lote: submete as SQEs e colhe todas as CQEs
+ * @param motor Motor de E/S
+ * @param resultados Resultado de cada requisição (indexado pelo user_data);
+ *                   as submetidas devem estar marcadas com RESULTADO_PENDENTE
+ * @param n Tamanho do lote
+ * @param submetidas Número de SQEs preparadas nesta fase
  * 
- * Atualiza a ordem de finalização da thread no array de métricas.
- * A ordem é mantida separadamente para produtores e consumidores.
+ * Uma submissão parcial é repetida com as SQEs restantes; se o kernel não
+ * aceitar mais nenhuma, elas saem do anel com o erro, e as já consumidas
+ * ainda são colhidas antes de a fase terminar.
  */
-void registrar_finalizacao(int thread_id, int tipo_thread) {
-    pthread_mutex_lock(&mutex_ordem);
-    if (tipo_thread == 0) { // Produtor
-        metricas_produtores[thread_id].ordem_finalizacao = ++ordem_finalizacao_produtores;
-    } else { // Consumidor
-        metricas_consumidores[thread_id].ordem_finalizacao = ++ordem_finalizacao_consumidores;
+void anel_concluir_fase(MotorES* motor, int* resultados, int n, unsigned submetidas) {
+    unsigned pendentes = submetidas;  // Preparadas, ainda não consumidas pelo kernel
+    unsigned em_voo = 0;              // Consumidas, ainda sem CQE colhida
+    while (pendentes > 0 || em_voo > 0) {
+        unsigned long long indice;
+        int resultado;
+        if (anel_colher(&motor->anel, &indice, &resultado)) {
+            resultados[indice] = resultado;
+            em_voo--;
+            continue;
+        }
+
+        int ret = anel_submeter(motor, pendentes, pendentes + em_voo);
+        if (ret > 0 || (ret == 0 && pendentes == 0)) {
+            pendentes -= (unsigned)ret;
+            em_voo += (unsigned)ret;
+            continue;
+        }
+
+        // Nenhuma SQE consumida: sem recursos no kernel, espera uma conclusão e tenta de novo
+        int erro = ret < 0 ? ret : -EAGAIN;
+        if (em_voo > 0 && (erro == -EAGAIN || erro == -EBUSY) && anel_submeter(motor, 0, 1) >= 0) continue;
+        if (pendentes > 0) {
+            anel_devolver_sqes(&motor->anel, pendentes, resultados, erro);
+            pendentes = 0;
+            continue;
+        }
+
+        // Nem a espera funciona: as requisições restantes recebem o erro
+        for (int i = 0; i < n; i++) {
+            if (resultados[i] == RESULTADO_PENDENTE) resultados[i] = erro;
+        }
+        break;
     }
-    pthread_mutex_unlock(&mutex_ordem);
 }
 
 /**
- * @brief Função executada por cada thread produtora
- * @param arg Argumentos da thread (ThreadArgs*)
- * @return NULL
+ * @brief Processa um lote de requisições com io_uring
+ * @param motor Motor de E/S
+ * @param lote Requisições a processar
+ * @param n Número de requisições no lote
  * 
- * A thread produtora:
- * 1. Lê arquivos do diretório de entrada
- * 2. Carrega cada imagem encontrada
- * 3. Insere a imagem na fila
- * 4. Registra métricas de desempenho
- * 5. Registra sua ordem de finalização
+ * O lote é executado em três fases, cada uma com uma única submissão:
+ * 1. openat de todos os arquivos
+ * 2. read/write de todos os conteúdos (repetida para transferências parciais)
+ * 3. close de todos os descritores
  */
-void* produtor(void* arg) {
-    ThreadArgs* args = (ThreadArgs*)arg;
-    DIR* dir;
-    struct dirent* ent;
-    struct timespec inicio, fim;
-    
-    printf("Produtor %d iniciado\n", args->thread_id);
-    
-    dir = opendir(args->diretorio_entrada);
-    if (!dir) {
-        perror("Erro ao abrir diretório");
-        return NULL;
+void motor_es_lote_io_uring(MotorES* motor, RequisicaoES** lote, int n) {
+    int resultados[n];
+    unsigned submetidas = 0;
+
+    // Fase 1: aberturas
+    for (int i = 0; i < n; i++) {
+        struct io_uring_sqe* sqe = anel_obter_sqe(&motor->anel);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long long)(uintptr_t)lote[i]->caminho;
+        if (lote[i]->tipo == ES_LEITURA) {
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        } else {
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            sqe->len = 0644;
+        }
+        sqe->user_data = i;
+        resultados[i] = RESULTADO_PENDENTE;
+        submetidas++;
+    }
+    anel_concluir_fase(motor, resultados, n, submetidas);
+    for (int i = 0; i < n; i++) {
+        if (resultados[i] < 0) {
+            lote[i]->erro = -resultados[i];
+            lote[i]->fd = -1;
+        } else {
+            lote[i]->fd = resultados[i];
+        }
+        if (lote[i]->tipo == ES_LEITURA && lote[i]->fd >= 0) {
+            lote[i]->buffer = (unsigned char*)malloc(lote[i]->tamanho ? lote[i]->tamanho : 1);
+            if (!lote[i]->buffer) lote[i]->erro = ENOMEM;
+        }
     }
-    
-    while (executando && (ent = readdir(dir)) != NULL) {
-        char caminho[512];
-        snprintf(caminho, sizeof(caminho), "%s/%s", args->diretorio_entrada, ent->d_name);
 
-        struct stat st;
-        if (stat(caminho, &st) == 0 && S_ISREG(st.st_mode)) {
-            clock_gettime(CLOCK_MONOTONIC, &inicio);
-            
-            Imagem* img = carregar_imagem_do_disco(caminho, args->thread_id);
-            if (img) {
-                img->produtor_id = args->thread_id;  // Define o ID do produtor
-                printf("Produtor %d: inserindo imagem %s na fila\n", 
-                       args->thread_id, ent->d_name);
-                
-                if (inserir_imagem_na_fila(args->fila, img)) {
-                    printf("Produtor %d: Imagem %s inserida na fila\n", 
-                           args->thread_id, ent->d_name);
-                }
-                
-                liberar_imagem_da_memoria(img);
+    // Fase 2: transferências, repetidas enquanto houver leituras/escritas parciais
+    int ativas = 1;
+    while (ativas) {
+        ativas = 0;
+        submetidas = 0;
+        for (int i = 0; i < n; i++) {
+            RequisicaoES* req = lote[i];
+            resultados[i] = RESULTADO_NAO_SUBMETIDA;
+            if (req->fd < 0 || req->erro || req->transferidos >= req->tamanho) continue;
+
+            struct io_uring_sqe* sqe = anel_obter_sqe(&motor->anel);
+            sqe->opcode = req->tipo == ES_LEITURA ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = req->fd;
+            sqe->addr = (unsigned long long)(uintptr_t)(req->buffer + req->transferidos);
+            size_t restante = req->tamanho - req->transferidos;
+            sqe->len = restante < ES_MAX_TRECHO ? (unsigned)restante : ES_MAX_TRECHO;
+            sqe->off = req->transferidos;
+            sqe->user_data = i;
+            resultados[i] = RESULTADO_PENDENTE;
+            submetidas++;
+        }
+        if (submetidas == 0) break;
+
+        anel_concluir_fase(motor, resultados, n, submetidas);
+        for (int i = 0; i < n; i++) {
+            if (resultados[i] == RESULTADO_NAO_SUBMETIDA) continue;
+            RequisicaoES* req = lote[i];
+            if (resultados[i] < 0) {
+                req->erro = -resultados[i];
+            } else if (resultados[i] == 0) {
+                // Fim de arquivo antes do esperado: o arquivo encolheu
+                req->tamanho = req->transferidos;
+            } else {
+                req->transferidos += resultados[i];
+                if (req->transferidos < req->tamanho) ativas = 1;
             }
-            
-            clock_gettime(CLOCK_MONOTONIC, &fim);
-            double tempo = (fim.tv_sec - inicio.tv_sec) + 
-                          (fim.tv_nsec - inicio.tv_nsec) / 1e9;
-            atualizar_metricas(args->thread_id, 0, tempo);
         }
     }
-    
-    closedir(dir);
-    registrar_finalizacao(args->thread_id, 0);
-    printf("Produtor %d finalizado\n", args->thread_id);
-    return NULL;
+
+    // Fase 3: fechamentos
+    submetidas = 0;
+    for (int i = 0; i < n; i++) {
+        resultados[i] = RESULTADO_NAO_SUBMETIDA;
+        if (lote[i]->fd < 0) continue;
+        struct io_uring_sqe* sqe = anel_obter_sqe(&motor->anel);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = lote[i]->fd;
+        sqe->user_data = i;
+        resultados[i] = RESULTADO_PENDENTE;
+        submetidas++;
+    }
+    if (submetidas > 0) {
+        anel_concluir_fase(motor, resultados, n, submetidas);
+    }
+    for (int i = 0; i < n; i++) {
+        if (resultados[i] < 0 && resultados[i] != RESULTADO_NAO_SUBMETIDA && !lote[i]->erro) {
+            lote[i]->erro = -resultados[i];
+        }
+        lote[i]->fd = -1;
+    }
 }
+#endif
 
 /**
- * @brief Função executada por cada thread consumidora
- * @param arg Argumentos da thread (ThreadArgs*)
- * @return NULL
+ * @brief Executa uma requisição de forma síncrona com open/pread/pwrite/close
+ * @param motor Motor de E/S (para estatísticas)
+ * @param req Requisição a executar
  * 
- * A thread consumidora:
- * 1. Remove imagens da fila
- * 2. Aplica transformações (cinza, inversão, brilho, contraste)
- * 3. Salva a imagem processada
- * 4. Registra métricas de desempenho
- * 5. Registra sua ordem de finalização
+ * Usado pelo pool de threads quando o io_uring não está disponível.
  */
-void* consumidor(void* arg) {
-    ThreadArgs* args = (ThreadArgs*)arg;
-    struct timespec inicio, fim;
-    
-    printf("Consumidor %d iniciado\n", args->thread_id);
-    
-    while (1) {
-        Imagem img;
-        Future* future = NULL;
-        
-        // Tenta remover imagem da fila com timeout
-        struct timespec timeout;
-        clock_gettime(CLOCK_MONOTONIC, &timeout);
-        timeout.tv_sec += 2; // 2 segundos de timeout
-        
-        int sem_result = sem_timedwait(&args->fila->cheio, &timeout);
-        if (sem_result == 0) {
-            pthread_mutex_lock(&args->fila->mutex);
-            if (args->fila->tamanho > 0) {
-                // Obtém o future da imagem
-                future = args->fila->futures[args->fila->inicio];
-
-                // Copia a imagem da fila
-                strncpy(img.nome, args->fila->imagens[args->fila->inicio].nome, sizeof(img.nome) - 1);
-                img.largura = args->fila->imagens[args->fila->inicio].largura;
-                img.altura = args->fila->imagens[args->fila->inicio].altura;
-                img.canais = args->fila->imagens[args->fila->inicio].canais;
-                img.produtor_id = args->fila->imagens[args->fila->inicio].produtor_id;
-                
-                // Aloca e copia os dados da imagem
-                size_t tamanho_dados = img.largura * img.altura * img.canais;
-                img.dados = (unsigned char*)malloc(tamanho_dados);
-                if (img.dados) {
-                    memcpy(img.dados, args->fila->imagens[args->fila->inicio].dados, tamanho_dados);
-                }
+void motor_es_executar_pread(MotorES* motor, RequisicaoES* req) {
+    int fd;
+    if (req->tipo == ES_LEITURA) {
+        fd = open(req->caminho, O_RDONLY | O_CLOEXEC);
+    } else {
+        fd = open(req->caminho, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        req->erro = errno;
+        return;
+    }
 
-                // Libera os dados da imagem na fila
-                free(args->fila->imagens[args->fila->inicio].dados);
-                args->fila->imagens[args->fila->inicio].dados = NULL;
+    if (req->tipo == ES_LEITURA) {
+        req->buffer = (unsigned char*)malloc(req->tamanho ? req->tamanho : 1);
+        if (!req->buffer) req->erro = ENOMEM;
+    }
 
-                // Limpa o future
-                args->fila->futures[args->fila->inicio] = NULL;
+    long chamadas = 2;
+    while (!req->erro && req->transferidos < req->tamanho) {
+        ssize_t ret;
+        if (req->tipo == ES_LEITURA) {
+            ret = pread(fd, req->buffer + req->transferidos, req->tamanho - req->transferidos, req->transferidos);
+        } else {
+            ret = pwrite(fd, req->buffer + req->transferidos, req->tamanho - req->transferidos, req->transferidos);
+        }
+        chamadas++;
+        if (ret < 0) {
+            if (errno != EINTR) req->erro = errno;
+        } else if (ret == 0) {
+            req->tamanho = req->transferidos;
+        } else {
+            req->transferidos += ret;
+        }
+    }
 
-                // Atualiza índices da fila
-                args->fila->inicio = (args->fila->inicio + 1) % args->fila->capacidade;
-                args->fila->tamanho--;
+    if (close(fd) != 0 && !req->erro) req->erro = errno;
 
-                pthread_mutex_unlock(&args->fila->mutex);
-                sem_post(&args->fila->vazio);
+    pthread_mutex_lock(&motor->mutex);
+    motor->chamadas_sistema += chamadas;
+    pthread_mutex_unlock(&motor->mutex);
+}
 
-                clock_gettime(CLOCK_MONOTONIC, &inicio);
-                
-                printf("Consumidor %d: Processando imagem %s\n", 
-                       args->thread_id, img.nome);
-                
-                // Processa a imagem
-                converter_para_cinza(&img);
-                inverter_cores(&img);
-                ajustar_brilho(&img, 1.2f);
-                ajustar_contraste(&img, 1.3f);
-                
-                // Salva a imagem processada
-                salvar_imagem_no_disco(&img, args->diretorio_saida, args->thread_id);
-                
-                // Define o resultado no future
-                if (future) {
-                    printf("Consumidor %d: Definindo resultado no Future para imagem %s\n",
-                           args->thread_id, img.nome);
-                    definir_resultado_future(future, &img);
-                }
-                
-                free(img.dados);
-                
-                clock_gettime(CLOCK_MONOTONIC, &fim);
-                double tempo = (fim.tv_sec - inicio.tv_sec) + 
-                              (fim.tv_nsec - inicio.tv_nsec) / 1e9;
-                atualizar_metricas(args->thread_id, 1, tempo);
-            } else {
-                pthread_mutex_unlock(&args->fila->mutex);
-                // Não faz break aqui, apenas continua tentando
-                usleep(10000); // Pequeno delay para evitar busy-wait
-                continue;
-            }
+/**
+ * @brief Conclui uma requisição: atualiza estatísticas e sinaliza o Future
+ * @param motor Motor de E/S
+ * @param req Requisição concluída
+ * 
+ * Requisições marcadas com descartar (escritas "fire-and-forget")
+ * são liberadas aqui, junto com o buffer. É aqui, e só com a escrita bem
+ * sucedida, que a saída entra no índice incremental e serve às duplicatas.
+ */
+void motor_es_concluir(MotorES* motor, RequisicaoES* req) {
+    pthread_mutex_lock(&motor->mutex);
+    if (req->tipo == ES_LEITURA) {
+        motor->leituras++;
+        motor->bytes_lidos += req->transferidos;
+    } else {
+        motor->escritas++;
+        motor->bytes_escritos += req->transferidos;
+    }
+    pthread_mutex_unlock(&motor->mutex);
+
+    if (req->descartar) {
+        if (req->erro) {
+            printf("Erro ao salvar imagem: %s (%s)\n", req->caminho, strerror(req->erro));
         } else {
-            // Timeout ocorreu
-            pthread_mutex_lock(&args->fila->mutex);
-            int fila_vazia = (args->fila->tamanho == 0);
-            pthread_mutex_unlock(&args->fila->mutex);
-            if (!executando && fila_vazia) {
-                break; // Só sai se não estiver executando e a fila estiver vazia
-            }
-            // Caso contrário, continua tentando
-            usleep(10000);
+            printf("Imagem salva com sucesso: %s\n", req->caminho);
         }
+        conclusao_saida_registrar(req->conclusao, req->caminho, !req->erro);
+        orcamento_liberar(req->tamanho);
+        free(req->buffer);
+        free(req);
+        return;
     }
-    
-    registrar_finalizacao(args->thread_id, 1);
-    printf("Consumidor %d finalizado\n", args->thread_id);
-    return NULL;
+    definir_resultado_future(req->future, NULL);
 }
 
 /**
- * @brief Cria uma nova fila de imagens
- * @param capacidade Número máximo de imagens que a fila pode armazenar
- * @return Ponteiro para a fila criada, ou NULL em caso de erro
+ * @brief Retira até max requisições pendentes (bloqueante)
+ * @param motor Motor de E/S
+ * @param lote Array que recebe as requisições
+ * @param max Tamanho máximo do lote
+ * @return Número de requisições retiradas; 0 quando o motor está encerrando
+ */
+int motor_es_retirar_lote(MotorES* motor, RequisicaoES** lote, int max) {
+    pthread_mutex_lock(&motor->mutex);
+    while (motor->num_pendentes == 0 && !motor->encerrando) {
+        pthread_cond_wait(&motor->cond, &motor->mutex);
+    }
+    int n = 0;
+    while (n < max && motor->pendentes_inicio) {
+        RequisicaoES* req = motor->pendentes_inicio;
+        motor->pendentes_inicio = req->proxima;
+        req->proxima = NULL;
+        lote[n++] = req;
+    }
+    if (!motor->pendentes_inicio) motor->pendentes_fim = NULL;
+    motor->num_pendentes -= n;
+    if (n > 0 && motor->usa_io_uring) motor->lotes++;
+    pthread_mutex_unlock(&motor->mutex);
+    return n;
+}
+
+/**
+ * @brief Função executada pelas threads do motor de E/S
+ * @param arg Ponteiro para o MotorES
+ * @return NULL
  * 
- * A função inicializa uma fila circular com semáforos para controle de acesso.
- * A fila é thread-safe e pode ser usada por múltiplos produtores e consumidores.
+ * Com io_uring, uma única thread agrupa até "profundidade" requisições por lote.
+ * No modo pread, cada thread do pool executa uma requisição por vez.
+ */
+void* thread_motor_es(void* arg) {
+    MotorES* motor = (MotorES*)arg;
+    int max = motor->usa_io_uring ? motor->profundidade : 1;
+    RequisicaoES** lote = (RequisicaoES**)malloc(max * sizeof(RequisicaoES*));
+    if (!lote) {
+        perror("Erro ao alocar lote do motor de E/S");
+        return NULL;
+    }
+
+    int n;
+    while ((n = motor_es_retirar_lote(motor, lote, max)) > 0) {
+#ifdef TEM_IO_URING
+        if (motor->usa_io_uring) {
+            motor_es_lote_io_uring(motor, lote, n);
+        } else
+#endif
+        {
+            motor_es_executar_pread(motor, lote[0]);
+        }
+        for (int i = 0; i < n; i++) {
+            motor_es_concluir(motor, lote[i]);
+        }
+    }
+
+    free(lote);
+    return NULL;
+}
+
+/**
+ * @brief Cria o motor de E/S
+ * @param modo MODO_ES_AUTO, MODO_ES_IO_URING ou MODO_ES_PREAD
+ * @param profundidade Máximo de requisições por lote
+ * @param cpus CPUs disponíveis (o pool de pread tem duas threads por CPU, até a profundidade)
+ * @return Ponteiro para o motor criado, ou NULL em caso de erro
  * 
- * É responsabilidade do chamador destruir a fila usando destruir_fila().
+ * No modo automático tenta io_uring e recai para o pool de pread se o
+ * kernel não suportar (ou se estiver bloqueado por seccomp), inclusive
+ * quando o anel existe mas faltam as operações de arquivo (kernels 5.1 a 5.5).
+ * Em caso de erro, tudo o que já foi criado é desfeito com motor_es_destruir().
+ * É responsabilidade do chamador destruir o motor usando motor_es_destruir().
  */
-FilaImagens* criar_fila(int capacidade) {
-    FilaImagens* fila = (FilaImagens*)malloc(sizeof(FilaImagens));
-    if (!fila) {
-        perror("Erro ao alocar fila");
+MotorES* criar_motor_es(int modo, int profundidade, int cpus) {
+    MotorES* motor = (MotorES*)calloc(1, sizeof(MotorES));
+    if (!motor) {
+        perror("Erro ao alocar motor de E/S");
         return NULL;
     }
 
-    fila->imagens = (Imagem*)malloc(capacidade * sizeof(Imagem));
-    if (!fila->imagens) {
-        perror("Erro ao alocar array de imagens");
-        free(fila);
+    motor->profundidade = profundidade > 0 ? profundidade : 1;
+    pthread_mutex_init(&motor->mutex, NULL);
+    pthread_cond_init(&motor->cond, NULL);
+
+#ifdef TEM_IO_URING
+    if (modo != MODO_ES_PREAD) {
+        int iniciado = anel_iniciar(&motor->anel, (unsigned)motor->profundidade) == 0;
+        if (iniciado && !anel_suporta_operacoes(&motor->anel)) {
+            anel_finalizar(&motor->anel);
+            iniciado = 0;
+            errno = EOPNOTSUPP;
+        }
+        if (iniciado) {
+            motor->usa_io_uring = 1;
+            // O anel pode ter sido arredondado, mas o lote nunca o excede
+            if ((unsigned)motor->profundidade > motor->anel.entradas_sq) {
+                motor->profundidade = (int)motor->anel.entradas_sq;
+            }
+        } else if (modo == MODO_ES_IO_URING) {
+            perror("io_uring indisponível");
+            motor_es_destruir(motor);
+            return NULL;
+        } else {
+            printf("io_uring indisponível, usando pool de pread\n");
+        }
+    }
+#else
+    if (modo == MODO_ES_IO_URING) {
+        printf("io_uring não suportado nesta compilação\n");
+        motor_es_destruir(motor);
         return NULL;
     }
+#endif
 
-    fila->futures = (Future**)malloc(capacidade * sizeof(Future*));
-    if (!fila->futures) {
-        perror("Erro ao alocar array de futures");
-        free(fila->imagens);
-        free(fila);
+    // Cada thread do pool atende uma requisição por vez e passa boa parte do
+    // tempo bloqueada no disco; além de duas por CPU (ou da profundidade),
+    // só disputariam o disco e o escalonador
+    int num_threads = 1;
+    if (!motor->usa_io_uring) {
+        num_threads = cpus * 2 < motor->profundidade ? cpus * 2 : motor->profundidade;
+        if (num_threads < 1) num_threads = 1;
+    }
+    motor->threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    if (!motor->threads) {
+        perror("Erro ao alocar threads do motor de E/S");
+        motor_es_destruir(motor);
         return NULL;
     }
 
-    fila->capacidade = capacidade;
-    fila->inicio = 0;
-    fila->fim = 0;
-    fila->tamanho = 0;
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&motor->threads[i], NULL, thread_motor_es, motor) != 0) {
+            perror("Erro ao criar thread do motor de E/S");
+            break;
+        }
+        motor->num_threads++;
+    }
+    if (motor->num_threads == 0) {
+        // Sem threads, nenhuma requisição seria concluída
+        motor_es_destruir(motor);
+        return NULL;
+    }
 
-    // Inicializa mutex e semáforos
-    pthread_mutex_init(&fila->mutex, NULL);
-    sem_init(&fila->vazio, 0, capacidade);
-    sem_init(&fila->cheio, 0, 0);
+    if (motor->usa_io_uring) {
+        printf("Motor de E/S: io_uring (profundidade %d)\n", motor->profundidade);
+    } else {
+        printf("Motor de E/S: pool de pread (profundidade %d, %d threads)\n", motor->profundidade, motor->num_threads);
+    }
+    return motor;
+}
 
-    return fila;
+/**
+ * @brief Drena as requisições pendentes e encerra as threads do motor de E/S
+ * @param motor Motor a ser encerrado
+ * 
+ * Bloqueia até que todas as escritas submetidas tenham sido concluídas.
+ * As estatísticas continuam disponíveis até motor_es_destruir().
+ */
+void motor_es_encerrar(MotorES* motor) {
+    if (!motor || motor->encerrando) return;
+
+    pthread_mutex_lock(&motor->mutex);
+    motor->encerrando = 1;
+    pthread_cond_broadcast(&motor->cond);
+    pthread_mutex_unlock(&motor->mutex);
+
+    for (int i = 0; i < motor->num_threads; i++) {
+        pthread_join(motor->threads[i], NULL);
+    }
+}
+
+/**
+ * @brief Destrói o motor de E/S, encerrando-o antes se necessário
+ * @param motor Motor a ser destruído
+ */
+void motor_es_destruir(MotorES* motor) {
+    if (!motor) return;
+
+    motor_es_encerrar(motor);
+
+#ifdef TEM_IO_URING
+    if (motor->usa_io_uring) anel_finalizar(&motor->anel);
+#endif
+    pthread_mutex_destroy(&motor->mutex);
+    pthread_cond_destroy(&motor->cond);
+    free(motor->threads);
+    free(motor);
+}
+
+/**
+ * @brief Enfileira uma requisição no motor de E/S
+ * @param motor Motor de E/S
+ * @param req Requisição a enfileirar
+ */
+void motor_es_submeter(MotorES* motor, RequisicaoES* req) {
+    req->proxima = NULL;
+    req->fd = -1;
+    pthread_mutex_lock(&motor->mutex);
+    if (motor->pendentes_fim) {
+        motor->pendentes_fim->proxima = req;
+    } else {
+        motor->pendentes_inicio = req;
+    }
+    motor->pendentes_fim = req;
+    motor->num_pendentes++;
+    pthread_cond_signal(&motor->cond);
+    pthread_mutex_unlock(&motor->mutex);
+}
+
+/**
+ * @brief Solicita a leitura assíncrona de um arquivo inteiro
+ * @param motor Motor de E/S
+ * @param caminho Caminho do arquivo
+ * @param tamanho Tamanho do arquivo (obtido pelo stat da varredura)
+ * @return Requisição em andamento, ou NULL em caso de erro
+ * 
+ * O resultado é obtido com motor_es_aguardar(). O chamador libera a
+ * requisição e o buffer com liberar_requisicao_es().
+ */
+RequisicaoES* motor_es_ler(MotorES* motor, const char* caminho, size_t tamanho) {
+    RequisicaoES* req = (RequisicaoES*)calloc(1, sizeof(RequisicaoES));
+    if (!req) {
+        perror("Erro ao alocar requisição de leitura");
+        return NULL;
+    }
+    req->future = criar_future();
+    if (!req->future) {
+        free(req);
+        return NULL;
+    }
+    req->tipo = ES_LEITURA;
+    strncpy(req->caminho, caminho, sizeof(req->caminho) - 1);
+    req->tamanho = tamanho;
+    motor_es_submeter(motor, req);
+    return req;
+}
+
+/**
+ * @brief Solicita a escrita assíncrona de um buffer em um arquivo
+ * @param motor Motor de E/S
+ * @param caminho Caminho do arquivo de saída
+ * @param buffer Conteúdo a escrever (o motor assume a posse e o libera)
+ * @param tamanho Número de bytes a escrever
+ * @param conclusao Recebe o resultado da escrita quando ela termina (ou NULL)
+ * @return 1 se a escrita foi enfileirada, 0 caso contrário
+ * 
+ * A escrita é "fire-and-forget": erros são reportados pelo próprio motor.
+ * A conclusão recebe o resultado exatamente uma vez, mesmo que a escrita
+ * não chegue a ser enfileirada.
+ */
+int motor_es_escrever(MotorES* motor, const char* caminho, unsigned char* buffer, size_t tamanho,
+                      struct ConclusaoSaida* conclusao) {
+    RequisicaoES* req = (RequisicaoES*)calloc(1, sizeof(RequisicaoES));
+    if (!req) {
+        perror("Erro ao alocar requisição de escrita");
+        free(buffer);
+        conclusao_saida_registrar(conclusao, NULL, 0);
+        return 0;
+    }
+    req->tipo = ES_ESCRITA;
+    strncpy(req->caminho, caminho, sizeof(req->caminho) - 1);
+    req->buffer = buffer;
+    req->tamanho = tamanho;
+    req->descartar = 1;
+    req->conclusao = conclusao;
+    orcamento_acrescentar(tamanho);  // Devolvido quando a escrita termina
+    motor_es_submeter(motor, req);
+    return 1;
+}
+
+/**
+ * @brief Aguarda a conclusão de uma requisição de leitura
+ * @param req Requisição retornada por motor_es_ler()
+ * @return 0 em caso de sucesso, errno em caso de falha
+ */
+int motor_es_aguardar(RequisicaoES* req) {
+    obter_resultado_future(req->future);
+    return req->erro;
+}
+
+/**
+ * @brief Libera uma requisição de leitura e seu buffer
+ * @param req Requisição a liberar (seguro com NULL)
+ */
+void liberar_requisicao_es(RequisicaoES* req) {
+    if (!req) return;
+    destruir_future(req->future);
+    free(req->buffer);
+    free(req);
+}
+
+/**
+ * @brief Carrega uma imagem do disco para a memória
+ * @param caminho Caminho do arquivo de imagem a ser carregado
+ * @param produtor_id ID do produtor que está carregando a imagem (para logs)
+ * @return Ponteiro para a estrutura Imagem carregada, ou NULL em caso de erro
+ * 
+ * Esta função utiliza a biblioteca stb_image para carregar imagens em vários formatos
+ * (PNG, JPG, BMP, etc). A imagem é carregada em memória e suas dimensões e número
+ * de canais são detectados automaticamente.
+ * 
+ * A função aloca memória para a estrutura Imagem e seus dados. É responsabilidade
+ * do chamador liberar esta memória usando liberar_imagem_da_memoria().
+ */
+Imagem* carregar_imagem_do_disco(const char* caminho, int produtor_id) {
+    Imagem* img = (Imagem*)malloc(sizeof(Imagem));
+    if (!img) {
+        perror("Erro ao alocar estrutura de imagem");
+        return NULL;
+    }
+
+    // Copia o nome do arquivo
+    strncpy(img->nome, caminho, sizeof(img->nome) - 1);
+    img->nome[sizeof(img->nome) - 1] = '\0';
+
+    // Carrega a imagem usando stb_image, forçando 3 canais (RGB)
+    img->dados = stbi_load(caminho, &img->largura, &img->altura, &img->canais, 3);
+    
+    if (!img->dados) {
+        printf("Erro ao carregar imagem %s: %s\n", caminho, stbi_failure_reason());
+        free(img);
+        return NULL;
+    }
+
+    // Força 3 canais
+    img->canais = 3;
+    img->trabalho = NULL;
+    img->quadro = NULL;
+    img->fluxo = NULL;
+    img->sequencia = 0;
+    img->compartilhada = NULL;
+    img->variante = 0;
+    img->fonte = NULL;
+    img->passo = 0;
+    img->num_pendentes = 0;
+    img->custo_previsto = 0.0;
+    img->reserva = 0;
+    img->chegada = 0.0;
+
+    printf("Produtor %d: Carregou imagem %s (%dx%d, %d canais)\n", 
+           produtor_id, caminho, img->largura, img->altura, img->canais);
+
+    return img;
+}
+
+/**
+ * @brief Decodifica uma imagem a partir de um buffer em memória
+ * @param caminho Caminho do arquivo de origem (usado como nome da imagem)
+ * @param buffer Conteúdo codificado do arquivo
+ * @param tamanho Número de bytes no buffer
+ * @param produtor_id ID do produtor que está carregando a imagem (para logs)
+ * @return Ponteiro para a estrutura Imagem carregada, ou NULL em caso de erro
+ * 
+ * Usada quando o arquivo já foi lido pelo motor de E/S. O buffer continua
+ * pertencendo ao chamador. Libere a imagem com liberar_imagem_da_memoria().
+ */
+Imagem* carregar_imagem_da_memoria(const char* caminho, const unsigned char* buffer, size_t tamanho, int produtor_id) {
+    Imagem* img = (Imagem*)malloc(sizeof(Imagem));
+    if (!img) {
+        perror("Erro ao alocar estrutura de imagem");
+        return NULL;
+    }
+
+    // Copia o nome do arquivo
+    strncpy(img->nome, caminho, sizeof(img->nome) - 1);
+    img->nome[sizeof(img->nome) - 1] = '\0';
+
+    // Decodifica usando stb_image, forçando 3 canais (RGB)
+    img->dados = stbi_load_from_memory(buffer, (int)tamanho, &img->largura, &img->altura, &img->canais, 3);
+    
+    if (!img->dados) {
+        printf("Erro ao carregar imagem %s: %s\n", caminho, stbi_failure_reason());
+        free(img);
+        return NULL;
+    }
+
+    // Força 3 canais
+    img->canais = 3;
+    img->trabalho = NULL;
+    img->quadro = NULL;
+    img->fluxo = NULL;
+    img->sequencia = 0;
+    img->compartilhada = NULL;
+    img->variante = 0;
+    img->fonte = NULL;
+    img->passo = 0;
+    img->num_pendentes = 0;
+    img->custo_previsto = 0.0;
+    img->reserva = 0;
+    img->chegada = 0.0;
+
+    printf("Produtor %d: Carregou imagem %s (%dx%d, %d canais)\n", 
+           produtor_id, caminho, img->largura, img->altura, img->canais);
+
+    return img;
+}
+
+/**
+ * @brief Libera a memória alocada para uma imagem
+ * @param img Ponteiro para a estrutura Imagem a ser liberada
+ * 
+ * Esta função libera tanto a estrutura Imagem quanto os dados da imagem em si.
+ * É segura para chamar com NULL.
+ */
+void liberar_imagem_da_memoria(Imagem* img) {
+    if (img) {
+        if (img->dados) {
+            stbi_image_free(img->dados);
+        }
+        // Imagem que não chegou à fila: a reserva volta ao orçamento
+        orcamento_ajustar(img->reserva, 0);
+        free(img);
+    }
+}
+
+/**
+ * @brief Retorna o caminho relativo ao diretório raiz
+ * @param caminho Caminho completo
+ * @param raiz Diretório raiz (ex: diretório de entrada)
+ * @return Ponteiro para dentro de caminho, sem o prefixo "raiz/" se houver
+ */
+const char* caminho_relativo(const char* caminho, const char* raiz) {
+    size_t tamanho_raiz = strlen(raiz);
+    if (strncmp(caminho, raiz, tamanho_raiz) == 0 && caminho[tamanho_raiz] == '/') {
+        return caminho + tamanho_raiz + 1;
+    }
+    return caminho;
+}
+
+/**
+ * @brief Cria um diretório e todos os diretórios intermediários (mkdir -p)
+ * @param caminho Diretório a criar
+ * @param modo Permissões dos diretórios criados
+ * @return 0 em caso de sucesso (ou se já existir), -1 em caso de erro
+ * 
+ * Tolera corridas com outras threads criando o mesmo diretório.
+ */
+int criar_diretorios(const char* caminho, mode_t modo) {
+    char parcial[PATH_MAX];
+    snprintf(parcial, sizeof(parcial), "%s", caminho);
+
+    for (char* p = parcial + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(parcial, modo) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    if (mkdir(parcial, modo) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+// Buffer crescente usado para codificar imagens em memória
+typedef struct {
+    unsigned char* dados;
+    size_t tamanho;
+    size_t capacidade;
+    int erro;
+} BufferSaida;
+
+// Job recebido pelo modo servidor, em trânsito pela fila de imagens
+typedef struct TrabalhoServidor {
+    OperacaoProtocolo operacoes[MAX_OPERACOES];
+    int num_operacoes;
+    char extensao[16];     // Formato da saída (ex: ".png")
+    BufferSaida resultado; // Imagem codificada pelo consumidor
+    int status;            // 0 ou código errno
+    Future* future;        // Sinalizado pelo consumidor ao concluir
+} TrabalhoServidor;
+
+/**
+ * @brief Callback do stb_image_write que acumula a saída em um BufferSaida
+ * @param contexto Ponteiro para o BufferSaida
+ * @param dados Bytes produzidos pelo codificador
+ * @param tamanho Número de bytes produzidos
+ */
+void escrever_no_buffer(void* contexto, void* dados, int tamanho) {
+    BufferSaida* saida = (BufferSaida*)contexto;
+    if (saida->erro) return;
+
+    if (saida->tamanho + tamanho > saida->capacidade) {
+        size_t nova_capacidade = saida->capacidade ? saida->capacidade * 2 : 64 * 1024;
+        while (nova_capacidade < saida->tamanho + tamanho) nova_capacidade *= 2;
+        unsigned char* novos_dados = (unsigned char*)realloc(saida->dados, nova_capacidade);
+        if (!novos_dados) {
+            saida->erro = 1;
+            return;
+        }
+        saida->dados = novos_dados;
+        saida->capacidade = nova_capacidade;
+    }
+    memcpy(saida->dados + saida->tamanho, dados, tamanho);
+    saida->tamanho += tamanho;
+}
+
+/**
+ * @brief Callback do stb_image_write que grava a saída em um FILE*
+ * @param contexto Ponteiro para o FILE aberto
+ * @param dados Bytes produzidos pelo codificador
+ * @param tamanho Número de bytes produzidos
+ */
+void escrever_no_arquivo(void* contexto, void* dados, int tamanho) {
+    fwrite(dados, 1, tamanho, (FILE*)contexto);
+}
+
+/**
+ * @brief Codifica uma imagem no formato indicado pela extensão
+ * @param img Imagem a codificar
+ * @param extensao Extensão do arquivo original (ex: ".png"), ou NULL
+ * @param func Callback que recebe os bytes codificados
+ * @param contexto Contexto repassado ao callback
+ * @return Diferente de zero em caso de sucesso
+ * 
+ * Formatos não reconhecidos (ou sem extensão) são codificados como PNG.
+ * Operações pendentes são aplicadas antes (a codificação materializa a imagem).
+ * O PNG é codificado direto de uma vista (recorte); os demais formatos
+ * exigem linhas contíguas, e a vista é compactada antes.
+ */
+int codificar_imagem(Imagem* img, const char* extensao, stbi_write_func* func, void* contexto) {
+    if (!materializar_imagem(img)) return 0;
+    int png = !extensao || (strcasecmp(extensao, ".jpg") != 0 && strcasecmp(extensao, ".jpeg") != 0 &&
+                            strcasecmp(extensao, ".bmp") != 0 && strcasecmp(extensao, ".tga") != 0);
+    if (!png && !compactar_imagem(img)) return 0;
+    const unsigned char* pixels = img->fonte ? img->fonte : img->dados;
+    int passo = img->fonte && img->passo ? (int)img->passo : img->largura * img->canais;
+
+    if (extensao) {
+        if (strcasecmp(extensao, ".jpg") == 0 || strcasecmp(extensao, ".jpeg") == 0) {
+            return stbi_write_jpg_to_func(func, contexto, img->largura, img->altura, img->canais, pixels, QUALIDADE_JPG);
+        } else if (strcasecmp(extensao, ".bmp") == 0) {
+            return stbi_write_bmp_to_func(func, contexto, img->largura, img->altura, img->canais, pixels);
+        } else if (strcasecmp(extensao, ".tga") == 0) {
+            return stbi_write_tga_to_func(func, contexto, img->largura, img->altura, img->canais, pixels);
+        }
+    }
+    // PNG, extensão não reconhecida ou sem extensão
+    return stbi_write_png_to_func(func, contexto, img->largura, img->altura, img->canais, pixels, passo);
+}
+
+/**
+ * @brief Monta o caminho de saída de uma imagem e cria seu diretório
+ * @param nome Caminho de entrada da imagem
+ * @param diretorio_entrada Diretório de entrada (para obter o caminho relativo)
+ * @param diretorio_saida Diretório de saída
+ * @param caminho_saida Recebe o caminho de saída
+ * @param tamanho Tamanho do buffer caminho_saida
+ * @return 0 em caso de sucesso, -1 se o caminho não couber no buffer
+ * 
+ * O caminho de saída é o caminho relativo da entrada dentro do diretório
+ * de saída, com o mesmo nome: não depende de qual consumidor processou a
+ * imagem, então execuções repetidas produzem sempre os mesmos arquivos.
+ * Uma saída anterior é removida em vez de sobrescrita, pois pode ser um
+ * link para uma entrada do cache de resultados. Um destino que é o próprio
+ * arquivo de entrada (o mesmo inode, por um link ou por um caminho
+ * equivalente) nunca é removido nem sobrescrito.
+ */
+int montar_caminho_saida(const char* nome, const char* diretorio_entrada, const char* diretorio_saida,
+                         char* caminho_saida, size_t tamanho) {
+    const char* relativo = caminho_relativo(nome, diretorio_entrada);
+    if (relativo[0] == '/') relativo = strrchr(relativo, '/') + 1; // Fora da entrada: só o nome
+
+    int escritos = snprintf(caminho_saida, tamanho, "%s/%s", diretorio_saida, relativo);
+    if (escritos < 0 || (size_t)escritos >= tamanho) {
+        printf("Caminho de saída muito longo para: %s\n", nome);
+        return -1;
+    }
+
+    // Garante que o diretório de saída (e o subdiretório relativo) existe
+    char* ultima_barra = strrchr(caminho_saida, '/');
+    *ultima_barra = '\0';
+    struct stat st = {0};
+    if (stat(caminho_saida, &st) == -1) {
+        criar_diretorios(caminho_saida, 0700);
+    }
+    *ultima_barra = '/';
+
+    struct stat st_entrada, st_destino;
+    if (lstat(caminho_saida, &st_destino) == 0 && stat(nome, &st_entrada) == 0 &&
+        st_destino.st_dev == st_entrada.st_dev && st_destino.st_ino == st_entrada.st_ino) {
+        printf("Saída %s é o próprio arquivo de entrada; não será sobrescrita\n", caminho_saida);
+        return -1;
+    }
+    unlink(caminho_saida);
+    return 0;
+}
+
+/**
+ * @brief Verifica se o diretório de saída é o próprio diretório de entrada
+ * @param diretorio_entrada Diretório de entrada
+ * @param diretorio_saida Diretório de saída (criado se não existir)
+ * @return 0 se são diretórios distintos, -1 se são o mesmo (ou a saída não pôde ser criada)
+ * 
+ * As saídas têm o nome das entradas, então gravá-las no diretório de
+ * entrada substituiria as originais. A comparação é por dispositivo e
+ * inode, que também pega links simbólicos e caminhos equivalentes.
+ */
+int verificar_diretorio_saida(const char* diretorio_entrada, const char* diretorio_saida) {
+    struct stat st_entrada, st_saida;
+    if (criar_diretorios(diretorio_saida, 0700) != 0 || stat(diretorio_saida, &st_saida) != 0) {
+        printf("Erro ao criar diretório de saída %s: %s\n", diretorio_saida, strerror(errno));
+        return -1;
+    }
+    if (stat(diretorio_entrada, &st_entrada) == 0 && st_entrada.st_dev == st_saida.st_dev &&
+        st_entrada.st_ino == st_saida.st_ino) {
+        printf("O diretório de saída (%s) não pode ser o diretório de entrada (%s): "
+               "as imagens processadas substituiriam as originais\n", diretorio_saida, diretorio_entrada);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Salva uma imagem processada no disco
+ * @param img Ponteiro para a estrutura Imagem a ser salva
+ * @param diretorio_entrada Diretório de entrada (para obter o subdiretório relativo)
+ * @param diretorio_saida Diretório onde a imagem será salva
+ * @return 1 se a imagem foi salva (ou entregue ao motor de E/S), 0 em caso de erro
+ * 
+ * A função detecta automaticamente o formato original da imagem e salva no mesmo formato.
+ * Se o formato não for reconhecido, salva como PNG.
+ * Utiliza a biblioteca stb_image_write para salvar a imagem.
+ * 
+ * Com o motor de E/S ativo, a imagem é codificada em memória e a escrita
+ * é entregue ao motor, que a agrupa com as demais em lotes.
+ * 
+ * Imagens encontradas em subdiretórios da entrada (varredura recursiva)
+ * são salvas no mesmo subdiretório relativo dentro da saída.
+ */
+int salvar_imagem_no_disco(Imagem* img, const char* diretorio_entrada, const char* diretorio_saida) {
+    if (!img || !img->dados) {
+        printf("Erro: Imagem inválida para salvar.\n");
+        return 0;
+    }
+
+    char caminho_saida[PATH_MAX];
+    if (montar_caminho_saida(img->nome, diretorio_entrada, diretorio_saida, caminho_saida, sizeof(caminho_saida)) != 0) {
+        return 0;
+    }
+
+    printf("Tentando salvar imagem em: %s\n", caminho_saida);
+    printf("Dimensões: %dx%d, Canais: %d\n", img->largura, img->altura, img->canais);
+
+    // Detectar extensão do arquivo original
+    const char* nome_arquivo = strrchr(caminho_saida, '/') + 1;
+    const char* extensao_original = strrchr(nome_arquivo, '.');
+
+    if (motor_es) {
+        BufferSaida saida = {0};
+        if (!codificar_imagem(img, extensao_original, escrever_no_buffer, &saida) || saida.erro) {
+            printf("Erro ao codificar imagem: %s\n", caminho_saida);
+            free(saida.dados);
+            return 0;
+        }
+        // O motor assume a posse do buffer e reporta o resultado da escrita; o
+        // índice e as duplicatas esperam o arquivo chegar ao disco
+        struct ConclusaoSaida* conclusao = criar_conclusao_saida(img->nome, diretorio_entrada, &img->origem, 1);
+        return motor_es_escrever(motor_es, caminho_saida, saida.dados, saida.tamanho, conclusao);
+    }
+
+    int sucesso = 0;
+    FILE* arquivo = fopen(caminho_saida, "wb");
+    if (arquivo) {
+        sucesso = codificar_imagem(img, extensao_original, escrever_no_arquivo, arquivo);
+        if (fclose(arquivo) != 0) sucesso = 0;
+    }
+
+    if (!sucesso) {
+        printf("Erro ao salvar imagem: %s\n", caminho_saida);
+    } else {
+        printf("Imagem salva com sucesso: %s\n", caminho_saida);
+        saida_gravada(img->nome, caminho_relativo(img->nome, diretorio_entrada), &img->origem, caminho_saida);
+    }
+    return sucesso;
+}
+
+/**
+ * @brief Grava um buffer já codificado em um arquivo
+ * @param caminho Caminho do arquivo (criado ou truncado)
+ * @param dados Bytes a gravar
+ * @param tamanho Número de bytes
+ * @return 1 em caso de sucesso, 0 em caso de erro
+ */
+int gravar_arquivo(const char* caminho, const unsigned char* dados, size_t tamanho) {
+    FILE* arquivo = fopen(caminho, "wb");
+    if (!arquivo) return 0;
+    int sucesso = fwrite(dados, 1, tamanho, arquivo) == tamanho;
+    if (fclose(arquivo) != 0) sucesso = 0;
+    return sucesso;
+}
+
+/**
+ * @brief Converte uma imagem colorida para escala de cinza
+ * @param img Ponteiro para a estrutura Imagem a ser convertida
+ * 
+ * A função aplica a fórmula padrão de conversão para escala de cinza:
+ * cinza = 0.299R + 0.587G + 0.114B
+ * 
+ * A conversão é feita in-place, modificando os dados originais da imagem.
+ * Requer que a imagem tenha pelo menos 3 canais (RGB).
+ */
+void converter_para_cinza(Imagem* img) {
+    if (!img || !img->dados || img->canais < 3) return;
+    
+    for (int i = 0; i < img->largura * img->altura; i++) {
+        unsigned char* pixel = &img->dados[i * img->canais];
+        unsigned char cinza = (unsigned char)(0.299f * pixel[0] + 0.587f * pixel[1] + 0.114f * pixel[2]);
+        pixel[0] = pixel[1] = pixel[2] = cinza;
+    }
+}
+
+/**
+ * @brief Inverte as cores de uma imagem
+ * @param img Ponteiro para a estrutura Imagem a ser invertida
+ * 
+ * A função inverte cada canal da imagem subtraindo seu valor de 255.
+ * A inversão é feita in-place, modificando os dados originais da imagem.
+ */
+void inverter_cores(Imagem* img) {
+    if (!img || !img->dados) return;
+    
+    for (int i = 0; i < img->largura * img->altura * img->canais; i++) {
+        img->dados[i] = 255 - img->dados[i];
+    }
+}
+
+/**
+ * @brief Ajusta o brilho de uma imagem
+ * @param img Ponteiro para a estrutura Imagem a ser ajustada
+ * @param fator Fator de multiplicação do brilho (1.0 = brilho original)
+ * 
+ * A função multiplica cada canal da imagem pelo fator especificado.
+ * Valores são limitados ao intervalo [0, 255].
+ * O ajuste é feito in-place, modificando os dados originais da imagem.
+ */
+void ajustar_brilho(Imagem* img, float fator) {
+    if (!img || !img->dados) return;
+    
+    for (int i = 0; i < img->largura * img->altura * img->canais; i++) {
+        int novo_valor = (int)(img->dados[i] * fator);
+        img->dados[i] = (unsigned char)(novo_valor > 255 ? 255 : (novo_valor < 0 ? 0 : novo_valor));
+    }
+}
+
+/**
+ * @brief Ajusta o contraste de uma imagem
+ * @param img Ponteiro para a estrutura Imagem a ser ajustada
+ * @param fator Fator de multiplicação do contraste (1.0 = contraste original)
+ * 
+ * A função ajusta o contraste subtraindo 128 de cada valor,
+ * multiplicando pelo fator e adicionando 128 novamente.
+ * Valores são limitados ao intervalo [0, 255].
+ * O ajuste é feito in-place, modificando os dados originais da imagem.
+ */
+void ajustar_contraste(Imagem* img, float fator) {
+    if (!img || !img->dados) return;
+    
+    for (int i = 0; i < img->largura * img->altura * img->canais; i++) {
+        int novo_valor = (int)((img->dados[i] - 128) * fator + 128);
+        img->dados[i] = (unsigned char)(novo_valor > 255 ? 255 : (novo_valor < 0 ? 0 : novo_valor));
+    }
+}
+
+/**
+ * @brief Calcula as dimensões de uma miniatura
+ * @param largura Largura da origem
+ * @param altura Altura da origem
+ * @param lado Lado do quadrado em que o resultado deve caber
+ * @param nova_largura Recebe a largura do resultado
+ * @param nova_altura Recebe a altura do resultado
+ * 
+ * A proporção é mantida; imagens que já cabem no quadrado não mudam.
+ */
+void dimensoes_miniatura(int largura, int altura, int lado, int* nova_largura, int* nova_altura) {
+    int nl = largura, na = altura;
+    if (largura > lado || altura > lado) {
+        if (largura >= altura) {
+            nl = lado;
+            na = (int)((long long)altura * lado / largura);
+        } else {
+            na = lado;
+            nl = (int)((long long)largura * lado / altura);
+        }
+        if (nl < 1) nl = 1;
+        if (na < 1) na = 1;
+    }
+    *nova_largura = nl;
+    *nova_altura = na;
+}
+
+/**
+ * @brief Reduz pixels RGB para caber em um quadrado, pela média das áreas
+ * @param dados Pixels de origem (não são alterados)
+ * @param passo Bytes entre as linhas da origem
+ * @param largura Largura da origem
+ * @param altura Altura da origem
+ * @param canais Canais por pixel
+ * @param lado Lado do quadrado em que o resultado deve caber
+ * @param nova_largura Recebe a largura do resultado
+ * @param nova_altura Recebe a altura do resultado
+ * @return Novo buffer compacto (liberado pelo chamador), ou NULL em caso de erro
+ * 
+ * A origem pode ser uma vista (recorte) sobre um buffer maior. Imagens que
+ * já cabem no quadrado são copiadas sem alteração.
+ */
+unsigned char* reduzir_pixels(const unsigned char* dados, size_t passo, int largura, int altura, int canais, int lado,
+                              int* nova_largura, int* nova_altura) {
+    int nl, na;
+    dimensoes_miniatura(largura, altura, lado, &nl, &na);
+
+    unsigned char* reduzidos = (unsigned char*)malloc((size_t)nl * na * canais);
+    if (!reduzidos) return NULL;
+    if (nl == largura && na == altura) {
+        for (int y = 0; y < na; y++) {
+            memcpy(reduzidos + (size_t)y * nl * canais, dados + (size_t)y * passo, (size_t)nl * canais);
+        }
+    } else {
+        for (int y = 0; y < na; y++) {
+            int y0 = (int)((long long)y * altura / na);
+            int y1 = (int)((long long)(y + 1) * altura / na);
+            for (int x = 0; x < nl; x++) {
+                int x0 = (int)((long long)x * largura / nl);
+                int x1 = (int)((long long)(x + 1) * largura / nl);
+                uint64_t somas[4] = {0, 0, 0, 0};
+                for (int sy = y0; sy < y1; sy++) {
+                    const unsigned char* p = dados + (size_t)sy * passo + (size_t)x0 * canais;
+                    for (int sx = x0; sx < x1; sx++) {
+                        for (int c = 0; c < canais; c++) somas[c] += *p++;
+                    }
+                }
+                uint64_t area = (uint64_t)(y1 - y0) * (x1 - x0);
+                unsigned char* destino = reduzidos + ((size_t)y * nl + x) * canais;
+                for (int c = 0; c < canais; c++) destino[c] = (unsigned char)((somas[c] + area / 2) / area);
+            }
+        }
+    }
+    *nova_largura = nl;
+    *nova_altura = na;
+    return reduzidos;
+}
+
+/**
+ * @brief Aplica uma tabela de 256 valores a cada byte
+ * @param origem Linhas de entrada
+ * @param passo Bytes entre as linhas da origem
+ * @param destino Saída compacta (pode ser o buffer da origem: nunca ultrapassa a leitura)
+ * @param bytes_linha Bytes úteis de cada linha
+ * @param linhas Número de linhas
+ * @param tabela Novo valor de cada valor de byte
+ */
+void aplicar_tabela(const unsigned char* origem, size_t passo, unsigned char* destino, size_t bytes_linha, int linhas,
+                    const unsigned char* tabela) {
+    if (passo == bytes_linha) {
+        // Sem recorte: as linhas são contíguas
+        bytes_linha *= (size_t)linhas;
+        linhas = 1;
+    }
+    for (int y = 0; y < linhas; y++) {
+        const unsigned char* entrada = origem + (size_t)y * passo;
+        unsigned char* saida = destino + (size_t)y * bytes_linha;
+        for (size_t i = 0; i < bytes_linha; i++) {
+            saida[i] = tabela[entrada[i]];
+        }
+    }
+}
+
+/**
+ * @brief Converte para cinza, aplicando uma tabela antes e outra depois, em uma passada
+ * @param origem Pixels RGB de entrada
+ * @param passo Bytes entre as linhas da origem
+ * @param destino Saída compacta, com etapa->canais_saida canais (pode ser o buffer da origem)
+ * @param largura Largura em pixels
+ * @param altura Altura em pixels
+ * @param canais Canais por pixel da origem
+ * @param etapa Etapa ETAPA_CINZA do plano
+ * 
+ * Com canais_saida == 1 a imagem é compactada para um canal por pixel, o
+ * que reduz o trabalho das etapas seguintes a um terço.
+ */
+void converter_para_cinza_com_tabelas(const unsigned char* origem, size_t passo, unsigned char* destino,
+                                      int largura, int altura, int canais, const EtapaPlano* etapa) {
+    const unsigned char* entrada = etapa->tabela_entrada;
+    const unsigned char* saida = etapa->tabela;
+    for (int y = 0; y < altura; y++) {
+        const unsigned char* linha = origem + (size_t)y * passo;
+        size_t base = (size_t)y * largura;
+        for (int x = 0; x < largura; x++) {
+            const unsigned char* pixel = &linha[(size_t)x * canais];
+            unsigned char r = pixel[0], g = pixel[1], b = pixel[2];
+            if (etapa->usa_tabela_entrada) {
+                r = entrada[r];
+                g = entrada[g];
+                b = entrada[b];
+            }
+            unsigned char cinza = saida[(unsigned char)(0.299f * r + 0.587f * g + 0.114f * b)];
+            size_t i = base + x;
+            if (etapa->canais_saida == 1) {
+                destino[i] = cinza; // No mesmo buffer, nunca ultrapassa a leitura
+            } else {
+                destino[i * canais] = destino[i * canais + 1] = destino[i * canais + 2] = cinza;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Volta uma imagem cinza de um canal para RGB
+ * @param img Imagem de um canal (o buffer pode ser realocado)
+ * @return 1 em caso de sucesso, 0 se faltou memória
+ */
+int expandir_cinza(Imagem* img) {
+    if (img->canais != 1) return 1;
+
+    size_t pixels = (size_t)img->largura * img->altura;
+    if (img->fonte) {
+        // Vista (recorte): os pixels vão para um buffer novo
+        unsigned char* dados = (unsigned char*)malloc(pixels * 3);
+        if (!dados) return 0;
+        for (int y = 0; y < img->altura; y++) {
+            const unsigned char* linha = img->fonte + (size_t)y * img->passo;
+            unsigned char* saida = dados + (size_t)y * img->largura * 3;
+            for (int x = 0; x < img->largura; x++) {
+                saida[x * 3] = saida[x * 3 + 1] = saida[x * 3 + 2] = linha[x];
+            }
+        }
+        free(img->dados);
+        img->dados = dados;
+        img->fonte = NULL;
+        img->passo = 0;
+        img->canais = 3;
+        return 1;
+    }
+    if (!img->dados) return 1;
+
+    unsigned char* dados = (unsigned char*)realloc(img->dados, pixels * 3);
+    if (!dados) return 0;
+    // De trás para frente, para não sobrescrever pixels ainda não lidos
+    for (size_t i = pixels; i-- > 0;) {
+        dados[i * 3] = dados[i * 3 + 1] = dados[i * 3 + 2] = dados[i];
+    }
+    img->dados = dados;
+    img->canais = 3;
+    return 1;
+}
+
+/**
+ * @brief Torna compactos os pixels de uma imagem que é uma vista (recorte)
+ * @param img Imagem
+ * @return 1 em caso de sucesso, 0 se faltou memória
+ * 
+ * Uma vista dentro do próprio buffer é compactada nele mesmo, linha a
+ * linha; uma vista sobre pixels compartilhados é copiada para um buffer
+ * novo. Só é necessária para quem não aceita linhas espaçadas.
+ */
+int compactar_imagem(Imagem* img) {
+    size_t bytes_linha = (size_t)img->largura * img->canais;
+    if (!img->fonte || img->passo == 0 || img->passo == bytes_linha) return 1;
+
+    unsigned char* dados = img->dados;
+    if (!dados && !(dados = (unsigned char*)malloc(bytes_linha * img->altura))) return 0;
+    for (int y = 0; y < img->altura; y++) {
+        memmove(dados + (size_t)y * bytes_linha, img->fonte + (size_t)y * img->passo, bytes_linha);
+    }
+    img->dados = dados;
+    img->fonte = NULL;
+    img->passo = 0;
+    return 1;
+}
+
+/**
+ * @brief Preenche a tabela equivalente a uma operação pontual
+ * @param operacao Operação (inverter, brilho ou contraste)
+ * @param tabela Destino
+ * 
+ * Os valores são calculados com as mesmas expressões das funções que
+ * transformam a imagem, então o resultado é idêntico byte a byte.
+ */
+void tabela_da_operacao(const OperacaoProtocolo* operacao, unsigned char* tabela) {
+    for (int v = 0; v < 256; v++) {
+        int novo_valor = v;
+        switch (operacao->codigo) {
+            case OP_INVERTER: novo_valor = 255 - v; break;
+            case OP_BRILHO: novo_valor = (int)(v * operacao->parametro); break;
+            case OP_CONTRASTE: novo_valor = (int)((v - 128) * operacao->parametro + 128); break;
+        }
+        tabela[v] = (unsigned char)(novo_valor > 255 ? 255 : (novo_valor < 0 ? 0 : novo_valor));
+    }
+}
+
+/**
+ * @brief Compila uma lista de operações em um plano de execução
+ * @param operacoes Operações, na ordem em que devem ser aplicadas
+ * @param num_operacoes Número de operações
+ * @param largura Largura da imagem, ou 0 se ainda não é conhecida
+ * @param altura Altura da imagem, ou 0 se ainda não é conhecida
+ * @param plano Destino
+ * 
+ * Com as dimensões conhecidas, miniaturas que não reduziriam a imagem são
+ * eliminadas; sem elas, só as que seguem uma miniatura ou um recorte menor.
+ * Recortes comutam com as operações pontuais e com a conversão para cinza:
+ * os de um mesmo trecho entre miniaturas são compostos em uma única vista
+ * no início do trecho, e as etapas seguintes só leem os pixels da região.
+ */
+void compilar_plano(const OperacaoProtocolo* operacoes, int num_operacoes, int largura, int altura,
+                    PlanoExecucao* plano) {
+    memset(plano, 0, sizeof(*plano));
+    plano->num_operacoes = num_operacoes;
+    if (largura <= 0 || altura <= 0) largura = altura = 0;
+    int maior_lado = largura > 0 ? (largura > altura ? largura : altura) : INT_MAX;
+    int inicio_trecho = 0;     // Primeira etapa depois da última miniatura
+    int largura_trecho = largura, altura_trecho = altura; // Dimensões na entrada do trecho
+    EtapaPlano* recorte = NULL; // Recorte do trecho atual
+
+    unsigned char identidade[256];
+    for (int v = 0; v < 256; v++) identidade[v] = (unsigned char)v;
+
+    // Tabela das operações pontuais ainda não atribuídas a uma etapa
+    unsigned char pendente[256];
+    memcpy(pendente, identidade, sizeof(pendente));
+    int cinza = 0;             // Os três canais já são iguais
+    EtapaPlano* ultima_cinza = NULL; // Etapa de cinza que ainda pode absorver tabelas
+
+    for (int i = 0; i < num_operacoes; i++) {
+        if (operacoes[i].codigo < OP_CINZA || operacoes[i].codigo > OP_RECORTE) continue;
+        if (operacoes[i].codigo == OP_MINIATURA) {
+            // A imagem já cabe no quadrado: a miniatura seria só uma cópia
+            if ((int)operacoes[i].parametro >= maior_lado) continue;
+            maior_lado = (int)operacoes[i].parametro;
+            if (largura > 0) dimensoes_miniatura(largura, altura, maior_lado, &largura, &altura);
+        }
+        if (operacoes[i].codigo == OP_RECORTE) {
+            const OperacaoProtocolo* op = &operacoes[i];
+            if (!recorte) {
+                // Sobe para o início do trecho, antes das etapas já montadas
+                memmove(&plano->etapas[inicio_trecho + 1], &plano->etapas[inicio_trecho],
+                        (plano->num_etapas - inicio_trecho) * sizeof(EtapaPlano));
+                plano->num_etapas++;
+                if (ultima_cinza) ultima_cinza++;
+                recorte = &plano->etapas[inicio_trecho];
+                memset(recorte, 0, sizeof(*recorte));
+                recorte->tipo = ETAPA_RECORTE;
+                recorte->x = (int)op->x;
+                recorte->y = (int)op->y;
+                recorte->largura = (int)op->largura;
+                recorte->altura = (int)op->altura;
+            } else {
+                // Compõe com o recorte anterior (coordenadas relativas à região dele)
+                int l = (int)op->x < recorte->largura ? recorte->largura - (int)op->x : 0;
+                int a = (int)op->y < recorte->altura ? recorte->altura - (int)op->y : 0;
+                recorte->x += (int)op->x;
+                recorte->y += (int)op->y;
+                recorte->largura = (int)op->largura < l ? (int)op->largura : l;
+                recorte->altura = (int)op->altura < a ? (int)op->altura : a;
+            }
+            if (largura > 0) {
+                // Região limitada à imagem na entrada do trecho
+                int l = recorte->x < largura_trecho ? largura_trecho - recorte->x : 0;
+                int a = recorte->y < altura_trecho ? altura_trecho - recorte->y : 0;
+                if (recorte->largura > l) recorte->largura = l;
+                if (recorte->altura > a) recorte->altura = a;
+                largura = recorte->largura;
+                altura = recorte->altura;
+            }
+            int lado = recorte->largura > recorte->altura ? recorte->largura : recorte->altura;
+            if (lado < maior_lado) maior_lado = lado;
+            plano->altera_dimensoes = 1;
+            continue;
+        }
+
+        unsigned char tabela[256];
+        if (operacoes[i].codigo == OP_CINZA && cinza) {
+            // Cinza de uma imagem já cinza é pontual (e nem sempre a identidade, pelo arredondamento)
+            for (int v = 0; v < 256; v++) tabela[v] = (unsigned char)(0.299f * v + 0.587f * v + 0.114f * v);
+        } else if (operacoes[i].codigo == OP_INVERTER || operacoes[i].codigo == OP_BRILHO ||
+                   operacoes[i].codigo == OP_CONTRASTE) {
+            tabela_da_operacao(&operacoes[i], tabela);
+        } else {
+            // Etapa não pontual: a tabela pendente vai para a etapa de cinza ou vira uma etapa própria
+            if (memcmp(pendente, identidade, sizeof(pendente)) != 0) {
+                if (ultima_cinza) {
+                    memcpy(ultima_cinza->tabela, pendente, sizeof(pendente));
+                } else if (operacoes[i].codigo == OP_CINZA) {
+                    // Será a tabela de entrada da conversão, logo abaixo
+                } else {
+                    EtapaPlano* etapa = &plano->etapas[plano->num_etapas++];
+                    etapa->tipo = ETAPA_TABELA;
+                    memcpy(etapa->tabela, pendente, sizeof(pendente));
+                    memcpy(pendente, identidade, sizeof(pendente));
+                }
+            }
+            ultima_cinza = NULL;
+
+            EtapaPlano* etapa = &plano->etapas[plano->num_etapas++];
+            if (operacoes[i].codigo == OP_CINZA) {
+                etapa->tipo = ETAPA_CINZA;
+                etapa->canais_saida = 3;
+                etapa->usa_tabela_entrada = memcmp(pendente, identidade, sizeof(pendente)) != 0;
+                memcpy(etapa->tabela_entrada, pendente, sizeof(pendente));
+                memcpy(etapa->tabela, identidade, sizeof(identidade));
+                cinza = 1;
+                ultima_cinza = etapa;
+            } else {
+                etapa->tipo = ETAPA_MINIATURA;
+                etapa->lado = (int)operacoes[i].parametro;
+                plano->altera_dimensoes = 1;
+                // Começa um novo trecho: recortes seguintes são relativos à miniatura
+                inicio_trecho = plano->num_etapas;
+                recorte = NULL;
+                largura_trecho = largura;
+                altura_trecho = altura;
+            }
+            memcpy(pendente, identidade, sizeof(pendente));
+            continue;
+        }
+
+        // Compõe a operação com as pontuais anteriores
+        for (int v = 0; v < 256; v++) pendente[v] = tabela[pendente[v]];
+    }
+
+    if (memcmp(pendente, identidade, sizeof(pendente)) != 0) {
+        if (ultima_cinza) {
+            memcpy(ultima_cinza->tabela, pendente, sizeof(pendente));
+        } else {
+            EtapaPlano* etapa = &plano->etapas[plano->num_etapas++];
+            etapa->tipo = ETAPA_TABELA;
+            memcpy(etapa->tabela, pendente, sizeof(pendente));
+        }
+    }
+
+    // Depois da primeira conversão para cinza, as etapas seguintes trabalham com um canal
+    for (int i = 0; i < plano->num_etapas - 1; i++) {
+        if (plano->etapas[i].tipo == ETAPA_CINZA) {
+            plano->etapas[i].canais_saida = 1;
+            plano->etapas[plano->num_etapas++].tipo = ETAPA_EXPANDIR;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Executa um plano sobre uma imagem
+ * @param plano Plano compilado por compilar_plano()
+ * @param img Imagem a transformar: in-place em img->dados, ou a partir de img->fonte
+ * @return 1 em caso de sucesso, 0 se faltou memória ou o recorte ficou fora da imagem
+ * 
+ * Quando a imagem só tem uma fonte somente leitura (img->dados == NULL), a
+ * primeira etapa lê da fonte e grava em um buffer novo, em vez de copiar a
+ * fonte e transformá-la. Recortes só apontam img->fonte para a região, com
+ * o passo do buffer de origem; a etapa seguinte lê a vista e grava pixels
+ * compactos (no próprio buffer, se for da imagem). Sem etapas, img->dados
+ * continua NULL e a imagem é codificada direto da fonte.
+ */
+int executar_plano(const PlanoExecucao* plano, Imagem* img) {
+    for (int i = 0; i < plano->num_etapas; i++) {
+        const EtapaPlano* etapa = &plano->etapas[i];
+        const unsigned char* origem = img->fonte ? img->fonte : img->dados;
+        size_t bytes_linha = (size_t)img->largura * img->canais;
+        size_t passo = img->fonte && img->passo ? img->passo : bytes_linha;
+        size_t pixels = (size_t)img->largura * img->altura;
+        unsigned char* destino = img->dados;
+
+        switch (etapa->tipo) {
+            case ETAPA_TABELA:
+                if (!destino && !(destino = (unsigned char*)malloc(pixels * img->canais))) return 0;
+                aplicar_tabela(origem, passo, destino, bytes_linha, img->altura, etapa->tabela);
+                break;
+            case ETAPA_CINZA:
+                if (img->canais < 3) continue;
+                if (!destino && !(destino = (unsigned char*)malloc(pixels * etapa->canais_saida))) return 0;
+                converter_para_cinza_com_tabelas(origem, passo, destino, img->largura, img->altura, img->canais, etapa);
+                img->canais = etapa->canais_saida == 1 ? 1 : img->canais;
+                break;
+            case ETAPA_MINIATURA: {
+                int largura, altura;
+                destino = reduzir_pixels(origem, passo, img->largura, img->altura, img->canais, etapa->lado,
+                                         &largura, &altura);
+                if (!destino) return 0;
+                free(img->dados);
+                img->largura = largura;
+                img->altura = altura;
+                break;
+            }
+            case ETAPA_EXPANDIR:
+                if (!expandir_cinza(img)) return 0;
+                continue;
+            case ETAPA_RECORTE: {
+                // Limita a região à imagem atual (o plano pode ter sido compilado sem as dimensões)
+                int largura = etapa->x < img->largura ? img->largura - etapa->x : 0;
+                int altura = etapa->y < img->altura ? img->altura - etapa->y : 0;
+                if (etapa->largura < largura) largura = etapa->largura;
+                if (etapa->altura < altura) altura = etapa->altura;
+                if (largura <= 0 || altura <= 0) {
+                    printf("Recorte fora da imagem (%dx%d): %s\n", img->largura, img->altura, img->nome);
+                    return 0;
+                }
+                img->fonte = origem + (size_t)etapa->y * passo + (size_t)etapa->x * img->canais;
+                img->passo = passo;
+                img->largura = largura;
+                img->altura = altura;
+                continue;
+            }
+        }
+        // Etapa que produziu pixels compactos em destino
+        img->dados = destino;
+        img->fonte = NULL;
+        img->passo = 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Descreve as etapas de um plano (ex: "cinza+tabela(1c) > miniatura > rgb")
+ * @param plano Plano compilado
+ * @param destino Buffer do texto
+ * @param tamanho Tamanho do buffer
+ */
+void descrever_plano(const PlanoExecucao* plano, char* destino, size_t tamanho) {
+    size_t n = 0;
+    destino[0] = '\0';
+    for (int i = 0; i < plano->num_etapas && n < tamanho; i++) {
+        const EtapaPlano* etapa = &plano->etapas[i];
+        const char* separador = i ? " > " : "";
+        switch (etapa->tipo) {
+            case ETAPA_TABELA:
+                n += snprintf(destino + n, tamanho - n, "%stabela", separador);
+                break;
+            case ETAPA_CINZA:
+                n += snprintf(destino + n, tamanho - n, "%s%scinza+tabela%s", separador,
+                              etapa->usa_tabela_entrada ? "tabela+" : "", etapa->canais_saida == 1 ? "(1 canal)" : "");
+                break;
+            case ETAPA_MINIATURA:
+                n += snprintf(destino + n, tamanho - n, "%sminiatura=%d", separador, etapa->lado);
+                break;
+            case ETAPA_EXPANDIR:
+                n += snprintf(destino + n, tamanho - n, "%srgb", separador);
+                break;
+            case ETAPA_RECORTE:
+                n += snprintf(destino + n, tamanho - n, "%srecorte=%dx%d+%d+%d", separador,
+                              etapa->largura, etapa->altura, etapa->x, etapa->y);
+                break;
+        }
+    }
+    if (plano->num_etapas == 0) snprintf(destino, tamanho, "nenhuma etapa");
+}
+
+// Plano das operações de --pipeline, compilado uma vez na inicialização
+PlanoExecucao plano_pipeline;
+
+/**
+ * @brief Adia operações: só são aplicadas quando os pixels forem necessários
+ * @param img Imagem (as operações se juntam às já pendentes)
+ * @param operacoes Operações, na ordem em que devem ser aplicadas
+ * @param num_operacoes Número de operações
+ * @return 1 em caso de sucesso, 0 se faltou memória ao materializar operações anteriores
+ * 
+ * A imagem funciona como um grafo de operações: cada chamada estende a
+ * cadeia, e materializar_imagem() a otimiza inteira, já com as dimensões
+ * conhecidas, e a executa no menor número de passadas.
+ */
+int adiar_operacoes(Imagem* img, const OperacaoProtocolo* operacoes, int num_operacoes) {
+    if (img->num_pendentes + num_operacoes > MAX_OPERACOES && !materializar_imagem(img)) return 0;
+    while (num_operacoes > MAX_OPERACOES) {
+        memcpy(img->pendentes, operacoes, MAX_OPERACOES * sizeof(OperacaoProtocolo));
+        img->num_pendentes = MAX_OPERACOES;
+        if (!materializar_imagem(img)) return 0;
+        operacoes += MAX_OPERACOES;
+        num_operacoes -= MAX_OPERACOES;
+    }
+    memcpy(img->pendentes + img->num_pendentes, operacoes, num_operacoes * sizeof(OperacaoProtocolo));
+    img->num_pendentes += num_operacoes;
+    return 1;
+}
+
+/**
+ * @brief Produz os pixels de uma imagem, aplicando as operações pendentes
+ * @param img Imagem
+ * @return 1 em caso de sucesso, 0 se faltou memória
+ * 
+ * Chamada ao codificar e sempre que os pixels precisam estar prontos. O
+ * plano de --pipeline já compilado é reaproveitado quando as operações
+ * pendentes são exatamente as dele e não dependem das dimensões.
+ */
+int materializar_imagem(Imagem* img) {
+    if (img->num_pendentes == 0) return 1;
+
+    PlanoExecucao plano;
+    const PlanoExecucao* executar = &plano_pipeline;
+    if (plano_pipeline.altera_dimensoes || img->num_pendentes != config.num_pipeline ||
+        memcmp(img->pendentes, config.pipeline, img->num_pendentes * sizeof(OperacaoProtocolo)) != 0) {
+        compilar_plano(img->pendentes, img->num_pendentes, img->largura, img->altura, &plano);
+        executar = &plano;
+    }
+    img->num_pendentes = 0;
+    return executar_plano(executar, img);
+}
+
+
+/**
+ * @brief Atualiza as métricas de desempenho de uma thread
+ * @param thread_id ID da thread
+ * @param tipo_thread 0 para produtor, 1 para consumidor
+ * @param tempo_processamento Tempo gasto no processamento atual
+ * 
+ * Atualiza o número de imagens processadas e o tempo total
+ * de processamento para a thread especificada.
+ */
+void atualizar_metricas(int thread_id, int tipo_thread, double tempo_processamento) {
+    pthread_mutex_lock(&mutex_metricas);
+    if (tipo_thread == 0) { // Produtor
+        metricas_produtores[thread_id].imagens_processadas++;
+        metricas_produtores[thread_id].tempo_total += tempo_processamento;
+    } else { // Consumidor
+        struct timespec agora;
+        clock_gettime(CLOCK_MONOTONIC, &agora);
+        metricas_consumidores[thread_id].imagens_processadas++;
+        metricas_consumidores[thread_id].tempo_total += tempo_processamento;
+        metricas_consumidores[thread_id].ultimo_termino = agora.tv_sec + agora.tv_nsec / 1e9;
+    }
+    pthread_mutex_unlock(&mutex_metricas);
+}
+
+/**
+ * @brief Registra a ordem de finalização de uma thread
+ * @param thread_id ID da thread
+ * @param tipo_thread 0 para produtor, 1 para consumidor
+ * 
+ * Atualiza a ordem de finalização da thread no array de métricas.
+ * A ordem é mantida separadamente para produtores e consumidores.
+ */
+void registrar_finalizacao(int thread_id, int tipo_thread) {
+    pthread_mutex_lock(&mutex_ordem);
+    if (tipo_thread == 0) { // Produtor
+        metricas_produtores[thread_id].ordem_finalizacao = ++ordem_finalizacao_produtores;
+    } else { // Consumidor
+        metricas_consumidores[thread_id].ordem_finalizacao = ++ordem_finalizacao_consumidores;
+    }
+    pthread_mutex_unlock(&mutex_ordem);
+}
+
+// Latência de cada imagem, da leitura do arquivo ao fim do consumidor; só é
+// guardada com --relatorio-json, que publica os percentis
+double* latencias_imagens = NULL;
+size_t num_latencias_imagens = 0;
+size_t capacidade_latencias_imagens = 0;
+double megapixels_processados = 0.0;
+
+/**
+ * @brief Registra uma imagem concluída para o relatório JSON
+ * @param chegada Instante em que o produtor começou a ler o arquivo (0: sem latência medida)
+ * @param megapixels Megapixels decodificados
+ */
+void registrar_latencia_imagem(double chegada, double megapixels) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    pthread_mutex_lock(&mutex_metricas);
+    megapixels_processados += megapixels;
+    if (chegada > 0) {
+        if (num_latencias_imagens == capacidade_latencias_imagens) {
+            size_t capacidade = capacidade_latencias_imagens ? capacidade_latencias_imagens * 2 : 1024;
+            double* maior = (double*)realloc(latencias_imagens, capacidade * sizeof(double));
+            if (maior) {
+                latencias_imagens = maior;
+                capacidade_latencias_imagens = capacidade;
+            }
+        }
+        if (num_latencias_imagens < capacidade_latencias_imagens) {
+            latencias_imagens[num_latencias_imagens++] = agora.tv_sec + agora.tv_nsec / 1e9 - chegada;
+        }
+    }
+    pthread_mutex_unlock(&mutex_metricas);
+}
+
+/**
+ * @brief Calcula um hash de 64 bits no estilo xxHash64
+ * @param dados Bytes a processar
+ * @param tamanho Número de bytes
+ * @param semente Semente do hash
+ * @return Hash de 64 bits
+ * 
+ * Processa 32 bytes por iteração em quatro acumuladores independentes,
+ * chegando perto da largura de banda da memória.
+ */
+uint64_t hash_rapido(const void* dados, size_t tamanho, uint64_t semente) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ULL, P2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t P3 = 0x165667B19E3779F9ULL, P4 = 0x85EBCA77C2B2AE63ULL, P5 = 0x27D4EB2F165667C5ULL;
+    const unsigned char* p = (const unsigned char*)dados;
+    const unsigned char* fim = p + tamanho;
+    uint64_t h;
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+#define RODADA(acc, v) ((acc) = ROTL64((acc) + (v) * P2, 31) * P1)
+    if (tamanho >= 32) {
+        uint64_t v1 = semente + P1 + P2, v2 = semente + P2, v3 = semente, v4 = semente - P1;
+        while (p + 32 <= fim) {
+            uint64_t k[4];
+            memcpy(k, p, 32);
+            RODADA(v1, k[0]);
+            RODADA(v2, k[1]);
+            RODADA(v3, k[2]);
+            RODADA(v4, k[3]);
+            p += 32;
+        }
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        uint64_t v[4] = { v1, v2, v3, v4 };
+        for (int i = 0; i < 4; i++) {
+            uint64_t t = 0;
+            RODADA(t, v[i]);
+            h = (h ^ t) * P1 + P4;
+        }
+    } else {
+        h = semente + P5;
+    }
+    h += tamanho;
+
+    while (p + 8 <= fim) {
+        uint64_t k, t = 0;
+        memcpy(&k, p, 8);
+        RODADA(t, k);
+        h = ROTL64(h ^ t, 27) * P1 + P4;
+        p += 8;
+    }
+    if (p + 4 <= fim) {
+        uint32_t k;
+        memcpy(&k, p, 4);
+        h = ROTL64(h ^ ((uint64_t)k * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    while (p < fim) {
+        h = ROTL64(h ^ (*p * P5), 11) * P1;
+        p++;
+    }
+#undef RODADA
+#undef ROTL64
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * @brief Calcula o hash do conteúdo de um arquivo
+ * @param dirfd Descritor do diretório (ou AT_FDCWD)
+ * @param nome Caminho do arquivo relativo a dirfd
+ * @param hash Recebe o hash do conteúdo
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ * 
+ * O arquivo é mapeado em memória, sem cópia para um buffer intermediário.
+ */
+int hash_conteudo_arquivo(int dirfd, const char* nome, uint64_t* hash) {
+    int fd = openat(dirfd, nome, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        *hash = hash_rapido("", 0, 0);
+        return 0;
+    }
+
+    void* mapa = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) return -1;
+
+    madvise(mapa, st.st_size, MADV_SEQUENTIAL);
+    *hash = hash_rapido(mapa, st.st_size, 0);
+    munmap(mapa, st.st_size);
+    return 0;
+}
+
+/**
+ * @brief Compara registros do índice pelo hash do caminho (para qsort)
+ */
+int comparar_registros_indice(const void* a, const void* b) {
+    uint64_t ha = ((const RegistroIndice*)a)->hash_caminho;
+    uint64_t hb = ((const RegistroIndice*)b)->hash_caminho;
+    return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+/**
+ * @brief Calcula o hash da configuração do pipeline
+ * @return Hash da descrição canônica das operações e do codificador
+ * 
+ * Qualquer mudança nas operações ou em seus parâmetros invalida o índice
+ * incremental, pois as saídas já geradas deixam de corresponder.
+ */
+uint64_t calcular_hash_pipeline(void) {
+    static const char* nomes[] = { "", "cinza", "inverter", "brilho", "contraste", "miniatura", "recorte" };
+    char descricao[4096];
+    int n = 0;
+    for (int i = 0; i < config.num_pipeline && n < (int)sizeof(descricao); i++) {
+        const OperacaoProtocolo* operacao = &config.pipeline[i];
+        if (operacao->codigo == OP_BRILHO || operacao->codigo == OP_CONTRASTE) {
+            n += snprintf(descricao + n, sizeof(descricao) - n, "%s=%.4f;", nomes[operacao->codigo], operacao->parametro);
+        } else if (operacao->codigo == OP_MINIATURA) {
+            n += snprintf(descricao + n, sizeof(descricao) - n, "miniatura=%d;", (int)operacao->parametro);
+        } else if (operacao->codigo == OP_RECORTE) {
+            n += snprintf(descricao + n, sizeof(descricao) - n, "recorte=%ux%u+%u+%u;", operacao->largura,
+                          operacao->altura, operacao->x, operacao->y);
+        } else {
+            n += snprintf(descricao + n, sizeof(descricao) - n, "%s;", nomes[operacao->codigo]);
+        }
+    }
+    if (n < (int)sizeof(descricao)) n += snprintf(descricao + n, sizeof(descricao) - n, "jpg=%d", QUALIDADE_JPG);
+    // Com variantes, o resultado de um arquivo é o conjunto das saídas de todas elas
+    for (int i = 0; i < config.num_variantes && n < (int)sizeof(descricao); i++) {
+        const Variante* variante = &config.variantes[i];
+        n += snprintf(descricao + n, sizeof(descricao) - n, "|%s%s:", variante->nome, variante->extensao);
+        for (int j = 0; j < variante->num_operacoes && n < (int)sizeof(descricao); j++) {
+            const OperacaoProtocolo* operacao = &variante->operacoes[j];
+            n += snprintf(descricao + n, sizeof(descricao) - n, "%u=%.4f,", operacao->codigo, operacao->parametro);
+            if (operacao->codigo == OP_RECORTE && n < (int)sizeof(descricao)) {
+                n += snprintf(descricao + n, sizeof(descricao) - n, "%ux%u+%u+%u,", operacao->largura,
+                              operacao->altura, operacao->x, operacao->y);
+            }
+        }
+    }
+    if (n > (int)sizeof(descricao) - 1) n = sizeof(descricao) - 1;
+    return hash_rapido(descricao, n, 0);
+}
+
+/**
+ * @brief Abre o índice incremental, mapeando o arquivo da execução anterior
+ * @param caminho Arquivo do índice
+ * @param hash_pipeline Hash da configuração atual do pipeline
+ * @param usar_conteudo Se 1, arquivos com data alterada são comparados pelo conteúdo
+ * @return Ponteiro para o índice, ou NULL em caso de erro de alocação
+ * 
+ * Se o arquivo não existir, for inválido ou tiver sido gerado por outra
+ * configuração de pipeline, o índice começa vazio e tudo é reprocessado.
+ * É responsabilidade do chamador destruir o índice usando destruir_indice().
+ */
+IndiceIncremental* abrir_indice(const char* caminho, uint64_t hash_pipeline, int usar_conteudo) {
+    IndiceIncremental* indice = (IndiceIncremental*)calloc(1, sizeof(IndiceIncremental));
+    if (!indice) {
+        perror("Erro ao alocar índice incremental");
+        return NULL;
+    }
+    snprintf(indice->caminho, sizeof(indice->caminho), "%s", caminho);
+    indice->hash_pipeline = hash_pipeline;
+    indice->usar_conteudo = usar_conteudo;
+    pthread_mutex_init(&indice->mutex, NULL);
+
+    int fd = open(caminho, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Índice incremental: %s não existe, processando tudo\n", caminho);
+        return indice;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CabecalhoIndice)) {
+        void* mapa = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapa != MAP_FAILED) {
+            const CabecalhoIndice* cabecalho = (const CabecalhoIndice*)mapa;
+            size_t esperado = sizeof(CabecalhoIndice) + cabecalho->num_registros * sizeof(RegistroIndice);
+            if (cabecalho->magico != INDICE_MAGICO || cabecalho->versao != INDICE_VERSAO ||
+                esperado != (size_t)st.st_size) {
+                printf("Índice incremental: %s inválido, processando tudo\n", caminho);
+                munmap(mapa, st.st_size);
+            } else if (cabecalho->hash_pipeline != hash_pipeline) {
+                printf("Índice incremental: configuração do pipeline mudou, processando tudo\n");
+                munmap(mapa, st.st_size);
+            } else {
+                indice->mapa = mapa;
+                indice->tamanho_mapa = st.st_size;
+                indice->antigos = (const RegistroIndice*)(cabecalho + 1);
+                indice->num_antigos = cabecalho->num_registros;
+                madvise(mapa, st.st_size, MADV_RANDOM);
+                printf("Índice incremental: %zu arquivos já processados\n", indice->num_antigos);
+            }
+        }
+    }
+    close(fd);
+    return indice;
+}
+
+/**
+ * @brief Libera o índice incremental
+ * @param indice Índice a ser liberado (seguro com NULL)
+ */
+void destruir_indice(IndiceIncremental* indice) {
+    if (!indice) return;
+    if (indice->mapa) munmap(indice->mapa, indice->tamanho_mapa);
+    pthread_mutex_destroy(&indice->mutex);
+    free(indice->novos);
+    free(indice);
+}
+
+/**
+ * @brief Acrescenta um registro aos que serão gravados ao final da execução
+ * @param indice Índice incremental
+ * @param registro Registro a acrescentar
+ */
+void indice_acrescentar(IndiceIncremental* indice, const RegistroIndice* registro) {
+    pthread_mutex_lock(&indice->mutex);
+    if (indice->num_novos == indice->capacidade_novos) {
+        size_t nova_capacidade = indice->capacidade_novos ? indice->capacidade_novos * 2 : 4096;
+        RegistroIndice* novos = (RegistroIndice*)realloc(indice->novos, nova_capacidade * sizeof(RegistroIndice));
+        if (!novos) {
+            perror("Erro ao ampliar índice incremental");
+            pthread_mutex_unlock(&indice->mutex);
+            return;
+        }
+        indice->novos = novos;
+        indice->capacidade_novos = nova_capacidade;
+    }
+    indice->novos[indice->num_novos++] = *registro;
+    pthread_mutex_unlock(&indice->mutex);
+}
+
+/**
+ * @brief Verifica, antes de qualquer leitura, se um arquivo já foi processado
+ * @param indice Índice incremental
+ * @param relativo Caminho relativo ao diretório de entrada
+ * @param dirfd Descritor do diretório do arquivo
+ * @param nome Nome do arquivo dentro de dirfd
+ * @param origem Tamanho e data do arquivo; recebe o hash do conteúdo se calculado
+ * @return 1 se o arquivo está inalterado e pode ser pulado, 0 caso contrário
+ * 
+ * A busca é binária sobre os registros mapeados, sem carregar o índice.
+ * Tamanho e data iguais bastam; com usar_conteudo, um arquivo com mesmo
+ * tamanho e data diferente (ex: copiado ou "touch") é comparado pelo hash.
+ * Arquivos inalterados são levados para o índice da próxima execução.
+ */
+int indice_arquivo_inalterado(IndiceIncremental* indice, const char* relativo, int dirfd,
+                              const char* nome, OrigemArquivo* origem) {
+    uint64_t hash_caminho = hash_rapido(relativo, strlen(relativo), 0);
+
+    const RegistroIndice* encontrado = NULL;
+    size_t baixo = 0, alto = indice->num_antigos;
+    while (baixo < alto) {
+        size_t meio = baixo + (alto - baixo) / 2;
+        if (indice->antigos[meio].hash_caminho < hash_caminho) {
+            baixo = meio + 1;
+        } else {
+            alto = meio;
+        }
+    }
+    if (baixo < indice->num_antigos && indice->antigos[baixo].hash_caminho == hash_caminho) {
+        encontrado = &indice->antigos[baixo];
+    }
+
+    if (encontrado && encontrado->tamanho == origem->tamanho) {
+        if (encontrado->mtime_ns == origem->mtime_ns) {
+            origem->hash_conteudo = encontrado->hash_conteudo;
+            indice_acrescentar(indice, encontrado);
+            __atomic_fetch_add(&indice->inalterados, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+
+    if (indice->usar_conteudo && hash_conteudo_arquivo(dirfd, nome, &origem->hash_conteudo) == 0 &&
+        encontrado && encontrado->tamanho == origem->tamanho && encontrado->hash_conteudo != 0) {
+        __atomic_fetch_add(&indice->verificados_por_conteudo, 1, __ATOMIC_RELAXED);
+        if (encontrado->hash_conteudo == origem->hash_conteudo) {
+            RegistroIndice registro = *encontrado;
+            registro.mtime_ns = origem->mtime_ns;
+            indice_acrescentar(indice, &registro);
+            __atomic_fetch_add(&indice->inalterados, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Registra um arquivo processado com sucesso nesta execução
+ * @param indice Índice incremental
+ * @param relativo Caminho relativo ao diretório de entrada
+ * @param origem Tamanho, data e hash do arquivo, como vistos pela varredura
+ */
+void indice_registrar(IndiceIncremental* indice, const char* relativo, const OrigemArquivo* origem) {
+    RegistroIndice registro;
+    registro.hash_caminho = hash_rapido(relativo, strlen(relativo), 0);
+    registro.tamanho = origem->tamanho;
+    registro.mtime_ns = origem->mtime_ns;
+    registro.hash_conteudo = origem->hash_conteudo;
+    indice_acrescentar(indice, &registro);
+    __atomic_fetch_add(&indice->registrados, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Grava o índice da execução atual de forma atômica
+ * @param indice Índice incremental
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ * 
+ * Ordena os registros por hash do caminho e grava em um arquivo temporário,
+ * que substitui o anterior com rename(). Arquivos que sumiram da entrada
+ * ou falharam não entram no novo índice (e serão tentados de novo).
+ */
+int indice_salvar(IndiceIncremental* indice) {
+    qsort(indice->novos, indice->num_novos, sizeof(RegistroIndice), comparar_registros_indice);
+
+    // Remove duplicatas (um mesmo caminho registrado mais de uma vez)
+    size_t unicos = 0;
+    for (size_t i = 0; i < indice->num_novos; i++) {
+        if (unicos > 0 && indice->novos[unicos - 1].hash_caminho == indice->novos[i].hash_caminho) {
+            indice->novos[unicos - 1] = indice->novos[i];
+        } else {
+            indice->novos[unicos++] = indice->novos[i];
+        }
+    }
+
+    char temporario[PATH_MAX + 8];
+    snprintf(temporario, sizeof(temporario), "%s.tmp", indice->caminho);
+    FILE* arquivo = fopen(temporario, "wb");
+    if (!arquivo) {
+        perror("Erro ao gravar índice incremental");
+        return -1;
+    }
+
+    CabecalhoIndice cabecalho = { INDICE_MAGICO, INDICE_VERSAO, indice->hash_pipeline, unicos, 0 };
+    int ok = fwrite(&cabecalho, sizeof(cabecalho), 1, arquivo) == 1;
+    if (ok && unicos > 0) {
+        ok = fwrite(indice->novos, sizeof(RegistroIndice), unicos, arquivo) == unicos;
+    }
+    if (fclose(arquivo) != 0) ok = 0;
+
+    if (!ok || rename(temporario, indice->caminho) != 0) {
+        perror("Erro ao gravar índice incremental");
+        unlink(temporario);
+        return -1;
+    }
+    return 0;
+}
+
+// Cache de resultados endereçado por conteúdo (--cache). Cada entrada é um
+// arquivo <diretório>/<chave em hex> com a imagem já codificada; a chave
+// combina o hash do arquivo de entrada, o hash do pipeline e o formato de
+// saída, então o mesmo conteúdo em outro caminho ou outro job reaproveita o
+// resultado. A data de modificação do arquivo guarda o último uso (LRU).
+#define CACHE_TAMANHO_INICIAL 1024
+
+// Clonagem de arquivos (reflink), de linux/fs.h
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+typedef struct {
+    uint64_t chave;        // 0 marca posição livre
+    uint64_t tamanho;      // Bytes do arquivo da entrada
+    int64_t uso_ns;        // Último uso (CLOCK_REALTIME)
+} EntradaCache;
+
+typedef struct {
+    char diretorio[PATH_MAX];
+    uint64_t hash_pipeline;
+    uint64_t limite;             // Bytes máximos no cache
+    int alvo_percentual;         // Após exceder o limite, remove até este percentual
+    EntradaCache* entradas;      // Tabela de espalhamento (sondagem linear)
+    size_t capacidade;           // Potência de 2
+    size_t num_entradas;
+    uint64_t bytes;
+    pthread_mutex_t mutex;
+    // Estatísticas
+    long consultas;
+    long acertos;
+    long guardados;
+    long removidos;
+    uint64_t bytes_reaproveitados;
+    long por_link;               // Acertos atendidos com link, reflink ou cópia
+    long por_reflink;
+    long por_copia;
+} CacheResultados;
+
+CacheResultados* cache_resultados = NULL;
+
+/**
+ * @brief Retorna o instante atual em nanossegundos (CLOCK_REALTIME)
+ */
+int64_t agora_ns(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_REALTIME, &agora);
+    return (int64_t)agora.tv_sec * 1000000000LL + agora.tv_nsec;
+}
+
+/**
+ * @brief Localiza a posição de uma chave na tabela do cache
+ * @param cache Cache (com o mutex travado)
+ * @param chave Chave procurada
+ * @return Posição da chave, ou da posição livre onde ela entraria
+ */
+size_t cache_posicao(const CacheResultados* cache, uint64_t chave) {
+    size_t mascara = cache->capacidade - 1;
+    size_t i = chave & mascara;
+    while (cache->entradas[i].chave != 0 && cache->entradas[i].chave != chave) {
+        i = (i + 1) & mascara;
+    }
+    return i;
+}
+
+/**
+ * @brief Insere ou atualiza uma entrada na tabela do cache
+ * @param cache Cache (com o mutex travado)
+ * @param entrada Entrada a inserir
+ * @return 0 em caso de sucesso, -1 se não foi possível ampliar a tabela
+ */
+int cache_inserir_entrada(CacheResultados* cache, const EntradaCache* entrada) {
+    if ((cache->num_entradas + 1) * 4 > cache->capacidade * 3) {
+        size_t nova_capacidade = cache->capacidade * 2;
+        EntradaCache* novas = (EntradaCache*)calloc(nova_capacidade, sizeof(EntradaCache));
+        if (!novas) return -1;
+        EntradaCache* antigas = cache->entradas;
+        size_t capacidade_antiga = cache->capacidade;
+        cache->entradas = novas;
+        cache->capacidade = nova_capacidade;
+        for (size_t i = 0; i < capacidade_antiga; i++) {
+            if (antigas[i].chave != 0) cache->entradas[cache_posicao(cache, antigas[i].chave)] = antigas[i];
+        }
+        free(antigas);
+    }
+
+    size_t i = cache_posicao(cache, entrada->chave);
+    if (cache->entradas[i].chave == 0) {
+        cache->num_entradas++;
+    } else {
+        cache->bytes -= cache->entradas[i].tamanho;
+    }
+    cache->entradas[i] = *entrada;
+    cache->bytes += entrada->tamanho;
+    return 0;
+}
+
+/**
+ * @brief Remove uma entrada da tabela do cache (sem apagar o arquivo)
+ * @param cache Cache (com o mutex travado)
+ * @param chave Chave a remover
+ * 
+ * Com sondagem linear, as entradas seguintes do mesmo grupo são puxadas
+ * para trás, o que dispensa marcadores de remoção.
+ */
+void cache_remover_entrada(CacheResultados* cache, uint64_t chave) {
+    size_t mascara = cache->capacidade - 1;
+    size_t i = cache_posicao(cache, chave);
+    if (cache->entradas[i].chave == 0) return;
+
+    cache->bytes -= cache->entradas[i].tamanho;
+    cache->num_entradas--;
+    size_t j = i;
+    while (1) {
+        cache->entradas[i].chave = 0;
+        size_t ideal;
+        do {
+            j = (j + 1) & mascara;
+            if (cache->entradas[j].chave == 0) return;
+            ideal = cache->entradas[j].chave & mascara;
+        } while (i <= j ? (i < ideal && ideal <= j) : (i < ideal || ideal <= j));
+        cache->entradas[i] = cache->entradas[j];
+        i = j;
+    }
+}
+
+/**
+ * @brief Monta o caminho do arquivo de uma entrada do cache
+ */
+void cache_caminho(const CacheResultados* cache, uint64_t chave, char* caminho, size_t tamanho) {
+    snprintf(caminho, tamanho, "%s/%016llx", cache->diretorio, (unsigned long long)chave);
+}
+
+/**
+ * @brief Abre o cache de resultados, carregando as entradas já existentes
+ * @param diretorio Diretório do cache (criado se não existir)
+ * @param limite Bytes máximos no cache
+ * @param alvo_percentual Percentual do limite mantido após uma remoção
+ * @param hash_pipeline Hash da configuração atual do pipeline
+ * @return Ponteiro para o cache, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir o cache usando destruir_cache().
+ */
+CacheResultados* abrir_cache(const char* diretorio, uint64_t limite, int alvo_percentual, uint64_t hash_pipeline) {
+    if (criar_diretorios(diretorio, 0700) != 0) {
+        printf("Erro ao criar diretório do cache %s: %s\n", diretorio, strerror(errno));
+        return NULL;
+    }
+    DIR* dir = opendir(diretorio);
+    if (!dir) {
+        printf("Erro ao abrir diretório do cache %s: %s\n", diretorio, strerror(errno));
+        return NULL;
+    }
+
+    CacheResultados* cache = (CacheResultados*)calloc(1, sizeof(CacheResultados));
+    if (cache) cache->entradas = (EntradaCache*)calloc(CACHE_TAMANHO_INICIAL, sizeof(EntradaCache));
+    if (!cache || !cache->entradas) {
+        perror("Erro ao alocar cache de resultados");
+        if (cache) free(cache);
+        closedir(dir);
+        return NULL;
+    }
+    snprintf(cache->diretorio, sizeof(cache->diretorio), "%s", diretorio);
+    cache->capacidade = CACHE_TAMANHO_INICIAL;
+    cache->limite = limite;
+    cache->alvo_percentual = alvo_percentual;
+    cache->hash_pipeline = hash_pipeline;
+    pthread_mutex_init(&cache->mutex, NULL);
+
+    struct dirent* item;
+    while ((item = readdir(dir)) != NULL) {
+        // Temporários de uma execução interrompida
+        if (strncmp(item->d_name, "tmp-", 4) == 0) {
+            unlinkat(dirfd(dir), item->d_name, 0);
+            continue;
+        }
+        char* fim;
+        unsigned long long chave = strtoull(item->d_name, &fim, 16);
+        struct stat st;
+        if (strlen(item->d_name) != 16 || *fim != '\0' || chave == 0 ||
+            fstatat(dirfd(dir), item->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        EntradaCache entrada = { chave, (uint64_t)st.st_size,
+                                 (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec };
+        cache_inserir_entrada(cache, &entrada);
+    }
+    closedir(dir);
+
+    printf("Cache de resultados: %zu entradas (%.1f MB) em %s\n", cache->num_entradas,
+           cache->bytes / (1024.0 * 1024.0), diretorio);
+    return cache;
+}
+
+/**
+ * @brief Libera o cache de resultados (os arquivos permanecem no disco)
+ * @param cache Cache a ser liberado (seguro com NULL)
+ */
+void destruir_cache(CacheResultados* cache) {
+    if (!cache) return;
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->entradas);
+    free(cache);
+}
+
+/**
+ * @brief Calcula a chave do cache para um arquivo de entrada
+ * @param cache Cache de resultados
+ * @param hash_conteudo Hash do conteúdo do arquivo de entrada
+ * @param extensao Extensão da saída (define o codificador), ou NULL
+ * @return Chave (nunca 0)
+ */
+uint64_t cache_chave(const CacheResultados* cache, uint64_t hash_conteudo, const char* extensao) {
+    char descricao[64];
+    int n = snprintf(descricao, sizeof(descricao), "%016llx;%016llx;", (unsigned long long)hash_conteudo,
+                     (unsigned long long)cache->hash_pipeline);
+    for (const char* p = extensao; p && *p && n < (int)sizeof(descricao) - 1; p++) {
+        descricao[n++] = (char)tolower((unsigned char)*p);
+    }
+    uint64_t chave = hash_rapido(descricao, n, 0);
+    return chave ? chave : 1;
+}
+
+/**
+ * @brief Compara entradas do cache pelo último uso, da mais antiga para a mais recente (para qsort)
+ */
+int comparar_uso_cache(const void* a, const void* b) {
+    int64_t ua = ((const EntradaCache*)a)->uso_ns;
+    int64_t ub = ((const EntradaCache*)b)->uso_ns;
+    return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+/**
+ * @brief Remove as entradas usadas há mais tempo até voltar ao alvo
+ * @param cache Cache (com o mutex travado)
+ */
+void cache_remover_antigas(CacheResultados* cache) {
+    if (cache->bytes <= cache->limite) return;
+
+    EntradaCache* ordenadas = (EntradaCache*)malloc(cache->num_entradas * sizeof(EntradaCache));
+    if (!ordenadas) return;
+    size_t n = 0;
+    for (size_t i = 0; i < cache->capacidade; i++) {
+        if (cache->entradas[i].chave != 0) ordenadas[n++] = cache->entradas[i];
+    }
+    qsort(ordenadas, n, sizeof(EntradaCache), comparar_uso_cache);
+
+    uint64_t alvo = cache->limite / 100 * cache->alvo_percentual;
+    for (size_t i = 0; i < n && cache->bytes > alvo; i++) {
+        char caminho[PATH_MAX + 32];
+        cache_caminho(cache, ordenadas[i].chave, caminho, sizeof(caminho));
+        unlink(caminho);
+        cache_remover_entrada(cache, ordenadas[i].chave);
+        cache->removidos++;
+    }
+    free(ordenadas);
+}
+
+/**
+ * @brief Copia um arquivo, compartilhando os blocos (reflink) quando possível
+ * @param origem Arquivo de origem
+ * @param destino Arquivo de destino (criado ou truncado)
+ * @return 2 se foi feito um reflink, 3 se os bytes foram copiados, 0 em caso de erro
+ */
+int copiar_arquivo(const char* origem, const char* destino) {
+    int entrada = open(origem, O_RDONLY | O_CLOEXEC);
+    if (entrada < 0) return 0;
+    int saida = open(destino, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (saida < 0) {
+        close(entrada);
+        return 0;
+    }
+
+    int metodo = 0;
+    if (ioctl(saida, FICLONE, entrada) == 0) {
+        metodo = 2;
+    } else {
+        // Sem reflink (ex: ext4): copy_file_range ainda evita passar pelo espaço do usuário
+        ssize_t copiados;
+        while ((copiados = copy_file_range(entrada, NULL, saida, NULL, 1 << 30, 0)) > 0);
+        if (copiados == 0) {
+            metodo = 3;
+        } else if (lseek(entrada, 0, SEEK_SET) == 0 && ftruncate(saida, 0) == 0 && lseek(saida, 0, SEEK_SET) == 0) {
+            char buffer[65536];
+            ssize_t lidos;
+            metodo = 3;
+            while ((lidos = read(entrada, buffer, sizeof(buffer))) > 0) {
+                if (write(saida, buffer, lidos) != lidos) {
+                    metodo = 0;
+                    break;
+                }
+            }
+            if (lidos < 0) metodo = 0;
+        }
+    }
+    close(entrada);
+    if (close(saida) != 0) metodo = 0;
+    if (!metodo) unlink(destino);
+    return metodo;
+}
+
+/**
+ * @brief Faz um arquivo aparecer em outro caminho sem regravá-lo
+ * @param origem Arquivo existente
+ * @param destino Caminho de destino (substituído se existir)
+ * @return 1 com link, 2 com reflink, 3 com cópia, 0 em caso de erro
+ * 
+ * O link é tentado primeiro: não copia nada e não ocupa espaço. Entre
+ * sistemas de arquivos diferentes, recai para reflink ou cópia.
+ */
+int vincular_arquivo(const char* origem, const char* destino) {
+    unlink(destino);
+    if (link(origem, destino) == 0) return 1;
+    if (errno == ENOENT) return 0;
+    return copiar_arquivo(origem, destino);
+}
+
+/**
+ * @brief Coloca o resultado de uma entrada do cache no caminho de saída
+ * @param cache Cache de resultados
+ * @param chave Chave da entrada
+ * @param destino Caminho de saída (substituído se existir)
+ * @return 1 com link, 2 com reflink, 3 com cópia, 0 em caso de erro
+ */
+int cache_materializar(const CacheResultados* cache, uint64_t chave, const char* destino) {
+    char caminho[PATH_MAX + 32];
+    cache_caminho(cache, chave, caminho, sizeof(caminho));
+    return vincular_arquivo(caminho, destino);
+}
+
+/**
+ * @brief Procura o resultado de um arquivo no cache
+ * @param cache Cache de resultados
+ * @param hash_conteudo Hash do conteúdo do arquivo de entrada
+ * @param destino Caminho de saída do arquivo (define o formato)
+ * @return Chave da entrada encontrada, ou 0 se o resultado não está no cache
+ */
+uint64_t cache_procurar(CacheResultados* cache, uint64_t hash_conteudo, const char* destino) {
+    uint64_t chave = cache_chave(cache, hash_conteudo, strrchr(strrchr(destino, '/') + 1, '.'));
+
+    pthread_mutex_lock(&cache->mutex);
+    cache->consultas++;
+    int presente = cache->entradas[cache_posicao(cache, chave)].chave != 0;
+    pthread_mutex_unlock(&cache->mutex);
+    return presente ? chave : 0;
+}
+
+/**
+ * @brief Reaproveita um resultado encontrado no cache
+ * @param cache Cache de resultados
+ * @param chave Chave retornada por cache_procurar()
+ * @param destino Caminho de saída do arquivo
+ * @return 1 se o resultado está no caminho de saída (acerto), 0 caso contrário
+ * 
+ * Em um acerto a entrada não é decodificada, processada nem codificada.
+ */
+int cache_reaproveitar(CacheResultados* cache, uint64_t chave, const char* destino) {
+    int metodo = cache_materializar(cache, chave, destino);
+
+    pthread_mutex_lock(&cache->mutex);
+    size_t i = cache_posicao(cache, chave);
+    if (!metodo) {
+        // O arquivo sumiu do cache (removido por fora ou por outra thread)
+        cache_remover_entrada(cache, chave);
+    } else {
+        cache->acertos++;
+        if (metodo == 1) cache->por_link++;
+        if (metodo == 2) cache->por_reflink++;
+        if (metodo == 3) cache->por_copia++;
+        if (cache->entradas[i].chave != 0) {
+            cache->entradas[i].uso_ns = agora_ns();
+            cache->bytes_reaproveitados += cache->entradas[i].tamanho;
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (metodo) {
+        // O último uso sobrevive entre execuções na data de modificação
+        char caminho[PATH_MAX + 32];
+        cache_caminho(cache, chave, caminho, sizeof(caminho));
+        utimensat(AT_FDCWD, caminho, NULL, 0);
+    }
+    return metodo != 0;
+}
+
+/**
+ * @brief Guarda no cache o resultado codificado de um arquivo
+ * @param cache Cache de resultados
+ * @param hash_conteudo Hash do conteúdo do arquivo de entrada
+ * @param destino Caminho de saída (define o formato; recebe o resultado)
+ * @param dados Imagem codificada
+ * @param tamanho Bytes da imagem codificada
+ * @return 1 se o resultado já está no caminho de saída, 0 se o chamador deve gravá-lo
+ * 
+ * O resultado é gravado uma vez, no cache, e a saída vira um link para ele.
+ */
+int cache_guardar(CacheResultados* cache, uint64_t hash_conteudo, const char* destino,
+                  const unsigned char* dados, size_t tamanho) {
+    uint64_t chave = cache_chave(cache, hash_conteudo, strrchr(strrchr(destino, '/') + 1, '.'));
+    if (tamanho > cache->limite) return 0;
+
+    char temporario[PATH_MAX + 64];
+    snprintf(temporario, sizeof(temporario), "%s/tmp-%ld-%016llx", cache->diretorio,
+             (long)syscall(SYS_gettid), (unsigned long long)chave);
+    int fd = open(temporario, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0444);
+    if (fd < 0) return 0;
+    size_t escritos = 0;
+    while (escritos < tamanho) {
+        ssize_t n = write(fd, dados + escritos, tamanho - escritos);
+        if (n <= 0) break;
+        escritos += n;
+    }
+    char caminho[PATH_MAX + 32];
+    cache_caminho(cache, chave, caminho, sizeof(caminho));
+    if (close(fd) != 0 || escritos != tamanho || rename(temporario, caminho) != 0) {
+        unlink(temporario);
+        return 0;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    EntradaCache entrada = { chave, tamanho, agora_ns() };
+    if (cache_inserir_entrada(cache, &entrada) == 0) cache->guardados++;
+    cache_remover_antigas(cache);
+    pthread_mutex_unlock(&cache->mutex);
+
+    return cache_materializar(cache, chave, destino) != 0;
+}
+
+/**
+ * @brief Salva uma imagem processada guardando o resultado no cache
+ * @param img Imagem processada (img->origem.hash_conteudo preenchido)
+ * @param diretorio_entrada Diretório de entrada
+ * @param diretorio_saida Diretório de saída
+ * @return 1 se a imagem foi salva (ou entregue ao motor de E/S), 0 em caso de erro
+ * 
+ * A imagem é codificada em memória e gravada no cache; a saída vira um
+ * link para a entrada do cache. Se o cache não puder guardá-la, a saída é
+ * gravada normalmente.
+ */
+int salvar_imagem_com_cache(Imagem* img, const char* diretorio_entrada, const char* diretorio_saida) {
+    char caminho_saida[PATH_MAX];
+    if (!img->dados ||
+        montar_caminho_saida(img->nome, diretorio_entrada, diretorio_saida, caminho_saida, sizeof(caminho_saida)) != 0) {
+        return 0;
+    }
+
+    BufferSaida saida = {0};
+    const char* nome_arquivo = strrchr(caminho_saida, '/') + 1;
+    if (!codificar_imagem(img, strrchr(nome_arquivo, '.'), escrever_no_buffer, &saida) || saida.erro) {
+        printf("Erro ao codificar imagem: %s\n", caminho_saida);
+        free(saida.dados);
+        return 0;
+    }
+
+    int sucesso;
+    if (cache_guardar(cache_resultados, img->origem.hash_conteudo, caminho_saida, saida.dados, saida.tamanho)) {
+        sucesso = 1;
+        saida_gravada(img->nome, caminho_relativo(img->nome, diretorio_entrada), &img->origem, caminho_saida);
+        free(saida.dados);
+    } else if (motor_es) {
+        // O motor assume a posse do buffer; o índice e as duplicatas esperam a escrita
+        struct ConclusaoSaida* conclusao = criar_conclusao_saida(img->nome, diretorio_entrada, &img->origem, 1);
+        sucesso = motor_es_escrever(motor_es, caminho_saida, saida.dados, saida.tamanho, conclusao);
+    } else {
+        sucesso = gravar_arquivo(caminho_saida, saida.dados, saida.tamanho);
+        if (sucesso) {
+            saida_gravada(img->nome, caminho_relativo(img->nome, diretorio_entrada), &img->origem, caminho_saida);
+        }
+        free(saida.dados);
+    }
+
+    if (!sucesso) {
+        printf("Erro ao salvar imagem: %s\n", caminho_saida);
+    } else {
+        printf("Imagem salva com sucesso: %s\n", caminho_saida);
+    }
+    return sucesso;
+}
+
+// Detecção de entradas duplicadas (--deduplicar). Arquivos com conteúdo
+// idêntico viram um único job: o primeiro (líder) é processado e os demais
+// recebem a mesma saída, sem serem decodificados. O filtro é em etapas,
+// para que arquivos únicos quase nunca sejam lidos: só arquivos com um
+// tamanho já visto têm o prefixo lido, e só prefixos repetidos levam ao
+// hash do conteúdo inteiro.
+#define DEDUP_BALDES 4096
+#define DEDUP_PREFIXO 4096
+#define LIDER_PROCESSANDO 0
+#define LIDER_CONCLUIDO 1
+#define LIDER_FALHOU 2
+#define HASH_AUSENTE 0     // Hash do líder ainda não calculado
+#define HASH_CALCULANDO 1  // Sendo lido por uma thread, fora do mutex
+#define HASH_PRONTO 2
+#define HASH_FALHOU 3      // Líder ilegível: nunca corresponde
+
+// Duplicata aguardando a saída do líder
+typedef struct DuplicataPendente {
+    char* caminho;
+    OrigemArquivo origem;
+    struct DuplicataPendente* proxima;
+} DuplicataPendente;
+
+// Conteúdo distinto já visto, representado pelo primeiro arquivo que o trouxe
+typedef struct GrupoConteudo {
+    uint64_t tamanho;
+    int64_t mtime_ns;             // Do líder (distingue versões do mesmo caminho no --vigiar)
+    char* caminho;                // Caminho do líder
+    int tem_prefixo;              // HASH_*
+    uint64_t hash_prefixo;
+    int tem_conteudo;             // HASH_*
+    uint64_t hash_conteudo;
+    int estado;                   // LIDER_*
+    char* saida;                  // Saída do líder, depois de concluído
+    DuplicataPendente* pendentes;
+    struct GrupoConteudo* proximo; // Próximo grupo do mesmo balde
+} GrupoConteudo;
+
+typedef struct {
+    GrupoConteudo* baldes[DEDUP_BALDES]; // Indexados pelo tamanho do arquivo
+    const char* diretorio_entrada;
+    const char* diretorio_saida;
+    pthread_mutex_t mutex;
+    pthread_cond_t hash_calculado; // Sinalizada quando um hash de líder sai de HASH_CALCULANDO
+    // Estatísticas
+    long prefixos;                // Arquivos com o prefixo lido
+    long conteudos;               // Arquivos com o conteúdo inteiro lido
+    long duplicatas;              // Duplicatas encontradas
+    long atendidas;               // Saídas geradas a partir do líder (decodificações evitadas)
+    long sem_saida;               // Duplicatas de um líder que falhou
+} Deduplicacao;
+
+Deduplicacao* deduplicacao = NULL;
+
+/**
+ * @brief Cria o detector de duplicatas
+ * @param diretorio_entrada Diretório de entrada
+ * @param diretorio_saida Diretório de saída
+ * @return Ponteiro para o detector, ou NULL em caso de erro
+ */
+Deduplicacao* criar_deduplicacao(const char* diretorio_entrada, const char* diretorio_saida) {
+    Deduplicacao* dedup = (Deduplicacao*)calloc(1, sizeof(Deduplicacao));
+    if (!dedup) {
+        perror("Erro ao alocar detector de duplicatas");
+        return NULL;
+    }
+    dedup->diretorio_entrada = diretorio_entrada;
+    dedup->diretorio_saida = diretorio_saida;
+    pthread_mutex_init(&dedup->mutex, NULL);
+    pthread_cond_init(&dedup->hash_calculado, NULL);
+    return dedup;
+}
+
+/**
+ * @brief Libera o detector de duplicatas
+ * @param dedup Detector a ser liberado (seguro com NULL)
+ */
+void destruir_deduplicacao(Deduplicacao* dedup) {
+    if (!dedup) return;
+    for (int i = 0; i < DEDUP_BALDES; i++) {
+        GrupoConteudo* grupo = dedup->baldes[i];
+        while (grupo) {
+            GrupoConteudo* proximo = grupo->proximo;
+            while (grupo->pendentes) {
+                DuplicataPendente* pendente = grupo->pendentes;
+                grupo->pendentes = pendente->proxima;
+                free(pendente->caminho);
+                free(pendente);
+            }
+            free(grupo->caminho);
+            free(grupo->saida);
+            free(grupo);
+            grupo = proximo;
+        }
+    }
+    pthread_mutex_destroy(&dedup->mutex);
+    pthread_cond_destroy(&dedup->hash_calculado);
+    free(dedup);
+}
+
+/**
+ * @brief Calcula o hash dos primeiros bytes de um arquivo
+ * @param dirfd Descritor do diretório (ou AT_FDCWD)
+ * @param nome Caminho do arquivo relativo a dirfd
+ * @param hash Recebe o hash
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int hash_prefixo_arquivo(int dirfd, const char* nome, uint64_t* hash) {
+    int fd = openat(dirfd, nome, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    unsigned char buffer[DEDUP_PREFIXO];
+    ssize_t lidos = pread(fd, buffer, sizeof(buffer), 0);
+    close(fd);
+    if (lidos < 0) return -1;
+    *hash = hash_rapido(buffer, lidos, 0);
+    return 0;
+}
+
+/**
+ * @brief Registra um novo conteúdo, com o arquivo atual como líder
+ * @param dedup Detector (com o mutex travado)
+ */
+void deduplicacao_novo_grupo(Deduplicacao* dedup, const char* caminho, const OrigemArquivo* origem,
+                             int tem_prefixo, uint64_t hash_prefixo, int tem_conteudo, uint64_t hash_conteudo) {
+    GrupoConteudo* grupo = (GrupoConteudo*)calloc(1, sizeof(GrupoConteudo));
+    if (!grupo || !(grupo->caminho = strdup(caminho))) {
+        free(grupo);
+        return;
+    }
+    grupo->tamanho = origem->tamanho;
+    grupo->mtime_ns = origem->mtime_ns;
+    grupo->tem_prefixo = tem_prefixo;
+    grupo->hash_prefixo = hash_prefixo;
+    grupo->tem_conteudo = tem_conteudo;
+    grupo->hash_conteudo = hash_conteudo;
+    GrupoConteudo** balde = &dedup->baldes[origem->tamanho % DEDUP_BALDES];
+    grupo->proximo = *balde;
+    *balde = grupo;
+}
+
+/**
+ * @brief Calcula os hashes ainda ausentes dos líderes de um tamanho
+ * @param dedup Detector (com o mutex travado; travado de novo ao retornar)
+ * @param balde Balde do tamanho
+ * @param tamanho Tamanho do arquivo comparado
+ * @param hash_prefixo NULL para os prefixos; senão, o prefixo dos líderes cujo conteúdo é lido
+ * 
+ * Cada líder é lido com o mutex liberado, a partir de uma cópia do seu
+ * caminho, e o resultado é publicado ao travar de novo: os varredores só
+ * disputam o mutex pelo tempo de percorrer o balde. Um líder marcado como
+ * HASH_CALCULANDO por outra thread é aguardado, e não lido de novo.
+ */
+void deduplicacao_calcular_lideres(Deduplicacao* dedup, GrupoConteudo** balde, uint64_t tamanho,
+                                   const uint64_t* hash_prefixo) {
+    for (;;) {
+        GrupoConteudo* alvo = NULL;
+        int aguardar = 0;
+        for (GrupoConteudo* grupo = *balde; grupo && !alvo; grupo = grupo->proximo) {
+            if (grupo->tamanho != tamanho) continue;
+            int estado = grupo->tem_prefixo;
+            if (hash_prefixo) {
+                if (grupo->tem_prefixo != HASH_PRONTO || grupo->hash_prefixo != *hash_prefixo) continue;
+                estado = grupo->tem_conteudo;
+            }
+            if (estado == HASH_AUSENTE) alvo = grupo;
+            if (estado == HASH_CALCULANDO) aguardar = 1;
+        }
+        if (!alvo) {
+            if (!aguardar) return;
+            pthread_cond_wait(&dedup->hash_calculado, &dedup->mutex);
+            continue;
+        }
+
+        char* caminho_lider = strdup(alvo->caminho);
+        if (!caminho_lider) return;
+        int* estado = hash_prefixo ? &alvo->tem_conteudo : &alvo->tem_prefixo;
+        *estado = HASH_CALCULANDO;
+        pthread_mutex_unlock(&dedup->mutex);
+
+        uint64_t hash;
+        int ok = (hash_prefixo ? hash_conteudo_arquivo(AT_FDCWD, caminho_lider, &hash)
+                               : hash_prefixo_arquivo(AT_FDCWD, caminho_lider, &hash)) == 0;
+        free(caminho_lider);
+        if (ok) __atomic_fetch_add(hash_prefixo ? &dedup->conteudos : &dedup->prefixos, 1, __ATOMIC_RELAXED);
+
+        // Os grupos só são liberados no fim: alvo continua válido
+        pthread_mutex_lock(&dedup->mutex);
+        if (ok) *(hash_prefixo ? &alvo->hash_conteudo : &alvo->hash_prefixo) = hash;
+        *estado = ok ? HASH_PRONTO : HASH_FALHOU;
+        pthread_cond_broadcast(&dedup->hash_calculado);
+    }
+}
+
+/**
+ * @brief Verifica se um arquivo encontrado pela varredura duplica outro
+ * @param dedup Detector de duplicatas
+ * @param caminho Caminho completo do arquivo (a função assume a posse se retornar 1)
+ * @param dirfd Descritor do diretório do arquivo (ou AT_FDCWD)
+ * @param nome Nome do arquivo relativo a dirfd
+ * @param origem Tamanho e data do arquivo; recebe o hash do conteúdo se calculado
+ * @return 1 se o arquivo é uma duplicata (não deve ser processado), 0 caso contrário
+ * 
+ * Os hashes do arquivo atual são calculados sem o mutex. Os do líder são
+ * calculados uma única vez, na primeira comparação que precisar deles,
+ * também sem o mutex (deduplicacao_calcular_lideres()).
+ * Uma duplicata de um líder em processamento espera por ele; a de um
+ * líder já concluído recebe a saída na hora.
+ */
+int deduplicacao_verificar(Deduplicacao* dedup, char* caminho, int dirfd, const char* nome, OrigemArquivo* origem) {
+    GrupoConteudo** balde = &dedup->baldes[origem->tamanho % DEDUP_BALDES];
+
+    // Etapa 1: tamanho
+    pthread_mutex_lock(&dedup->mutex);
+    int tamanho_visto = 0;
+    for (GrupoConteudo* grupo = *balde; grupo && !tamanho_visto; grupo = grupo->proximo) {
+        tamanho_visto = grupo->tamanho == origem->tamanho;
+    }
+    if (!tamanho_visto) {
+        deduplicacao_novo_grupo(dedup, caminho, origem, HASH_AUSENTE, 0, HASH_AUSENTE, 0);
+        pthread_mutex_unlock(&dedup->mutex);
+        return 0;
+    }
+    pthread_mutex_unlock(&dedup->mutex);
+
+    // Etapa 2: prefixo
+    uint64_t hash_prefixo;
+    if (hash_prefixo_arquivo(dirfd, nome, &hash_prefixo) != 0) return 0;
+    __atomic_fetch_add(&dedup->prefixos, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&dedup->mutex);
+    deduplicacao_calcular_lideres(dedup, balde, origem->tamanho, NULL);
+    int prefixo_visto = 0;
+    for (GrupoConteudo* grupo = *balde; grupo; grupo = grupo->proximo) {
+        if (grupo->tamanho != origem->tamanho) continue;
+        if (grupo->tem_prefixo == HASH_PRONTO && grupo->hash_prefixo == hash_prefixo) prefixo_visto = 1;
+    }
+    if (!prefixo_visto) {
+        deduplicacao_novo_grupo(dedup, caminho, origem, HASH_PRONTO, hash_prefixo, HASH_AUSENTE, 0);
+        pthread_mutex_unlock(&dedup->mutex);
+        return 0;
+    }
+    pthread_mutex_unlock(&dedup->mutex);
+
+    // Etapa 3: conteúdo inteiro (o hash também serve ao cache de resultados)
+    if (hash_conteudo_arquivo(dirfd, nome, &origem->hash_conteudo) != 0) {
+        origem->hash_conteudo = 0;
+        return 0;
+    }
+    __atomic_fetch_add(&dedup->conteudos, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&dedup->mutex);
+    deduplicacao_calcular_lideres(dedup, balde, origem->tamanho, &hash_prefixo);
+    GrupoConteudo* lider = NULL;
+    for (GrupoConteudo* grupo = *balde; grupo && !lider; grupo = grupo->proximo) {
+        if (grupo->tamanho != origem->tamanho || grupo->tem_prefixo != HASH_PRONTO ||
+            grupo->hash_prefixo != hash_prefixo) continue;
+        // O próprio caminho visto de novo (--vigiar) não é duplicata de si mesmo
+        if (grupo->tem_conteudo == HASH_PRONTO && grupo->hash_conteudo == origem->hash_conteudo &&
+            strcmp(grupo->caminho, caminho) != 0) {
+            lider = grupo;
+        }
+    }
+    if (!lider) {
+        deduplicacao_novo_grupo(dedup, caminho, origem, HASH_PRONTO, hash_prefixo, HASH_PRONTO, origem->hash_conteudo);
+        pthread_mutex_unlock(&dedup->mutex);
+        return 0;
+    }
+
+    __atomic_fetch_add(&dedup->duplicatas, 1, __ATOMIC_RELAXED);
+    if (lider->estado == LIDER_PROCESSANDO) {
+        DuplicataPendente* pendente = (DuplicataPendente*)malloc(sizeof(DuplicataPendente));
+        if (!pendente) {
+            pthread_mutex_unlock(&dedup->mutex);
+            return 0;
+        }
+        pendente->caminho = caminho;
+        pendente->origem = *origem;
+        pendente->proxima = lider->pendentes;
+        lider->pendentes = pendente;
+        pthread_mutex_unlock(&dedup->mutex);
+        printf("Duplicata: %s aguarda a saída de %s\n", caminho, lider->caminho);
+        return 1;
+    }
+    if (lider->estado == LIDER_FALHOU) {
+        __atomic_fetch_add(&dedup->sem_saida, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&dedup->mutex);
+        printf("Duplicata: %s ignorada (o processamento de %s falhou)\n", caminho, lider->caminho);
+        free(caminho);
+        return 1;
+    }
+    char saida_lider[PATH_MAX];
+    snprintf(saida_lider, sizeof(saida_lider), "%s", lider->saida);
+    pthread_mutex_unlock(&dedup->mutex);
+
+    // Líder já concluído: a saída é vinculada agora (se falhar, o arquivo é processado)
+    char destino[PATH_MAX];
+    if (montar_caminho_saida(caminho, dedup->diretorio_entrada, dedup->diretorio_saida, destino, sizeof(destino)) != 0 ||
+        !vincular_arquivo(saida_lider, destino)) {
+        return 0;
+    }
+    __atomic_fetch_add(&dedup->atendidas, 1, __ATOMIC_RELAXED);
+    printf("Duplicata: %s atendida com a saída de %s\n", caminho, saida_lider);
+    if (indice_incremental) indice_registrar(indice_incremental, caminho_relativo(caminho, dedup->diretorio_entrada), origem);
+    free(caminho);
+    return 1;
+}
+
+/**
+ * @brief Informa que o arquivo líder de um conteúdo terminou
+ * @param nome Caminho de entrada do arquivo
+ * @param origem Tamanho e data do arquivo
+ * @param caminho_saida Saída gravada, já no disco (NULL se o arquivo falhou)
+ * 
+ * As duplicatas que aguardavam recebem a mesma saída, um link para o
+ * arquivo do líder. Com o motor de E/S, é chamada quando a escrita termina
+ * (ConclusaoSaida). Sem efeito para arquivos que não lideram nenhum conteúdo.
+ */
+void deduplicacao_concluir(const char* nome, const OrigemArquivo* origem, const char* caminho_saida) {
+    Deduplicacao* dedup = deduplicacao;
+    if (!dedup) return;
+
+    pthread_mutex_lock(&dedup->mutex);
+    GrupoConteudo* lider = dedup->baldes[origem->tamanho % DEDUP_BALDES];
+    while (lider && (lider->tamanho != origem->tamanho || lider->mtime_ns != origem->mtime_ns ||
+                     lider->estado != LIDER_PROCESSANDO || strcmp(lider->caminho, nome) != 0)) {
+        lider = lider->proximo;
+    }
+    if (!lider) {
+        pthread_mutex_unlock(&dedup->mutex);
+        return;
+    }
+    lider->estado = caminho_saida ? LIDER_CONCLUIDO : LIDER_FALHOU;
+    if (caminho_saida) lider->saida = strdup(caminho_saida);
+    if (caminho_saida && !lider->saida) lider->estado = LIDER_FALHOU;
+    DuplicataPendente* pendentes = lider->pendentes;
+    lider->pendentes = NULL;
+    pthread_mutex_unlock(&dedup->mutex);
+
+    while (pendentes) {
+        DuplicataPendente* pendente = pendentes;
+        pendentes = pendente->proxima;
+
+        char destino[PATH_MAX];
+        int sucesso = 0;
+        if (caminho_saida &&
+            montar_caminho_saida(pendente->caminho, dedup->diretorio_entrada, dedup->diretorio_saida,
+                                 destino, sizeof(destino)) == 0) {
+            sucesso = vincular_arquivo(caminho_saida, destino) != 0;
+        }
+        if (sucesso) {
+            __atomic_fetch_add(&dedup->atendidas, 1, __ATOMIC_RELAXED);
+            printf("Duplicata: %s atendida com a saída de %s\n", pendente->caminho, caminho_saida);
+            if (indice_incremental) {
+                indice_registrar(indice_incremental, caminho_relativo(pendente->caminho, dedup->diretorio_entrada),
+                                 &pendente->origem);
+            }
+        } else {
+            __atomic_fetch_add(&dedup->sem_saida, 1, __ATOMIC_RELAXED);
+            printf("Duplicata: %s sem saída (%s falhou)\n", pendente->caminho, nome);
+        }
+        free(pendente->caminho);
+        free(pendente);
+    }
+}
+
+// Efeitos de uma saída que só valem depois que ela chega ao disco: o
+// registro no índice incremental e a liberação das duplicatas que aguardam o
+// arquivo. Com o motor de E/S, a escrita termina depois do retorno de
+// salvar_*(); a conclusão segue com a RequisicaoES e é aplicada em
+// motor_es_concluir(). Um arquivo com várias saídas (variantes) só entra no
+// índice quando todas foram gravadas.
+typedef struct ConclusaoSaida {
+    char nome[PATH_MAX];   // Caminho de entrada
+    const char* relativo;  // Chave no índice incremental (dentro de nome)
+    OrigemArquivo origem;
+    int pendentes;         // Saídas ainda sem resultado
+    int falhas;            // Saídas que não foram gravadas
+} ConclusaoSaida;
+
+/**
+ * @brief Aplica os efeitos de uma saída gravada (ou que falhou)
+ * @param nome Caminho de entrada
+ * @param relativo Caminho relativo à entrada (chave no índice)
+ * @param origem Tamanho e data do arquivo de entrada
+ * @param caminho_saida Saída já no disco (NULL se falhou)
+ */
+void saida_gravada(const char* nome, const char* relativo, const OrigemArquivo* origem, const char* caminho_saida) {
+    deduplicacao_concluir(nome, origem, caminho_saida);
+    if (caminho_saida && indice_incremental) indice_registrar(indice_incremental, relativo, origem);
+}
+
+/**
+ * @brief Cria a conclusão das saídas de um arquivo
+ * @param nome Caminho de entrada
+ * @param diretorio_entrada Diretório de entrada
+ * @param origem Tamanho e data do arquivo
+ * @param saidas Número de saídas que vão reportar seu resultado
+ * @return Conclusão, ou NULL se não houver efeito a aplicar (sem índice e sem deduplicação)
+ */
+ConclusaoSaida* criar_conclusao_saida(const char* nome, const char* diretorio_entrada,
+                                      const OrigemArquivo* origem, int saidas) {
+    if (!indice_incremental && !deduplicacao) return NULL;
+    ConclusaoSaida* conclusao = (ConclusaoSaida*)malloc(sizeof(ConclusaoSaida));
+    if (!conclusao) {
+        perror("Erro ao alocar conclusão de saída");
+        return NULL;
+    }
+    snprintf(conclusao->nome, sizeof(conclusao->nome), "%s", nome);
+    conclusao->relativo = caminho_relativo(conclusao->nome, diretorio_entrada);
+    conclusao->origem = *origem;
+    conclusao->pendentes = saidas;
+    conclusao->falhas = 0;
+    return conclusao;
+}
+
+/**
+ * @brief Registra o resultado de uma saída e, com a última, aplica os efeitos
+ * @param conclusao Conclusão do arquivo (seguro com NULL)
+ * @param caminho_saida Saída gravada (ignorado se sucesso for 0)
+ * @param sucesso 1 se a saída chegou ao disco
+ */
+void conclusao_saida_registrar(ConclusaoSaida* conclusao, const char* caminho_saida, int sucesso) {
+    if (!conclusao) return;
+    if (!sucesso) __atomic_fetch_add(&conclusao->falhas, 1, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&conclusao->pendentes, 1, __ATOMIC_ACQ_REL) > 0) return;
+    int falhou = __atomic_load_n(&conclusao->falhas, __ATOMIC_ACQUIRE) > 0;
+    saida_gravada(conclusao->nome, conclusao->relativo, &conclusao->origem, falhou ? NULL : caminho_saida);
+    free(conclusao);
+}
+
+// Detecção de quase duplicatas (--quase-duplicatas). Cada imagem decodificada
+// ganha um hash perceptual de 64 bits, calculado sobre uma miniatura em tons
+// de cinza; imagens parecidas têm hashes a poucos bits de distância. Os
+// hashes ficam em uma BK-tree, que encontra vizinhos por distância de
+// Hamming sem comparar com todos.
+#define QUASE_DESATIVADO 0
+#define QUASE_PULAR 1     // Quase duplicatas não são processadas
+#define QUASE_MARCAR 2    // Quase duplicatas são processadas e reportadas
+#define HASH_DHASH 0      // Gradiente horizontal em 9x8
+#define HASH_PHASH 1      // DCT 32x32, coeficientes 8x8 de baixa frequência
+
+typedef struct NoBK {
+    uint64_t hash;
+    char* caminho;
+    int distancia;              // Distância até o pai
+    struct NoBK* primeiro_filho;
+    struct NoBK* proximo_irmao;
+} NoBK;
+
+typedef struct {
+    NoBK* raiz;
+    int modo;                   // QUASE_*
+    int tipo_hash;              // HASH_*
+    int distancia_maxima;       // Distância de Hamming até a qual as imagens são parecidas
+    pthread_mutex_t mutex;
+    // Estatísticas
+    long hashes;
+    long quase_duplicatas;
+    long comparacoes;           // Nós visitados nas consultas à árvore
+    double tempo_hash;
+} IndicePerceptual;
+
+IndicePerceptual* indice_perceptual = NULL;
+
+/**
+ * @brief Cria o índice de hashes perceptuais
+ * @param modo QUASE_PULAR ou QUASE_MARCAR
+ * @param tipo_hash HASH_DHASH ou HASH_PHASH
+ * @param distancia_maxima Distância de Hamming máxima entre quase duplicatas
+ * @return Ponteiro para o índice, ou NULL em caso de erro
+ */
+IndicePerceptual* criar_indice_perceptual(int modo, int tipo_hash, int distancia_maxima) {
+    IndicePerceptual* indice = (IndicePerceptual*)calloc(1, sizeof(IndicePerceptual));
+    if (!indice) {
+        perror("Erro ao alocar índice perceptual");
+        return NULL;
+    }
+    indice->modo = modo;
+    indice->tipo_hash = tipo_hash;
+    indice->distancia_maxima = distancia_maxima;
+    pthread_mutex_init(&indice->mutex, NULL);
+    return indice;
+}
+
+/**
+ * @brief Libera um nó da BK-tree e seus descendentes
+ */
+void liberar_no_bk(NoBK* no) {
+    while (no) {
+        NoBK* irmao = no->proximo_irmao;
+        liberar_no_bk(no->primeiro_filho);
+        free(no->caminho);
+        free(no);
+        no = irmao;
+    }
+}
+
+/**
+ * @brief Libera o índice de hashes perceptuais
+ * @param indice Índice a ser liberado (seguro com NULL)
+ */
+void destruir_indice_perceptual(IndicePerceptual* indice) {
+    if (!indice) return;
+    liberar_no_bk(indice->raiz);
+    pthread_mutex_destroy(&indice->mutex);
+    free(indice);
+}
+
+/**
+ * @brief Reduz uma imagem RGB a uma miniatura em tons de cinza pela média das áreas
+ * @param img Imagem decodificada (3 canais)
+ * @param largura Largura da miniatura
+ * @param altura Altura da miniatura
+ * @param miniatura Destino, largura * altura valores
+ * 
+ * Cada área da imagem é amostrada em no máximo 8x8 pontos, então o custo
+ * não cresce com a resolução da imagem.
+ */
+void reduzir_para_cinza(const Imagem* img, int largura, int altura, float* miniatura) {
+    for (int y = 0; y < altura; y++) {
+        int y0 = (int)((long long)y * img->altura / altura);
+        int y1 = (int)((long long)(y + 1) * img->altura / altura);
+        if (y1 <= y0) y1 = y0 + 1;
+        int passo_y = (y1 - y0 + 7) / 8;
+        for (int x = 0; x < largura; x++) {
+            int x0 = (int)((long long)x * img->largura / largura);
+            int x1 = (int)((long long)(x + 1) * img->largura / largura);
+            if (x1 <= x0) x1 = x0 + 1;
+            int passo_x = (x1 - x0 + 7) / 8;
+
+            float soma = 0.0f;
+            int amostras = 0;
+            for (int sy = y0; sy < y1 && sy < img->altura; sy += passo_y) {
+                const unsigned char* linha = img->dados + (size_t)sy * img->largura * img->canais;
+                for (int sx = x0; sx < x1 && sx < img->largura; sx += passo_x) {
+                    const unsigned char* p = linha + (size_t)sx * img->canais;
+                    soma += 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+                    amostras++;
+                }
+            }
+            miniatura[y * largura + x] = amostras ? soma / amostras : 0.0f;
+        }
+    }
+}
+
+/**
+ * @brief Calcula o dHash: cada bit diz se um pixel é mais claro que o vizinho à direita
+ * @param img Imagem decodificada
+ * @return Hash de 64 bits
+ */
+uint64_t calcular_dhash(const Imagem* img) {
+    float miniatura[9 * 8];
+    reduzir_para_cinza(img, 9, 8, miniatura);
+
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            hash = (hash << 1) | (miniatura[y * 9 + x] > miniatura[y * 9 + x + 1]);
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Compara floats (para qsort)
+ */
+int comparar_floats(const void* a, const void* b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+/**
+ * @brief Calcula o pHash: DCT da miniatura 32x32, comparando as baixas frequências com a mediana
+ * @param img Imagem decodificada
+ * @return Hash de 64 bits
+ * 
+ * Mais robusto que o dHash a mudanças de brilho, contraste e compressão,
+ * ao custo de uma DCT separável (2 x 8 x 32 x 32 multiplicações).
+ */
+uint64_t calcular_phash(const Imagem* img) {
+    float miniatura[32 * 32];
+    reduzir_para_cinza(img, 32, 32, miniatura);
+
+    // Só os 8 primeiros coeficientes de cada direção são usados
+    float cossenos[8][32];
+    for (int u = 0; u < 8; u++) {
+        for (int x = 0; x < 32; x++) {
+            cossenos[u][x] = cosf((2 * x + 1) * u * (float)M_PI / 64.0f);
+        }
+    }
+    float linhas[32][8];
+    for (int y = 0; y < 32; y++) {
+        for (int u = 0; u < 8; u++) {
+            float soma = 0.0f;
+            for (int x = 0; x < 32; x++) soma += miniatura[y * 32 + x] * cossenos[u][x];
+            linhas[y][u] = soma;
+        }
+    }
+    float coeficientes[64];
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            float soma = 0.0f;
+            for (int y = 0; y < 32; y++) soma += linhas[y][u] * cossenos[v][y];
+            coeficientes[v * 8 + u] = soma;
+        }
+    }
+
+    // Mediana sem o termo DC, que só reflete o brilho médio
+    float ordenados[63];
+    memcpy(ordenados, coeficientes + 1, sizeof(ordenados));
+    qsort(ordenados, 63, sizeof(float), comparar_floats);
+    float mediana = ordenados[31];
+
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; i++) {
+        hash = (hash << 1) | (coeficientes[i] > mediana);
+    }
+    return hash;
+}
+
+/**
+ * @brief Procura na BK-tree o hash mais próximo dentro da distância máxima
+ * @param indice Índice (com o mutex travado)
+ * @param hash Hash procurado
+ * @param distancia Recebe a distância do mais próximo
+ * @return Nó mais próximo, ou NULL se nenhum está dentro da distância máxima
+ * 
+ * Pela desigualdade triangular, só os filhos cuja distância ao pai está em
+ * [d - máxima, d + máxima] podem conter um vizinho.
+ */
+NoBK* bk_procurar(IndicePerceptual* indice, uint64_t hash, int* distancia) {
+    NoBK* melhor = NULL;
+    int melhor_distancia = indice->distancia_maxima + 1;
+    *distancia = melhor_distancia;
+    if (!indice->raiz) return NULL;
+
+    int capacidade = 64, topo = 0;
+    NoBK** pilha = (NoBK**)malloc(capacidade * sizeof(NoBK*));
+    if (!pilha) return NULL;
+    pilha[topo++] = indice->raiz;
+    while (topo > 0) {
+        NoBK* no = pilha[--topo];
+        indice->comparacoes++;
+        int d = __builtin_popcountll(no->hash ^ hash);
+        if (d < melhor_distancia) {
+            melhor = no;
+            melhor_distancia = d;
+        }
+        for (NoBK* filho = no->primeiro_filho; filho; filho = filho->proximo_irmao) {
+            if (abs(filho->distancia - d) > indice->distancia_maxima) continue;
+            if (topo == capacidade) {
+                NoBK** maior = (NoBK**)realloc(pilha, 2 * capacidade * sizeof(NoBK*));
+                if (!maior) break;
+                pilha = maior;
+                capacidade *= 2;
+            }
+            pilha[topo++] = filho;
+        }
+    }
+    free(pilha);
+    *distancia = melhor_distancia;
+    return melhor;
+}
+
+/**
+ * @brief Insere um hash na BK-tree
+ * @param indice Índice (com o mutex travado)
+ * @param hash Hash da imagem
+ * @param caminho Caminho da imagem (copiado)
+ */
+void bk_inserir(IndicePerceptual* indice, uint64_t hash, const char* caminho) {
+    NoBK* novo = (NoBK*)calloc(1, sizeof(NoBK));
+    if (!novo || !(novo->caminho = strdup(caminho))) {
+        free(novo);
+        return;
+    }
+    novo->hash = hash;
+    if (!indice->raiz) {
+        indice->raiz = novo;
+        return;
+    }
+
+    NoBK* no = indice->raiz;
+    while (1) {
+        int d = __builtin_popcountll(no->hash ^ hash);
+        NoBK* filho = no->primeiro_filho;
+        while (filho && filho->distancia != d) filho = filho->proximo_irmao;
+        if (!filho) {
+            novo->distancia = d;
+            novo->proximo_irmao = no->primeiro_filho;
+            no->primeiro_filho = novo;
+            return;
+        }
+        no = filho;
+    }
+}
+
+/**
+ * @brief Verifica se uma imagem decodificada é quase duplicata de uma já vista
+ * @param indice Índice de hashes perceptuais
+ * @param img Imagem decodificada
+ * @param caminho Caminho do arquivo da imagem
+ * @return 1 se a imagem deve ser pulada, 0 se deve ser processada
+ * 
+ * A consulta e a inserção acontecem sob o mesmo mutex, então de uma rajada
+ * de imagens parecidas só uma segue adiante. No modo marcar, todas seguem
+ * e as quase duplicatas são apenas reportadas.
+ */
+int indice_perceptual_verificar(IndicePerceptual* indice, const Imagem* img, const char* caminho) {
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    uint64_t hash = indice->tipo_hash == HASH_PHASH ? calcular_phash(img) : calcular_dhash(img);
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+
+    pthread_mutex_lock(&indice->mutex);
+    indice->hashes++;
+    indice->tempo_hash += (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+    int distancia;
+    NoBK* parecido = bk_procurar(indice, hash, &distancia);
+    if (parecido) {
+        indice->quase_duplicatas++;
+        printf("Quase duplicata: %s ~ %s (distância %d)\n", caminho, parecido->caminho, distancia);
+    }
+    int pular = parecido && indice->modo == QUASE_PULAR;
+    if (!pular) bk_inserir(indice, hash, caminho);
+    pthread_mutex_unlock(&indice->mutex);
+    return pular;
+}
+
+// Variantes de saída (--variante). O produtor decodifica cada imagem uma
+// única vez e enfileira um ramo por variante; os ramos rodam em paralelo nos
+// consumidores e compartilham os pixels decodificados, somente leitura, com
+// contagem de referências. As operações de cada ramo são adiadas e a
+// primeira etapa lê os pixels compartilhados e grava em um buffer próprio,
+// sem cópia prévia; o último ramo a rodar assume o buffer e trabalha in-place.
+typedef struct DecodificacaoCompartilhada {
+    unsigned char* dados;  // Pixels decodificados (NULL depois que o último ramo os assume)
+    int largura;
+    int altura;
+    int canais;
+    int referencias;       // Ramos ainda não concluídos
+    char nome[PATH_MAX];   // Caminho do arquivo de entrada
+    struct ConclusaoSaida* conclusao; // Resultado das saídas dos ramos (índice incremental) ou NULL
+} DecodificacaoCompartilhada;
+
+// Estatísticas das variantes (atualizadas com operações atômicas)
+typedef struct {
+    long decodificacoes;    // Imagens decodificadas e compartilhadas entre as variantes
+    long gravadas;          // Saídas de variantes gravadas
+    long falhas;            // Saídas de variantes que falharam
+    long leituras;          // Ramos que leram os pixels compartilhados
+    long assumidas;         // Ramos que assumiram o buffer compartilhado
+} EstatisticasVariantes;
+
+EstatisticasVariantes estatisticas_variantes = {0};
+
+/**
+ * @brief Compartilha os pixels de uma imagem decodificada entre as variantes
+ * @param img Imagem decodificada (o buffer de pixels passa para a decodificação compartilhada)
+ * @param num_ramos Número de ramos que vão referenciar os pixels
+ * @param diretorio_entrada Diretório de entrada (para o índice incremental)
+ * @return Decodificação compartilhada, ou NULL em caso de erro (img não é alterada)
+ */
+DecodificacaoCompartilhada* compartilhar_decodificacao(Imagem* img, int num_ramos, const char* diretorio_entrada) {
+    DecodificacaoCompartilhada* dec = (DecodificacaoCompartilhada*)calloc(1, sizeof(DecodificacaoCompartilhada));
+    if (!dec) {
+        perror("Erro ao alocar decodificação compartilhada");
+        return NULL;
+    }
+    dec->dados = img->dados;
+    dec->largura = img->largura;
+    dec->altura = img->altura;
+    dec->canais = img->canais;
+    dec->referencias = num_ramos;
+    snprintf(dec->nome, sizeof(dec->nome), "%s", img->nome);
+    dec->conclusao = criar_conclusao_saida(img->nome, diretorio_entrada, &img->origem, num_ramos);
+    img->dados = NULL;
+    __atomic_fetch_add(&estatisticas_variantes.decodificacoes, 1, __ATOMIC_RELAXED);
+    return dec;
+}
+
+/**
+ * @brief Assume o buffer compartilhado se nenhum outro ramo ainda o lê
+ * @param dec Decodificação compartilhada
+ * @return Buffer de pixels (liberado pelo ramo), ou NULL se outros ramos ainda o leem
+ * 
+ * A decisão é um único compare-and-swap de referencias de 1 para 0: só o
+ * ramo que faz essa troca assume o buffer, e a partir dela já não é contado
+ * (decodificacao_concluir_ramo() com assumiu = 1). Os demais leem os pixels
+ * compartilhados para um buffer próprio.
+ */
+unsigned char* decodificacao_assumir(DecodificacaoCompartilhada* dec) {
+    int esperado = 1;
+    if (!__atomic_compare_exchange_n(&dec->referencias, &esperado, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    unsigned char* dados = dec->dados;
+    dec->dados = NULL;
+    return dados;
+}
+
+/**
+ * @brief Conclui um ramo e, se for o último, libera a decodificação compartilhada
+ * @param dec Decodificação compartilhada
+ * @param assumiu 1 se o ramo assumiu o buffer (e já zerou as referências)
+ * 
+ * O resultado da saída do ramo vai para dec->conclusao (salvar_variante()),
+ * que pode sobreviver à decodificação enquanto o motor de E/S grava.
+ */
+void decodificacao_concluir_ramo(DecodificacaoCompartilhada* dec, int assumiu) {
+    if (!assumiu && __atomic_sub_fetch(&dec->referencias, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(dec->dados);
+    free(dec);
+}
+
+/**
+ * @brief Grava a saída de um ramo em <saída>/<variante>/<caminho relativo>
+ * @param img Imagem do ramo, já transformada
+ * @param variante Variante do ramo
+ * @param diretorio_entrada Diretório de entrada
+ * @param diretorio_saida Diretório de saída
+ * @param conclusao Conclusão do arquivo: recebe o resultado desta saída (com o
+ *                  motor de E/S, quando a escrita termina)
+ * @return 1 se a imagem foi gravada (ou entregue ao motor de E/S), 0 em caso de erro
+ */
+int salvar_variante(Imagem* img, const Variante* variante, const char* diretorio_entrada, const char* diretorio_saida,
+                    struct ConclusaoSaida* conclusao) {
+    char diretorio_variante[PATH_MAX];
+    char caminho_saida[PATH_MAX];
+    snprintf(diretorio_variante, sizeof(diretorio_variante), "%s/%s", diretorio_saida, variante->nome);
+    if (montar_caminho_saida(img->nome, diretorio_entrada, diretorio_variante, caminho_saida, sizeof(caminho_saida)) != 0) {
+        conclusao_saida_registrar(conclusao, NULL, 0);
+        return 0;
+    }
+
+    // Formato próprio da variante: troca a extensão do nome de saída
+    char* nome_arquivo = strrchr(caminho_saida, '/') + 1;
+    if (variante->extensao[0]) {
+        char* ponto = strrchr(nome_arquivo, '.');
+        if (ponto) *ponto = '\0';
+        size_t usado = strlen(caminho_saida);
+        if (usado + strlen(variante->extensao) >= sizeof(caminho_saida)) {
+            printf("Caminho de saída muito longo para: %s\n", img->nome);
+            conclusao_saida_registrar(conclusao, NULL, 0);
+            return 0;
+        }
+        strcpy(caminho_saida + usado, variante->extensao);
+        unlink(caminho_saida);
+    }
+    const char* extensao = strrchr(nome_arquivo, '.');
+
+    if (motor_es) {
+        BufferSaida saida = {0};
+        if (!codificar_imagem(img, extensao, escrever_no_buffer, &saida) || saida.erro) {
+            printf("Erro ao codificar imagem: %s\n", caminho_saida);
+            free(saida.dados);
+            conclusao_saida_registrar(conclusao, NULL, 0);
+            return 0;
+        }
+        return motor_es_escrever(motor_es, caminho_saida, saida.dados, saida.tamanho, conclusao);
+    }
+
+    int sucesso = 0;
+    FILE* arquivo = fopen(caminho_saida, "wb");
+    if (arquivo) {
+        sucesso = codificar_imagem(img, extensao, escrever_no_arquivo, arquivo);
+        if (fclose(arquivo) != 0) sucesso = 0;
+    }
+    if (sucesso) {
+        printf("Variante %s salva: %s\n", variante->nome, caminho_saida);
+    } else {
+        printf("Erro ao salvar imagem: %s\n", caminho_saida);
+    }
+    conclusao_saida_registrar(conclusao, caminho_saida, sucesso);
+    return sucesso;
+}
+
+/**
+ * @brief Processa um ramo: aplica as operações da variante e grava o resultado
+ * @param img Imagem do ramo (img->compartilhada preenchido, sem pixels próprios)
+ * @param diretorio_entrada Diretório de entrada
+ * @param diretorio_saida Diretório de saída
+ * 
+ * Ao retornar, img->dados é NULL ou um buffer do próprio ramo.
+ */
+void processar_variante(Imagem* img, const char* diretorio_entrada, const char* diretorio_saida) {
+    DecodificacaoCompartilhada* dec = img->compartilhada;
+    const Variante* variante = &config.variantes[img->variante];
+    int sucesso = 0;
+
+    img->largura = dec->largura;
+    img->altura = dec->altura;
+    img->canais = dec->canais;
+    img->dados = decodificacao_assumir(dec);
+    int assumiu = img->dados != NULL;
+    img->fonte = assumiu ? NULL : dec->dados;
+    __atomic_fetch_add(assumiu ? &estatisticas_variantes.assumidas : &estatisticas_variantes.leituras,
+                       1, __ATOMIC_RELAXED);
+
+    // Dimensões já conhecidas: o plano é montado (e otimizado) na materialização
+    if (adiar_operacoes(img, variante->operacoes, variante->num_operacoes)) {
+        sucesso = salvar_variante(img, variante, diretorio_entrada, diretorio_saida, dec->conclusao);
+    } else {
+        conclusao_saida_registrar(dec->conclusao, NULL, 0);
+    }
+    img->fonte = NULL;
+    img->passo = 0;
+    img->num_pendentes = 0;
+
+    __atomic_fetch_add(sucesso ? &estatisticas_variantes.gravadas : &estatisticas_variantes.falhas, 1, __ATOMIC_RELAXED);
+    img->compartilhada = NULL;
+    decodificacao_concluir_ramo(dec, assumiu);
+}
+
+// Agendamento por custo (--agendamento=lpt). A varredura lê o cabeçalho de
+// cada arquivo e estima seu custo em ns a partir das dimensões, do formato e
+// das operações; a lista de varredura entrega primeiro os arquivos mais caros
+// (longest processing time first), para que uma imagem enorme não comece
+// por último e deixe um consumidor trabalhando sozinho no fim. Os custos
+// medidos são comparados aos previstos no fim da execução, por formato, para
+// calibrar os coeficientes abaixo.
+#define AGENDAMENTO_FIFO 0 // Ordem da varredura
+#define AGENDAMENTO_LPT 1  // Maior custo estimado primeiro
+
+#define FORMATO_PNG 0
+#define FORMATO_JPG 1
+#define FORMATO_BMP 2
+#define FORMATO_TGA 3
+#define FORMATO_OUTRO 4    // PPM, GIF, PSD...
+#define NUM_FORMATOS 5
+
+static const char* nomes_formatos[NUM_FORMATOS] = { "png", "jpg", "bmp", "tga", "outros" };
+
+// Coeficientes do modelo, em ns por pixel (medidos com a stb_image em um núcleo x86-64)
+static const double CUSTO_DECODIFICACAO[NUM_FORMATOS] = { 18.0, 25.0, 2.5, 10.0, 10.0 };
+static const double CUSTO_CODIFICACAO[NUM_FORMATOS] = { 110.0, 35.0, 4.0, 8.0, 110.0 };
+#define CUSTO_POR_BYTE 0.5         // Leitura do arquivo, por byte
+#define CUSTO_SEM_CABECALHO 40.0   // Por byte, quando o cabeçalho não pôde ser lido
+#define CUSTO_TABELA 1.0           // Por byte de pixel
+#define CUSTO_CINZA 5.0            // Por pixel
+#define CUSTO_MINIATURA 2.0        // Por byte de pixel da entrada
+#define CUSTO_EXPANDIR 2.0         // Por pixel
+
+// Amostras de um estágio para um formato
+typedef struct {
+    long amostras;
+    double previsto;       // Soma dos custos previstos (ns)
+    double medido;         // Soma dos custos medidos (ns)
+    double erro_relativo;  // Soma de |medido - previsto| / medido
+} AmostrasCusto;
+
+typedef struct {
+    AmostrasCusto decodificacao[NUM_FORMATOS];  // Por formato de entrada
+    AmostrasCusto processamento[NUM_FORMATOS];  // Por formato de saída
+    double estimado_varredura;  // Soma das estimativas feitas na varredura (ns)
+    long arquivos_estimados;
+    long sem_cabecalho;         // Estimados só pelo tamanho do arquivo
+    pthread_mutex_t mutex;
+} ModeloCusto;
+
+// Modelo de custo do agendamento LPT (NULL no agendamento por ordem de varredura)
+ModeloCusto* modelo_custo = NULL;
+
+/**
+ * @brief Cria o modelo de custo
+ * @return Ponteiro para o modelo, ou NULL em caso de erro de alocação
+ */
+ModeloCusto* criar_modelo_custo(void) {
+    ModeloCusto* modelo = (ModeloCusto*)calloc(1, sizeof(ModeloCusto));
+    if (!modelo) {
+        perror("Erro ao alocar modelo de custo");
+        return NULL;
+    }
+    pthread_mutex_init(&modelo->mutex, NULL);
+    return modelo;
+}
+
+/**
+ * @brief Destrói o modelo de custo
+ * @param modelo Modelo a destruir (pode ser NULL)
+ */
+void destruir_modelo_custo(ModeloCusto* modelo) {
+    if (!modelo) return;
+    pthread_mutex_destroy(&modelo->mutex);
+    free(modelo);
+}
+
+/**
+ * @brief Identifica o formato de um arquivo pela extensão
+ * @param nome Nome ou caminho do arquivo
+ * @param padrao Formato devolvido para extensões não reconhecidas
+ * @return FORMATO_*
+ */
+int formato_do_nome(const char* nome, int padrao) {
+    const char* barra = strrchr(nome, '/');
+    const char* extensao = strrchr(barra ? barra : nome, '.');
+    if (!extensao) return padrao;
+    if (strcasecmp(extensao, ".png") == 0) return FORMATO_PNG;
+    if (strcasecmp(extensao, ".jpg") == 0 || strcasecmp(extensao, ".jpeg") == 0) return FORMATO_JPG;
+    if (strcasecmp(extensao, ".bmp") == 0) return FORMATO_BMP;
+    if (strcasecmp(extensao, ".tga") == 0) return FORMATO_TGA;
+    return padrao;
+}
+
+/**
+ * @brief Estima o custo de decodificar uma imagem
+ * @param formato Formato do arquivo (FORMATO_*)
+ * @param largura Largura
+ * @param altura Altura
+ * @param bytes Tamanho do arquivo
+ * @return Custo em ns
+ */
+double custo_decodificacao(int formato, int largura, int altura, uint64_t bytes) {
+    return (double)largura * altura * CUSTO_DECODIFICACAO[formato] + (double)bytes * CUSTO_POR_BYTE;
+}
+
+/**
+ * @brief Estima o custo de transformar e codificar uma imagem
+ * @param operacoes Operações (config.pipeline ou as de uma variante)
+ * @param num_operacoes Número de operações
+ * @param largura Largura da imagem decodificada
+ * @param altura Altura da imagem decodificada
+ * @param formato Formato da saída (FORMATO_*)
+ * @return Custo em ns
+ * 
+ * Percorre as etapas do plano que seria executado, acompanhando as
+ * dimensões e os canais de cada uma, e soma a codificação do resultado.
+ */
+double custo_processamento(const OperacaoProtocolo* operacoes, int num_operacoes, int largura, int altura,
+                           int formato) {
+    // O plano de --pipeline já compilado serve se não depende das dimensões
+    PlanoExecucao plano;
+    const PlanoExecucao* executado = &plano_pipeline;
+    if (operacoes != config.pipeline || plano_pipeline.altera_dimensoes) {
+        compilar_plano(operacoes, num_operacoes, largura, altura, &plano);
+        executado = &plano;
+    }
+
+    double custo = 0.0;
+    int canais = 3;
+    for (int i = 0; i < executado->num_etapas; i++) {
+        const EtapaPlano* etapa = &executado->etapas[i];
+        double pixels = (double)largura * altura;
+        switch (etapa->tipo) {
+            case ETAPA_TABELA:
+                custo += pixels * canais * CUSTO_TABELA;
+                break;
+            case ETAPA_CINZA:
+                custo += pixels * CUSTO_CINZA;
+                canais = etapa->canais_saida;
+                break;
+            case ETAPA_MINIATURA:
+                custo += pixels * canais * CUSTO_MINIATURA;
+                dimensoes_miniatura(largura, altura, etapa->lado, &largura, &altura);
+                break;
+            case ETAPA_EXPANDIR:
+                custo += pixels * CUSTO_EXPANDIR;
+                canais = 3;
+                break;
+            case ETAPA_RECORTE:
+                if (etapa->x < largura && etapa->y < altura) {
+                    largura = etapa->largura < largura - etapa->x ? etapa->largura : largura - etapa->x;
+                    altura = etapa->altura < altura - etapa->y ? etapa->altura : altura - etapa->y;
+                }
+                break;
+        }
+    }
+    return custo + (double)largura * altura * CUSTO_CODIFICACAO[formato];
+}
+
+/**
+ * @brief Formato em que a saída de um ramo é codificada
+ * @param variante Índice da variante, ou -1 para o pipeline padrão
+ * @param nome Nome do arquivo de entrada
+ * @return FORMATO_* (extensões não reconhecidas são codificadas como PNG)
+ */
+int formato_saida_ramo(int variante, const char* nome) {
+    if (variante >= 0 && config.variantes[variante].extensao[0]) {
+        return formato_do_nome(config.variantes[variante].extensao, FORMATO_PNG);
+    }
+    return formato_do_nome(nome, FORMATO_PNG);
+}
+
+/**
+ * @brief Estima o custo de transformar e codificar um ramo (uma variante ou o pipeline)
+ * @param variante Índice da variante, ou -1 para o pipeline padrão
+ * @param nome Nome do arquivo de entrada (define o formato da saída sem variante)
+ * @param largura Largura da imagem decodificada
+ * @param altura Altura da imagem decodificada
+ * @return Custo em ns
+ */
+double custo_ramo(int variante, const char* nome, int largura, int altura) {
+    int formato = formato_saida_ramo(variante, nome);
+    if (variante < 0) {
+        return custo_processamento(config.pipeline, config.num_pipeline, largura, altura, formato);
+    }
+    const Variante* v = &config.variantes[variante];
+    return custo_processamento(v->operacoes, v->num_operacoes, largura, altura, formato);
+}
+
+/**
+ * @brief Estima o custo total de um arquivo a partir do seu cabeçalho
+ * @param modelo Modelo de custo
+ * @param dirfd Descritor do diretório do arquivo (ou AT_FDCWD)
+ * @param nome Nome do arquivo relativo a dirfd
+ * @param origem Tamanho do arquivo
+ * @return Custo em ns (decodificação, transformação e codificação de todas as saídas)
+ * 
+ * Só o cabeçalho é lido (stbi_info), o que custa uma fração da decodificação.
+ * Arquivos sem cabeçalho reconhecível são estimados pelo tamanho.
+ */
+double estimar_custo_arquivo(ModeloCusto* modelo, int dirfd, const char* nome, const OrigemArquivo* origem) {
+    int largura = 0, altura = 0, canais = 0;
+    int fd = openat(dirfd, nome, O_RDONLY | O_CLOEXEC);
+    FILE* arquivo = fd >= 0 ? fdopen(fd, "rb") : NULL;
+    int lido = arquivo && stbi_info_from_file(arquivo, &largura, &altura, &canais);
+    if (arquivo) {
+        fclose(arquivo);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    double custo;
+    if (!lido || largura <= 0 || altura <= 0) {
+        custo = (double)origem->tamanho * CUSTO_SEM_CABECALHO;
+        __atomic_fetch_add(&modelo->sem_cabecalho, 1, __ATOMIC_RELAXED);
+    } else {
+        custo = custo_decodificacao(formato_do_nome(nome, FORMATO_OUTRO), largura, altura, origem->tamanho);
+        if (config.num_variantes == 0) {
+            custo += custo_ramo(-1, nome, largura, altura);
+        }
+        for (int i = 0; i < config.num_variantes; i++) {
+            custo += custo_ramo(i, nome, largura, altura);
+        }
+    }
+
+    pthread_mutex_lock(&modelo->mutex);
+    modelo->estimado_varredura += custo;
+    modelo->arquivos_estimados++;
+    pthread_mutex_unlock(&modelo->mutex);
+    return custo;
+}
+
+/**
+ * @brief Registra o custo previsto e o medido de um estágio
+ * @param modelo Modelo de custo
+ * @param amostras Amostras do estágio e formato
+ * @param previsto Custo previsto (ns)
+ * @param medido Custo medido (s)
+ */
+void modelo_custo_registrar(ModeloCusto* modelo, AmostrasCusto* amostras, double previsto, double medido) {
+    medido *= 1e9;
+    pthread_mutex_lock(&modelo->mutex);
+    amostras->amostras++;
+    amostras->previsto += previsto;
+    amostras->medido += medido;
+    if (medido > 0) amostras->erro_relativo += fabs(medido - previsto) / medido;
+    pthread_mutex_unlock(&modelo->mutex);
+}
+
+/**
+ * @brief Registra o custo medido da decodificação de uma imagem
+ * @param img Imagem decodificada
+ * @param entrada Entrada da varredura (tamanho do arquivo)
+ * @param inicio Instante em que a decodificação começou (CLOCK_MONOTONIC)
+ */
+void registrar_custo_decodificacao(const Imagem* img, const EntradaArquivo* entrada, const struct timespec* inicio) {
+    if (!modelo_custo) return;
+    struct timespec fim;
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    int formato = formato_do_nome(img->nome, FORMATO_OUTRO);
+    modelo_custo_registrar(modelo_custo, &modelo_custo->decodificacao[formato],
+                           custo_decodificacao(formato, img->largura, img->altura, entrada->origem.tamanho),
+                           (fim.tv_sec - inicio->tv_sec) + (fim.tv_nsec - inicio->tv_nsec) / 1e9);
+}
+
+/**
+ * @brief Exibe a comparação entre custos previstos e medidos de um estágio
+ * @param titulo Nome do estágio
+ * @param amostras Amostras do estágio, por formato
+ * @param coeficientes Coeficiente do modelo para cada formato (ns/pixel), ou NULL
+ * 
+ * Com os coeficientes, mostra também o valor que teria acertado a média.
+ */
+void exibir_amostras_custo(const char* titulo, const AmostrasCusto* amostras, const double* coeficientes) {
+    AmostrasCusto total = {0};
+    for (int f = 0; f < NUM_FORMATOS; f++) {
+        total.amostras += amostras[f].amostras;
+        total.previsto += amostras[f].previsto;
+        total.medido += amostras[f].medido;
+        total.erro_relativo += amostras[f].erro_relativo;
+    }
+    if (total.amostras == 0) return;
+
+    printf("  - %s: previsto %.3f s, medido %.3f s (erro médio por imagem: %.0f%%)\n", titulo,
+           total.previsto / 1e9, total.medido / 1e9, 100.0 * total.erro_relativo / total.amostras);
+    for (int f = 0; f < NUM_FORMATOS; f++) {
+        if (amostras[f].amostras == 0 || amostras[f].previsto <= 0) continue;
+        double razao = amostras[f].medido / amostras[f].previsto;
+        printf("      %-6s %ld imagens, medido/previsto = %.2f", nomes_formatos[f], amostras[f].amostras, razao);
+        if (coeficientes) printf(" (coeficiente calibrado: %.1f ns/pixel)", coeficientes[f] * razao);
+        printf("\n");
+    }
+}
+
+/**
+ * @brief Cria uma lista de varredura
+ * @param capacidade Número máximo de entradas pendentes
+ * @return Ponteiro para a lista criada, ou NULL em caso de erro
+ * 
+ * A lista desacopla a varredura do diretório dos produtores: um único
+ * varredor adiciona os arquivos em ordem, e cada arquivo é retirado por
+ * exatamente um produtor. O pré-carregador espia as entradas pendentes.
+ * 
+ * É responsabilidade do chamador destruir a lista usando destruir_lista_varredura().
+ */
+ListaVarredura* criar_lista_varredura(int capacidade) {
+    ListaVarredura* lista = (ListaVarredura*)calloc(1, sizeof(ListaVarredura));
+    if (!lista) {
+        perror("Erro ao alocar lista de varredura");
+        return NULL;
+    }
+
+    lista->entradas = (EntradaArquivo*)malloc(capacidade * sizeof(EntradaArquivo));
+    if (!lista->entradas) {
+        perror("Erro ao alocar entradas da lista de varredura");
+        free(lista);
+        return NULL;
+    }
+
+    lista->capacidade = capacidade;
+    pthread_mutex_init(&lista->mutex, NULL);
+    pthread_cond_init(&lista->nao_vazia, NULL);
+    pthread_cond_init(&lista->nao_cheia, NULL);
+    return lista;
+}
+
+/**
+ * @brief Destrói uma lista de varredura e libera seus recursos
+ * @param lista Lista a ser destruída
+ */
+void destruir_lista_varredura(ListaVarredura* lista) {
+    if (!lista) return;
+
+    // Entradas que não chegaram a ser retiradas (execução interrompida)
+    for (unsigned long long i = lista->lidos; i < lista->escritos; i++) {
+        free(lista->entradas[i % lista->capacidade].caminho);
+    }
+
+    pthread_mutex_destroy(&lista->mutex);
+    pthread_cond_destroy(&lista->nao_vazia);
+    pthread_cond_destroy(&lista->nao_cheia);
+    free(lista->entradas);
+    free(lista);
+}
+
+/**
+ * @brief Adiciona um arquivo ao final da lista de varredura
+ * @param lista Lista de varredura
+ * @param caminho Caminho do arquivo, alocado com malloc (a lista assume a posse)
+ * @param origem Tamanho, data de modificação e hash do arquivo
+ * @param custo Custo estimado (ns), usado com --agendamento=lpt
+ * @return 1 se o arquivo foi adicionado, 0 se a execução foi interrompida
+ * 
+ * Bloqueia enquanto a lista estiver cheia, o que limita a memória da
+ * varredura e segura os varredores quando os produtores estão atrasados.
+ * No agendamento LPT, a entrada é inserida entre as pendentes em ordem
+ * decrescente de custo (empates mantêm a ordem da varredura).
+ */
+int lista_varredura_adicionar(ListaVarredura* lista, char* caminho, const OrigemArquivo* origem, double custo) {
+    pthread_mutex_lock(&lista->mutex);
+    while (executando && lista->escritos - lista->lidos >= (unsigned long long)lista->capacidade) {
+        pthread_cond_wait(&lista->nao_cheia, &lista->mutex);
+    }
+    if (!executando) {
+        pthread_mutex_unlock(&lista->mutex);
+        free(caminho);
+        return 0;
+    }
+
+    unsigned long long posicao = lista->escritos;
+    if (config.agendamento == AGENDAMENTO_LPT) {
+        // Inserção ordenada: abre espaço deslocando as entradas mais baratas
+        while (posicao > lista->lidos && lista->entradas[(posicao - 1) % lista->capacidade].custo < custo) {
+            lista->entradas[posicao % lista->capacidade] = lista->entradas[(posicao - 1) % lista->capacidade];
+            posicao--;
+        }
+    }
+    EntradaArquivo* entrada = &lista->entradas[posicao % lista->capacidade];
+    entrada->caminho = caminho;
+    entrada->origem = *origem;
+    entrada->sequencia = lista->escritos;
+    entrada->custo = custo;
+    entrada->pre_carregada = 0;
+    lista->escritos++;
+
+    pthread_cond_signal(&lista->nao_vazia);
+    pthread_mutex_unlock(&lista->mutex);
+    return 1;
+}
+
+/**
+ * @brief Marca a varredura como concluída e acorda os produtores
+ * @param lista Lista de varredura
+ */
+void lista_varredura_concluir(ListaVarredura* lista) {
+    pthread_mutex_lock(&lista->mutex);
+    lista->concluida = 1;
+    pthread_cond_broadcast(&lista->nao_vazia);
+    pthread_mutex_unlock(&lista->mutex);
+}
+
+/**
+ * @brief Retira o próximo arquivo da lista de varredura
+ * @param lista Lista de varredura
+ * @param entrada Recebe a entrada retirada (o chamador libera entrada->caminho)
+ * @return 1 se um arquivo foi retirado, 0 se a varredura terminou e a lista está vazia
+ * 
+ * Bloqueia enquanto a lista estiver vazia e a varredura em andamento. No
+ * agendamento LPT, a primeira retirada espera a varredura terminar (ou a
+ * lista encher): só então a entrada mais cara é de fato a mais cara de
+ * todas. No modo daemon não há fim de varredura, e a espera não se aplica.
+ */
+int lista_varredura_obter(ListaVarredura* lista, EntradaArquivo* entrada) {
+    pthread_mutex_lock(&lista->mutex);
+    while (executando && !lista->concluida &&
+           (lista->lidos == lista->escritos ||
+            (config.agendamento == AGENDAMENTO_LPT && !config.vigiar && !lista->liberada &&
+             lista->escritos - lista->lidos < (unsigned long long)lista->capacidade))) {
+        pthread_cond_wait(&lista->nao_vazia, &lista->mutex);
+    }
+    if (!lista->liberada) {
+        // Os demais produtores também esperavam a liberação
+        lista->liberada = 1;
+        pthread_cond_broadcast(&lista->nao_vazia);
+    }
+    if (!executando || lista->lidos == lista->escritos) {
+        pthread_mutex_unlock(&lista->mutex);
+        return 0;
+    }
+
+    *entrada = lista->entradas[lista->lidos % lista->capacidade];
+    lista->lidos++;
+
+    pthread_cond_signal(&lista->nao_cheia);
+    pthread_mutex_unlock(&lista->mutex);
+    return 1;
+}
+
+/**
+ * @brief Informa se há uma entrada que pode ser retirada sem esperar
+ * @param lista Lista de varredura
+ * @return 1 se a próxima chamada a lista_varredura_obter() provavelmente não bloqueia
+ */
+int lista_varredura_pronta(ListaVarredura* lista) {
+    pthread_mutex_lock(&lista->mutex);
+    int pronta = lista->lidos < lista->escritos && lista->liberada;
+    pthread_mutex_unlock(&lista->mutex);
+    return pronta;
+}
+
+// Buffer de reordenação: itens numerados chegam fora de ordem (consumidores
+// terminam em ordens diferentes) e saem estritamente em ordem de sequência.
+// As vagas limitam quantos itens existem entre a numeração e a saída; cada
+// item deve ser entregue exatamente uma vez, mesmo que vazio (NULL), para
+// que a saída não pare esperando por ele.
+typedef struct {
+    void** itens;                 // Itens prontos, indexados por sequência % capacidade
+    int* ocupados;
+    int capacidade;
+    unsigned long long proxima;   // Próxima sequência a sair
+    unsigned long long total;     // Número de itens (ULLONG_MAX enquanto desconhecido)
+    int aguardando;               // Itens prontos esperando a vez de sair
+    int aguardando_max;
+    sem_t vagas;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} BufferReordenacao;
+
+/**
+ * @brief Cria um buffer de reordenação
+ * @param capacidade Máximo de itens entre a reserva de uma vaga e a saída
+ * @return Ponteiro para o buffer, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir o buffer usando destruir_reordenacao().
+ */
+BufferReordenacao* criar_reordenacao(int capacidade) {
+    BufferReordenacao* reordenacao = (BufferReordenacao*)calloc(1, sizeof(BufferReordenacao));
+    if (!reordenacao) {
+        perror("Erro ao alocar buffer de reordenação");
+        return NULL;
+    }
+    reordenacao->itens = (void**)calloc(capacidade, sizeof(void*));
+    reordenacao->ocupados = (int*)calloc(capacidade, sizeof(int));
+    if (!reordenacao->itens || !reordenacao->ocupados) {
+        perror("Erro ao alocar buffer de reordenação");
+        free(reordenacao->itens);
+        free(reordenacao->ocupados);
+        free(reordenacao);
+        return NULL;
+    }
+    reordenacao->capacidade = capacidade;
+    reordenacao->total = ULLONG_MAX;
+    sem_init(&reordenacao->vagas, 0, capacidade);
+    pthread_mutex_init(&reordenacao->mutex, NULL);
+    pthread_cond_init(&reordenacao->cond, NULL);
+    return reordenacao;
+}
+
+/**
+ * @brief Destrói um buffer de reordenação
+ * @param reordenacao Buffer a ser destruído (seguro com NULL)
+ * @param liberar Função que libera os itens que não chegaram a sair (ou NULL)
+ */
+void destruir_reordenacao(BufferReordenacao* reordenacao, void (*liberar)(void*)) {
+    if (!reordenacao) return;
+
+    for (int i = 0; i < reordenacao->capacidade; i++) {
+        if (reordenacao->ocupados[i] && reordenacao->itens[i] && liberar) liberar(reordenacao->itens[i]);
+    }
+    free(reordenacao->itens);
+    free(reordenacao->ocupados);
+    sem_destroy(&reordenacao->vagas);
+    pthread_mutex_destroy(&reordenacao->mutex);
+    pthread_cond_destroy(&reordenacao->cond);
+    free(reordenacao);
+}
+
+/**
+ * @brief Reserva uma vaga antes de tirar o próximo item da origem (bloqueante)
+ * @param reordenacao Buffer de reordenação
+ */
+void reordenacao_reservar(BufferReordenacao* reordenacao) {
+    while (sem_wait(&reordenacao->vagas) != 0 && errno == EINTR);
+}
+
+/**
+ * @brief Tenta reservar uma vaga sem bloquear
+ * @param reordenacao Buffer de reordenação
+ * @return 1 se a vaga foi reservada, 0 se o buffer está cheio
+ * 
+ * Quem já segura itens ainda não entregues não pode bloquear na reserva:
+ * a vaga só volta quando o item mais antigo sair, e ele pode ser um deles.
+ */
+int reordenacao_tentar_reservar(BufferReordenacao* reordenacao) {
+    return sem_trywait(&reordenacao->vagas) == 0;
+}
+
+/**
+ * @brief Devolve uma vaga reservada e não usada (ou a de um item já escrito)
+ * @param reordenacao Buffer de reordenação
+ */
+void reordenacao_liberar_vaga(BufferReordenacao* reordenacao) {
+    sem_post(&reordenacao->vagas);
+}
+
+/**
+ * @brief Entrega um item pronto
+ * @param reordenacao Buffer de reordenação
+ * @param sequencia Sequência do item
+ * @param item Item (o buffer assume a posse); NULL marca um item descartado
+ */
+void reordenacao_entregar(BufferReordenacao* reordenacao, unsigned long long sequencia, void* item) {
+    pthread_mutex_lock(&reordenacao->mutex);
+    int posicao = sequencia % reordenacao->capacidade;
+    reordenacao->itens[posicao] = item;
+    reordenacao->ocupados[posicao] = 1;
+    reordenacao->aguardando++;
+    if (reordenacao->aguardando > reordenacao->aguardando_max) reordenacao->aguardando_max = reordenacao->aguardando;
+    if (sequencia == reordenacao->proxima) pthread_cond_broadcast(&reordenacao->cond);
+    pthread_mutex_unlock(&reordenacao->mutex);
+}
+
+/**
+ * @brief Informa quantos itens existem ao todo
+ * @param reordenacao Buffer de reordenação
+ * @param total Número de itens numerados
+ */
+void reordenacao_concluir(BufferReordenacao* reordenacao, unsigned long long total) {
+    pthread_mutex_lock(&reordenacao->mutex);
+    reordenacao->total = total;
+    pthread_cond_broadcast(&reordenacao->cond);
+    pthread_mutex_unlock(&reordenacao->mutex);
+}
+
+/**
+ * @brief Retira o próximo item em ordem de sequência (bloqueante)
+ * @param reordenacao Buffer de reordenação
+ * @param item Recebe o item (o chamador assume a posse; pode ser NULL)
+ * @return 1 se um item saiu, 0 quando todos os itens já saíram
+ * 
+ * A vaga do item não é devolvida aqui: o chamador usa
+ * reordenacao_liberar_vaga() depois de terminar de escrevê-lo.
+ */
+int reordenacao_retirar(BufferReordenacao* reordenacao, void** item) {
+    pthread_mutex_lock(&reordenacao->mutex);
+    int posicao = reordenacao->proxima % reordenacao->capacidade;
+    while (!reordenacao->ocupados[posicao] && reordenacao->proxima < reordenacao->total) {
+        pthread_cond_wait(&reordenacao->cond, &reordenacao->mutex);
+    }
+    if (!reordenacao->ocupados[posicao]) {
+        pthread_mutex_unlock(&reordenacao->mutex);
+        return 0;
+    }
+    *item = reordenacao->itens[posicao];
+    reordenacao->ocupados[posicao] = 0;
+    reordenacao->aguardando--;
+    reordenacao->proxima++;
+    pthread_mutex_unlock(&reordenacao->mutex);
+    return 1;
+}
+
+// Saída ordenada (--ordenado): as imagens são gravadas na ordem da varredura
+BufferReordenacao* reordenacao_saida = NULL;
+
+// Imagem codificada à espera da sua vez na saída ordenada
+typedef struct {
+    char caminho[PATH_MAX];  // Caminho de saída
+    const char* relativo;    // Caminho relativo à entrada (aponta para o nome da imagem)
+    char nome[PATH_MAX];     // Caminho de entrada
+    OrigemArquivo origem;    // Para o índice incremental
+    BufferSaida dados;       // Imagem codificada
+    uint64_t chave_cache;    // Acerto do cache: resultado a reaproveitar (0 se codificado)
+} SaidaOrdenada;
+
+// Estatísticas da saída ordenada (escritas só pela thread escritora)
+unsigned long long saidas_ordenadas_escritas = 0;
+unsigned long long saidas_ordenadas_descartadas = 0;
+
+/**
+ * @brief Libera uma saída ordenada que não chegou a ser gravada
+ * @param item Ponteiro para SaidaOrdenada
+ */
+void liberar_saida_ordenada(void* item) {
+    SaidaOrdenada* saida = (SaidaOrdenada*)item;
+    free(saida->dados.dados);
+    free(saida);
+}
+
+// Registro retornado pela syscall getdents64
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} EntradaDiretorioLinux;
+
+/**
+ * @brief Verifica se um caminho corresponde a algum dos padrões glob
+ * @param relativo Caminho relativo ao diretório de entrada
+ * @param nome Nome do arquivo ou diretório (último componente)
+ * @param padroes Padrões glob
+ * @param num_padroes Número de padrões
+ * @return 1 se algum padrão corresponde, 0 caso contrário
+ * 
+ * Padrões com '/' são comparados ao caminho relativo; os demais, ao nome.
+ */
+int corresponde_padroes(const char* relativo, const char* nome, const char* const* padroes, int num_padroes) {
+    for (int i = 0; i < num_padroes; i++) {
+        if (strchr(padroes[i], '/')) {
+            if (fnmatch(padroes[i], relativo, FNM_PATHNAME) == 0) return 1;
+        } else if (fnmatch(padroes[i], nome, 0) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Cria a vigilância do inotify usada no modo daemon
+ * @return Ponteiro para a vigilância criada, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir a vigilância usando destruir_vigilancia().
+ */
+Vigilancia* criar_vigilancia(void) {
+    Vigilancia* vigilancia = (Vigilancia*)calloc(1, sizeof(Vigilancia));
+    if (!vigilancia) {
+        perror("Erro ao alocar vigilância");
+        return NULL;
+    }
+
+    vigilancia->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (vigilancia->fd < 0) {
+        perror("Erro ao iniciar inotify");
+        free(vigilancia);
+        return NULL;
+    }
+    pthread_mutex_init(&vigilancia->mutex, NULL);
+    return vigilancia;
+}
+
+/**
+ * @brief Destrói a vigilância e fecha o inotify
+ * @param vigilancia Vigilância a ser destruída (seguro com NULL)
+ */
+void destruir_vigilancia(Vigilancia* vigilancia) {
+    if (!vigilancia) return;
+
+    close(vigilancia->fd);
+    for (int i = 0; i < vigilancia->capacidade; i++) {
+        free(vigilancia->diretorios[i]);
+    }
+    free(vigilancia->diretorios);
+    pthread_mutex_destroy(&vigilancia->mutex);
+    free(vigilancia);
+}
+
+/**
+ * @brief Passa a vigiar um diretório
+ * @param vigilancia Vigilância do inotify
+ * @param caminho Diretório a vigiar
+ * 
+ * Arquivos são reportados ao terminar de ser escritos (IN_CLOSE_WRITE) ou
+ * ao serem movidos para o diretório (IN_MOVED_TO), nunca pela metade.
+ */
+void vigilancia_adicionar_diretorio(Vigilancia* vigilancia, const char* caminho) {
+    int wd = inotify_add_watch(vigilancia->fd, caminho, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+    if (wd < 0) {
+        printf("Erro ao vigiar diretório %s: %s\n", caminho, strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&vigilancia->mutex);
+    if (wd >= vigilancia->capacidade) {
+        int nova_capacidade = vigilancia->capacidade ? vigilancia->capacidade : 64;
+        while (nova_capacidade <= wd) nova_capacidade *= 2;
+        char** diretorios = (char**)realloc(vigilancia->diretorios, nova_capacidade * sizeof(char*));
+        if (!diretorios) {
+            pthread_mutex_unlock(&vigilancia->mutex);
+            perror("Erro ao ampliar tabela de diretórios vigiados");
+            return;
+        }
+        memset(diretorios + vigilancia->capacidade, 0, (nova_capacidade - vigilancia->capacidade) * sizeof(char*));
+        vigilancia->diretorios = diretorios;
+        vigilancia->capacidade = nova_capacidade;
+    }
+    // O mesmo diretório devolve o mesmo wd; mantém o caminho mais recente
+    free(vigilancia->diretorios[wd]);
+    vigilancia->diretorios[wd] = strdup(caminho);
+    pthread_mutex_unlock(&vigilancia->mutex);
+}
+
+/**
+ * @brief Monta o caminho completo de um evento do inotify
+ * @param vigilancia Vigilância do inotify
+ * @param wd Watch descriptor do evento
+ * @param nome Nome da entrada dentro do diretório vigiado
+ * @return Caminho alocado (o chamador libera), ou NULL se o wd é desconhecido
+ */
+char* vigilancia_caminho_evento(Vigilancia* vigilancia, int wd, const char* nome) {
+    char* completo = NULL;
+    pthread_mutex_lock(&vigilancia->mutex);
+    if (wd >= 0 && wd < vigilancia->capacidade && vigilancia->diretorios[wd]) {
+        size_t tamanho = strlen(vigilancia->diretorios[wd]) + strlen(nome) + 2;
+        completo = (char*)malloc(tamanho);
+        if (completo) snprintf(completo, tamanho, "%s/%s", vigilancia->diretorios[wd], nome);
+    }
+    pthread_mutex_unlock(&vigilancia->mutex);
+    return completo;
+}
+
+/**
+ * @brief Aplica os padrões --incluir/--excluir a uma entrada
+ * @param relativo Caminho relativo ao diretório de entrada
+ * @param nome Último componente do caminho
+ * @param diretorio 1 se a entrada é um diretório (só a exclusão se aplica)
+ * @return 1 se a entrada deve ser considerada, 0 caso contrário
+ */
+int aceito_pelos_filtros(const char* relativo, const char* nome, int diretorio) {
+    if (corresponde_padroes(relativo, nome, config.excluir, config.num_excluir)) return 0;
+    if (!diretorio && config.num_incluir > 0 &&
+        !corresponde_padroes(relativo, nome, config.incluir, config.num_incluir)) return 0;
+    return 1;
+}
+
+/**
+ * @brief Cria o estado de uma varredura recursiva
+ * @param lista Lista de varredura que receberá os arquivos
+ * @param raiz Diretório de entrada
+ * @return Ponteiro para a varredura criada, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir a varredura usando destruir_varredura().
+ */
+Varredura* criar_varredura(ListaVarredura* lista, const char* raiz) {
+    Varredura* varredura = (Varredura*)calloc(1, sizeof(Varredura));
+    if (!varredura) {
+        perror("Erro ao alocar varredura");
+        return NULL;
+    }
+
+    varredura->lista = lista;
+    varredura->raiz = raiz;
+    pthread_mutex_init(&varredura->mutex, NULL);
+    pthread_cond_init(&varredura->cond, NULL);
+
+    DiretorioPendente* inicial = (DiretorioPendente*)malloc(sizeof(DiretorioPendente));
+    if (!inicial || !(inicial->caminho = strdup(raiz))) {
+        perror("Erro ao alocar diretório inicial");
+        free(inicial);
+        pthread_mutex_destroy(&varredura->mutex);
+        pthread_cond_destroy(&varredura->cond);
+        free(varredura);
+        return NULL;
+    }
+    inicial->proximo = NULL;
+    varredura->pendentes = inicial;
+
+    return varredura;
+}
+
+/**
+ * @brief Destrói o estado de uma varredura
+ * @param varredura Varredura a ser destruída
+ */
+void destruir_varredura(Varredura* varredura) {
+    if (!varredura) return;
+
+    while (varredura->pendentes) {
+        DiretorioPendente* pendente = varredura->pendentes;
+        varredura->pendentes = pendente->proximo;
+        free(pendente->caminho);
+        free(pendente);
+    }
+    pthread_mutex_destroy(&varredura->mutex);
+    pthread_cond_destroy(&varredura->cond);
+    free(varredura->visitados);
+    free(varredura);
+}
+
+/**
+ * @brief Exclui da varredura um caminho gerado pelo próprio programa
+ * @param varredura Varredura ainda não iniciada
+ * @param caminho Diretório de saída ou do cache, ou arquivo do índice
+ * 
+ * Dentro da árvore de entrada, a saída de uma execução viraria a entrada da
+ * seguinte. O caminho é guardado por dispositivo e inode e podado como um
+ * diretório de --excluir; se ainda não existe, não há o que ignorar.
+ */
+void varredura_ignorar(Varredura* varredura, const char* caminho) {
+    struct stat st;
+    if (!caminho || varredura->num_ignorados >= MAX_IGNORADOS || stat(caminho, &st) != 0) return;
+    varredura->ignorados[varredura->num_ignorados].dispositivo = st.st_dev;
+    varredura->ignorados[varredura->num_ignorados].inode = st.st_ino;
+    varredura->num_ignorados++;
+}
+
+/**
+ * @brief Verifica se um diretório ou arquivo foi excluído com varredura_ignorar()
+ * @param varredura Varredura em andamento
+ * @param st Resultado do stat do caminho
+ * @return 1 se o caminho deve ser ignorado, 0 caso contrário
+ */
+int varredura_ignorado(const Varredura* varredura, const struct stat* st) {
+    for (int i = 0; i < varredura->num_ignorados; i++) {
+        if (varredura->ignorados[i].dispositivo == st->st_dev && varredura->ignorados[i].inode == st->st_ino) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Registra um diretório como visitado
+ * @param varredura Varredura em andamento
+ * @param st Resultado do stat do diretório
+ * @return 1 se é a primeira visita, 0 se o diretório já foi percorrido (ciclo)
+ * 
+ * Usa uma tabela hash de endereçamento aberto indexada por (dispositivo, inode).
+ */
+int varredura_marcar_visitado(Varredura* varredura, const struct stat* st) {
+    pthread_mutex_lock(&varredura->mutex);
+
+    // Mantém a ocupação abaixo de 70%
+    if ((varredura->num_visitados + 1) * 10 > varredura->capacidade_visitados * 7) {
+        size_t nova_capacidade = varredura->capacidade_visitados ? varredura->capacidade_visitados * 2 : 1024;
+        IdentificadorDiretorio* nova = (IdentificadorDiretorio*)calloc(nova_capacidade, sizeof(IdentificadorDiretorio));
+        if (!nova) {
+            pthread_mutex_unlock(&varredura->mutex);
+            return 1;
+        }
+        for (size_t i = 0; i < varredura->capacidade_visitados; i++) {
+            IdentificadorDiretorio* id = &varredura->visitados[i];
+            if (id->inode == 0) continue;
+            size_t h = ((uint64_t)id->dispositivo * 0x9E3779B97F4A7C15ULL ^ (uint64_t)id->inode) % nova_capacidade;
+            while (nova[h].inode != 0) h = (h + 1) % nova_capacidade;
+            nova[h] = *id;
+        }
+        free(varredura->visitados);
+        varredura->visitados = nova;
+        varredura->capacidade_visitados = nova_capacidade;
+    }
+
+    size_t h = ((uint64_t)st->st_dev * 0x9E3779B97F4A7C15ULL ^ (uint64_t)st->st_ino) % varredura->capacidade_visitados;
+    while (varredura->visitados[h].inode != 0) {
+        if (varredura->visitados[h].dispositivo == st->st_dev && varredura->visitados[h].inode == st->st_ino) {
+            pthread_mutex_unlock(&varredura->mutex);
+            return 0;
+        }
+        h = (h + 1) % varredura->capacidade_visitados;
+    }
+    varredura->visitados[h].dispositivo = st->st_dev;
+    varredura->visitados[h].inode = st->st_ino;
+    varredura->num_visitados++;
+
+    pthread_mutex_unlock(&varredura->mutex);
+    return 1;
+}
+
+/**
+ * @brief Esquece os diretórios visitados, para percorrer a árvore de novo
+ * @param varredura Varredura em andamento
+ * 
+ * Só a raiz continua marcada, como no início da varredura. Sem isso, uma nova
+ * passada (IN_Q_OVERFLOW com --seguir-links) tomaria cada subdiretório por
+ * um ciclo e pararia na raiz.
+ */
+void varredura_esquecer_visitados(Varredura* varredura) {
+    pthread_mutex_lock(&varredura->mutex);
+    if (varredura->visitados) {
+        memset(varredura->visitados, 0, varredura->capacidade_visitados * sizeof(IdentificadorDiretorio));
+    }
+    varredura->num_visitados = 0;
+    pthread_mutex_unlock(&varredura->mutex);
+
+    struct stat st_raiz;
+    if (stat(varredura->raiz, &st_raiz) == 0) varredura_marcar_visitado(varredura, &st_raiz);
+}
+
+/**
+ * @brief Empilha um subdiretório para ser percorrido por algum varredor
+ * @param varredura Varredura em andamento
+ * @param caminho Caminho do subdiretório (a varredura assume a posse)
+ */
+void varredura_empilhar(Varredura* varredura, char* caminho) {
+    DiretorioPendente* pendente = (DiretorioPendente*)malloc(sizeof(DiretorioPendente));
+    if (!pendente) {
+        perror("Erro ao alocar diretório pendente");
+        free(caminho);
+        return;
+    }
+    pendente->caminho = caminho;
+
+    pthread_mutex_lock(&varredura->mutex);
+    pendente->proximo = varredura->pendentes;
+    varredura->pendentes = pendente;
+    pthread_cond_signal(&varredura->cond);
+    pthread_mutex_unlock(&varredura->mutex);
+}
+
+/**
+ * @brief Retira o próximo diretório a percorrer (bloqueante)
+ * @param varredura Varredura em andamento
+ * @return Caminho do diretório (o chamador libera), ou NULL quando a varredura terminou
+ * 
+ * A varredura termina quando a pilha está vazia e nenhum varredor está
+ * percorrendo um diretório (que poderia empilhar novos subdiretórios).
+ * O primeiro varredor a perceber isso conclui a lista de varredura.
+ * No modo daemon (manter_aberta), os varredores ficam aguardando os
+ * diretórios novos detectados pelo inotify.
+ */
+char* varredura_desempilhar(Varredura* varredura) {
+    pthread_mutex_lock(&varredura->mutex);
+    while (executando && !varredura->pendentes && (varredura->ativos > 0 || varredura->manter_aberta)) {
+        pthread_cond_wait(&varredura->cond, &varredura->mutex);
+    }
+    if (!executando || !varredura->pendentes) {
+        int primeira_vez = !varredura->concluida;
+        varredura->concluida = 1;
+        pthread_cond_broadcast(&varredura->cond);
+        pthread_mutex_unlock(&varredura->mutex);
+        if (primeira_vez) lista_varredura_concluir(varredura->lista);
+        return NULL;
+    }
+
+    DiretorioPendente* pendente = varredura->pendentes;
+    varredura->pendentes = pendente->proximo;
+    varredura->ativos++;
+    pthread_mutex_unlock(&varredura->mutex);
+
+    char* caminho = pendente->caminho;
+    free(pendente);
+    return caminho;
+}
+
+/**
+ * @brief Sinaliza que um varredor terminou de percorrer um diretório
+ * @param varredura Varredura em andamento
+ */
+void varredura_terminar_diretorio(Varredura* varredura) {
+    pthread_mutex_lock(&varredura->mutex);
+    varredura->ativos--;
+    if (varredura->ativos == 0 && !varredura->pendentes) {
+        pthread_cond_broadcast(&varredura->cond);
+    }
+    pthread_mutex_unlock(&varredura->mutex);
+}
+
+/**
+ * @brief Entrega um arquivo regular encontrado à lista de varredura
+ * @param varredura Varredura em andamento
+ * @param completo Caminho completo (a função assume a posse)
+ * @param relativo Caminho relativo à entrada (aponta para dentro de completo)
+ * @param dirfd Descritor do diretório do arquivo (ou AT_FDCWD)
+ * @param nome Nome do arquivo relativo a dirfd
+ * @param st Resultado do stat do arquivo
+ * @return 0 se a execução foi interrompida, 1 caso contrário
+ * 
+ * No modo incremental, arquivos inalterados são descartados aqui,
+ * antes de qualquer leitura. Com --deduplicar, duplicatas ficam com o
+ * arquivo que trouxe o conteúdo primeiro.
+ */
+int varredura_adicionar_arquivo(Varredura* varredura, char* completo, const char* relativo,
+                                int dirfd, const char* nome, const struct stat* st) {
+    OrigemArquivo origem;
+    origem.tamanho = (uint64_t)st->st_size;
+    origem.mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    origem.hash_conteudo = 0;
+
+    // O índice incremental dentro da entrada não é uma imagem
+    if (varredura_ignorado(varredura, st)) {
+        __atomic_fetch_add(&varredura->filtrados, 1, __ATOMIC_RELAXED);
+        free(completo);
+        return 1;
+    }
+
+    // Modo incremental: arquivos inalterados nem chegam a ser lidos
+    if (indice_incremental && indice_arquivo_inalterado(indice_incremental, relativo, dirfd, nome, &origem)) {
+        free(completo);
+        return 1;
+    }
+
+    // Duplicatas de um conteúdo já visto não viram um novo job
+    if (deduplicacao && deduplicacao_verificar(deduplicacao, completo, dirfd, nome, &origem)) return 1;
+
+    double custo = modelo_custo ? estimar_custo_arquivo(modelo_custo, dirfd, nome, &origem) : 0.0;
+    if (!lista_varredura_adicionar(varredura->lista, completo, &origem, custo)) return 0;
+    __atomic_fetch_add(&varredura->arquivos, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * @brief Percorre um diretório com getdents64 e distribui suas entradas
+ * @param varredura Varredura em andamento
+ * @param caminho Caminho do diretório
+ * @param buffer Buffer de trabalho para o getdents64
+ * @param tamanho_buffer Tamanho do buffer
+ * 
+ * Arquivos regulares que passam pelos filtros vão direto para a lista de
+ * varredura (os produtores começam antes do fim da varredura); subdiretórios
+ * são empilhados. Os stats são feitos com fstatat relativo ao descritor do
+ * diretório, e só quando o d_type não basta.
+ */
+void percorrer_diretorio(Varredura* varredura, const char* caminho, char* buffer, size_t tamanho_buffer) {
+    int fd = openat(AT_FDCWD, caminho, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Erro ao abrir diretório %s: %s\n", caminho, strerror(errno));
+        __atomic_fetch_add(&varredura->erros, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Saída e cache dentro da entrada (empilhados por aqui ou pelo inotify) são podados
+    struct stat st_diretorio;
+    if (varredura->num_ignorados > 0 && fstat(fd, &st_diretorio) == 0 && varredura_ignorado(varredura, &st_diretorio)) {
+        __atomic_fetch_add(&varredura->filtrados, 1, __ATOMIC_RELAXED);
+        close(fd);
+        return;
+    }
+    __atomic_fetch_add(&varredura->diretorios, 1, __ATOMIC_RELAXED);
+
+    // No modo daemon, a vigilância começa antes da leitura para não perder arquivos
+    if (varredura->vigilancia) {
+        vigilancia_adicionar_diretorio(varredura->vigilancia, caminho);
+    }
+
+    size_t tamanho_caminho = strlen(caminho);
+    size_t tamanho_raiz = strlen(varredura->raiz);
+
+    long lidos = 0;
+    while (executando && (lidos = syscall(SYS_getdents64, fd, buffer, tamanho_buffer)) > 0) {
+        for (long deslocamento = 0; deslocamento < lidos; ) {
+            EntradaDiretorioLinux* ent = (EntradaDiretorioLinux*)(buffer + deslocamento);
+            deslocamento += ent->d_reclen;
+
+            const char* nome = ent->d_name;
+            if (nome[0] == '.' && (nome[1] == '\0' || (nome[1] == '.' && nome[2] == '\0'))) continue;
+
+            // Links para arquivos são sempre seguidos; links para diretórios só com --seguir-links
+            struct stat st;
+            int tem_stat = 0;
+            unsigned char tipo = ent->d_type;
+            if (tipo == DT_UNKNOWN || tipo == DT_LNK) {
+                if (fstatat(fd, nome, &st, 0) != 0) continue;
+                tem_stat = 1;
+                if (S_ISDIR(st.st_mode)) {
+                    if (tipo == DT_LNK && !config.seguir_links) continue;
+                    tipo = DT_DIR;
+                } else {
+                    tipo = S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                }
+            }
+            if (tipo != DT_DIR && tipo != DT_REG) continue;
+            if (tipo == DT_DIR && !config.recursivo) continue;
+
+            // Monta o caminho completo sem limite fixo de tamanho
+            size_t tamanho_nome = strlen(nome);
+            char* completo = (char*)malloc(tamanho_caminho + tamanho_nome + 2);
+            if (!completo) {
+                perror("Erro ao alocar caminho");
+                continue;
+            }
+            memcpy(completo, caminho, tamanho_caminho);
+            completo[tamanho_caminho] = '/';
+            memcpy(completo + tamanho_caminho + 1, nome, tamanho_nome + 1);
+            const char* relativo = completo + (tamanho_caminho >= tamanho_raiz ? tamanho_raiz + 1 : 0);
+
+            if (!aceito_pelos_filtros(relativo, nome, tipo == DT_DIR)) {
+                __atomic_fetch_add(&varredura->filtrados, 1, __ATOMIC_RELAXED);
+                free(completo);
+                continue;
+            }
+
+            if (tipo == DT_DIR) {
+                // Ciclos só são possíveis seguindo links simbólicos
+                if (config.seguir_links) {
+                    if (!tem_stat && fstatat(fd, nome, &st, 0) != 0) {
+                        free(completo);
+                        continue;
+                    }
+                    if (!varredura_marcar_visitado(varredura, &st)) {
+                        __atomic_fetch_add(&varredura->ciclos, 1, __ATOMIC_RELAXED);
+                        free(completo);
+                        continue;
+                    }
+                }
+                varredura_empilhar(varredura, completo);
+                continue;
+            }
+
+            if (!tem_stat && fstatat(fd, nome, &st, 0) != 0) {
+                free(completo);
+                continue;
+            }
+            if (!varredura_adicionar_arquivo(varredura, completo, relativo, fd, nome, &st)) break;
+        }
+    }
+    if (lidos < 0) {
+        printf("Erro ao ler diretório %s: %s\n", caminho, strerror(errno));
+        __atomic_fetch_add(&varredura->erros, 1, __ATOMIC_RELAXED);
+    }
+
+    close(fd);
+}
+
+/**
+ * @brief Função executada por cada thread de varredura
+ * @param arg Ponteiro para a Varredura compartilhada
+ * @return NULL
+ * 
+ * Cada varredor retira um diretório da pilha compartilhada, percorre suas
+ * entradas e repete até que a árvore inteira tenha sido visitada.
+ */
+void* varredor(void* arg) {
+    Varredura* varredura = (Varredura*)arg;
+    size_t tamanho_buffer = 64 * 1024;
+    char* buffer = (char*)malloc(tamanho_buffer);
+    if (!buffer) {
+        perror("Erro ao alocar buffer de varredura");
+        return NULL;
+    }
+
+    char* caminho;
+    while ((caminho = varredura_desempilhar(varredura)) != NULL) {
+        percorrer_diretorio(varredura, caminho, buffer, tamanho_buffer);
+        free(caminho);
+        varredura_terminar_diretorio(varredura);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief Compara dois caminhos (para qsort)
+ */
+int comparar_caminhos(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Entrega à lista de varredura uma rajada de arquivos do inotify
+ * @param varredura Varredura em andamento
+ * @param caminhos Caminhos acumulados desde a última entrega (liberados aqui)
+ * @param num_caminhos Número de caminhos
+ * 
+ * Caminhos repetidos na rajada (várias escritas no mesmo arquivo) viram
+ * uma única entrada. Cada arquivo passa pelos mesmos filtros e pelo mesmo
+ * índice incremental da varredura inicial.
+ */
+void vigilancia_entregar_rajada(Varredura* varredura, char** caminhos, int num_caminhos) {
+    Vigilancia* vigilancia = varredura->vigilancia;
+    qsort(caminhos, num_caminhos, sizeof(char*), comparar_caminhos);
+
+    for (int i = 0; i < num_caminhos; i++) {
+        if (i > 0 && strcmp(caminhos[i], caminhos[i - 1]) == 0) {
+            vigilancia->coalescidos++;
+            continue;
+        }
+
+        struct stat st;
+        if (stat(caminhos[i], &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        char* completo = strdup(caminhos[i]);
+        if (!completo) continue;
+        const char* relativo = caminho_relativo(completo, varredura->raiz);
+        if (varredura_adicionar_arquivo(varredura, completo, relativo, AT_FDCWD, completo, &st)) {
+            vigilancia->enfileirados++;
+        }
+    }
+
+    for (int i = 0; i < num_caminhos; i++) {
+        free(caminhos[i]);
+    }
+}
+
+/**
+ * @brief Função executada pela thread de vigilância (modo daemon)
+ * @param arg Ponteiro para a Varredura compartilhada
+ * @return NULL
+ * 
+ * Lê os eventos do inotify e acumula os arquivos de uma rajada até que
+ * fiquem config.janela_rajada_ms sem novos eventos (ou RAJADA_MAX_MS desde
+ * o primeiro), entregando então todos de uma vez aos produtores, que já
+ * estão aquecidos esperando na lista de varredura. Diretórios novos são
+ * empilhados para os varredores, que os percorrem e passam a vigiá-los.
+ * Ao receber SIGINT/SIGTERM, libera os varredores e conclui a lista.
+ */
+void* vigia(void* arg) {
+    Varredura* varredura = (Varredura*)arg;
+    Vigilancia* vigilancia = varredura->vigilancia;
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    char** rajada = NULL;
+    int num_rajada = 0;
+    int capacidade_rajada = 0;
+    struct timespec primeiro_evento = {0}, ultimo_evento = {0};
+
+    printf("Vigiando %s (Ctrl+C para encerrar)\n", varredura->raiz);
+
+    while (!encerramento_solicitado) {
+        int espera_ms = 100;
+        if (num_rajada > 0) {
+            struct timespec agora;
+            clock_gettime(CLOCK_MONOTONIC, &agora);
+            double desde_ultimo = (agora.tv_sec - ultimo_evento.tv_sec) * 1e3 + (agora.tv_nsec - ultimo_evento.tv_nsec) / 1e6;
+            double desde_primeiro = (agora.tv_sec - primeiro_evento.tv_sec) * 1e3 + (agora.tv_nsec - primeiro_evento.tv_nsec) / 1e6;
+            if (desde_ultimo >= config.janela_rajada_ms || desde_primeiro >= RAJADA_MAX_MS) {
+                vigilancia_entregar_rajada(varredura, rajada, num_rajada);
+                num_rajada = 0;
+                continue;
+            }
+            espera_ms = config.janela_rajada_ms - (int)desde_ultimo;
+            if (espera_ms < 1) espera_ms = 1;
+        }
+
+        struct pollfd pfd = { vigilancia->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, espera_ms) <= 0) continue;
+
+        ssize_t lidos = read(vigilancia->fd, buffer, sizeof(buffer));
+        if (lidos <= 0) continue;
+
+        for (char* p = buffer; p < buffer + lidos; ) {
+            struct inotify_event* evento = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + evento->len;
+
+            if (evento->mask & IN_Q_OVERFLOW) {
+                // Eventos perdidos: percorre a árvore de novo, do zero
+                vigilancia->transbordamentos++;
+                if (config.seguir_links) varredura_esquecer_visitados(varredura);
+                char* raiz = strdup(varredura->raiz);
+                if (raiz) varredura_empilhar(varredura, raiz);
+                continue;
+            }
+            if (evento->len == 0) continue;
+
+            char* completo = vigilancia_caminho_evento(vigilancia, evento->wd, evento->name);
+            if (!completo) continue;
+            const char* relativo = caminho_relativo(completo, varredura->raiz);
+
+            if (evento->mask & IN_ISDIR) {
+                if (config.recursivo && (evento->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                    aceito_pelos_filtros(relativo, evento->name, 1)) {
+                    varredura_empilhar(varredura, completo);
+                } else {
+                    free(completo);
+                }
+                continue;
+            }
+            if (!(evento->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) ||
+                !aceito_pelos_filtros(relativo, evento->name, 0)) {
+                free(completo);
+                continue;
+            }
+
+            if (num_rajada == capacidade_rajada) {
+                int nova_capacidade = capacidade_rajada ? capacidade_rajada * 2 : 256;
+                char** nova = (char**)realloc(rajada, nova_capacidade * sizeof(char*));
+                if (!nova) {
+                    free(completo);
+                    continue;
+                }
+                rajada = nova;
+                capacidade_rajada = nova_capacidade;
+            }
+            rajada[num_rajada++] = completo;
+            vigilancia->eventos++;
+
+            clock_gettime(CLOCK_MONOTONIC, &ultimo_evento);
+            if (num_rajada == 1) primeiro_evento = ultimo_evento;
+        }
+    }
+
+    // Entrega o que já chegou e libera os varredores para a lista ser concluída
+    vigilancia_entregar_rajada(varredura, rajada, num_rajada);
+    free(rajada);
+
+    pthread_mutex_lock(&varredura->mutex);
+    varredura->manter_aberta = 0;
+    pthread_cond_broadcast(&varredura->cond);
+    pthread_mutex_unlock(&varredura->mutex);
+
+    printf("Vigilância encerrada\n");
+    return NULL;
+}
+
+/**
+ * @brief Trata SIGINT/SIGTERM no modo daemon
+ * @param sinal Número do sinal recebido
+ * 
+ * Apenas marca o pedido; a thread de vigilância conduz o encerramento,
+ * deixando os produtores e consumidores esvaziarem o trabalho pendente.
+ */
+void tratar_sinal_encerramento(int sinal) {
+    (void)sinal;
+    encerramento_solicitado = 1;
+}
+
+/**
+ * @brief Solicita ao kernel que traga um arquivo para o page cache
+ * @param caminho Caminho do arquivo
+ * @return 1 se o readahead foi solicitado, 0 caso contrário
+ * 
+ * posix_fadvise(WILLNEED) retorna sem esperar a leitura terminar, então o
+ * disco trabalha enquanto os produtores decodificam os arquivos anteriores.
+ */
+int solicitar_readahead(const char* caminho) {
+    int fd = open(caminho, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+    return ret == 0;
+}
+
+/**
+ * @brief Função executada pela thread de pré-carregamento (readahead)
+ * @param arg Argumentos da thread (ThreadArgs*)
+ * @return NULL
+ * 
+ * Mantém os próximos N arquivos da lista de varredura no page cache antes
+ * que algum produtor chegue até eles. N acompanha a taxa de decodificação
+ * observada (arquivos retirados da lista por segundo) para cobrir
+ * PREFETCH_HORIZONTE segundos de trabalho, limitado a config.prefetch_max
+ * arquivos e a limite_prefetch_bytes bytes à frente dos produtores. A janela é
+ * percorrida a partir da próxima entrada a retirar e cada entrada é marcada
+ * ao ser pré-carregada, pois no agendamento LPT entradas novas podem ser
+ * inseridas no meio da janela.
+ */
+void* pre_carregador(void* arg) {
+    ThreadArgs* args = (ThreadArgs*)arg;
+    ListaVarredura* lista = args->lista;
+    unsigned long long lidos_anterior = 0;
+    double taxa = 0.0;                  // Média móvel exponencial da taxa de decodificação
+    struct timespec anterior, agora;
+
+    clock_gettime(CLOCK_MONOTONIC, &anterior);
+
+    while (executando) {
+        // Mede a taxa com que os produtores consomem a lista
+        clock_gettime(CLOCK_MONOTONIC, &agora);
+        double dt = (agora.tv_sec - anterior.tv_sec) + (agora.tv_nsec - anterior.tv_nsec) / 1e9;
+
+        pthread_mutex_lock(&lista->mutex);
+        unsigned long long lidos = lista->lidos;
+        unsigned long long escritos = lista->escritos;
+        int terminou = lista->concluida && lidos == escritos;
+        pthread_mutex_unlock(&lista->mutex);
+
+        if (terminou) break;
+
+        if (dt >= 0.05) {
+            double instantanea = (lidos - lidos_anterior) / dt;
+            taxa = taxa == 0.0 ? instantanea : 0.7 * taxa + 0.3 * instantanea;
+            lidos_anterior = lidos;
+            anterior = agora;
+        }
+
+        int janela = (int)ceil(taxa * PREFETCH_HORIZONTE);
+        if (janela < PREFETCH_MIN) janela = PREFETCH_MIN;
+        if (janela > config.prefetch_max) janela = config.prefetch_max;
+
+        size_t bytes_a_frente = 0;
+        for (unsigned long long posicao = lidos; executando && posicao < lidos + janela; posicao++) {
+            // Copia o caminho: a entrada pode ser retirada e liberada a qualquer momento
+            char caminho[PATH_MAX];
+            size_t tamanho = 0;
+            int pendente = 0;
+            pthread_mutex_lock(&lista->mutex);
+            int disponivel = posicao >= lista->lidos && posicao < lista->escritos;
+            if (disponivel) {
+                EntradaArquivo* entrada = &lista->entradas[posicao % lista->capacidade];
+                tamanho = entrada->origem.tamanho;
+                pendente = !entrada->pre_carregada &&
+                           (bytes_a_frente == 0 || bytes_a_frente + tamanho <= limite_prefetch_bytes);
+                if (pendente) {
+                    snprintf(caminho, sizeof(caminho), "%s", entrada->caminho);
+                    entrada->pre_carregada = 1;
+                }
+            }
+            pthread_mutex_unlock(&lista->mutex);
+            if (!disponivel) break;
+
+            if (bytes_a_frente + tamanho > limite_prefetch_bytes && bytes_a_frente > 0) break;
+            bytes_a_frente += tamanho;
+
+            if (pendente && solicitar_readahead(caminho)) {
+                metricas_prefetch.arquivos++;
+                metricas_prefetch.bytes += tamanho;
+            }
+        }
+
+        metricas_prefetch.janela_atual = janela;
+        if (janela > metricas_prefetch.janela_maxima) metricas_prefetch.janela_maxima = janela;
+        metricas_prefetch.taxa = taxa;
+
+        // Reavalia a janela a cada 5ms (no modo daemon ocioso, a cada 50ms)
+        usleep(config.vigiar && lidos == escritos ? 50000 : 5000);
+    }
+
+    return NULL;
+}
+
+// Posicionamento NUMA (--numa): em máquinas com mais de um nó, cada produtor
+// e cada consumidor é fixado nas CPUs de um nó, e cada nó tem seus próprios
+// fragmentos da fila (veja a fila fragmentada abaixo). O produtor decodifica
+// já fixado, então o buffer de pixels é tocado pela primeira vez (e alocado
+// pelo kernel) no nó dele; a imagem vai para um fragmento desse nó e é
+// transformada por um consumidor do mesmo nó. Só as imagens roubadas por um
+// consumidor de outro nó atravessam a interconexão entre os soquetes.
+#define RAIZ_NOS_NUMA "/sys/devices/system/node"
+#define MAX_NOS_NUMA 16
+
+typedef struct {
+    int num_nos;                        // Nós com CPUs na máscara de afinidade
+    int ids[MAX_NOS_NUMA];              // Número de cada nó no sistema
+    cpu_set_t cpus[MAX_NOS_NUMA];       // CPUs utilizáveis de cada nó
+    int ativa;                          // 1 se as threads são fixadas por nó
+} TopologiaNuma;
+
+TopologiaNuma topologia_numa;
+
+/**
+ * @brief Converte uma lista de CPUs do sysfs ("0-3,8-11") em um cpu_set_t
+ * @param texto Lista de CPUs
+ * @param conjunto Recebe as CPUs
+ */
+void ler_lista_cpus(const char* texto, cpu_set_t* conjunto) {
+    CPU_ZERO(conjunto);
+    const char* p = texto;
+    while (*p) {
+        char* fim;
+        long primeira = strtol(p, &fim, 10);
+        if (fim == p) break;
+        long ultima = primeira;
+        p = fim;
+        if (*p == '-') {
+            ultima = strtol(p + 1, &fim, 10);
+            p = fim;
+        }
+        for (long cpu = primeira; cpu <= ultima && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, conjunto);
+        if (*p != ',') break;
+        p++;
+    }
+}
+
+/**
+ * @brief Detecta os nós NUMA que têm CPUs utilizáveis pelo processo
+ * @param topologia Recebe os nós e suas CPUs
+ * 
+ * Nós sem CPUs na máscara de afinidade (só memória, ou excluídos por
+ * taskset/cpuset) são ignorados. Sem o sysfs de nós, o resultado é um nó.
+ */
+void detectar_topologia_numa(TopologiaNuma* topologia) {
+    cpu_set_t mascara;
+    CPU_ZERO(&mascara);
+    if (sched_getaffinity(0, sizeof(mascara), &mascara) != 0) return;
+
+    topologia->num_nos = 0;
+    for (int no = 0; no < 1024 && topologia->num_nos < MAX_NOS_NUMA; no++) {
+        char caminho[PATH_MAX], linha[1024];
+        snprintf(caminho, sizeof(caminho), "%s/node%d/cpulist", RAIZ_NOS_NUMA, no);
+        if (ler_linha_arquivo(caminho, linha, sizeof(linha)) != 0) continue;
+
+        cpu_set_t cpus;
+        ler_lista_cpus(linha, &cpus);
+        CPU_AND(&cpus, &cpus, &mascara);
+        if (CPU_COUNT(&cpus) == 0) continue;
+        topologia->ids[topologia->num_nos] = no;
+        topologia->cpus[topologia->num_nos] = cpus;
+        topologia->num_nos++;
+    }
+    if (topologia->num_nos == 0) {
+        topologia->num_nos = 1;
+        topologia->cpus[0] = mascara;
+    }
+}
+
+/**
+ * @brief Fixa a thread chamadora nas CPUs de um nó (posicionamento ativo)
+ * @param no Índice do nó em topologia_numa
+ */
+void numa_fixar_thread(int no) {
+    if (!topologia_numa.ativa) return;
+    int erro = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &topologia_numa.cpus[no]);
+    if (erro != 0) printf("Aviso: não foi possível fixar a thread no nó %d: %s\n", topologia_numa.ids[no], strerror(erro));
+}
+
+// Fila fragmentada (--fragmentos): com dezenas de threads, o mutex e os
+// semáforos de uma FilaImagens única viram o gargalo, e as linhas de cache
+// deles passam o tempo todo de um núcleo para outro. Fragmentada, a fila é
+// um conjunto de FilaImagens independentes, cada uma de um nó NUMA. Cada
+// consumidor tem seu fragmento e, quando ele está vazio, rouba sem bloquear
+// dos outros fragmentos do mesmo nó e só depois dos outros nós. Cada produtor
+// insere no fragmento menos ocupado do seu nó, a começar pelo seu, o que
+// espalha as imagens sem um ponto central de sincronização.
+#define MAX_FRAGMENTOS 64
+#define FRAGMENTOS_ESPERA_MS 10  // Espera no próprio fragmento antes de tentar roubar de novo
+
+typedef struct {
+    FilaImagens* filas[MAX_FRAGMENTOS];
+    int no[MAX_FRAGMENTOS];     // Nó NUMA (índice em topologia_numa) de cada fragmento
+    int num;                    // > 1 quando a fila está fragmentada
+    long proprias;              // Imagens retiradas do fragmento do próprio consumidor
+    long roubadas_no;           // Roubadas de outro fragmento do mesmo nó
+    long roubadas_remotas;      // Roubadas de um fragmento de outro nó
+    double bytes_remotos;       // Pixels que atravessaram entre nós
+    pthread_mutex_t mutex;
+} FilaFragmentada;
+
+FilaFragmentada fragmentos = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * @brief Escolhe o fragmento em que um produtor insere a próxima imagem
+ * @param args Argumentos do produtor (fragmento próprio)
+ * @return O fragmento próprio, ou o menos ocupado do nó se o próprio estiver
+ *         cheio (a fila única sem fragmentos)
+ * 
+ * O caso comum toca só as linhas de cache do fragmento próprio; o roubo dos
+ * consumidores desfaz os desequilíbrios. As ocupações são lidas sem o mutex:
+ * um valor ligeiramente desatualizado só torna a escolha menos equilibrada.
+ */
+FilaImagens* fila_do_produtor(ThreadArgs* args) {
+    if (fragmentos.num <= 1) return args->fila;
+    int proprio = args->fragmento;
+    FilaImagens* escolhida = fragmentos.filas[proprio];
+    int menor = __atomic_load_n(&escolhida->tamanho, __ATOMIC_RELAXED);
+    if (menor < escolhida->capacidade) return escolhida;
+    for (int i = 1; i < fragmentos.num; i++) {
+        int k = (proprio + i) % fragmentos.num;
+        if (fragmentos.no[k] != fragmentos.no[proprio]) continue;
+        int tamanho = __atomic_load_n(&fragmentos.filas[k]->tamanho, __ATOMIC_RELAXED);
+        if (tamanho < menor) {
+            menor = tamanho;
+            escolhida = fragmentos.filas[k];
+        }
+    }
+    return escolhida;
+}
+
+/**
+ * @brief Espera uma imagem para um consumidor, roubando de outros fragmentos se preciso
+ * @param args Argumentos do consumidor (fragmento próprio)
+ * @param origem Recebe o índice do fragmento cujo semáforo "cheio" foi decrementado
+ * @return 0 se obteve uma vaga de imagem, -1 se a espera expirou
+ * 
+ * O fragmento próprio tem prioridade; os demais são consultados sem
+ * bloquear, primeiro os do mesmo nó, a partir do fragmento seguinte, para
+ * espalhar os roubos.
+ */
+int fragmentos_aguardar_imagem(ThreadArgs* args, int* origem) {
+    int proprio = args->fragmento;
+    *origem = proprio;
+    if (sem_trywait(&fragmentos.filas[proprio]->cheio) == 0) return 0;
+    for (int remoto = 0; remoto <= 1; remoto++) {
+        for (int i = 1; i < fragmentos.num; i++) {
+            int k = (proprio + i) % fragmentos.num;
+            if ((fragmentos.no[k] != fragmentos.no[proprio]) != remoto) continue;
+            if (sem_trywait(&fragmentos.filas[k]->cheio) == 0) {
+                *origem = k;
+                return 0;
+            }
+        }
+    }
+
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += FRAGMENTOS_ESPERA_MS * 1000000L;
+    if (timeout.tv_nsec >= 1000000000) {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+    }
+    return sem_timedwait(&fragmentos.filas[proprio]->cheio, &timeout);
+}
+
+/**
+ * @brief Contabiliza uma imagem retirada por um consumidor
+ * @param args Argumentos do consumidor
+ * @param origem Fragmento de onde a imagem veio
+ * @param img Imagem retirada (para os bytes que atravessaram)
+ */
+void fragmentos_registrar_retirada(ThreadArgs* args, int origem, const Imagem* img) {
+    if (fragmentos.num <= 1) return;
+    pthread_mutex_lock(&fragmentos.mutex);
+    if (origem == args->fragmento) {
+        fragmentos.proprias++;
+    } else if (fragmentos.no[origem] == fragmentos.no[args->fragmento]) {
+        fragmentos.roubadas_no++;
+    } else {
+        fragmentos.roubadas_remotas++;
+        fragmentos.bytes_remotos += (double)img->largura * img->altura * img->canais;
+    }
+    pthread_mutex_unlock(&fragmentos.mutex);
+}
+
+/**
+ * @brief Informa se a fila (ou, fragmentada, todos os fragmentos) está vazia
+ * @param fila Fila do chamador
+ * @return 1 se vazia
+ */
+int filas_vazias(FilaImagens* fila) {
+    int num = fragmentos.num > 1 ? fragmentos.num : 1;
+    for (int i = 0; i < num; i++) {
+        FilaImagens* f = num > 1 ? fragmentos.filas[i] : fila;
+        pthread_mutex_lock(&f->mutex);
+        int tamanho = f->tamanho;
+        pthread_mutex_unlock(&f->mutex);
+        if (tamanho > 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Ocupação da fila (ou a de todos os fragmentos juntos), entre 0 e 1
+ * @param fila Fila única
+ * @return Fração ocupada
+ */
+double ocupacao_filas(FilaImagens* fila) {
+    int num = fragmentos.num > 1 ? fragmentos.num : 1;
+    int tamanho = 0, capacidade = 0;
+    for (int i = 0; i < num; i++) {
+        FilaImagens* f = num > 1 ? fragmentos.filas[i] : fila;
+        pthread_mutex_lock(&f->mutex);
+        tamanho += f->tamanho;
+        capacidade += f->capacidade;
+        pthread_mutex_unlock(&f->mutex);
+    }
+    return (double)tamanho / capacidade;
+}
+
+/**
+ * @brief Cria os fragmentos da fila, distribuídos entre os nós
+ * @param fila Primeiro fragmento, já criado (a fila dos modos sem fragmentos)
+ * @param num Número de fragmentos, múltiplo do número de nós
+ * @param nos Número de nós
+ * @param capacidade Capacidade de cada fragmento
+ * @return 0 em caso de sucesso, -1 em caso de erro (os fragmentos criados são destruídos)
+ */
+int criar_fragmentos(FilaImagens* fila, int num, int nos, int capacidade) {
+    fragmentos.filas[0] = fila;
+    fragmentos.no[0] = 0;
+    fragmentos.num = 1;
+    for (int i = 1; i < num; i++) {
+        fragmentos.filas[i] = criar_fila(capacidade);
+        if (!fragmentos.filas[i]) {
+            for (int j = 1; j < i; j++) destruir_fila(fragmentos.filas[j]);
+            fragmentos.num = 0;
+            return -1;
+        }
+        fragmentos.no[i] = i % nos;
+        fragmentos.num++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Destrói os fragmentos além do primeiro (que é destruído como a fila única)
+ */
+void destruir_fragmentos(void) {
+    for (int i = 1; i < fragmentos.num; i++) destruir_fila(fragmentos.filas[i]);
+    fragmentos.num = 0;
+}
+
+// Autoajuste (--autoajuste): um controlador observa a ocupação da fila e a
+// vazão de cada estágio e move threads entre produtores (leitura e
+// decodificação) e consumidores (transformação e codificação). São criadas
+// threads suficientes para qualquer divisão do total, e as que excedem as
+// vagas do seu estágio ficam estacionadas entre duas imagens. Fila quase
+// sempre cheia indica consumidores insuficientes; quase sempre vazia, com
+// arquivos ainda na varredura, indica produtores insuficientes. No modo
+// fixo, as decisões são medidas e registradas, mas a divisão não muda, o que
+// mantém a execução reproduzível e comparável com o modo ativo.
+#define AUTOAJUSTE_DESLIGADO 0
+#define AUTOAJUSTE_ATIVO 1
+#define AUTOAJUSTE_FIXO 2
+
+#define AUTOAJUSTE_INTERVALO_MS 250   // Período de decisão
+#define AUTOAJUSTE_AMOSTRAS 10        // Amostras da ocupação da fila por período
+#define AUTOAJUSTE_OCUPACAO_ALTA 0.75 // Acima disso, falta capacidade nos consumidores
+#define AUTOAJUSTE_OCUPACAO_BAIXA 0.25 // Abaixo disso, falta capacidade nos produtores
+#define AUTOAJUSTE_CONFIRMACOES 2     // Períodos seguidos com o mesmo sinal antes de mover
+
+typedef struct {
+    int modo;                  // AUTOAJUSTE_*
+    int produtores_ativos;     // Vagas de produtor: threads com id maior ficam estacionadas
+    int consumidores_ativos;   // Vagas de consumidor
+    int fim_produtores;        // A varredura acabou: todas as vagas vão para os consumidores
+    long movidos_para_consumidores;
+    long movidos_para_produtores;
+    long decisoes_nao_aplicadas; // Modo fixo
+    pthread_mutex_t mutex;
+    pthread_cond_t mudou;
+} Autoajuste;
+
+Autoajuste autoajuste = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .mudou = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief Estaciona a thread enquanto seu id não couber nas vagas do estágio
+ * @param consumidor 1 para consumidores, 0 para produtores
+ * @param id ID da thread no estágio
+ * @param bloquear Se 0, só informa se a thread tem vaga
+ * @return 1 se a thread pode trabalhar, 0 se deveria estar estacionada (só sem bloquear)
+ */
+int autoajuste_aguardar_vaga(int consumidor, int id, int bloquear) {
+    if (autoajuste.modo != AUTOAJUSTE_ATIVO) return 1;
+    pthread_mutex_lock(&autoajuste.mutex);
+    int* vagas = consumidor ? &autoajuste.consumidores_ativos : &autoajuste.produtores_ativos;
+    while (bloquear && id >= *vagas && executando && !autoajuste.fim_produtores) {
+        pthread_cond_wait(&autoajuste.mudou, &autoajuste.mutex);
+    }
+    int tem_vaga = id < *vagas || !executando || autoajuste.fim_produtores;
+    pthread_mutex_unlock(&autoajuste.mutex);
+    return tem_vaga;
+}
+
+/**
+ * @brief Registra o fim da varredura (um produtor não obteve mais arquivos)
+ * 
+ * Produtores estacionados acordam para sair, e as vagas passam todas aos
+ * consumidores, que ainda esvaziam a fila.
+ */
+void autoajuste_concluir_produtores(void) {
+    pthread_mutex_lock(&autoajuste.mutex);
+    autoajuste.fim_produtores = 1;
+    pthread_cond_broadcast(&autoajuste.mudou);
+    pthread_mutex_unlock(&autoajuste.mutex);
+}
+
+/**
+ * @brief Acorda todas as threads estacionadas (encerramento)
+ */
+void autoajuste_acordar_todos(void) {
+    pthread_mutex_lock(&autoajuste.mutex);
+    pthread_cond_broadcast(&autoajuste.mudou);
+    pthread_mutex_unlock(&autoajuste.mutex);
+}
+
+/**
+ * @brief Soma as imagens concluídas pelas threads de um estágio
+ * @param metricas Métricas do estágio
+ * @param n Threads do estágio
+ * @return Total de imagens
+ */
+long autoajuste_somar_imagens(const Metricas* metricas, int n) {
+    long total = 0;
+    pthread_mutex_lock(&mutex_metricas);
+    for (int i = 0; i < n; i++) total += metricas[i].imagens_processadas;
+    pthread_mutex_unlock(&mutex_metricas);
+    return total;
+}
+
+/**
+ * @brief Função da thread controladora do autoajuste
+ * @param arg ThreadArgs (fila e lista de varredura)
+ * @return NULL
+ * 
+ * A cada AUTOAJUSTE_INTERVALO_MS, mede a ocupação média da fila e a vazão
+ * dos dois estágios e move no máximo uma thread, depois de
+ * AUTOAJUSTE_CONFIRMACOES períodos seguidos com o mesmo sinal. Cada decisão
+ * é registrada no log com as medidas que a motivaram.
+ */
+void* controlador_autoajuste(void* arg) {
+    ThreadArgs* args = (ThreadArgs*)arg;
+    struct timespec inicio, agora;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    long produzidas_antes = 0, consumidas_antes = 0;
+    int produtores = autoajuste.produtores_ativos, consumidores = autoajuste.consumidores_ativos;
+    int tendencia = 0;  // > 0: mover para consumidores; < 0: mover para produtores
+
+    while (executando) {
+        double ocupacao = 0.0;
+        for (int i = 0; i < AUTOAJUSTE_AMOSTRAS && executando; i++) {
+            usleep(AUTOAJUSTE_INTERVALO_MS * 1000 / AUTOAJUSTE_AMOSTRAS);
+            ocupacao += ocupacao_filas(args->fila);
+        }
+        ocupacao /= AUTOAJUSTE_AMOSTRAS;
+
+        pthread_mutex_lock(&autoajuste.mutex);
+        int fim = autoajuste.fim_produtores;
+        pthread_mutex_unlock(&autoajuste.mutex);
+        if (fim) break;
+
+        long produzidas = autoajuste_somar_imagens(metricas_produtores, config.num_produtores);
+        long consumidas = autoajuste_somar_imagens(metricas_consumidores, config.num_consumidores);
+        double segundos = AUTOAJUSTE_INTERVALO_MS / 1000.0;
+        double vazao_produtores = (produzidas - produzidas_antes) / segundos;
+        double vazao_consumidores = (consumidas - consumidas_antes) / segundos;
+        produzidas_antes = produzidas;
+        consumidas_antes = consumidas;
+
+        pthread_mutex_lock(&args->lista->mutex);
+        int pendentes = args->lista->escritos > args->lista->lidos || !args->lista->concluida;
+        pthread_mutex_unlock(&args->lista->mutex);
+
+        int sinal = 0;
+        if (ocupacao >= AUTOAJUSTE_OCUPACAO_ALTA && produtores > 1) sinal = 1;
+        // Fila vazia só indica falta de produtores se os consumidores dão conta do que
+        // chega; com eles ocupados em imagens grandes, tirar um deles só atrasaria a fila
+        else if (ocupacao <= AUTOAJUSTE_OCUPACAO_BAIXA && pendentes && consumidores > 1 &&
+                 vazao_consumidores >= vazao_produtores) sinal = -1;
+        tendencia = sinal == 0 ? 0 : (sinal > 0 ? (tendencia > 0 ? tendencia + 1 : 1)
+                                                : (tendencia < 0 ? tendencia - 1 : -1));
+        if (tendencia < AUTOAJUSTE_CONFIRMACOES && tendencia > -AUTOAJUSTE_CONFIRMACOES) continue;
+        tendencia = 0;
+
+        produtores -= sinal;
+        consumidores += sinal;
+        clock_gettime(CLOCK_MONOTONIC, &agora);
+        printf("\033[1;35m[AUTOAJUSTE %.2fs] fila %.0f%% cheia, decodificação %.1f img/s, "
+               "transformação e codificação %.1f img/s: um %s vira %s (%d produtores, %d consumidores)%s\033[0m\n",
+               (agora.tv_sec - inicio.tv_sec) + (agora.tv_nsec - inicio.tv_nsec) / 1e9, 100.0 * ocupacao,
+               vazao_produtores, vazao_consumidores, sinal > 0 ? "produtor" : "consumidor",
+               sinal > 0 ? "consumidor" : "produtor", produtores, consumidores,
+               autoajuste.modo == AUTOAJUSTE_FIXO ? " [modo fixo: não aplicado]" : "");
+
+        pthread_mutex_lock(&autoajuste.mutex);
+        if (autoajuste.modo == AUTOAJUSTE_ATIVO) {
+            autoajuste.produtores_ativos = produtores;
+            autoajuste.consumidores_ativos = consumidores;
+            if (sinal > 0) autoajuste.movidos_para_consumidores++;
+            else autoajuste.movidos_para_produtores++;
+            pthread_cond_broadcast(&autoajuste.mudou);
+        } else {
+            autoajuste.decisoes_nao_aplicadas++;
+        }
+        pthread_mutex_unlock(&autoajuste.mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Retira o próximo arquivo da varredura para um produtor
+ * @param args Argumentos da thread produtora
+ * @param entrada Recebe a entrada retirada (o chamador libera entrada->caminho)
+ * @param bloquear Se 0, não espera por uma vaga na saída ordenada
+ * @return 1 se um arquivo foi retirado, 0 no fim da varredura, -1 se não há vaga
+ * 
+ * Com a saída ordenada, cada arquivo ocupa uma vaga da reordenação desde
+ * que sai da varredura até ser gravado, o que limita quantas imagens
+ * prontas podem se acumular atrás de uma imagem lenta.
+ */
+int produtor_obter_entrada(ThreadArgs* args, EntradaArquivo* entrada, int bloquear) {
+    if (reordenacao_saida) {
+        if (!bloquear && !reordenacao_tentar_reservar(reordenacao_saida)) return -1;
+        if (bloquear) reordenacao_reservar(reordenacao_saida);
+    }
+    if (!lista_varredura_obter(args->lista, entrada)) {
+        if (reordenacao_saida) reordenacao_liberar_vaga(reordenacao_saida);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Registra que um arquivo retirado da varredura não terá saída
+ * @param entrada Entrada descartada (erro de leitura ou decodificação)
+ * 
+ * Na saída ordenada, o arquivo ainda precisa passar pela reordenação para
+ * que os seguintes não fiquem esperando por ele.
+ */
+void produtor_descartar(const EntradaArquivo* entrada) {
+    deduplicacao_concluir(entrada->caminho, &entrada->origem, NULL);
+    if (reordenacao_saida) reordenacao_entregar(reordenacao_saida, entrada->sequencia, NULL);
+}
+
+/**
+ * @brief Tenta atender um arquivo com um resultado do cache, sem decodificá-lo
+ * @param args Argumentos da thread produtora
+ * @param entrada Entrada da varredura (recebe o hash do conteúdo, se ainda não calculado)
+ * @param buffer Conteúdo do arquivo, se já lido pelo motor de E/S (ou NULL)
+ * @param tamanho Bytes em buffer
+ * @return 1 se o arquivo foi atendido pelo cache, 0 se deve ser processado
+ * 
+ * O hash do conteúdo fica na origem da entrada e acompanha a imagem até o
+ * consumidor, que o usa para guardar o resultado no cache.
+ */
+int produtor_atender_do_cache(ThreadArgs* args, EntradaArquivo* entrada, const unsigned char* buffer, size_t tamanho) {
+    if (!cache_resultados) return 0;
+
+    if (buffer) {
+        entrada->origem.hash_conteudo = hash_rapido(buffer, tamanho, 0);
+    } else if (!entrada->origem.hash_conteudo &&
+               hash_conteudo_arquivo(AT_FDCWD, entrada->caminho, &entrada->origem.hash_conteudo) != 0) {
+        entrada->origem.hash_conteudo = 0;
+        return 0;
+    }
+
+    char caminho_saida[PATH_MAX];
+    const char* relativo = caminho_relativo(entrada->caminho, args->diretorio_entrada);
+    if (snprintf(caminho_saida, sizeof(caminho_saida), "%s/%s", args->diretorio_saida, relativo) >= (int)sizeof(caminho_saida)) {
+        return 0;
+    }
+    uint64_t chave = cache_procurar(cache_resultados, entrada->origem.hash_conteudo, caminho_saida);
+    if (!chave) return 0;
+
+    if (reordenacao_saida) {
+        // Saída ordenada: o resultado é reaproveitado na vez do arquivo
+        SaidaOrdenada* saida = (SaidaOrdenada*)calloc(1, sizeof(SaidaOrdenada));
+        if (!saida || montar_caminho_saida(entrada->caminho, args->diretorio_entrada, args->diretorio_saida,
+                                           saida->caminho, sizeof(saida->caminho)) != 0) {
+            free(saida);
+            return 0;
+        }
+        snprintf(saida->nome, sizeof(saida->nome), "%s", entrada->caminho);
+        saida->relativo = caminho_relativo(saida->nome, args->diretorio_entrada);
+        saida->origem = entrada->origem;
+        saida->chave_cache = chave;
+        reordenacao_entregar(reordenacao_saida, entrada->sequencia, saida);
+        return 1;
+    }
+
+    if (montar_caminho_saida(entrada->caminho, args->diretorio_entrada, args->diretorio_saida,
+                             caminho_saida, sizeof(caminho_saida)) != 0 ||
+        !cache_reaproveitar(cache_resultados, chave, caminho_saida)) {
+        return 0;
+    }
+    printf("Produtor %d: %s reaproveitado do cache em %s\n", args->thread_id, entrada->caminho, caminho_saida);
+    deduplicacao_concluir(entrada->caminho, &entrada->origem, caminho_saida);
+    if (indice_incremental) indice_registrar(indice_incremental, relativo, &entrada->origem);
+    return 1;
+}
+
+/**
+ * @brief Bytes que uma imagem decodificada mantém em voo até ser concluída
+ * @param largura Largura
+ * @param altura Altura
+ * @return Bytes dos pixels RGB, multiplicados pelo número de ramos
+ * 
+ * Com variantes, cada ramo pode ter um buffer próprio enquanto os demais
+ * ainda leem os pixels compartilhados.
+ */
+size_t bytes_em_voo(int largura, int altura) {
+    int ramos = config.num_variantes > 0 ? config.num_variantes : 1;
+    return (size_t)largura * altura * 3 * ramos;
+}
+
+/**
+ * @brief Reserva no orçamento de memória os pixels de uma imagem antes de decodificá-la
+ * @param caminho Arquivo (só o cabeçalho é lido), usado quando buffer é NULL
+ * @param buffer Conteúdo já lido pelo motor de E/S, ou NULL
+ * @param tamanho Bytes em buffer
+ * @return Bytes reservados; espera enquanto o orçamento estiver esgotado
+ * 
+ * Sem limite, o cabeçalho não é lido: a reserva é feita depois, com as
+ * dimensões reais (produtor_confirmar_reserva).
+ */
+size_t produtor_reservar_pixels(const char* caminho, const unsigned char* buffer, size_t tamanho) {
+    if (!orcamento_memoria.limite) return 0;
+    int largura = 0, altura = 0, canais = 0;
+    int lido = buffer ? stbi_info_from_memory(buffer, (int)tamanho, &largura, &altura, &canais)
+                      : stbi_info(caminho, &largura, &altura, &canais);
+    if (!lido) return 0;
+    size_t bytes = bytes_em_voo(largura, altura);
+    orcamento_reservar(bytes);
+    return bytes;
+}
+
+/**
+ * @brief Ajusta a reserva feita antes da decodificação às dimensões reais
+ * @param img Imagem decodificada (recebe a reserva), ou NULL se a decodificação falhou
+ * @param reservado Bytes reservados por produtor_reservar_pixels()
+ */
+void produtor_confirmar_reserva(Imagem* img, size_t reservado) {
+    size_t real = img ? bytes_em_voo(img->largura, img->altura) : 0;
+    orcamento_ajustar(reservado, real);
+    if (img) img->reserva = real;
+}
+
+// Lotes (--lote): com ícones e miniaturas, o lock e os semáforos da fila
+// custam tanto quanto a imagem. O produtor junta imagens pequenas e as insere
+// de uma vez, e o consumidor retira várias de uma vez e as processa em
+// sequência, o que também mantém o mesmo código quente no cache de instruções
+// e no preditor de desvios. Imagens grandes não se agrupam (LOTE_BYTES_MAX).
+#define MAX_LOTE 64
+#define LOTE_BYTES_MAX (1 << 20)  // Pixels somados de um lote
+
+typedef struct {
+    Imagem* imagens;  // config.lote imagens (alocadas no primeiro uso)
+    int num;
+    size_t bytes;
+} LoteProdutor;
+
+LoteProdutor lotes_produtores[MAX_PRODUTORES];
+
+// Estatísticas dos lotes (atualizadas com operações atômicas)
+typedef struct {
+    long inseridos;            // Inserções em lote dos produtores
+    long imagens_inseridas;
+    long retirados;            // Retiradas em lote dos consumidores
+    long imagens_retiradas;
+} EstatisticasLotes;
+
+EstatisticasLotes lotes_fila;
+
+/**
+ * @brief Contabiliza um lote
+ * @param lotes Contador de lotes
+ * @param imagens Contador de imagens
+ * @param n Imagens do lote
+ */
+void lotes_registrar(long* lotes, long* imagens, int n) {
+    __atomic_fetch_add(lotes, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(imagens, n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Informa se os produtores agrupam imagens antes de inseri-las
+ * @return 1 com --lote maior que 1
+ * 
+ * Na saída ordenada, uma imagem retida no lote poderia segurar a vaga de
+ * reordenação de que o próprio produtor precisa; no modo vigia, esperaria
+ * pelo próximo evento do diretório. Nos dois casos só os consumidores agrupam.
+ */
+int produtor_agrupa_lotes(void) {
+    return config.lote > 1 && !reordenacao_saida && !config.vigiar && !config.execucao_completa;
+}
+
+/**
+ * @brief Transforma, codifica e grava uma imagem na própria thread (--execucao=completa)
+ * @param args Argumentos da thread
+ * @param img Imagem carregada (seus pixels e sua reserva passam ao processamento)
+ * 
+ * Os pixels decodificados seguem direto para o processamento, ainda quentes
+ * no cache da CPU que os decodificou: sem cópia para a fila, sem Future e
+ * sem sincronização com outra thread.
+ */
+void concluir_na_thread(ThreadArgs* args, Imagem* img) {
+    Imagem local = *img;
+    img->dados = NULL;
+    img->reserva = 0;
+    orcamento_repassar(local.reserva);
+    consumir_imagem(args, &local, NULL);
+}
+
+/**
+ * @brief Insere na fila as imagens do lote do produtor
+ * @param args Argumentos da thread produtora
+ */
+void produtor_esvaziar_lote(ThreadArgs* args) {
+    LoteProdutor* lote = &lotes_produtores[args->thread_id];
+    if (lote->num == 0) return;
+
+    int inseridas = inserir_imagens_na_fila(fila_do_produtor(args), lote->imagens, lote->num);
+    lotes_registrar(&lotes_fila.inseridos, &lotes_fila.imagens_inseridas, inseridas);
+    printf("Produtor %d: lote de %d imagens inserido na fila\n", args->thread_id, inseridas);
+    for (int i = inseridas; i < lote->num; i++) {
+        Imagem* img = &lote->imagens[i];
+        EntradaArquivo entrada = { .caminho = img->nome, .origem = img->origem, .sequencia = img->sequencia };
+        free(img->dados);
+        orcamento_ajustar(img->reserva, 0);
+        produtor_descartar(&entrada);
+    }
+    lote->num = 0;
+    lote->bytes = 0;
+}
+
+/**
+ * @brief Acrescenta uma imagem ao lote do produtor, inserindo-o se ficar cheio
+ * @param args Argumentos da thread produtora
+ * @param img Imagem carregada (o lote assume os pixels e a reserva)
+ * @return 1 se a imagem entrou no lote, 0 se deve ser inserida sozinha
+ */
+int produtor_agrupar(ThreadArgs* args, Imagem* img) {
+    LoteProdutor* lote = &lotes_produtores[args->thread_id];
+    if (!lote->imagens) {
+        lote->imagens = (Imagem*)malloc(config.lote * sizeof(Imagem));
+        if (!lote->imagens) return 0;
+    }
+
+    lote->imagens[lote->num++] = *img;
+    lote->bytes += (size_t)img->largura * img->altura * img->canais;
+    img->dados = NULL;
+    img->reserva = 0;
+    if (lote->num == config.lote || lote->bytes >= LOTE_BYTES_MAX) produtor_esvaziar_lote(args);
+    return 1;
+}
+
+/**
+ * @brief Insere o lote do produtor se a próxima espera puder se prolongar
+ * @param args Argumentos da thread produtora
+ * 
+ * Sem arquivo pronto na varredura, ou sem vaga no autoajuste, o produtor
+ * pode ficar parado por tempo indefinido, e as imagens do lote não devem
+ * ficar paradas com ele.
+ */
+void produtor_lote_antes_de_esperar(ThreadArgs* args) {
+    if (lotes_produtores[args->thread_id].num == 0) return;
+    if (!lista_varredura_pronta(args->lista) || !autoajuste_aguardar_vaga(0, args->thread_id, 0)) {
+        produtor_esvaziar_lote(args);
+    }
+}
+
+/**
+ * @brief Insere na fila um ramo por variante, todos sobre a mesma decodificação
+ * @param args Argumentos da thread produtora
+ * @param img Imagem carregada (seus pixels passam a ser compartilhados)
+ * @param nome Nome do arquivo (para o log)
+ */
+void produtor_enfileirar_variantes(ThreadArgs* args, Imagem* img, const char* nome) {
+    DecodificacaoCompartilhada* dec = compartilhar_decodificacao(img, config.num_variantes, args->diretorio_entrada);
+    if (!dec) return;
+
+    // A reserva é dividida entre os ramos, e cada um devolve sua parte ao terminar
+    size_t parte = img->reserva / config.num_variantes;
+    size_t resto = img->reserva % config.num_variantes;
+    img->reserva = 0;
+
+    // Os ramos entram na fila juntos, sob um único lock (ou são processados aqui mesmo)
+    Imagem ramos[MAX_VARIANTES];
+    for (int i = 0; i < config.num_variantes; i++) {
+        ramos[i] = *img;
+        ramos[i].dados = NULL;
+        ramos[i].compartilhada = dec;
+        ramos[i].variante = i;
+        ramos[i].reserva = parte + (i == 0 ? resto : 0);
+        if (modelo_custo) ramos[i].custo_previsto = custo_ramo(i, dec->nome, dec->largura, dec->altura);
+    }
+    if (config.execucao_completa) {
+        for (int i = 0; i < config.num_variantes; i++) concluir_na_thread(args, &ramos[i]);
+        printf("Produtor %d: Imagem %s processada em %d variantes\n", args->thread_id, nome, config.num_variantes);
+        return;
+    }
+    int inseridos = inserir_imagens_na_fila(fila_do_produtor(args), ramos, config.num_variantes);
+    for (int i = inseridos; i < config.num_variantes; i++) {
+        orcamento_ajustar(ramos[i].reserva, 0);
+        conclusao_saida_registrar(dec->conclusao, NULL, 0);
+        decodificacao_concluir_ramo(dec, 0);
+    }
+    printf("Produtor %d: Imagem %s inserida na fila em %d variantes\n",
+           args->thread_id, nome, config.num_variantes);
+}
+
+/**
+ * @brief Insere na fila uma imagem carregada por um produtor
+ * @param args Argumentos da thread produtora
+ * @param img Imagem carregada (liberada ao final)
+ * @param entrada Entrada da varredura de onde a imagem veio
+ */
+void produtor_enfileirar(ThreadArgs* args, Imagem* img, const EntradaArquivo* entrada) {
+    const char* nome = strrchr(entrada->caminho, '/');
+    nome = nome ? nome + 1 : entrada->caminho;
+
+    if (indice_perceptual && indice_perceptual_verificar(indice_perceptual, img, entrada->caminho)) {
+        // Quase duplicata: a transformação e a codificação são poupadas
+        liberar_imagem_da_memoria(img);
+        produtor_descartar(entrada);
+        return;
+    }
+
+    img->produtor_id = args->thread_id;  // Define o ID do produtor
+    img->origem = entrada->origem;
+    img->sequencia = entrada->sequencia;
+    if (modelo_custo && config.num_variantes == 0) {
+        img->custo_previsto = custo_ramo(-1, img->nome, img->largura, img->altura);
+    }
+
+    if (config.num_variantes > 0) {
+        // Uma decodificação alimenta todas as variantes
+        produtor_enfileirar_variantes(args, img, nome);
+        liberar_imagem_da_memoria(img);
+        return;
+    }
+
+    if (config.execucao_completa) {
+        concluir_na_thread(args, img);
+        liberar_imagem_da_memoria(img);
+        return;
+    }
+
+    if (produtor_agrupa_lotes() && produtor_agrupar(args, img)) {
+        liberar_imagem_da_memoria(img);
+        return;
+    }
+
+    printf("Produtor %d: inserindo imagem %s na fila\n", 
+           args->thread_id, nome);
+    
+    if (inserir_imagem_na_fila(fila_do_produtor(args), img)) {
+        printf("Produtor %d: Imagem %s inserida na fila\n", 
+               args->thread_id, nome);
+    } else {
+        produtor_descartar(entrada);
+    }
+    
+    liberar_imagem_da_memoria(img);
+}
+
+/**
+ * @brief Laço do produtor quando o motor de E/S está ativo
+ * @param args Argumentos da thread produtora
+ * 
+ * Mantém uma janela de leituras em andamento no motor: enquanto a imagem
+ * mais antiga é decodificada, as seguintes já estão sendo lidas em lote.
+ */
+void produzir_com_motor_es(ThreadArgs* args) {
+    struct timespec inicio, fim;
+
+    // Divide a profundidade do motor entre os produtores
+    int janela = config.profundidade_es / config.num_produtores;
+    if (janela < 2) janela = 2;
+
+    RequisicaoES** leituras = (RequisicaoES**)malloc(janela * sizeof(RequisicaoES*));
+    EntradaArquivo* entradas = (EntradaArquivo*)malloc(janela * sizeof(EntradaArquivo));
+    if (!leituras || !entradas) {
+        perror("Erro ao alocar janela de leituras");
+        free(leituras);
+        free(entradas);
+        return;
+    }
+
+    int primeira = 0;
+    int em_andamento = 0;
+    int fim_lista = 0;
+
+    while (em_andamento > 0 || (executando && !fim_lista)) {
+        // Completa a janela com os próximos arquivos da varredura
+        while (executando && !fim_lista && em_andamento < janela) {
+            // Sem vaga no estágio, a janela se esvazia antes de a thread estacionar
+            if (!autoajuste_aguardar_vaga(0, args->thread_id, em_andamento == 0)) break;
+
+            // Com leituras na janela, o orçamento de memória esgotado
+            // interrompe o preenchimento: a mais antiga é decodificada antes
+            if (em_andamento > 0 && orcamento_esgotado()) break;
+
+            // Com leituras na janela, esperar por uma vaga da saída ordenada
+            // poderia travar: a vaga pode depender de uma delas
+            EntradaArquivo entrada;
+            int obtida = produtor_obter_entrada(args, &entrada, em_andamento == 0);
+            if (obtida < 0) break;
+            if (!obtida) {
+                fim_lista = 1;
+                break;
+            }
+
+            orcamento_reservar(entrada.origem.tamanho);
+            RequisicaoES* req = motor_es_ler(motor_es, entrada.caminho, entrada.origem.tamanho);
+            if (!req) {
+                orcamento_ajustar(entrada.origem.tamanho, 0);
+                produtor_descartar(&entrada);
+                free(entrada.caminho);
+                continue;
+            }
+            leituras[(primeira + em_andamento) % janela] = req;
+            entradas[(primeira + em_andamento) % janela] = entrada;
+            em_andamento++;
+        }
+        if (em_andamento == 0) break;
+
+        // Decodifica a leitura mais antiga da janela
+        RequisicaoES* req = leituras[primeira];
+        EntradaArquivo entrada = entradas[primeira];
+        primeira = (primeira + 1) % janela;
+        em_andamento--;
+
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+        int erro = motor_es_aguardar(req);
+        if (erro) {
+            printf("Erro ao ler arquivo %s: %s\n", req->caminho, strerror(erro));
+            produtor_descartar(&entrada);
+        } else if (!produtor_atender_do_cache(args, &entrada, req->buffer, req->transferidos)) {
+            size_t reservado = produtor_reservar_pixels(req->caminho, req->buffer, req->transferidos);
+            struct timespec inicio_decodificacao;
+            clock_gettime(CLOCK_MONOTONIC, &inicio_decodificacao);
+            Imagem* img = carregar_imagem_da_memoria(req->caminho, req->buffer, req->transferidos, args->thread_id);
+            produtor_confirmar_reserva(img, reservado);
+            if (img) {
+                img->chegada = inicio.tv_sec + inicio.tv_nsec / 1e9;
+                registrar_custo_decodificacao(img, &entrada, &inicio_decodificacao);
+                produtor_enfileirar(args, img, &entrada);
+            } else {
+                produtor_descartar(&entrada);
+            }
+        }
+        liberar_requisicao_es(req);
+        orcamento_ajustar(entrada.origem.tamanho, 0);
+        free(entrada.caminho);
+
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        double tempo = (fim.tv_sec - inicio.tv_sec) + 
+                      (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+        atualizar_metricas(args->thread_id, 0, tempo);
+
+        // Sem leituras na janela, a próxima volta pode esperar pela varredura
+        if (em_andamento == 0) produtor_lote_antes_de_esperar(args);
+    }
+
+    free(leituras);
+    free(entradas);
+}
+
+/**
+ * @brief Função executada por cada thread produtora
+ * @param arg Argumentos da thread (ThreadArgs*)
+ * @return NULL
+ * 
+ * A thread produtora:
+ * 1. Retira o próximo arquivo da lista de varredura
+ * 2. Carrega a imagem correspondente
+ * 3. Insere a imagem na fila
+ * 4. Registra métricas de desempenho
+ * 5. Registra sua ordem de finalização
+ */
+void* produtor(void* arg) {
+    ThreadArgs* args = (ThreadArgs*)arg;
+    EntradaArquivo entrada;
+    struct timespec inicio, fim;
+    
+    printf("Produtor %d iniciado\n", args->thread_id);
+    numa_fixar_thread(fragmentos.no[args->fragmento]);
+    
+    if (motor_es) {
+        produzir_com_motor_es(args);
+    }
+
+    while (!motor_es && autoajuste_aguardar_vaga(0, args->thread_id, 1) &&
+           produtor_obter_entrada(args, &entrada, 1) > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        
+        if (!produtor_atender_do_cache(args, &entrada, NULL, 0)) {
+            size_t reservado = produtor_reservar_pixels(entrada.caminho, NULL, 0);
+            struct timespec inicio_decodificacao;
+            clock_gettime(CLOCK_MONOTONIC, &inicio_decodificacao);
+            Imagem* img = carregar_imagem_do_disco(entrada.caminho, args->thread_id);
+            produtor_confirmar_reserva(img, reservado);
+            if (img) {
+                img->chegada = inicio.tv_sec + inicio.tv_nsec / 1e9;
+                registrar_custo_decodificacao(img, &entrada, &inicio_decodificacao);
+                produtor_enfileirar(args, img, &entrada);
+            } else {
+                produtor_descartar(&entrada);
+            }
+        }
+        free(entrada.caminho);
+        
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        double tempo = (fim.tv_sec - inicio.tv_sec) + 
+                      (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+        atualizar_metricas(args->thread_id, 0, tempo);
+        produtor_lote_antes_de_esperar(args);
+    }
+    
+    produtor_esvaziar_lote(args);
+    free(lotes_produtores[args->thread_id].imagens);
+    lotes_produtores[args->thread_id].imagens = NULL;
+    autoajuste_concluir_produtores();
+    registrar_finalizacao(args->thread_id, 0);
+    if (config.execucao_completa) registrar_finalizacao(args->thread_id, 1);
+    printf("Produtor %d finalizado\n", args->thread_id);
+    return NULL;
+}
+
+// Segmento de memória compartilhada atendido pelo pipeline
+typedef struct {
+    char nome[NAME_MAX];        // Nome do segmento (shm_open)
+    CabecalhoSegmento* segmento;
+    CabecalhoQuadro* quadros;
+    FilaImagens* fila;
+    // Geometria calculada na criação (o escritor pode corromper o cabeçalho)
+    uint32_t num_quadros;
+    size_t bytes_por_quadro;
+    size_t inicio_pixels;       // Deslocamento da área de pixels do primeiro quadro
+    size_t area_pixels;         // Distância entre as áreas de dois quadros
+    size_t tamanho;
+    // Estatísticas
+    long recebidos;             // Quadros retirados do segmento
+    long concluidos;            // Quadros devolvidos ao escritor
+    long invalidos;             // Quadros com dimensões fora da capacidade
+} MemoriaCompartilhada;
+
+// Segmento de memória compartilhada ativo (NULL quando desativado)
+MemoriaCompartilhada* memoria_compartilhada = NULL;
+
+/**
+ * @brief Aguarda enquanto *endereco == esperado (futex compartilhado entre processos)
+ * @param endereco Palavra do futex, dentro do segmento compartilhado
+ * @param esperado Valor observado antes de dormir
+ * @param timeout_ms Tempo máximo de espera
+ */
+void futex_esperar(uint32_t* endereco, uint32_t esperado, int timeout_ms) {
+    struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, endereco, FUTEX_WAIT, esperado, &timeout, NULL, 0);
+}
+
+/**
+ * @brief Acorda todos os que aguardam em um futex compartilhado
+ * @param endereco Palavra do futex
+ */
+void futex_acordar(uint32_t* endereco) {
+    syscall(SYS_futex, endereco, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @brief Normaliza o nome de um segmento para o shm_open ("/nome")
+ * @param nome Nome informado na linha de comando
+ * @param destino Buffer de saída
+ * @param tamanho Tamanho do buffer
+ */
+void nome_segmento(const char* nome, char* destino, size_t tamanho) {
+    snprintf(destino, tamanho, "%s%s", nome[0] == '/' ? "" : "/", nome);
+}
+
+/**
+ * @brief Cria o segmento de quadros e o publica para os escritores
+ * @param nome Nome do segmento (shm_open)
+ * @param num_quadros Número de quadros do anel
+ * @param largura_max Largura máxima de um quadro
+ * @param altura_max Altura máxima de um quadro
+ * @param fila Fila de imagens compartilhada
+ * @return Ponteiro para o segmento, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir o segmento usando
+ * destruir_memoria_compartilhada(), que também remove o nome.
+ */
+MemoriaCompartilhada* criar_memoria_compartilhada(const char* nome, int num_quadros, int largura_max,
+                                                  int altura_max, FilaImagens* fila) {
+    MemoriaCompartilhada* mc = (MemoriaCompartilhada*)calloc(1, sizeof(MemoriaCompartilhada));
+    if (!mc) {
+        perror("Erro ao alocar memória compartilhada");
+        return NULL;
+    }
+    nome_segmento(nome, mc->nome, sizeof(mc->nome));
+
+    size_t bytes_por_quadro = (size_t)largura_max * altura_max * 3;
+    size_t area_pixels = (bytes_por_quadro + 4095) & ~(size_t)4095;
+    size_t inicio_pixels = (sizeof(CabecalhoSegmento) + num_quadros * sizeof(CabecalhoQuadro) + 4095) & ~(size_t)4095;
+    size_t tamanho = inicio_pixels + num_quadros * area_pixels;
+
+    int fd = shm_open(mc->nome, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        // Segmento deixado por uma execução anterior
+        shm_unlink(mc->nome);
+        fd = shm_open(mc->nome, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    }
+    if (fd < 0 || ftruncate(fd, tamanho) != 0) {
+        printf("Erro ao criar memória compartilhada %s: %s\n", mc->nome, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(mc->nome);
+        }
+        free(mc);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("Erro ao mapear memória compartilhada %s: %s\n", mc->nome, strerror(errno));
+        shm_unlink(mc->nome);
+        free(mc);
+        return NULL;
+    }
+
+    mc->segmento = (CabecalhoSegmento*)base;
+    mc->quadros = (CabecalhoQuadro*)(mc->segmento + 1);
+    mc->fila = fila;
+    mc->num_quadros = num_quadros;
+    mc->bytes_por_quadro = bytes_por_quadro;
+    mc->inicio_pixels = inicio_pixels;
+    mc->area_pixels = area_pixels;
+    mc->tamanho = tamanho;
+    for (int i = 0; i < num_quadros; i++) {
+        mc->quadros[i].estado = QUADRO_LIVRE;
+        mc->quadros[i].deslocamento = inicio_pixels + i * area_pixels;
+    }
+    mc->segmento->num_quadros = num_quadros;
+    mc->segmento->bytes_por_quadro = bytes_por_quadro;
+    mc->segmento->tamanho_total = tamanho;
+    mc->segmento->versao = SEGMENTO_VERSAO;
+    // O magic é publicado por último: o escritor só confia no segmento depois dele
+    __atomic_store_n(&mc->segmento->magico, SEGMENTO_MAGICO, __ATOMIC_RELEASE);
+
+    return mc;
+}
+
+/**
+ * @brief Encerra o segmento, acorda os escritores e remove o nome
+ * @param mc Segmento a ser destruído (seguro com NULL)
+ */
+void destruir_memoria_compartilhada(MemoriaCompartilhada* mc) {
+    if (!mc) return;
+
+    __atomic_store_n(&mc->segmento->encerrado, 1, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < mc->num_quadros; i++) {
+        futex_acordar(&mc->quadros[i].estado);
+    }
+    shm_unlink(mc->nome);
+    munmap(mc->segmento, mc->tamanho);
+    free(mc);
+}
+
+/**
+ * @brief Devolve um quadro ao escritor
+ * @param quadro Quadro processado
+ * @param status 0 ou código errno
+ * 
+ * Depois desta chamada os pixels voltam a pertencer ao escritor e não
+ * podem mais ser acessados pelo pipeline.
+ */
+void concluir_quadro(CabecalhoQuadro* quadro, int status) {
+    quadro->status = status;
+    __atomic_store_n(&quadro->estado, QUADRO_CONCLUIDO, __ATOMIC_RELEASE);
+    futex_acordar(&quadro->estado);
+    if (memoria_compartilhada) {
+        __atomic_fetch_add(&memoria_compartilhada->concluidos, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Função executada pela thread que recebe quadros da memória compartilhada
+ * @param arg Ponteiro para MemoriaCompartilhada
+ * @return NULL
+ * 
+ * Dorme no futex "preenchidos" do segmento até o escritor entregar quadros.
+ * Cada quadro entra na fila como uma Imagem cujos pixels apontam para o
+ * próprio segmento: nem a fila nem o consumidor copiam os dados, e o
+ * consumidor transforma o quadro in-place e o devolve com concluir_quadro().
+ * O número de quadros em trânsito é limitado pelo tamanho do anel.
+ */
+void* receber_quadros(void* arg) {
+    MemoriaCompartilhada* mc = (MemoriaCompartilhada*)arg;
+    CabecalhoSegmento* segmento = mc->segmento;
+    uint32_t num_quadros = mc->num_quadros;
+    uint32_t proximo = 0;
+
+    printf("Aguardando quadros em %s (%u quadros de até %dx%d)\n", mc->nome, num_quadros,
+           config.largura_max_quadro, config.altura_max_quadro);
+
+    while (!encerramento_solicitado) {
+        uint32_t preenchidos = __atomic_load_n(&segmento->preenchidos, __ATOMIC_ACQUIRE);
+
+        // Procura o próximo quadro preenchido, em ordem circular
+        int encontrou = 0;
+        for (uint32_t k = 0; k < num_quadros; k++) {
+            uint32_t i = (proximo + k) % num_quadros;
+            CabecalhoQuadro* quadro = &mc->quadros[i];
+            uint32_t esperado = QUADRO_PREENCHIDO;
+            if (!__atomic_compare_exchange_n(&quadro->estado, &esperado, QUADRO_PROCESSANDO, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            proximo = (i + 1) % num_quadros;
+            encontrou = 1;
+            mc->recebidos++;
+
+            uint64_t largura = quadro->largura, altura = quadro->altura;
+            if (largura == 0 || altura == 0 || largura * altura * 3 > mc->bytes_por_quadro) {
+                mc->invalidos++;
+                concluir_quadro(quadro, EINVAL);
+                break;
+            }
+
+            Imagem img;
+            memset(&img, 0, sizeof(img));
+            snprintf(img.nome, sizeof(img.nome), "%s:%llu", mc->nome, (unsigned long long)quadro->sequencia);
+            img.largura = (int)largura;
+            img.altura = (int)altura;
+            img.canais = 3;
+            img.produtor_id = -1;
+            img.quadro = quadro;
+            // Usa a geometria da criação, não o deslocamento gravado no segmento
+            img.dados = (unsigned char*)segmento + mc->inicio_pixels + i * mc->area_pixels;
+            if (!inserir_imagem_na_fila(mc->fila, &img)) {
+                concluir_quadro(quadro, ENOMEM);
+            }
+            break;
+        }
+
+        if (!encontrou) futex_esperar(&segmento->preenchidos, preenchidos, 100);
+    }
+
+    printf("Recepção de quadros encerrada\n");
+    return NULL;
+}
+
+/**
+ * @brief Adia o pipeline configurado (--pipeline; padrão: cinza, inversão, brilho, contraste)
+ * @param img Imagem (os pixels são produzidos ao codificar ou por materializar_imagem())
+ */
+void aplicar_pipeline_padrao(Imagem* img) {
+    adiar_operacoes(img, config.pipeline, config.num_pipeline);
+}
+
+// Formatos do modo fluxo (--fluxo)
+#define FLUXO_DESATIVADO 0
+#define FLUXO_RAW 1   // rgb24 de tamanho fixo (--tamanho-quadro)
+#define FLUXO_Y4M 2   // YUV4MPEG2 8 bits (420, 422, 444 ou mono)
+#define FLUXO_PPM 3   // Sequência de PPM binários (P6, maxval 255)
+
+// Histograma de latência do fluxo: baldes de 0,1ms até 1s (o último acumula o resto)
+#define LATENCIA_BALDES 10000
+
+// Estado do modo fluxo: quadros lidos de stdin, processados em paralelo e
+// escritos em ordem em stdout
+typedef struct FluxoQuadros {
+    int formato;                // FLUXO_*
+    FILE* entrada;
+    FILE* saida;
+    FilaImagens* fila;
+    int largura;                // Dimensões dos quadros (raw e Y4M)
+    int altura;
+    int croma_h;                // Subamostragem horizontal da croma Y4M (0 = mono)
+    int croma_v;                // Subamostragem vertical da croma Y4M
+    size_t bytes_quadro;        // Bytes de um quadro de entrada (raw e Y4M)
+    char cabecalho_y4m[256];    // Cabeçalho do fluxo Y4M, repetido na saída
+    BufferReordenacao* reordenacao; // Quadros prontos (Imagem*) voltam à ordem de leitura
+    struct timespec* chegada;   // Instante em que cada quadro em voo foi lido, por sequência % capacidade
+    int capacidade;             // Quadros em voo (lidos e ainda não escritos)
+    unsigned long long lidos;
+    unsigned long long escritos;
+    pthread_mutex_t mutex;      // Protege os contadores
+    // Estatísticas
+    int em_voo_max;
+    unsigned int histograma[LATENCIA_BALDES + 1];
+    double latencia_total;
+    double latencia_max;
+    size_t bytes_lidos;
+    size_t bytes_escritos;
+    int erro_leitura;           // Entrada corrompida ou truncada (o processo termina com erro)
+    int erro_escrita;
+} FluxoQuadros;
+
+/**
+ * @brief Lê uma linha de texto do fluxo (cabeçalhos Y4M)
+ * @param arquivo Fluxo de entrada
+ * @param linha Destino (sem o '\n')
+ * @param tamanho Tamanho do destino
+ * @return 0 em caso de sucesso, -1 no fim do fluxo ou se a linha não cabe
+ */
+int ler_linha_fluxo(FILE* arquivo, char* linha, size_t tamanho) {
+    size_t n = 0;
+    int c;
+    while ((c = getc(arquivo)) != EOF && c != '\n') {
+        if (n + 1 >= tamanho) return -1;
+        linha[n++] = (char)c;
+    }
+    linha[n] = '\0';
+    return (c == EOF && n == 0) ? -1 : 0;
+}
+
+/**
+ * @brief Lê um inteiro do cabeçalho de um PPM, pulando espaços e comentários
+ * @param arquivo Fluxo de entrada
+ * @param valor Valor lido
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int ler_inteiro_ppm(FILE* arquivo, int* valor) {
+    int c;
+    while ((c = getc(arquivo)) != EOF) {
+        if (c == '#') {
+            while ((c = getc(arquivo)) != EOF && c != '\n');
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+    }
+    if (c < '0' || c > '9') return -1;
+    *valor = 0;
+    while (c >= '0' && c <= '9') {
+        if (*valor > 100000) return -1;
+        *valor = *valor * 10 + (c - '0');
+        c = getc(arquivo);
+    }
+    // O espaço em branco após o número já foi consumido: depois do maxval começam os dados
+    return 0;
+}
+
+/**
+ * @brief Cria o estado do modo fluxo e lê o cabeçalho do Y4M, se houver
+ * @param formato FLUXO_RAW, FLUXO_Y4M ou FLUXO_PPM
+ * @param entrada Fluxo de entrada (stdin)
+ * @param saida Fluxo de saída (o stdout original)
+ * @param em_voo Máximo de quadros lidos e ainda não escritos
+ * @param fila Fila de imagens compartilhada
+ * @return Ponteiro para o fluxo, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir o fluxo usando destruir_fluxo().
+ */
+FluxoQuadros* criar_fluxo(int formato, FILE* entrada, FILE* saida, int em_voo, FilaImagens* fila) {
+    FluxoQuadros* fluxo = (FluxoQuadros*)calloc(1, sizeof(FluxoQuadros));
+    if (!fluxo) {
+        perror("Erro ao alocar fluxo");
+        return NULL;
+    }
+    fluxo->formato = formato;
+    fluxo->entrada = entrada;
+    fluxo->saida = saida;
+    fluxo->fila = fila;
+    fluxo->capacidade = em_voo;
+    fluxo->largura = config.largura_max_quadro;
+    fluxo->altura = config.altura_max_quadro;
+    fluxo->croma_h = fluxo->croma_v = 1;
+
+    if (formato == FLUXO_Y4M) {
+        char cabecalho[sizeof(fluxo->cabecalho_y4m)];
+        if (ler_linha_fluxo(entrada, cabecalho, sizeof(cabecalho)) != 0 ||
+            strncmp(cabecalho, "YUV4MPEG2 ", 10) != 0) {
+            printf("Entrada não é um fluxo YUV4MPEG2\n");
+            free(fluxo);
+            return NULL;
+        }
+        snprintf(fluxo->cabecalho_y4m, sizeof(fluxo->cabecalho_y4m), "%s", cabecalho);
+
+        fluxo->croma_h = fluxo->croma_v = 2;  // C420 é o padrão do formato
+        char* contexto = NULL;
+        for (char* campo = strtok_r(cabecalho + 10, " ", &contexto); campo; campo = strtok_r(NULL, " ", &contexto)) {
+            if (campo[0] == 'W') {
+                fluxo->largura = atoi(campo + 1);
+            } else if (campo[0] == 'H') {
+                fluxo->altura = atoi(campo + 1);
+            } else if (campo[0] == 'C') {
+                if (strncmp(campo, "C420", 4) == 0 && (campo[4] == '\0' || isalpha((unsigned char)campo[4]))) {
+                    fluxo->croma_h = fluxo->croma_v = 2;
+                } else if (strcmp(campo, "C422") == 0) {
+                    fluxo->croma_h = 2;
+                    fluxo->croma_v = 1;
+                } else if (strcmp(campo, "C444") == 0) {
+                    fluxo->croma_h = fluxo->croma_v = 1;
+                } else if (strcmp(campo, "Cmono") == 0) {
+                    fluxo->croma_h = fluxo->croma_v = 0;
+                } else {
+                    printf("Espaço de cor Y4M não suportado: %s (use 420, 422, 444 ou mono de 8 bits)\n", campo + 1);
+                    free(fluxo);
+                    return NULL;
+                }
+            }
+        }
+        if (fluxo->largura <= 0 || fluxo->altura <= 0) {
+            printf("Cabeçalho Y4M sem dimensões válidas\n");
+            free(fluxo);
+            return NULL;
+        }
+    }
+
+    size_t luma = (size_t)fluxo->largura * fluxo->altura;
+    if (formato == FLUXO_Y4M) {
+        size_t croma = fluxo->croma_h ? (size_t)((fluxo->largura + fluxo->croma_h - 1) / fluxo->croma_h) *
+                                        ((fluxo->altura + fluxo->croma_v - 1) / fluxo->croma_v) : 0;
+        fluxo->bytes_quadro = luma + 2 * croma;
+    } else {
+        fluxo->bytes_quadro = luma * 3;
+    }
+
+    fluxo->chegada = (struct timespec*)calloc(em_voo, sizeof(struct timespec));
+    fluxo->reordenacao = criar_reordenacao(em_voo);
+    if (!fluxo->chegada || !fluxo->reordenacao) {
+        perror("Erro ao alocar buffer de reordenação");
+        free(fluxo->chegada);
+        destruir_reordenacao(fluxo->reordenacao, NULL);
+        free(fluxo);
+        return NULL;
+    }
+    pthread_mutex_init(&fluxo->mutex, NULL);
+    return fluxo;
+}
+
+/**
+ * @brief Libera um quadro que ficou no buffer de reordenação
+ * @param item Ponteiro para Imagem
+ */
+void liberar_quadro_fluxo(void* item) {
+    Imagem* img = (Imagem*)item;
+    free(img->dados);
+    free(img);
+}
+
+/**
+ * @brief Destrói o estado do modo fluxo
+ * @param fluxo Fluxo a ser destruído (seguro com NULL)
+ */
+void destruir_fluxo(FluxoQuadros* fluxo) {
+    if (!fluxo) return;
+
+    destruir_reordenacao(fluxo->reordenacao, liberar_quadro_fluxo);
+    free(fluxo->chegada);
+    pthread_mutex_destroy(&fluxo->mutex);
+    free(fluxo);
+}
+
+/**
+ * @brief Lê o próximo quadro do fluxo de entrada
+ * @param fluxo Fluxo
+ * @param img Recebe o quadro (dados alocados; em RGB, ou YUV planar no Y4M)
+ * @return 1 se um quadro foi lido, 0 no fim do fluxo ou em caso de erro
+ */
+int ler_quadro_fluxo(FluxoQuadros* fluxo, Imagem* img) {
+    FILE* entrada = fluxo->entrada;
+    img->largura = fluxo->largura;
+    img->altura = fluxo->altura;
+    img->canais = 3;
+    size_t bytes = fluxo->bytes_quadro;
+
+    if (fluxo->formato == FLUXO_Y4M) {
+        char linha[256];
+        if (ler_linha_fluxo(entrada, linha, sizeof(linha)) != 0) return 0;
+        if (strncmp(linha, "FRAME", 5) != 0) {
+            printf("Fluxo Y4M corrompido: esperado FRAME\n");
+            fluxo->erro_leitura = 1;
+            return 0;
+        }
+    } else if (fluxo->formato == FLUXO_PPM) {
+        int c1 = getc(entrada);
+        if (c1 == EOF) return 0;
+        int c2 = getc(entrada);
+        int maximo;
+        if (c1 != 'P' || c2 != '6' || ler_inteiro_ppm(entrada, &img->largura) != 0 ||
+            ler_inteiro_ppm(entrada, &img->altura) != 0 || ler_inteiro_ppm(entrada, &maximo) != 0 ||
+            img->largura <= 0 || img->altura <= 0) {
+            printf("Fluxo PPM corrompido (esperado P6)\n");
+            fluxo->erro_leitura = 1;
+            return 0;
+        }
+        if (maximo != 255) {
+            printf("PPM com maxval %d não suportado (use 255)\n", maximo);
+            fluxo->erro_leitura = 1;
+            return 0;
+        }
+        bytes = (size_t)img->largura * img->altura * 3;
+    }
+
+    img->dados = (unsigned char*)malloc(bytes);
+    if (!img->dados) {
+        perror("Erro ao alocar quadro");
+        fluxo->erro_leitura = 1;
+        return 0;
+    }
+    size_t lidos = fread(img->dados, 1, bytes, entrada);
+    if (lidos != bytes) {
+        // Um fluxo que termina entre quadros acabou bem; no meio de um, foi truncado
+        if (lidos > 0 || fluxo->formato != FLUXO_RAW) {
+            printf("Quadro incompleto no fim do fluxo (%zu de %zu bytes)\n", lidos, bytes);
+            fluxo->erro_leitura = 1;
+        }
+        free(img->dados);
+        img->dados = NULL;
+        return 0;
+    }
+    fluxo->bytes_lidos += bytes;
+    return 1;
+}
+
+/**
+ * @brief Função executada pela thread que lê o fluxo de entrada
+ * @param arg Ponteiro para FluxoQuadros
+ * @return NULL
+ * 
+ * Faz o papel de produtor: numera os quadros na ordem de leitura e os
+ * insere na fila. As vagas da reordenação impedem que mais de capacidade
+ * quadros estejam em voo, o que limita a memória e a latência.
+ */
+void* ler_fluxo(void* arg) {
+    FluxoQuadros* fluxo = (FluxoQuadros*)arg;
+
+    for (unsigned long long sequencia = 0; ; sequencia++) {
+        reordenacao_reservar(fluxo->reordenacao);
+
+        Imagem img;
+        memset(&img, 0, sizeof(img));
+        if (!ler_quadro_fluxo(fluxo, &img)) {
+            reordenacao_liberar_vaga(fluxo->reordenacao);
+            break;
+        }
+
+        snprintf(img.nome, sizeof(img.nome), "quadro:%llu", sequencia);
+        img.produtor_id = -1;
+        img.sequencia = sequencia;
+        img.fluxo = fluxo;
+
+        pthread_mutex_lock(&fluxo->mutex);
+        clock_gettime(CLOCK_MONOTONIC, &fluxo->chegada[sequencia % fluxo->capacidade]);
+        fluxo->lidos++;
+        int em_voo = (int)(fluxo->lidos - fluxo->escritos);
+        if (em_voo > fluxo->em_voo_max) fluxo->em_voo_max = em_voo;
+        pthread_mutex_unlock(&fluxo->mutex);
+
+        if (!inserir_imagem_na_fila(fluxo->fila, &img)) {
+            // O quadro não sai: o fluxo termina aqui para não travar a reordenação
+            free(img.dados);
+            pthread_mutex_lock(&fluxo->mutex);
+            fluxo->lidos--;
+            pthread_mutex_unlock(&fluxo->mutex);
+            reordenacao_liberar_vaga(fluxo->reordenacao);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&fluxo->mutex);
+    unsigned long long total = fluxo->lidos;
+    pthread_mutex_unlock(&fluxo->mutex);
+    reordenacao_concluir(fluxo->reordenacao, total);
+    return NULL;
+}
+
+/**
+ * @brief Limita um valor ao intervalo de um byte
+ */
+unsigned char saturar(float valor) {
+    return (unsigned char)(valor > 255.0f ? 255 : (valor < 0.0f ? 0 : (int)(valor + 0.5f)));
+}
+
+/**
+ * @brief Converte um quadro YUV planar (Y4M) para RGB
+ * @param fluxo Fluxo (dimensões e subamostragem)
+ * @param yuv Planos Y, U e V
+ * @param rgb Destino, largura * altura * 3 bytes
+ * 
+ * Usa BT.601 em faixa limitada, como o rawvideo yuv420p do ffmpeg.
+ */
+void yuv_para_rgb(const FluxoQuadros* fluxo, const unsigned char* yuv, unsigned char* rgb) {
+    int largura = fluxo->largura, altura = fluxo->altura;
+    int largura_croma = fluxo->croma_h ? (largura + fluxo->croma_h - 1) / fluxo->croma_h : 0;
+    int altura_croma = fluxo->croma_v ? (altura + fluxo->croma_v - 1) / fluxo->croma_v : 0;
+    const unsigned char* plano_u = yuv + (size_t)largura * altura;
+    const unsigned char* plano_v = plano_u + (size_t)largura_croma * altura_croma;
+
+    for (int y = 0; y < altura; y++) {
+        for (int x = 0; x < largura; x++) {
+            float l = 1.164f * (yuv[(size_t)y * largura + x] - 16);
+            float u = 0.0f, v = 0.0f;
+            if (fluxo->croma_h) {
+                size_t c = (size_t)(y / fluxo->croma_v) * largura_croma + x / fluxo->croma_h;
+                u = plano_u[c] - 128.0f;
+                v = plano_v[c] - 128.0f;
+            }
+            unsigned char* pixel = &rgb[((size_t)y * largura + x) * 3];
+            pixel[0] = saturar(l + 1.596f * v);
+            pixel[1] = saturar(l - 0.392f * u - 0.813f * v);
+            pixel[2] = saturar(l + 2.017f * u);
+        }
+    }
+}
+
+/**
+ * @brief Converte um quadro RGB de volta para YUV planar (Y4M)
+ * @param fluxo Fluxo (dimensões e subamostragem)
+ * @param rgb Quadro RGB
+ * @param yuv Destino, fluxo->bytes_quadro bytes
+ * 
+ * A croma de cada bloco subamostrado é a média dos pixels do bloco.
+ */
+void rgb_para_yuv(const FluxoQuadros* fluxo, const unsigned char* rgb, unsigned char* yuv) {
+    int largura = fluxo->largura, altura = fluxo->altura;
+
+    for (size_t i = 0; i < (size_t)largura * altura; i++) {
+        const unsigned char* pixel = &rgb[i * 3];
+        yuv[i] = saturar(16.0f + 0.257f * pixel[0] + 0.504f * pixel[1] + 0.098f * pixel[2]);
+    }
+    if (!fluxo->croma_h) return;
+
+    int largura_croma = (largura + fluxo->croma_h - 1) / fluxo->croma_h;
+    int altura_croma = (altura + fluxo->croma_v - 1) / fluxo->croma_v;
+    unsigned char* plano_u = yuv + (size_t)largura * altura;
+    unsigned char* plano_v = plano_u + (size_t)largura_croma * altura_croma;
+
+    for (int cy = 0; cy < altura_croma; cy++) {
+        for (int cx = 0; cx < largura_croma; cx++) {
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+            int n = 0;
+            for (int y = cy * fluxo->croma_v; y < (cy + 1) * fluxo->croma_v && y < altura; y++) {
+                for (int x = cx * fluxo->croma_h; x < (cx + 1) * fluxo->croma_h && x < largura; x++) {
+                    const unsigned char* pixel = &rgb[((size_t)y * largura + x) * 3];
+                    r += pixel[0];
+                    g += pixel[1];
+                    b += pixel[2];
+                    n++;
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            plano_u[(size_t)cy * largura_croma + cx] = saturar(128.0f - 0.148f * r - 0.291f * g + 0.439f * b);
+            plano_v[(size_t)cy * largura_croma + cx] = saturar(128.0f + 0.439f * r - 0.368f * g - 0.071f * b);
+        }
+    }
+}
+
+/**
+ * @brief Processa um quadro do fluxo e o entrega à reordenação
+ * @param img Quadro retirado da fila (o buffer passa para o fluxo)
+ * 
+ * Quadros Y4M são convertidos para RGB antes das operações e de volta para
+ * YUV depois, no próprio consumidor, para que a conversão também rode em
+ * paralelo.
+ */
+void processar_quadro_fluxo(Imagem* img) {
+    FluxoQuadros* fluxo = img->fluxo;
+
+    if (fluxo->formato == FLUXO_Y4M && img->dados) {
+        unsigned char* rgb = (unsigned char*)malloc((size_t)img->largura * img->altura * 3);
+        if (rgb) yuv_para_rgb(fluxo, img->dados, rgb);
+        free(img->dados);
+        img->dados = rgb;
+    }
+
+    aplicar_pipeline_padrao(img);
+    if (!materializar_imagem(img)) {
+        free(img->dados);
+        img->dados = NULL;
+    }
+
+    if (fluxo->formato == FLUXO_Y4M && img->dados) {
+        unsigned char* yuv = (unsigned char*)malloc(fluxo->bytes_quadro);
+        if (yuv) rgb_para_yuv(fluxo, img->dados, yuv);
+        free(img->dados);
+        img->dados = yuv;
+    }
+
+    // Um quadro sem dados (falta de memória) ainda ocupa sua vez na saída
+    Imagem* pronto = (Imagem*)malloc(sizeof(Imagem));
+    if (pronto) {
+        *pronto = *img;
+    } else {
+        free(img->dados);
+    }
+    reordenacao_entregar(fluxo->reordenacao, img->sequencia, pronto);
+    img->dados = NULL;
+}
+
+/**
+ * @brief Escreve um quadro processado no fluxo de saída
+ * @param fluxo Fluxo
+ * @param img Quadro processado
+ * @return 0 em caso de sucesso, -1 em caso de erro de escrita
+ */
+int escrever_quadro_fluxo(FluxoQuadros* fluxo, const Imagem* img) {
+    size_t bytes = fluxo->formato == FLUXO_Y4M ? fluxo->bytes_quadro : (size_t)img->largura * img->altura * 3;
+
+    if (fluxo->formato == FLUXO_Y4M) {
+        fputs("FRAME\n", fluxo->saida);
+    } else if (fluxo->formato == FLUXO_PPM) {
+        fprintf(fluxo->saida, "P6\n%d %d\n255\n", img->largura, img->altura);
+    }
+    if (fwrite(img->dados, 1, bytes, fluxo->saida) != bytes || fflush(fluxo->saida) != 0) return -1;
+    fluxo->bytes_escritos += bytes;
+    return 0;
+}
+
+/**
+ * @brief Função executada pela thread que escreve o fluxo de saída
+ * @param arg Ponteiro para FluxoQuadros
+ * @return NULL
+ * 
+ * Espera o próximo quadro na ordem de leitura (os consumidores terminam
+ * fora de ordem), escreve, registra a latência desde a leitura e libera
+ * uma vaga para o leitor. Termina depois do último quadro lido.
+ */
+void* escrever_fluxo(void* arg) {
+    FluxoQuadros* fluxo = (FluxoQuadros*)arg;
+
+    if (fluxo->formato == FLUXO_Y4M) {
+        fprintf(fluxo->saida, "%s\n", fluxo->cabecalho_y4m);
+    }
+
+    void* item;
+    while (reordenacao_retirar(fluxo->reordenacao, &item)) {
+        Imagem* img = (Imagem*)item;
+        pthread_mutex_lock(&fluxo->mutex);
+        struct timespec chegada = fluxo->chegada[fluxo->escritos % fluxo->capacidade];
+        pthread_mutex_unlock(&fluxo->mutex);
+
+        // Depois de um erro de escrita (ex: leitor do pipe fechou), só descarta
+        if (!img || !img->dados) {
+            printf("Quadro %llu descartado (sem memória)\n", fluxo->escritos);
+        } else if (!fluxo->erro_escrita && escrever_quadro_fluxo(fluxo, img) != 0) {
+            printf("Erro ao escrever na saída: %s\n", strerror(errno));
+            fluxo->erro_escrita = 1;
+        }
+        if (img) liberar_quadro_fluxo(img);
+
+        struct timespec agora;
+        clock_gettime(CLOCK_MONOTONIC, &agora);
+        double latencia = (agora.tv_sec - chegada.tv_sec) + (agora.tv_nsec - chegada.tv_nsec) / 1e9;
+        int balde = (int)(latencia * 1e4);
+        fluxo->histograma[balde < LATENCIA_BALDES ? balde : LATENCIA_BALDES]++;
+        fluxo->latencia_total += latencia;
+        if (latencia > fluxo->latencia_max) fluxo->latencia_max = latencia;
+
+        pthread_mutex_lock(&fluxo->mutex);
+        fluxo->escritos++;
+        pthread_mutex_unlock(&fluxo->mutex);
+        reordenacao_liberar_vaga(fluxo->reordenacao);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Calcula um percentil da latência a partir do histograma do fluxo
+ * @param fluxo Fluxo
+ * @param fracao Percentil desejado (ex: 0.99)
+ * @return Latência em segundos (limite superior do balde, sem passar da máxima observada)
+ */
+double percentil_latencia_fluxo(const FluxoQuadros* fluxo, double fracao) {
+    unsigned long long alvo = (unsigned long long)ceil(fracao * fluxo->escritos);
+    unsigned long long acumulado = 0;
+    for (int i = 0; i <= LATENCIA_BALDES; i++) {
+        acumulado += fluxo->histograma[i];
+        if (acumulado >= alvo && acumulado > 0) {
+            double limite = (i + 1) / 1e4;
+            return limite < fluxo->latencia_max ? limite : fluxo->latencia_max;
+        }
+    }
+    return fluxo->latencia_max;
+}
+
+/**
+ * @brief Processa um job do modo servidor retirado da fila
+ * @param img Imagem do job (img->trabalho preenchido)
+ * 
+ * Aplica as operações pedidas, codifica o resultado em memória e acorda a
+ * conexão que aguarda o job. O TrabalhoServidor pertence à conexão.
+ */
+void concluir_trabalho_servidor(Imagem* img) {
+    TrabalhoServidor* trabalho = img->trabalho;
+
+    if (!img->dados) {
+        trabalho->status = ENOMEM;
+    } else {
+        adiar_operacoes(img, trabalho->operacoes, trabalho->num_operacoes);
+        if (!codificar_imagem(img, trabalho->extensao, escrever_no_buffer, &trabalho->resultado) ||
+            trabalho->resultado.erro) {
+            trabalho->status = EIO;
+        }
+    }
+    definir_resultado_future(trabalho->future, NULL);
+}
+
+/**
+ * @brief Codifica uma imagem processada e a entrega à saída ordenada
+ * @param img Imagem processada
+ * @param diretorio_entrada Diretório de entrada
+ * @param diretorio_saida Diretório de saída
+ * 
+ * A codificação continua paralela nos consumidores; só a gravação é
+ * serializada, na ordem da varredura. Em caso de erro a vez da imagem é
+ * entregue vazia.
+ */
+void entregar_saida_ordenada(Imagem* img, const char* diretorio_entrada, const char* diretorio_saida) {
+    SaidaOrdenada* saida = (SaidaOrdenada*)calloc(1, sizeof(SaidaOrdenada));
+    if (!saida || !img->dados ||
+        montar_caminho_saida(img->nome, diretorio_entrada, diretorio_saida, saida->caminho, sizeof(saida->caminho)) != 0) {
+        free(saida);
+        deduplicacao_concluir(img->nome, &img->origem, NULL);
+        reordenacao_entregar(reordenacao_saida, img->sequencia, NULL);
+        return;
+    }
+    snprintf(saida->nome, sizeof(saida->nome), "%s", img->nome);
+    saida->relativo = caminho_relativo(saida->nome, diretorio_entrada);
+    saida->origem = img->origem;
+
+    const char* nome_arquivo = strrchr(saida->caminho, '/') + 1;
+    if (!codificar_imagem(img, strrchr(nome_arquivo, '.'), escrever_no_buffer, &saida->dados) || saida->dados.erro) {
+        printf("Erro ao codificar imagem: %s\n", saida->caminho);
+        liberar_saida_ordenada(saida);
+        saida = NULL;
+        deduplicacao_concluir(img->nome, &img->origem, NULL);
+    }
+    reordenacao_entregar(reordenacao_saida, img->sequencia, saida);
+}
+
+/**
+ * @brief Função executada pela thread que grava a saída ordenada
+ * @param arg Ponteiro para o BufferReordenacao
+ * @return NULL
+ * 
+ * Grava as imagens estritamente na ordem da varredura, registra cada uma
+ * no índice incremental e devolve a vaga para os produtores. Termina depois
+ * da última imagem retirada da varredura.
+ */
+void* escrever_saida_ordenada(void* arg) {
+    BufferReordenacao* reordenacao = (BufferReordenacao*)arg;
+    void* item;
+
+    while (reordenacao_retirar(reordenacao, &item)) {
+        SaidaOrdenada* saida = (SaidaOrdenada*)item;
+        if (!saida) {
+            saidas_ordenadas_descartadas++;
+            reordenacao_liberar_vaga(reordenacao);
+            continue;
+        }
+
+        int sucesso;
+        if (saida->chave_cache) {
+            sucesso = cache_reaproveitar(cache_resultados, saida->chave_cache, saida->caminho);
+        } else if (cache_resultados && saida->origem.hash_conteudo &&
+                   cache_guardar(cache_resultados, saida->origem.hash_conteudo, saida->caminho,
+                                 saida->dados.dados, saida->dados.tamanho)) {
+            sucesso = 1;
+        } else {
+            sucesso = gravar_arquivo(saida->caminho, saida->dados.dados, saida->dados.tamanho);
+        }
+
+        if (!sucesso) {
+            printf("Erro ao salvar imagem: %s\n", saida->caminho);
+            saidas_ordenadas_descartadas++;
+            deduplicacao_concluir(saida->nome, &saida->origem, NULL);
+        } else {
+            printf("Imagem salva com sucesso: %s\n", saida->caminho);
+            saidas_ordenadas_escritas++;
+            saida_gravada(saida->nome, saida->relativo, &saida->origem, saida->caminho);
+        }
+        liberar_saida_ordenada(saida);
+        reordenacao_liberar_vaga(reordenacao);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Processa uma imagem retirada da fila por um consumidor
+ * @param args Argumentos da thread consumidora
+ * @param img Imagem retirada (o consumidor é dono dos pixels, liberados ao final)
+ * @param future Future da imagem, ou NULL
+ */
+void consumir_imagem(ThreadArgs* args, Imagem* img, Future* future) {
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    double megapixels = (double)img->largura * img->altura / 1e6;
+    
+    printf("Consumidor %d: Processando imagem %s\n", 
+           args->thread_id, img->nome);
+
+    // Formato da saída, para comparar o custo medido ao previsto
+    int formato_custo = modelo_custo && img->custo_previsto > 0 ?
+                        formato_saida_ramo(img->compartilhada ? img->variante : -1, img->nome) : -1;
+    
+    if (img->trabalho) {
+        // Job do servidor: operações próprias, resultado devolvido pelo socket
+        concluir_trabalho_servidor(img);
+    } else if (img->fluxo) {
+        // Quadro do modo fluxo: segue para a reordenação e para o stdout
+        processar_quadro_fluxo(img);
+    } else if (img->compartilhada) {
+        // Ramo de uma variante: pixels compartilhados com os demais ramos
+        processar_variante(img, args->diretorio_entrada, args->diretorio_saida);
+    } else {
+        // Processa a imagem
+        aplicar_pipeline_padrao(img);
+        
+        if (img->quadro) {
+            // Quadro da memória compartilhada: transformado in-place, volta ao escritor
+            concluir_quadro(img->quadro, materializar_imagem(img) ? 0 : ENOMEM);
+            img->dados = NULL;
+        } else if (reordenacao_saida) {
+            // Saída ordenada: codifica aqui, a gravação segue a ordem da varredura
+            entregar_saida_ordenada(img, args->diretorio_entrada, args->diretorio_saida);
+        } else {
+            // Salva a imagem processada (passando pelo cache, se ativo)
+            int salva = cache_resultados && img->origem.hash_conteudo ?
+                        salvar_imagem_com_cache(img, args->diretorio_entrada, args->diretorio_saida) :
+                        salvar_imagem_no_disco(img, args->diretorio_entrada, args->diretorio_saida);
+            // O índice e as duplicatas são atualizados quando a saída chega ao
+            // disco (salvar_*() ou motor_es_concluir()); aqui só a falha imediata
+            if (!salva) deduplicacao_concluir(img->nome, &img->origem, NULL);
+        }
+    }
+    
+    // Define o resultado no future
+    if (future) {
+        printf("Consumidor %d: Definindo resultado no Future para imagem %s\n",
+               args->thread_id, img->nome);
+        definir_resultado_future(future, img);
+        // Ninguém mais referencia o future depois de retirado da fila
+        destruir_future(future);
+    }
+    
+    free(img->dados);
+    orcamento_liberar(img->reserva);
+    
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    double tempo = (fim.tv_sec - inicio.tv_sec) + 
+                  (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+    atualizar_metricas(args->thread_id, 1, tempo);
+    if (config.relatorio_json) registrar_latencia_imagem(img->chegada, megapixels);
+    if (formato_custo >= 0) {
+        modelo_custo_registrar(modelo_custo, &modelo_custo->processamento[formato_custo],
+                               img->custo_previsto, tempo);
+    }
+}
+
+/**
+ * @brief Função executada por cada thread consumidora
+ * @param arg Argumentos da thread (ThreadArgs*)
+ * @return NULL
+ * 
+ * A thread consumidora:
+ * 1. Remove imagens da fila
+ * 2. Aplica transformações (cinza, inversão, brilho, contraste)
+ * 3. Salva a imagem processada
+ * 4. Registra métricas de desempenho
+ * 5. Registra sua ordem de finalização
+ */
+void* consumidor(void* arg) {
+    ThreadArgs* args = (ThreadArgs*)arg;
+    
+    printf("Consumidor %d iniciado\n", args->thread_id);
+    numa_fixar_thread(fragmentos.no[args->fragmento]);
+    
+    while (1) {
+        // Imagens retiradas de uma vez (só uma sem --lote) e processadas em sequência
+        Imagem lote[MAX_LOTE];
+        Future* futures[MAX_LOTE];
+
+        // Autoajuste: estaciona entre dois lotes se o estágio perdeu a vaga
+        autoajuste_aguardar_vaga(1, args->thread_id, 1);
+        
+        // Tenta remover imagem da fila com timeout (sem_timedwait usa CLOCK_REALTIME)
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000; // 100ms de timeout
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+        
+        // Com a fila fragmentada, a imagem pode vir do fragmento de outra thread
+        int fragmento_origem = args->fragmento;
+        int sem_result = fragmentos.num > 1 ? fragmentos_aguardar_imagem(args, &fragmento_origem) :
+                                              sem_timedwait(&args->fila->cheio, &timeout);
+        FilaImagens* origem = fragmentos.num > 1 ? fragmentos.filas[fragmento_origem] : args->fila;
+        if (sem_result == 0) {
+            int n = retirar_lote_da_fila(origem, lote, futures, config.lote, LOTE_BYTES_MAX);
+            if (n == 0) {
+                // Não faz break aqui, apenas continua tentando
+                usleep(10000); // Pequeno delay para evitar busy-wait
+                continue;
+            }
+            if (config.lote > 1) lotes_registrar(&lotes_fila.retirados, &lotes_fila.imagens_retiradas, n);
+
+            for (int i = 0; i < n; i++) {
+                fragmentos_registrar_retirada(args, fragmento_origem, &lote[i]);
+                consumir_imagem(args, &lote[i], futures[i]);
+            }
+        } else {
+            // Timeout ocorreu
+            int fila_vazia = filas_vazias(args->fila);
+            if (!executando && fila_vazia) {
+                break; // Só sai se não estiver executando e a fila estiver vazia
+            }
+            // Caso contrário, continua tentando
+        }
+    }
+    
+    registrar_finalizacao(args->thread_id, 1);
+    printf("Consumidor %d finalizado\n", args->thread_id);
+    return NULL;
+}
+
+// Máximo de conexões atendidas ao mesmo tempo pelo servidor
+#define MAX_CONEXOES_SERVIDOR 64
+
+// Estado do modo servidor (socket Unix)
+typedef struct {
+    int fd;                     // Socket de escuta
+    const char* caminho;        // Caminho do socket no sistema de arquivos
+    FilaImagens* fila;          // Fila compartilhada com os produtores
+    int clientes[MAX_CONEXOES_SERVIDOR]; // Sockets das conexões ativas (-1 livre)
+    int conexoes_ativas;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // Estatísticas
+    long conexoes;
+    long requisicoes;
+    long erros;
+    size_t bytes_recebidos;
+    size_t bytes_enviados;
+    double tempo_total;         // Soma do tempo de atendimento das requisições
+} Servidor;
+
+// Argumentos de uma thread de conexão
+typedef struct {
+    Servidor* servidor;
+    int fd;
+    int posicao;                // Posição em servidor->clientes
+} ConexaoServidor;
+
+/**
+ * @brief Lê exatamente n bytes de um socket
+ * @param fd Socket
+ * @param buffer Destino
+ * @param n Número de bytes
+ * @return 0 em caso de sucesso, -1 em erro ou fim da conexão
+ */
+int ler_exatamente(int fd, void* buffer, size_t n) {
+    size_t lidos = 0;
+    while (lidos < n) {
+        ssize_t r = recv(fd, (char*)buffer + lidos, n - lidos, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        lidos += r;
+    }
+    return 0;
+}
+
+/**
+ * @brief Escreve exatamente n bytes em um socket
+ * @param fd Socket
+ * @param buffer Origem
+ * @param n Número de bytes
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ * 
+ * Usa MSG_NOSIGNAL para que um cliente desconectado não gere SIGPIPE.
+ */
+int escrever_exatamente(int fd, const void* buffer, size_t n) {
+    size_t escritos = 0;
+    while (escritos < n) {
+        ssize_t r = send(fd, (const char*)buffer + escritos, n - escritos, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        escritos += r;
+    }
+    return 0;
+}
+
+/**
+ * @brief Envia a resposta de uma requisição
+ * @param fd Socket da conexão
+ * @param id Id da requisição
+ * @param status 0 ou código errno
+ * @param dados Imagem codificada (NULL se status != 0)
+ * @param tamanho Bytes em dados
+ * @return 0 em caso de sucesso, -1 se a conexão caiu
+ */
+int enviar_resposta(int fd, uint32_t id, int status, const unsigned char* dados, size_t tamanho) {
+    RespostaProtocolo resposta = { PROTOCOLO_MAGICO, id, status, 0, status ? 0 : tamanho };
+    if (escrever_exatamente(fd, &resposta, sizeof(resposta)) != 0) return -1;
+    if (resposta.tamanho > 0 && escrever_exatamente(fd, dados, tamanho) != 0) return -1;
+    return 0;
+}
+
+/**
+ * @brief Verifica um formato de saída
+ * @param formato Nome do formato, sem ponto
+ * @return 1 se é png, jpg, bmp ou tga
+ */
+int formato_saida_valido(const char* formato) {
+    return strcmp(formato, "png") == 0 || strcmp(formato, "jpg") == 0 ||
+           strcmp(formato, "bmp") == 0 || strcmp(formato, "tga") == 0;
+}
+
+/**
+ * @brief Verifica o parâmetro de uma operação
+ * @param codigo Operação (OP_*)
+ * @param parametro Fator (brilho/contraste) ou lado (miniatura)
+ * @return 1 se o parâmetro é aceito (sempre, para as demais operações)
+ * 
+ * Os fatores entram em conta inteira nas tabelas de consulta: NaN, infinito
+ * ou valores enormes não podem chegar até lá.
+ */
+int parametro_operacao_valido(uint32_t codigo, float parametro) {
+    if (codigo == OP_BRILHO || codigo == OP_CONTRASTE) {
+        return isfinite(parametro) && parametro > 0.0f && parametro <= LIMITE_FATOR;
+    }
+    if (codigo == OP_MINIATURA) {
+        return parametro >= 1.0f && parametro <= (float)LIMITE_MINIATURA && parametro == floorf(parametro);
+    }
+    return 1;
+}
+
+/**
+ * @brief Valida o cabeçalho de uma requisição
+ * @param req Requisição recebida
+ * @return 0 se válida, ou o código errno a devolver ao cliente
+ */
+int validar_requisicao(const RequisicaoProtocolo* req) {
+    if (req->magico != PROTOCOLO_MAGICO || req->versao != PROTOCOLO_VERSAO) return EPROTO;
+    if (req->tamanho_carga == 0 || req->tamanho_carga > MAX_CARGA_SERVIDOR) return EMSGSIZE;
+    if (req->tipo_carga != CARGA_BYTES && req->tipo_carga != CARGA_CAMINHO) return EINVAL;
+    if (req->tipo_carga == CARGA_CAMINHO && req->tamanho_carga >= PATH_MAX) return ENAMETOOLONG;
+    if (strnlen(req->formato, sizeof(req->formato)) == sizeof(req->formato) ||
+        !formato_saida_valido(req->formato)) {
+        return EINVAL;
+    }
+    if (req->num_operacoes > MAX_OPERACOES) return EINVAL;
+    for (int i = 0; i < req->num_operacoes; i++) {
+        const OperacaoProtocolo* operacao = &req->operacoes[i];
+        if (operacao->codigo < OP_CINZA || operacao->codigo > OP_RECORTE) return EINVAL;
+        if (!parametro_operacao_valido(operacao->codigo, operacao->parametro)) return EINVAL;
+        if (operacao->codigo == OP_RECORTE &&
+            (operacao->largura == 0 || operacao->altura == 0 || operacao->largura > LIMITE_RECORTE ||
+             operacao->altura > LIMITE_RECORTE || operacao->x > LIMITE_RECORTE || operacao->y > LIMITE_RECORTE)) {
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Atende uma requisição: decodifica, enfileira e aguarda o consumidor
+ * @param servidor Servidor
+ * @param req Cabeçalho da requisição (já validado)
+ * @param carga Bytes da carga (imagem codificada ou caminho terminado em '\0')
+ * @param trabalho Job preenchido com o resultado
+ * 
+ * A thread da conexão faz o papel de produtor: a imagem entra na mesma fila
+ * das imagens do diretório, e inserir_imagem_na_fila() bloqueia quando a
+ * fila está cheia, propagando a contrapressão até o cliente.
+ */
+void atender_requisicao(Servidor* servidor, const RequisicaoProtocolo* req,
+                        unsigned char* carga, TrabalhoServidor* trabalho) {
+    char nome[64];
+    snprintf(nome, sizeof(nome), "socket:%u", req->id);
+
+    Imagem* img;
+    if (req->tipo_carga == CARGA_CAMINHO) {
+        img = carregar_imagem_do_disco((const char*)carga, -1);
+    } else {
+        img = carregar_imagem_da_memoria(nome, carga, req->tamanho_carga, -1);
+    }
+    if (!img) {
+        trabalho->status = EBADMSG;
+        return;
+    }
+
+    memcpy(trabalho->operacoes, req->operacoes, req->num_operacoes * sizeof(OperacaoProtocolo));
+    trabalho->num_operacoes = req->num_operacoes;
+    snprintf(trabalho->extensao, sizeof(trabalho->extensao), ".%s", req->formato);
+    trabalho->future = criar_future();
+    if (!trabalho->future) {
+        liberar_imagem_da_memoria(img);
+        trabalho->status = ENOMEM;
+        return;
+    }
+
+    img->produtor_id = -1;
+    img->trabalho = trabalho;
+    memset(&img->origem, 0, sizeof(img->origem));
+    int inserida = inserir_imagem_na_fila(servidor->fila, img);
+    liberar_imagem_da_memoria(img);
+
+    if (inserida) {
+        obter_resultado_future(trabalho->future);
+    } else {
+        trabalho->status = ENOMEM;
+    }
+    destruir_future(trabalho->future);
+    trabalho->future = NULL;
+}
+
+/**
+ * @brief Função executada por cada thread de conexão do servidor
+ * @param arg Ponteiro para ConexaoServidor (liberado ao final)
+ * @return NULL
+ * 
+ * Lê requisições até o cliente fechar a conexão (ou o servidor encerrar)
+ * e responde cada uma na ordem em que chegou.
+ */
+void* atender_conexao(void* arg) {
+    ConexaoServidor* conexao = (ConexaoServidor*)arg;
+    Servidor* servidor = conexao->servidor;
+    int fd = conexao->fd;
+
+    RequisicaoProtocolo req;
+    while (ler_exatamente(fd, &req, sizeof(req)) == 0) {
+        struct timespec inicio, fim;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+        int status = validar_requisicao(&req);
+        if (status) {
+            // Sem cabeçalho confiável não há como se ressincronizar com o cliente
+            __atomic_fetch_add(&servidor->erros, 1, __ATOMIC_RELAXED);
+            enviar_resposta(fd, req.id, status, NULL, 0);
+            break;
+        }
+
+        unsigned char* carga = (unsigned char*)malloc(req.tamanho_carga + 1);
+        if (!carga) {
+            perror("Erro ao alocar carga da requisição");
+            break;
+        }
+        if (ler_exatamente(fd, carga, req.tamanho_carga) != 0) {
+            free(carga);
+            break;
+        }
+        carga[req.tamanho_carga] = '\0';
+        __atomic_fetch_add(&servidor->bytes_recebidos, sizeof(req) + req.tamanho_carga, __ATOMIC_RELAXED);
+
+        TrabalhoServidor trabalho;
+        memset(&trabalho, 0, sizeof(trabalho));
+        atender_requisicao(servidor, &req, carga, &trabalho);
+        free(carga);
+
+        int enviada = enviar_resposta(fd, req.id, trabalho.status, trabalho.resultado.dados, trabalho.resultado.tamanho) == 0;
+        free(trabalho.resultado.dados);
+
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        pthread_mutex_lock(&servidor->mutex);
+        servidor->requisicoes++;
+        if (trabalho.status) servidor->erros++;
+        if (enviada && !trabalho.status) servidor->bytes_enviados += sizeof(RespostaProtocolo) + trabalho.resultado.tamanho;
+        servidor->tempo_total += (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+        pthread_mutex_unlock(&servidor->mutex);
+
+        if (!enviada) break;
+    }
+
+    close(fd);
+    pthread_mutex_lock(&servidor->mutex);
+    servidor->clientes[conexao->posicao] = -1;
+    servidor->conexoes_ativas--;
+    pthread_cond_broadcast(&servidor->cond);
+    pthread_mutex_unlock(&servidor->mutex);
+    free(conexao);
+    return NULL;
+}
+
+/**
+ * @brief Cria o servidor e começa a escutar no socket Unix
+ * @param caminho Caminho do socket (um socket antigo no mesmo caminho é removido)
+ * @param fila Fila de imagens compartilhada
+ * @return Ponteiro para o servidor, ou NULL em caso de erro
+ * 
+ * É responsabilidade do chamador destruir o servidor usando destruir_servidor().
+ */
+Servidor* criar_servidor(const char* caminho, FilaImagens* fila) {
+    struct sockaddr_un endereco;
+    if (strlen(caminho) >= sizeof(endereco.sun_path)) {
+        printf("Caminho do socket muito longo: %s\n", caminho);
+        return NULL;
+    }
+
+    Servidor* servidor = (Servidor*)calloc(1, sizeof(Servidor));
+    if (!servidor) {
+        perror("Erro ao alocar servidor");
+        return NULL;
+    }
+
+    servidor->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (servidor->fd < 0) {
+        perror("Erro ao criar socket");
+        free(servidor);
+        return NULL;
+    }
+
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strcpy(endereco.sun_path, caminho);
+    unlink(caminho);
+    if (bind(servidor->fd, (struct sockaddr*)&endereco, sizeof(endereco)) != 0 ||
+        listen(servidor->fd, MAX_CONEXOES_SERVIDOR) != 0) {
+        printf("Erro ao escutar em %s: %s\n", caminho, strerror(errno));
+        close(servidor->fd);
+        free(servidor);
+        return NULL;
+    }
+
+    servidor->caminho = caminho;
+    servidor->fila = fila;
+    for (int i = 0; i < MAX_CONEXOES_SERVIDOR; i++) servidor->clientes[i] = -1;
+    pthread_mutex_init(&servidor->mutex, NULL);
+    pthread_cond_init(&servidor->cond, NULL);
+    return servidor;
+}
+
+/**
+ * @brief Destrói o servidor e remove o socket do sistema de arquivos
+ * @param servidor Servidor a ser destruído (seguro com NULL)
+ */
+void destruir_servidor(Servidor* servidor) {
+    if (!servidor) return;
+
+    close(servidor->fd);
+    unlink(servidor->caminho);
+    pthread_mutex_destroy(&servidor->mutex);
+    pthread_cond_destroy(&servidor->cond);
+    free(servidor);
+}
+
+/**
+ * @brief Função executada pela thread que aceita conexões do servidor
+ * @param arg Ponteiro para o Servidor
+ * @return NULL
+ * 
+ * Cada conexão ganha sua própria thread. Com MAX_CONEXOES_SERVIDOR
+ * conexões ativas, novas conexões esperam no backlog do socket. Ao
+ * receber SIGINT/SIGTERM, para de aceitar, interrompe a leitura das
+ * conexões abertas (as requisições em andamento ainda são respondidas)
+ * e aguarda todas terminarem.
+ */
+void* servidor_aceitar(void* arg) {
+    Servidor* servidor = (Servidor*)arg;
+    printf("Servidor escutando em %s (Ctrl+C para encerrar)\n", servidor->caminho);
+
+    while (!encerramento_solicitado) {
+        struct pollfd pfd = { servidor->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0) continue;
+
+        // Contrapressão: não aceita além do limite de conexões
+        pthread_mutex_lock(&servidor->mutex);
+        int posicao = -1;
+        for (int i = 0; i < MAX_CONEXOES_SERVIDOR; i++) {
+            if (servidor->clientes[i] < 0) {
+                posicao = i;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&servidor->mutex);
+        if (posicao < 0) {
+            usleep(10000);
+            continue;
+        }
+
+        int fd = accept4(servidor->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        ConexaoServidor* conexao = (ConexaoServidor*)malloc(sizeof(ConexaoServidor));
+        if (!conexao) {
+            close(fd);
+            continue;
+        }
+        conexao->servidor = servidor;
+        conexao->fd = fd;
+        conexao->posicao = posicao;
+
+        pthread_mutex_lock(&servidor->mutex);
+        servidor->clientes[posicao] = fd;
+        servidor->conexoes_ativas++;
+        servidor->conexoes++;
+        pthread_mutex_unlock(&servidor->mutex);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, atender_conexao, conexao) != 0) {
+            perror("Erro ao criar thread de conexão");
+            pthread_mutex_lock(&servidor->mutex);
+            servidor->clientes[posicao] = -1;
+            servidor->conexoes_ativas--;
+            pthread_mutex_unlock(&servidor->mutex);
+            close(fd);
+            free(conexao);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // Interrompe as leituras bloqueadas e espera as conexões terminarem
+    pthread_mutex_lock(&servidor->mutex);
+    for (int i = 0; i < MAX_CONEXOES_SERVIDOR; i++) {
+        if (servidor->clientes[i] >= 0) shutdown(servidor->clientes[i], SHUT_RD);
+    }
+    while (servidor->conexoes_ativas > 0) {
+        pthread_cond_wait(&servidor->cond, &servidor->mutex);
+    }
+    pthread_mutex_unlock(&servidor->mutex);
+
+    printf("Servidor encerrado\n");
+    return NULL;
+}
+
+/**
+ * @brief Converte uma lista de operações em texto (ex: "cinza,brilho=1.5")
+ * @param texto Operações separadas por vírgula; brilho e contraste aceitam "=fator"
+ *              (até LIMITE_FATOR), miniatura exige "=lado" (até LIMITE_MINIATURA)
+ *              e recorte "=LARGURAxALTURA+X+Y"
+ * @param operacoes Destino (até MAX_OPERACOES)
+ * @return Número de operações, ou -1 se o texto é inválido
+ */
+int interpretar_operacoes(const char* texto, OperacaoProtocolo* operacoes) {
+    char copia[1024];
+    snprintf(copia, sizeof(copia), "%s", texto);
+
+    int n = 0;
+    char* contexto = NULL;
+    for (char* item = strtok_r(copia, ",", &contexto); item; item = strtok_r(NULL, ",", &contexto)) {
+        if (n >= MAX_OPERACOES) return -1;
+
+        // Espaços em volta dos itens são aceitos (ex: arquivo de --config)
+        while (isspace((unsigned char)*item)) item++;
+        char* fim = item + strlen(item);
+        while (fim > item && isspace((unsigned char)fim[-1])) *--fim = '\0';
+
+        char* igual = strchr(item, '=');
+        if (igual) *igual++ = '\0';
+
+        if (strcmp(item, "cinza") == 0) {
+            operacoes[n].codigo = OP_CINZA;
+        } else if (strcmp(item, "inverter") == 0) {
+            operacoes[n].codigo = OP_INVERTER;
+        } else if (strcmp(item, "brilho") == 0) {
+            operacoes[n].codigo = OP_BRILHO;
+        } else if (strcmp(item, "contraste") == 0) {
+            operacoes[n].codigo = OP_CONTRASTE;
+        } else if (strcmp(item, "miniatura") == 0) {
+            operacoes[n].codigo = OP_MINIATURA;
+        } else if (strcmp(item, "recorte") == 0) {
+            operacoes[n].codigo = OP_RECORTE;
+        } else {
+            return -1;
+        }
+
+        uint32_t codigo = operacoes[n].codigo;
+        memset(&operacoes[n], 0, sizeof(operacoes[n]));
+        operacoes[n].codigo = codigo;
+        if (operacoes[n].codigo == OP_BRILHO || operacoes[n].codigo == OP_CONTRASTE) {
+            operacoes[n].parametro = operacoes[n].codigo == OP_BRILHO ? FATOR_BRILHO : FATOR_CONTRASTE;
+            if (igual) {
+                char* fim_numero;
+                operacoes[n].parametro = strtof(igual, &fim_numero);
+                if (fim_numero == igual || *fim_numero != '\0') return -1;
+            }
+            if (!parametro_operacao_valido(operacoes[n].codigo, operacoes[n].parametro)) return -1;
+        } else if (operacoes[n].codigo == OP_MINIATURA) {
+            if (!igual) return -1;
+            char* fim_numero;
+            long lado = strtol(igual, &fim_numero, 10);
+            if (fim_numero == igual || *fim_numero != '\0' || lado < 1 || lado > LIMITE_MINIATURA) return -1;
+            operacoes[n].parametro = (float)lado;
+        } else if (operacoes[n].codigo == OP_RECORTE) {
+            // Geometria no estilo do X11: 640x480+10+20 (deslocamento opcional)
+            unsigned long largura, altura, x = 0, y = 0;
+            int usados = 0;
+            if (!igual || sscanf(igual, "%lux%lu%n", &largura, &altura, &usados) != 2) return -1;
+            const char* deslocamento = igual + usados;
+            if (*deslocamento && (sscanf(deslocamento, "+%lu+%lu%n", &x, &y, &usados) != 2 ||
+                                  deslocamento[usados] != '\0')) {
+                return -1;
+            }
+            if (largura == 0 || altura == 0 || largura > LIMITE_RECORTE || altura > LIMITE_RECORTE ||
+                x > LIMITE_RECORTE || y > LIMITE_RECORTE) {
+                return -1;
+            }
+            operacoes[n].x = (uint32_t)x;
+            operacoes[n].y = (uint32_t)y;
+            operacoes[n].largura = (uint32_t)largura;
+            operacoes[n].altura = (uint32_t)altura;
+        }
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Interpreta a especificação de uma variante (ex: "mini:miniatura=256:jpg")
+ * @param texto NOME:OPERACOES[:FORMATO]; as operações podem ser vazias (só recodifica)
+ * @param variante Destino
+ * @return 0 em caso de sucesso, -1 se o texto é inválido
+ */
+int interpretar_variante(const char* texto, Variante* variante) {
+    memset(variante, 0, sizeof(*variante));
+
+    const char* dois_pontos = strchr(texto, ':');
+    size_t tamanho_nome = dois_pontos ? (size_t)(dois_pontos - texto) : strlen(texto);
+    if (tamanho_nome == 0 || tamanho_nome >= sizeof(variante->nome)) return -1;
+    for (size_t i = 0; i < tamanho_nome; i++) {
+        // O nome vira um subdiretório da saída
+        if (!isalnum((unsigned char)texto[i]) && texto[i] != '-' && texto[i] != '_') return -1;
+    }
+    memcpy(variante->nome, texto, tamanho_nome);
+    if (!dois_pontos) return 0;
+
+    char operacoes[1024];
+    snprintf(operacoes, sizeof(operacoes), "%s", dois_pontos + 1);
+    char* formato = strchr(operacoes, ':');
+    if (formato) {
+        *formato++ = '\0';
+        if (!formato_saida_valido(formato)) return -1;
+        snprintf(variante->extensao, sizeof(variante->extensao), ".%s", formato);
+    }
+    variante->num_operacoes = interpretar_operacoes(operacoes, variante->operacoes);
+    return variante->num_operacoes < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Conecta ao socket de um servidor
+ * @param caminho Caminho do socket
+ * @return Descritor conectado, ou -1 em caso de erro
+ */
+int conectar_servidor(const char* caminho) {
+    struct sockaddr_un endereco;
+    if (strlen(caminho) >= sizeof(endereco.sun_path)) {
+        printf("Caminho do socket muito longo: %s\n", caminho);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Erro ao criar socket");
+        return -1;
+    }
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strcpy(endereco.sun_path, caminho);
+    if (connect(fd, (struct sockaddr*)&endereco, sizeof(endereco)) != 0) {
+        printf("Erro ao conectar em %s: %s\n", caminho, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Monta o cabeçalho de uma requisição a partir da configuração
+ * @param req Cabeçalho a preencher
+ * @param id Id da requisição
+ * @param tipo_carga CARGA_BYTES ou CARGA_CAMINHO
+ * @param tamanho_carga Bytes da carga
+ */
+void montar_requisicao(RequisicaoProtocolo* req, uint32_t id, int tipo_carga, size_t tamanho_carga) {
+    memset(req, 0, sizeof(*req));
+    req->magico = PROTOCOLO_MAGICO;
+    req->versao = PROTOCOLO_VERSAO;
+    req->tipo_carga = tipo_carga;
+    req->num_operacoes = config.num_operacoes;
+    req->id = id;
+    req->tamanho_carga = tamanho_carga;
+    snprintf(req->formato, sizeof(req->formato), "%s", config.formato);
+    memcpy(req->operacoes, config.operacoes, config.num_operacoes * sizeof(OperacaoProtocolo));
+}
+
+/**
+ * @brief Envia uma requisição e aguarda a resposta
+ * @param fd Socket conectado
+ * @param req Cabeçalho da requisição
+ * @param carga Bytes da carga
+ * @param resposta Cabeçalho da resposta recebida
+ * @param dados Recebe a imagem resultante (o chamador libera; NULL para descartar)
+ * @return 0 em caso de sucesso na troca de mensagens, -1 se a conexão falhou
+ */
+int trocar_mensagens(int fd, const RequisicaoProtocolo* req, const void* carga,
+                     RespostaProtocolo* resposta, unsigned char** dados) {
+    if (escrever_exatamente(fd, req, sizeof(*req)) != 0 ||
+        escrever_exatamente(fd, carga, req->tamanho_carga) != 0 ||
+        ler_exatamente(fd, resposta, sizeof(*resposta)) != 0 ||
+        resposta->magico != PROTOCOLO_MAGICO || resposta->tamanho > MAX_CARGA_SERVIDOR) {
+        return -1;
+    }
+
+    unsigned char* recebidos = (unsigned char*)malloc(resposta->tamanho ? resposta->tamanho : 1);
+    if (!recebidos || ler_exatamente(fd, recebidos, resposta->tamanho) != 0) {
+        free(recebidos);
+        return -1;
+    }
+    if (dados) {
+        *dados = recebidos;
+    } else {
+        free(recebidos);
+    }
+    return 0;
+}
+
+/**
+ * @brief Lê um arquivo inteiro para a memória
+ * @param caminho Arquivo
+ * @param tamanho Recebe o número de bytes lidos
+ * @return Buffer alocado (o chamador libera), ou NULL em caso de erro
+ */
+unsigned char* ler_arquivo_inteiro(const char* caminho, size_t* tamanho) {
+    FILE* arquivo = fopen(caminho, "rb");
+    if (!arquivo) {
+        printf("Erro ao abrir %s: %s\n", caminho, strerror(errno));
+        return NULL;
+    }
+    fseek(arquivo, 0, SEEK_END);
+    long fim = ftell(arquivo);
+    fseek(arquivo, 0, SEEK_SET);
+
+    unsigned char* buffer = fim > 0 ? (unsigned char*)malloc(fim) : NULL;
+    if (!buffer || fread(buffer, 1, fim, arquivo) != (size_t)fim) {
+        printf("Erro ao ler %s\n", caminho);
+        free(buffer);
+        fclose(arquivo);
+        return NULL;
+    }
+    fclose(arquivo);
+    *tamanho = fim;
+    return buffer;
+}
+
+/**
+ * @brief Modo cliente: envia uma imagem ao servidor e grava o resultado
+ * @return 0 em caso de sucesso, 1 em caso de erro
+ * 
+ * Uso: --cliente=SOCKET [--ops=...] [--formato=...] [--enviar-caminho] ENTRADA SAIDA
+ */
+int executar_cliente(void) {
+    if (config.num_argumentos != 2) {
+        printf("O cliente espera dois argumentos: ENTRADA SAIDA\n");
+        return 1;
+    }
+    const char* entrada = config.argumentos[0];
+    const char* saida = config.argumentos[1];
+
+    unsigned char* carga;
+    size_t tamanho_carga;
+    if (config.enviar_caminho) {
+        // O servidor abre o arquivo: envia o caminho absoluto
+        char absoluto[PATH_MAX];
+        if (!realpath(entrada, absoluto)) {
+            printf("Erro ao resolver %s: %s\n", entrada, strerror(errno));
+            return 1;
+        }
+        carga = (unsigned char*)strdup(absoluto);
+        tamanho_carga = strlen(absoluto);
+    } else {
+        carga = ler_arquivo_inteiro(entrada, &tamanho_carga);
+    }
+    if (!carga) return 1;
+
+    int fd = conectar_servidor(config.socket_cliente);
+    if (fd < 0) {
+        free(carga);
+        return 1;
+    }
+
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    RequisicaoProtocolo req;
+    RespostaProtocolo resposta;
+    unsigned char* dados = NULL;
+    montar_requisicao(&req, 1, config.enviar_caminho ? CARGA_CAMINHO : CARGA_BYTES, tamanho_carga);
+    int falhou = trocar_mensagens(fd, &req, carga, &resposta, &dados) != 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    close(fd);
+    free(carga);
+
+    if (falhou) {
+        printf("Erro na comunicação com o servidor\n");
+        return 1;
+    }
+    if (resposta.status) {
+        printf("Servidor recusou a requisição: %s\n", strerror(resposta.status));
+        free(dados);
+        return 1;
+    }
+
+    FILE* arquivo = fopen(saida, "wb");
+    int sucesso = arquivo && fwrite(dados, 1, resposta.tamanho, arquivo) == resposta.tamanho;
+    if (arquivo && fclose(arquivo) != 0) sucesso = 0;
+    free(dados);
+    if (!sucesso) {
+        printf("Erro ao gravar %s\n", saida);
+        return 1;
+    }
+
+    printf("%s -> %s (%lu bytes em %.2f ms)\n", entrada, saida, (unsigned long)resposta.tamanho,
+           ((fim.tv_sec - inicio.tv_sec) * 1e3 + (fim.tv_nsec - inicio.tv_nsec) / 1e6));
+    return 0;
+}
+
+// Estado de uma conexão do gerador de carga
+typedef struct {
+    const unsigned char* carga;
+    size_t tamanho_carga;
+    int requisicoes;            // Requisições a enviar por esta conexão
+    int primeiro_id;
+    double* latencias;          // Latência de cada requisição (segundos)
+    int concluidas;
+    int erros;
+} ConexaoCarga;
+
+/**
+ * @brief Função executada por cada conexão do gerador de carga
+ * @param arg Ponteiro para ConexaoCarga
+ * @return NULL
+ */
+void* gerar_carga(void* arg) {
+    ConexaoCarga* conexao = (ConexaoCarga*)arg;
+    int fd = conectar_servidor(config.socket_cliente);
+    if (fd < 0) {
+        conexao->erros = conexao->requisicoes;
+        return NULL;
+    }
+
+    for (int i = 0; i < conexao->requisicoes; i++) {
+        struct timespec inicio, fim;
+        RequisicaoProtocolo req;
+        RespostaProtocolo resposta;
+        montar_requisicao(&req, conexao->primeiro_id + i, CARGA_BYTES, conexao->tamanho_carga);
+
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        if (trocar_mensagens(fd, &req, conexao->carga, &resposta, NULL) != 0) {
+            conexao->erros += conexao->requisicoes - i;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+
+        if (resposta.status) {
+            conexao->erros++;
+            continue;
+        }
+        conexao->latencias[conexao->concluidas++] = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+/**
+ * @brief Compara duas latências (para qsort)
+ */
+int comparar_latencias(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Modo gerador de carga: mede a latência do servidor
+ * @return 0 em caso de sucesso, 1 em caso de erro
+ * 
+ * Uso: --carga=SOCKET [--conexoes=N] [--requisicoes=M] [--ops=...] IMAGEM
+ * 
+ * Abre N conexões que enviam, em sequência, M requisições no total com a
+ * mesma imagem, e exibe a vazão e os percentis de latência.
+ */
+int executar_gerador_carga(void) {
+    if (config.num_argumentos != 1) {
+        printf("O gerador de carga espera um argumento: IMAGEM\n");
+        return 1;
+    }
+
+    size_t tamanho_carga;
+    unsigned char* carga = ler_arquivo_inteiro(config.argumentos[0], &tamanho_carga);
+    if (!carga) return 1;
+
+    int n = config.conexoes;
+    ConexaoCarga* conexoes = (ConexaoCarga*)calloc(n, sizeof(ConexaoCarga));
+    double* latencias = (double*)malloc(config.requisicoes * sizeof(double));
+    pthread_t* threads = (pthread_t*)malloc(n * sizeof(pthread_t));
+    if (!conexoes || !latencias || !threads) {
+        perror("Erro ao alocar gerador de carga");
+        free(conexoes);
+        free(latencias);
+        free(threads);
+        free(carga);
+        return 1;
+    }
+
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    int distribuidas = 0;
+    int criadas = 0;
+    for (int i = 0; i < n; i++) {
+        conexoes[i].carga = carga;
+        conexoes[i].tamanho_carga = tamanho_carga;
+        conexoes[i].requisicoes = config.requisicoes / n + (i < config.requisicoes % n);
+        conexoes[i].primeiro_id = distribuidas;
+        conexoes[i].latencias = latencias + distribuidas;
+        distribuidas += conexoes[i].requisicoes;
+        if (pthread_create(&threads[i], NULL, gerar_carga, &conexoes[i]) != 0) {
+            perror("Erro ao criar thread do gerador de carga");
+            conexoes[i].erros = conexoes[i].requisicoes;
+            break;
+        }
+        criadas++;
+    }
+
+    // Junta as latências de todas as conexões no início do vetor
+    int concluidas = 0;
+    int erros = 0;
+    for (int i = 0; i < n; i++) {
+        if (i < criadas) pthread_join(threads[i], NULL);
+        memmove(latencias + concluidas, conexoes[i].latencias, conexoes[i].concluidas * sizeof(double));
+        concluidas += conexoes[i].concluidas;
+        erros += conexoes[i].erros;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    double tempo = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+
+    printf("\n=== Gerador de carga (%d conexões) ===\n", n);
+    printf("  - Requisições concluídas: %d (erros: %d)\n", concluidas, erros);
+    printf("  - Tempo total: %.2f segundos\n", tempo);
+    printf("  - Vazão: %.1f requisições/s\n", concluidas / tempo);
+    if (concluidas > 0) {
+        qsort(latencias, concluidas, sizeof(double), comparar_latencias);
+        double soma = 0.0;
+        for (int i = 0; i < concluidas; i++) soma += latencias[i];
+        printf("  - Latência média: %.2f ms\n", soma / concluidas * 1e3);
+        printf("  - Latência p50: %.2f ms\n", latencias[(int)(0.50 * (concluidas - 1))] * 1e3);
+        printf("  - Latência p90: %.2f ms\n", latencias[(int)(0.90 * (concluidas - 1))] * 1e3);
+        printf("  - Latência p99: %.2f ms\n", latencias[(int)(0.99 * (concluidas - 1))] * 1e3);
+        printf("  - Latência máxima: %.2f ms\n", latencias[concluidas - 1] * 1e3);
+    }
+
+    free(conexoes);
+    free(latencias);
+    free(threads);
+    free(carga);
+    return erros ? 1 : 0;
+}
+
+// Microbenchmark da fila (--bancada-fila): produtores e consumidores trocam
+// itens vazios pela fila única e depois pela fila fragmentada, com o mesmo
+// protocolo das imagens (semáforos, mutex e índices da FilaImagens) e o
+// mesmo roubo entre fragmentos, mas sem decodificar, sem Future e sem log.
+// Só a sincronização é medida, que é o que a fragmentação muda.
+#define BANCADA_THREADS_PADRAO 16  // Produtores e consumidores, cada, sem --produtores/--consumidores
+
+typedef struct {
+    ThreadArgs args;
+    long itens;                 // Itens a inserir (produtor)
+    long* restantes;            // Itens ainda não retirados (consumidores, atômico)
+    long retirados;
+    long roubados;
+} ThreadBancada;
+
+/**
+ * @brief Produtor do microbenchmark: insere itens no fragmento escolhido como o do pipeline
+ */
+void* produtor_bancada(void* arg) {
+    ThreadBancada* t = (ThreadBancada*)arg;
+    for (long i = 0; i < t->itens; i++) {
+        FilaImagens* fila = fila_do_produtor(&t->args);
+        sem_wait(&fila->vazio);
+        pthread_mutex_lock(&fila->mutex);
+        fila->imagens[fila->fim].sequencia = i;
+        fila->fim = (fila->fim + 1) % fila->capacidade;
+        fila->tamanho++;
+        pthread_mutex_unlock(&fila->mutex);
+        sem_post(&fila->cheio);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Consumidor do microbenchmark: retira itens, roubando de outros fragmentos
+ */
+void* consumidor_bancada(void* arg) {
+    ThreadBancada* t = (ThreadBancada*)arg;
+    while (__atomic_load_n(t->restantes, __ATOMIC_RELAXED) > 0) {
+        int origem = 0;
+        FilaImagens* fila = t->args.fila;
+        if (fragmentos.num > 1) {
+            if (fragmentos_aguardar_imagem(&t->args, &origem) != 0) continue;
+            fila = fragmentos.filas[origem];
+        } else {
+            struct timespec timeout;
+            clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_nsec += FRAGMENTOS_ESPERA_MS * 1000000L;
+            if (timeout.tv_nsec >= 1000000000) {
+                timeout.tv_sec++;
+                timeout.tv_nsec -= 1000000000;
+            }
+            if (sem_timedwait(&fila->cheio, &timeout) != 0) continue;
+        }
+        pthread_mutex_lock(&fila->mutex);
+        fila->inicio = (fila->inicio + 1) % fila->capacidade;
+        fila->tamanho--;
+        pthread_mutex_unlock(&fila->mutex);
+        sem_post(&fila->vazio);
+        __atomic_fetch_sub(t->restantes, 1, __ATOMIC_RELAXED);
+        t->retirados++;
+        if (origem != t->args.fragmento) t->roubados++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Executa uma rodada do microbenchmark
+ * @param num_fragmentos 1 para a fila única
+ * @param produtores Threads produtoras
+ * @param consumidores Threads consumidoras
+ * @param roubados Recebe os itens roubados de outro fragmento
+ * @return Itens por segundo, ou -1 em caso de erro
+ */
+double rodada_bancada_fila(int num_fragmentos, int produtores, int consumidores, long* roubados) {
+    int capacidade = config.capacidade_fila > 0 ? config.capacidade_fila : 2 * consumidores;
+    int capacidade_fragmento = (capacidade + num_fragmentos - 1) / num_fragmentos;
+    if (capacidade_fragmento < 2) capacidade_fragmento = 2;
+    FilaImagens* fila = criar_fila(capacidade_fragmento);
+    if (!fila) return -1;
+    if (num_fragmentos > 1 && criar_fragmentos(fila, num_fragmentos, 1, capacidade_fragmento) != 0) {
+        destruir_fila(fila);
+        return -1;
+    }
+
+    ThreadBancada* threads = (ThreadBancada*)calloc(produtores + consumidores, sizeof(ThreadBancada));
+    pthread_t* ids = (pthread_t*)malloc((produtores + consumidores) * sizeof(pthread_t));
+    if (!threads || !ids) {
+        free(threads);
+        free(ids);
+        destruir_fragmentos();
+        destruir_fila(fila);
+        return -1;
+    }
+
+    long restantes = config.itens_bancada;
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    int criadas = 0;
+    for (int i = 0; i < produtores + consumidores; i++) {
+        ThreadBancada* t = &threads[i];
+        int indice = i < produtores ? i : i - produtores;
+        t->args.fragmento = indice % num_fragmentos;
+        t->args.fila = num_fragmentos > 1 ? fragmentos.filas[t->args.fragmento] : fila;
+        t->restantes = &restantes;
+        t->itens = config.itens_bancada / produtores + (indice < config.itens_bancada % produtores);
+        if (pthread_create(&ids[i], NULL, i < produtores ? produtor_bancada : consumidor_bancada, t) != 0) {
+            perror("Erro ao criar thread do microbenchmark");
+            break;
+        }
+        criadas++;
+    }
+    for (int i = 0; i < criadas; i++) pthread_join(ids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+
+    *roubados = 0;
+    for (int i = produtores; i < criadas; i++) *roubados += threads[i].roubados;
+    double tempo = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+    int completa = criadas == produtores + consumidores;
+
+    free(threads);
+    free(ids);
+    destruir_fragmentos();
+    destruir_fila(fila);
+    return completa ? config.itens_bancada / tempo : -1;
+}
+
+/**
+ * @brief Modo microbenchmark da fila: compara a fila única com a fragmentada
+ * @return 0 em caso de sucesso, 1 em caso de erro
+ * 
+ * Uso: --bancada-fila=ITENS [--produtores=N] [--consumidores=N] [--fragmentos=N] [--capacidade-fila=N]
+ * 
+ * Sem --fragmentos, a fila fragmentada tem um fragmento por consumidor.
+ */
+int executar_bancada_fila(void) {
+    int produtores = config.num_produtores > 0 ? config.num_produtores : BANCADA_THREADS_PADRAO;
+    int consumidores = config.num_consumidores > 0 ? config.num_consumidores : BANCADA_THREADS_PADRAO;
+    int num_fragmentos = config.fragmentos > 0 ? config.fragmentos : consumidores;
+    if (num_fragmentos > MAX_FRAGMENTOS) num_fragmentos = MAX_FRAGMENTOS;
+
+    printf("=== Microbenchmark da fila: %d produtores, %d consumidores, %ld itens ===\n", produtores,
+           consumidores, config.itens_bancada);
+    long roubados_unica, roubados_fragmentada;
+    double unica = rodada_bancada_fila(1, produtores, consumidores, &roubados_unica);
+    double fragmentada = rodada_bancada_fila(num_fragmentos, produtores, consumidores, &roubados_fragmentada);
+    if (unica < 0 || fragmentada < 0) {
+        printf("Erro ao executar o microbenchmark da fila\n");
+        return 1;
+    }
+    printf("  - Fila única: %.0f itens/s\n", unica);
+    printf("  - Fila fragmentada (%d fragmentos): %.0f itens/s (%.1f%% roubados)\n", num_fragmentos, fragmentada,
+           100.0 * roubados_fragmentada / config.itens_bancada);
+    printf("  - Ganho: %.2fx\n", fragmentada / unica);
+    return 0;
+}
+
+/**
+ * @brief Modo escritor de quadros: entrega quadros ao pipeline pela memória compartilhada
+ * @return 0 em caso de sucesso, 1 em caso de erro
+ * 
+ * Uso: --enviar-quadros=NOME [--requisicoes=M] IMAGEM [SAIDA]
+ * 
+ * Faz o papel do processo de captura: decodifica IMAGEM uma vez, escreve
+ * M quadros com ela no anel (cada quadro usa o próximo slot, esperando no
+ * futex do slot enquanto o pipeline não o devolve) e exibe a vazão e a
+ * latência de cada quadro. Com SAIDA, grava o último quadro processado.
+ */
+int executar_envio_quadros(void) {
+    if (config.num_argumentos < 1 || config.num_argumentos > 2) {
+        printf("O escritor de quadros espera: IMAGEM [SAIDA]\n");
+        return 1;
+    }
+
+    int largura, altura, canais;
+    unsigned char* pixels = stbi_load(config.argumentos[0], &largura, &altura, &canais, 3);
+    if (!pixels) {
+        printf("Erro ao carregar imagem %s: %s\n", config.argumentos[0], stbi_failure_reason());
+        return 1;
+    }
+    size_t bytes = (size_t)largura * altura * 3;
+
+    char nome[NAME_MAX];
+    nome_segmento(config.nome_memoria, nome, sizeof(nome));
+    int fd = shm_open(nome, O_RDWR | O_CLOEXEC, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoSegmento)) {
+        printf("Erro ao abrir memória compartilhada %s: %s\n", nome, strerror(errno));
+        if (fd >= 0) close(fd);
+        stbi_image_free(pixels);
+        return 1;
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("Erro ao mapear memória compartilhada");
+        stbi_image_free(pixels);
+        return 1;
+    }
+
+    CabecalhoSegmento* segmento = (CabecalhoSegmento*)base;
+    CabecalhoQuadro* quadros = (CabecalhoQuadro*)(segmento + 1);
+    if (__atomic_load_n(&segmento->magico, __ATOMIC_ACQUIRE) != SEGMENTO_MAGICO ||
+        segmento->versao != SEGMENTO_VERSAO || segmento->tamanho_total > (uint64_t)st.st_size) {
+        printf("Segmento %s inválido\n", nome);
+        munmap(base, st.st_size);
+        stbi_image_free(pixels);
+        return 1;
+    }
+    if (bytes > segmento->bytes_por_quadro) {
+        printf("Imagem %dx%d não cabe em um quadro do segmento\n", largura, altura);
+        munmap(base, st.st_size);
+        stbi_image_free(pixels);
+        return 1;
+    }
+
+    uint32_t num_quadros = segmento->num_quadros;
+    struct timespec* envio = (struct timespec*)calloc(num_quadros, sizeof(struct timespec));
+    double* latencias = (double*)malloc(config.requisicoes * sizeof(double));
+    if (!envio || !latencias) {
+        perror("Erro ao alocar escritor de quadros");
+        free(envio);
+        free(latencias);
+        munmap(base, st.st_size);
+        stbi_image_free(pixels);
+        return 1;
+    }
+
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    int concluidos = 0, erros = 0;
+    unsigned char* ultimo = NULL;
+    // Envia os quadros e, no fim, recolhe os que ainda estão no anel
+    for (int f = 0; f < config.requisicoes + (int)num_quadros; f++) {
+        CabecalhoQuadro* quadro = &quadros[f % num_quadros];
+
+        uint32_t estado;
+        while ((estado = __atomic_load_n(&quadro->estado, __ATOMIC_ACQUIRE)) == QUADRO_PREENCHIDO ||
+               estado == QUADRO_PROCESSANDO) {
+            if (__atomic_load_n(&segmento->encerrado, __ATOMIC_ACQUIRE)) break;
+            futex_esperar(&quadro->estado, estado, 100);
+        }
+        if (estado != QUADRO_LIVRE && estado != QUADRO_CONCLUIDO) {
+            printf("Pipeline encerrado antes do fim do envio\n");
+            break;
+        }
+
+        // Recolhe o resultado do uso anterior do slot
+        if (estado == QUADRO_CONCLUIDO) {
+            clock_gettime(CLOCK_MONOTONIC, &fim);
+            if (quadro->status) {
+                erros++;
+            } else {
+                latencias[concluidos++] = (fim.tv_sec - envio[f % num_quadros].tv_sec) +
+                                          (fim.tv_nsec - envio[f % num_quadros].tv_nsec) / 1e9;
+                ultimo = (unsigned char*)base + quadro->deslocamento;
+            }
+            if (config.num_argumentos == 2 && concluidos + erros == config.requisicoes && !quadro->status) {
+                stbi_write_png(config.argumentos[1], largura, altura, 3, ultimo, largura * 3);
+            }
+            quadro->estado = QUADRO_LIVRE;
+        }
+        if (f >= config.requisicoes) continue;
+
+        // Escreve o quadro e o entrega ao pipeline
+        memcpy((unsigned char*)base + quadro->deslocamento, pixels, bytes);
+        quadro->largura = largura;
+        quadro->altura = altura;
+        quadro->sequencia = f;
+        clock_gettime(CLOCK_MONOTONIC, &envio[f % num_quadros]);
+        __atomic_store_n(&quadro->estado, QUADRO_PREENCHIDO, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&segmento->preenchidos, 1, __ATOMIC_RELEASE);
+        futex_acordar(&segmento->preenchidos);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    double tempo = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+
+    printf("\n=== Escritor de quadros (%s, %u slots, %dx%d) ===\n", nome, num_quadros, largura, altura);
+    printf("  - Quadros concluídos: %d (erros: %d)\n", concluidos, erros);
+    printf("  - Vazão: %.1f quadros/s (%.1f MB/s)\n", concluidos / tempo, concluidos * bytes / tempo / (1024.0 * 1024.0));
+    if (concluidos > 0) {
+        qsort(latencias, concluidos, sizeof(double), comparar_latencias);
+        printf("  - Latência p50: %.2f ms\n", latencias[(int)(0.50 * (concluidos - 1))] * 1e3);
+        printf("  - Latência p99: %.2f ms\n", latencias[(int)(0.99 * (concluidos - 1))] * 1e3);
+        printf("  - Latência máxima: %.2f ms\n", latencias[concluidos - 1] * 1e3);
+    }
+
+    free(envio);
+    free(latencias);
+    munmap(base, st.st_size);
+    stbi_image_free(pixels);
+    return concluidos == config.requisicoes ? 0 : 1;
+}
+
+/**
+ * @brief Cria uma nova fila de imagens
+ * @param capacidade Número máximo de imagens que a fila pode armazenar
+ * @return Ponteiro para a fila criada, ou NULL em caso de erro
+ * 
+ * A função inicializa uma fila circular com semáforos para controle de acesso.
+ * A fila é thread-safe e pode ser usada por múltiplos produtores e consumidores.
+ * 
+ * É responsabilidade do chamador destruir a fila usando destruir_fila().
+ */
+FilaImagens* criar_fila(int capacidade) {
+    // Alinhada à linha de cache, para que filas vizinhas não a compartilhem
+    FilaImagens* fila = (FilaImagens*)aligned_alloc(LINHA_CACHE, sizeof(FilaImagens));
+    if (!fila) {
+        perror("Erro ao alocar fila");
+        return NULL;
+    }
+
+    fila->imagens = (Imagem*)malloc(capacidade * sizeof(Imagem));
+    if (!fila->imagens) {
+        perror("Erro ao alocar array de imagens");
+        free(fila);
+        return NULL;
+    }
+
+    fila->futures = (Future**)calloc(capacidade, sizeof(Future*));  // O monitor lê também os slots nunca usados
+    if (!fila->futures) {
+        perror("Erro ao alocar array de futures");
+        free(fila->imagens);
+        free(fila);
+        return NULL;
+    }
+
+    fila->capacidade = capacidade;
+    fila->inicio = 0;
+    fila->fim = 0;
+    fila->tamanho = 0;
+
+    // Inicializa mutex e semáforos
+    pthread_mutex_init(&fila->mutex, NULL);
+    sem_init(&fila->vazio, 0, capacidade);
+    sem_init(&fila->cheio, 0, 0);
+
+    return fila;
+}
+
+/**
+ * @brief Destrói uma fila de imagens e libera seus recursos
+ * @param fila Ponteiro para a fila a ser destruída
+ * 
+ * Libera todos os recursos associados à fila, incluindo:
+ * - Mutex e semáforos
+ * - Array de imagens
+ * - Array de futures
+ * - Estrutura da fila
+ */
+void destruir_fila(FilaImagens* fila) {
+    if (!fila) return;
+
+    // Libera recursos de sincronização
+    pthread_mutex_destroy(&fila->mutex);
+    sem_destroy(&fila->vazio);
+    sem_destroy(&fila->cheio);
+
+    // Libera memória
+    free(fila->imagens);
+    free(fila->futures);
+    free(fila);
+}
+
+/**
+ * @brief Insere de uma vez até n imagens na fila
+ * @param fila Ponteiro para a fila
+ * @param imgs Imagens a inserir
+ * @param n Número de imagens
+ * @return Número de imagens inseridas (n, salvo falha ao criar um Future)
+ * 
+ * A função é thread-safe e bloqueia só pela vaga da primeira imagem; as
+ * demais vagas são tomadas sem bloquear e preenchidas sob um único lock.
+ * O que não coube segue em uma nova rodada. Esperar por todas as vagas de
+ * uma vez poderia travar dois produtores, cada um com parte das vagas.
+ * 
+ * Os pixels não são copiados: a fila assume o buffer de cada imagem (que
+ * passa a NULL) e o entrega a quem retirar a imagem.
+ */
+int inserir_imagens_na_fila(FilaImagens* fila, Imagem* imgs, int n) {
+    if (!fila || !imgs) return 0;
+
+    int inseridas = 0;
+    while (inseridas < n) {
+        // Espera por um slot vazio e toma os seguintes, se houver
+        sem_wait(&fila->vazio);
+        int vagas = 1;
+        while (inseridas + vagas < n && sem_trywait(&fila->vazio) == 0) vagas++;
+
+        // Trava o mutex para modificar a fila
+        pthread_mutex_lock(&fila->mutex);
+
+        int preenchidas = 0;
+        for (; preenchidas < vagas; preenchidas++) {
+            Imagem* img = &imgs[inseridas + preenchidas];
+
+            // Cria um novo future para a imagem
+            Future* future = criar_future();
+            if (!future) break;
+
+            printf("Future criado para imagem: %s\n", img->nome);
+
+            // Copia a imagem para a fila
+            strncpy(fila->imagens[fila->fim].nome, img->nome, sizeof(fila->imagens[fila->fim].nome) - 1);
+            fila->imagens[fila->fim].largura = img->largura;
+            fila->imagens[fila->fim].altura = img->altura;
+            fila->imagens[fila->fim].canais = img->canais;
+            fila->imagens[fila->fim].produtor_id = img->produtor_id;  // Copia o ID do produtor
+            fila->imagens[fila->fim].origem = img->origem;
+            fila->imagens[fila->fim].trabalho = img->trabalho;
+
+            fila->imagens[fila->fim].quadro = img->quadro;
+            fila->imagens[fila->fim].fluxo = img->fluxo;
+            fila->imagens[fila->fim].sequencia = img->sequencia;
+            fila->imagens[fila->fim].compartilhada = img->compartilhada;
+            fila->imagens[fila->fim].variante = img->variante;
+            fila->imagens[fila->fim].custo_previsto = img->custo_previsto;
+            fila->imagens[fila->fim].chegada = img->chegada;
+
+            // Transfere o buffer de pixels para a fila, sem cópia, junto com sua reserva
+            fila->imagens[fila->fim].dados = img->dados;
+            img->dados = NULL;
+            fila->imagens[fila->fim].reserva = img->reserva;
+            orcamento_repassar(img->reserva);
+            img->reserva = 0;
+
+            // Armazena o future
+            fila->futures[fila->fim] = future;
+            printf("Future armazenado na posição %d da fila\n", fila->fim);
+
+            // Atualiza índices da fila
+            fila->fim = (fila->fim + 1) % fila->capacidade;
+            fila->tamanho++;
+        }
+
+        // Libera o mutex
+        pthread_mutex_unlock(&fila->mutex);
+
+        // Sinaliza os novos itens e devolve as vagas não usadas
+        for (int i = 0; i < preenchidas; i++) sem_post(&fila->cheio);
+        for (int i = preenchidas; i < vagas; i++) sem_post(&fila->vazio);
+
+        inseridas += preenchidas;
+        if (preenchidas < vagas) break;
+    }
+
+    return inseridas;
+}
+
+/**
+ * @brief Insere uma imagem na fila
+ * @param fila Ponteiro para a fila
+ * @param img Ponteiro para a imagem a ser inserida
+ * @return 1 se a inserção foi bem-sucedida, 0 caso contrário
+ * 
+ * A função é thread-safe e bloqueia se a fila estiver cheia.
+ * Cria um novo Future para a imagem inserida.
+ * 
+ * Os pixels não são copiados: a fila assume o buffer img->dados (que passa
+ * a NULL) e o entrega a quem retirar a imagem.
+ */
+int inserir_imagem_na_fila(FilaImagens* fila, Imagem* img) {
+    return inserir_imagens_na_fila(fila, img, 1) == 1;
+}
+
+/**
+ * @brief Retira de uma vez até max imagens da fila
+ * @param fila Ponteiro para a fila
+ * @param imgs Recebem as imagens (o chamador passa a ser dono dos buffers)
+ * @param futures Recebem os futures das imagens
+ * @param max Máximo de imagens
+ * @param bytes_max Pixels somados além dos quais o lote não cresce
+ * @return Número de imagens retiradas (0 se a fila estava vazia)
+ * 
+ * O chamador já decrementou o semáforo "cheio" uma vez, pela primeira
+ * imagem; as seguintes são tomadas sem bloquear, sob o mesmo lock. A
+ * primeira sai sempre, mas uma imagem grande não entra em um lote: ela iria
+ * concentrar trabalho em um consumidor enquanto os outros esperam.
+ */
+int retirar_lote_da_fila(FilaImagens* fila, Imagem* imgs, Future** futures, int max, size_t bytes_max) {
+    // Trava o mutex para modificar a fila
+    pthread_mutex_lock(&fila->mutex);
+
+    int n = 0;
+    size_t bytes = 0;
+    while (n < max && fila->tamanho > 0) {
+        Imagem* proxima = &fila->imagens[fila->inicio];
+        size_t tamanho = (size_t)proxima->largura * proxima->altura * proxima->canais;
+        if (n > 0 && (bytes + tamanho > bytes_max || sem_trywait(&fila->cheio) != 0)) break;
+        bytes += tamanho;
+
+        // Obtém o future da imagem
+        futures[n] = fila->futures[fila->inicio];
+
+        // Copia a imagem da fila
+        Imagem* img = &imgs[n];
+        strncpy(img->nome, proxima->nome, sizeof(img->nome) - 1);
+        img->largura = proxima->largura;
+        img->altura = proxima->altura;
+        img->canais = proxima->canais;
+        img->produtor_id = proxima->produtor_id;
+        img->origem = proxima->origem;
+        img->trabalho = proxima->trabalho;
+        img->quadro = proxima->quadro;
+        img->fluxo = proxima->fluxo;
+        img->sequencia = proxima->sequencia;
+        img->compartilhada = proxima->compartilhada;
+        img->variante = proxima->variante;
+        img->fonte = NULL;
+        img->passo = 0;
+        img->num_pendentes = 0;
+        img->custo_previsto = proxima->custo_previsto;
+        img->reserva = proxima->reserva;
+        img->chegada = proxima->chegada;
+
+        // Transfere o buffer de pixels para quem retirou a imagem, sem cópia
+        img->dados = proxima->dados;
+        proxima->dados = NULL;
+
+        // Limpa o future
+        fila->futures[fila->inicio] = NULL;
+
+        // Atualiza índices da fila
+        fila->inicio = (fila->inicio + 1) % fila->capacidade;
+        fila->tamanho--;
+        n++;
+    }
+
+    // Libera o mutex
+    pthread_mutex_unlock(&fila->mutex);
+
+    // Sinaliza os novos slots vazios
+    for (int i = 0; i < n; i++) sem_post(&fila->vazio);
+
+    return n;
+}
+
+/**
+ * @brief Remove uma imagem da fila
+ * @param fila Ponteiro para a fila
+ * @param img Ponteiro para onde a imagem será copiada
+ * @return 1 se a remoção foi bem-sucedida, 0 caso contrário
+ * 
+ * A função é thread-safe e bloqueia se a fila estiver vazia.
+ * Copia a imagem; o chamador passa a ser o dono do buffer img->dados.
+ */
+int remover_imagem_da_fila(FilaImagens* fila, Imagem* img) {
+    if (!fila || !img) return 0;
+
+    // Espera por um item na fila
+    sem_wait(&fila->cheio);
+
+    Future* future;
+    return retirar_lote_da_fila(fila, img, &future, 1, 0) == 1;
+}
+
+// Recursos do ambiente: as CPUs e a memória que o processo pode de fato usar,
+// pela máscara de afinidade e pelos limites do cgroup (v2: cpu.max e
+// memory.max; v1: cpu.cfs_quota_us/cpu.cfs_period_us e
+// memory.limit_in_bytes). Um contêiner com cota de 2 CPUs pode enxergar 64
+// núcleos; com uma thread ativa por núcleo visível, a cota se esgota no
+// início de cada período e o kernel estrangula (throttle) todas elas.
+#define RAIZ_CGROUP "/sys/fs/cgroup"
+
+typedef struct {
+    int cpus_afinidade;       // CPUs na máscara de afinidade
+    double cota_cpu;          // CPUs da cota do cgroup (0: sem cota)
+    int cpus;                 // CPUs efetivas: a menor entre a afinidade e a cota arredondada para cima
+    uint64_t memoria_fisica;  // RAM da máquina
+    uint64_t limite_memoria;  // Limite de memória do cgroup (0: sem limite)
+    int versao_cgroup;        // 1, 2 ou 0 (cgroup não encontrado)
+} RecursosAmbiente;
+
+RecursosAmbiente recursos_ambiente = {0};
+
+// Lê um limite de um diretório de cgroup: > 0, ou 0 se ausente ou ilimitado
+typedef double (*LeitorLimiteCgroup)(const char* diretorio);
+
+/**
+ * @brief Lê a primeira linha de um arquivo pequeno (ex: de /proc ou do cgroup)
+ * @param caminho Arquivo
+ * @param destino Recebe a linha, sem o '\n'
+ * @param tamanho Tamanho de destino
+ * @return 0 em caso de sucesso, -1 se o arquivo não pôde ser lido
+ */
+int ler_linha_arquivo(const char* caminho, char* destino, size_t tamanho) {
+    FILE* arquivo = fopen(caminho, "r");
+    if (!arquivo) return -1;
+    int lido = fgets(destino, (int)tamanho, arquivo) != NULL;
+    fclose(arquivo);
+    if (!lido) return -1;
+    destino[strcspn(destino, "\n")] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Obtém o caminho do cgroup do processo em /proc/self/cgroup
+ * @param controlador Controlador do cgroup v1 (ex: "memory"), ou NULL para o cgroup v2
+ * @param destino Recebe o caminho (ex: "/kubepods/pod1234/abcd")
+ * @param tamanho Tamanho de destino
+ * @return 0 se encontrado, -1 caso contrário
+ */
+int caminho_cgroup(const char* controlador, char* destino, size_t tamanho) {
+    FILE* arquivo = fopen("/proc/self/cgroup", "r");
+    if (!arquivo) return -1;
+    char linha[PATH_MAX + 256];
+    int encontrado = -1;
+    while (encontrado < 0 && fgets(linha, sizeof(linha), arquivo)) {
+        // Formato: hierarquia:controladores:caminho
+        linha[strcspn(linha, "\n")] = '\0';
+        char* controladores = strchr(linha, ':');
+        char* caminho = controladores ? strchr(controladores + 1, ':') : NULL;
+        if (!caminho) continue;
+        *caminho++ = '\0';
+        controladores++;
+        if (!controlador) {
+            if (strcmp(linha, "0") == 0 && *controladores == '\0') encontrado = 0;
+        } else {
+            for (char* item = strtok(controladores, ","); item; item = strtok(NULL, ",")) {
+                if (strcmp(item, controlador) == 0) encontrado = 0;
+            }
+        }
+        if (encontrado == 0) snprintf(destino, tamanho, "%s", caminho);
+    }
+    fclose(arquivo);
+    return encontrado;
+}
+
+/**
+ * @brief Menor limite entre o cgroup do processo e seus ancestrais
+ * @param raiz Ponto de montagem da hierarquia (ex: /sys/fs/cgroup/memory)
+ * @param relativo Caminho do cgroup do processo dentro da hierarquia
+ * @param ler Leitor do limite em um diretório
+ * @return Menor limite encontrado, ou 0 se nenhum nível tem limite
+ * 
+ * O limite efetivo é o do nível mais restritivo. Dentro de um namespace de
+ * cgroup, o caminho pode não existir sob a raiz montada; nesse caso só os
+ * níveis existentes (no mínimo a própria raiz) são lidos.
+ */
+double menor_limite_cgroup(const char* raiz, const char* relativo, LeitorLimiteCgroup ler) {
+    char diretorio[PATH_MAX];
+    if (snprintf(diretorio, sizeof(diretorio), "%s%s", raiz, strcmp(relativo, "/") == 0 ? "" : relativo) >=
+        (int)sizeof(diretorio)) {
+        snprintf(diretorio, sizeof(diretorio), "%s", raiz);
+    }
+    size_t tamanho_raiz = strlen(raiz);
+    double menor = 0.0;
+    while (1) {
+        double limite = ler(diretorio);
+        if (limite > 0 && (menor == 0 || limite < menor)) menor = limite;
+        char* barra = strrchr(diretorio, '/');
+        if (strlen(diretorio) <= tamanho_raiz || !barra) break;
+        *barra = '\0';
+    }
+    return menor;
+}
+
+/**
+ * @brief Lê a cota de CPU do cgroup v2 (cpu.max: "cota período" ou "max período")
+ * @param diretorio Diretório do cgroup
+ * @return CPUs da cota, ou 0 se não há cota
+ */
+double ler_cota_cpu_v2(const char* diretorio) {
+    char caminho[PATH_MAX + 16], linha[64];
+    snprintf(caminho, sizeof(caminho), "%s/cpu.max", diretorio);
+    long long cota, periodo;
+    if (ler_linha_arquivo(caminho, linha, sizeof(linha)) != 0 ||
+        sscanf(linha, "%lld %lld", &cota, &periodo) != 2 || cota <= 0 || periodo <= 0) {
+        return 0.0;  // Inclui "max": sem cota
+    }
+    return (double)cota / periodo;
+}
+
+/**
+ * @brief Lê o limite de memória do cgroup v2 (memory.max: bytes ou "max")
+ * @param diretorio Diretório do cgroup
+ * @return Limite em bytes, ou 0 se não há limite
+ */
+double ler_limite_memoria_v2(const char* diretorio) {
+    char caminho[PATH_MAX + 16], linha[64];
+    snprintf(caminho, sizeof(caminho), "%s/memory.max", diretorio);
+    if (ler_linha_arquivo(caminho, linha, sizeof(linha)) != 0 || !isdigit((unsigned char)linha[0])) return 0.0;
+    return (double)strtoull(linha, NULL, 10);
+}
+
+/**
+ * @brief Lê a cota de CPU do cgroup v1 (cpu.cfs_quota_us / cpu.cfs_period_us)
+ * @param diretorio Diretório do cgroup
+ * @return CPUs da cota, ou 0 se não há cota (cota -1)
+ */
+double ler_cota_cpu_v1(const char* diretorio) {
+    char caminho[PATH_MAX + 32], linha[64];
+    snprintf(caminho, sizeof(caminho), "%s/cpu.cfs_quota_us", diretorio);
+    if (ler_linha_arquivo(caminho, linha, sizeof(linha)) != 0) return 0.0;
+    long long cota = atoll(linha);
+    snprintf(caminho, sizeof(caminho), "%s/cpu.cfs_period_us", diretorio);
+    if (cota <= 0 || ler_linha_arquivo(caminho, linha, sizeof(linha)) != 0) return 0.0;
+    long long periodo = atoll(linha);
+    return periodo > 0 ? (double)cota / periodo : 0.0;
+}
+
+/**
+ * @brief Lê o limite de memória do cgroup v1 (memory.limit_in_bytes)
+ * @param diretorio Diretório do cgroup
+ * @return Limite em bytes, ou 0 se não há limite
+ * 
+ * Sem limite, o v1 reporta um valor próximo de 2^63 (arredondado à página),
+ * descartado ao comparar com a memória física.
+ */
+double ler_limite_memoria_v1(const char* diretorio) {
+    char caminho[PATH_MAX + 32], linha[64];
+    snprintf(caminho, sizeof(caminho), "%s/memory.limit_in_bytes", diretorio);
+    if (ler_linha_arquivo(caminho, linha, sizeof(linha)) != 0) return 0.0;
+    return (double)strtoull(linha, NULL, 10);
+}
+
+/**
+ * @brief Detecta as CPUs e a memória disponíveis ao processo
+ * @param recursos Recebe o resultado
+ */
+void detectar_recursos_ambiente(RecursosAmbiente* recursos) {
+    memset(recursos, 0, sizeof(*recursos));
+
+    cpu_set_t mascara;
+    CPU_ZERO(&mascara);
+    if (sched_getaffinity(0, sizeof(mascara), &mascara) == 0) {
+        recursos->cpus_afinidade = CPU_COUNT(&mascara);
+    }
+    if (recursos->cpus_afinidade < 1) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        recursos->cpus_afinidade = online > 0 ? (int)online : 1;
+    }
+
+    long paginas = sysconf(_SC_PHYS_PAGES), tamanho_pagina = sysconf(_SC_PAGESIZE);
+    if (paginas > 0 && tamanho_pagina > 0) recursos->memoria_fisica = (uint64_t)paginas * tamanho_pagina;
+
+    char relativo[PATH_MAX];
+    double limite_memoria = 0.0;
+    if (access(RAIZ_CGROUP "/cgroup.controllers", F_OK) == 0) {
+        // cgroup v2: hierarquia única
+        if (caminho_cgroup(NULL, relativo, sizeof(relativo)) != 0) snprintf(relativo, sizeof(relativo), "/");
+        recursos->versao_cgroup = 2;
+        recursos->cota_cpu = menor_limite_cgroup(RAIZ_CGROUP, relativo, ler_cota_cpu_v2);
+        limite_memoria = menor_limite_cgroup(RAIZ_CGROUP, relativo, ler_limite_memoria_v2);
+    } else {
+        // cgroup v1: uma hierarquia por controlador
+        if (caminho_cgroup("cpu", relativo, sizeof(relativo)) == 0) {
+            recursos->versao_cgroup = 1;
+            const char* raiz = access(RAIZ_CGROUP "/cpu,cpuacct", F_OK) == 0 ? RAIZ_CGROUP "/cpu,cpuacct" :
+                                                                                   RAIZ_CGROUP "/cpu";
+            recursos->cota_cpu = menor_limite_cgroup(raiz, relativo, ler_cota_cpu_v1);
+        }
+        if (caminho_cgroup("memory", relativo, sizeof(relativo)) == 0) {
+            recursos->versao_cgroup = 1;
+            limite_memoria = menor_limite_cgroup(RAIZ_CGROUP "/memory", relativo, ler_limite_memoria_v1);
+        }
+    }
+    if (limite_memoria > 0 && (!recursos->memoria_fisica || limite_memoria < (double)recursos->memoria_fisica)) {
+        recursos->limite_memoria = (uint64_t)limite_memoria;
+    }
+
+    recursos->cpus = recursos->cpus_afinidade;
+    if (recursos->cota_cpu > 0) {
+        int cpus_cota = (int)ceil(recursos->cota_cpu - 1e-9);
+        if (cpus_cota < 1) cpus_cota = 1;
+        if (cpus_cota < recursos->cpus) recursos->cpus = cpus_cota;
+    }
+}
+
+/**
+ * @brief Preenche as threads, a fila e os orçamentos não informados pelo usuário
+ * 
+ * Com C CPUs, cerca de 2/3 vão para os consumidores (transformação e
+ * codificação custam várias vezes a decodificação) e o restante para os
+ * produtores, com pelo menos uma thread de cada. A fila guarda duas imagens
+ * por consumidor. Sob um limite de memória do cgroup, o orçamento em voo é
+ * metade dele (o restante cobre a memória temporária de decodificadores e
+ * codificadores) e o pré-carregador pede no máximo 1/8 dele ao page cache.
+ */
+void dimensionar_pelo_ambiente(void) {
+    detectar_recursos_ambiente(&recursos_ambiente);
+    int cpus = config.cpus > 0 ? config.cpus : recursos_ambiente.cpus;
+
+    if (config.num_consumidores == 0) {
+        config.num_consumidores = cpus * 2 / 3;
+        if (config.num_consumidores < 1) config.num_consumidores = 1;
+        if (config.num_consumidores > MAX_CONSUMIDORES) config.num_consumidores = MAX_CONSUMIDORES;
+    }
+    if (config.num_produtores == 0) {
+        config.num_produtores = cpus - config.num_consumidores;
+        if (config.num_produtores < 1) config.num_produtores = 1;
+        if (config.num_produtores > MAX_PRODUTORES) config.num_produtores = MAX_PRODUTORES;
+    }
+    if (config.threads_varredura == 0) {
+        config.threads_varredura = cpus < 4 ? cpus : 4;
+    }
+    if (config.capacidade_fila == 0) {
+        config.capacidade_fila = config.num_consumidores * 2;
+        if (config.capacidade_fila < 4) config.capacidade_fila = 4;
+    }
+
+    uint64_t limite = recursos_ambiente.limite_memoria;
+    if (config.memoria_max_mb < 0) {
+        config.memoria_max_mb = limite ? (long)(limite / 2 / (1024 * 1024)) : 0;
+        if (limite && config.memoria_max_mb < 1) config.memoria_max_mb = 1;
+    }
+    if (limite && limite / 8 < limite_prefetch_bytes) limite_prefetch_bytes = limite / 8;
+}
+
+/**
+ * @brief Exibe as opções de linha de comando
+ * @param programa Nome do executável (argv[0])
+ */
+void exibir_uso(const char* programa) {
+    printf("Uso: %s [opções]\n", programa);
+    printf("  --config=ARQUIVO       Lê as opções de um arquivo; a linha de comando tem precedência\n");
+    printf("  --entrada=DIR          Diretório de entrada (padrão: %s)\n", config.diretorio_entrada);
+    printf("  --saida=DIR            Diretório de saída (padrão: %s)\n", config.diretorio_saida);
+    printf("  --pipeline=LISTA       Operações aplicadas às imagens: cinza, inverter, brilho[=F], contraste[=F],\n");
+    printf("                         miniatura=LADO, recorte=LxA+X+Y (padrão: cinza,inverter,brilho=1.2,contraste=1.3)\n");
+    printf("  --produtores=N         Threads produtoras (padrão: pelas CPUs disponíveis)\n");
+    printf("  --consumidores=N       Threads consumidoras (padrão: pelas CPUs disponíveis)\n");
+    printf("  --capacidade-fila=N    Imagens decodificadas aguardando um consumidor (padrão: duas por\n");
+    printf("                         consumidor, no mínimo 4)\n");
+    printf("  --es=MODO              Motor de E/S: auto, io_uring, pread ou sincrono (padrão: auto)\n");
+    printf("  --profundidade-es=N    Requisições por lote do motor de E/S (padrão: %d)\n", config.profundidade_es);
+    printf("  --prefetch=N           Máximo de arquivos pré-carregados à frente, 0 desativa (padrão: %d)\n", config.prefetch_max);
+    printf("  -r, --recursivo        Percorre também os subdiretórios da entrada\n");
+    printf("  --seguir-links         Segue links simbólicos para diretórios (com proteção contra ciclos)\n");
+    printf("  --threads-varredura=N  Threads da varredura paralela (padrão: uma por CPU, até 4)\n");
+    printf("  --incluir=GLOB         Processa só arquivos que correspondem ao padrão (repetível)\n");
+    printf("  --excluir=GLOB         Ignora arquivos e diretórios que correspondem ao padrão (repetível)\n");
+    printf("  --incremental          Pula arquivos inalterados desde a última execução\n");
+    printf("  --indice=ARQUIVO       Arquivo do índice incremental (padrão: <saída>/%s)\n", NOME_INDICE);
+    printf("  --indice-conteudo      No modo incremental, compara também o hash do conteúdo\n");
+    printf("  --vigiar               Modo daemon: após a varredura, processa arquivos novos até SIGINT/SIGTERM\n");
+    printf("  --janela-rajada=MS     Agrupa eventos do --vigiar chegados em até MS ms (padrão: %d)\n", config.janela_rajada_ms);
+    printf("  --servidor=SOCKET      Atende jobs de outros processos em um socket Unix até SIGINT/SIGTERM\n");
+    printf("  --memoria-compartilhada=NOME  Recebe quadros RGB de outro processo por shm_open + futex\n");
+    printf("  --quadros=N            Quadros do anel em memória compartilhada (padrão: %d)\n", config.num_quadros);
+    printf("  --tamanho-quadro=LxA   Dimensões máximas de um quadro (padrão: %dx%d)\n", config.largura_max_quadro, config.altura_max_quadro);
+    printf("  --fluxo=FORMATO        Processa quadros de stdin para stdout: raw (rgb24), y4m ou ppm\n");
+    printf("  --quadros-em-voo=N     Modo fluxo: máximo de quadros lidos e não escritos (padrão: %d)\n", config.quadros_em_voo);
+    printf("  --ordenado             Grava as imagens na ordem da varredura (nomes de saída não mudam)\n");
+    printf("  --janela-reordenacao=N Saída ordenada: máximo de imagens entre a varredura e a gravação (padrão: %d)\n", config.janela_reordenacao);
+    printf("  --cache=DIR            Reaproveita resultados de entradas com o mesmo conteúdo (cache LRU em disco)\n");
+    printf("  --cache-max=MB         Tamanho máximo do cache (padrão: %ld)\n", config.cache_max_mb);
+    printf("  --cache-alvo=PCT       Ao exceder o máximo, remove as entradas mais antigas até PCT%% dele (padrão: %d)\n", config.cache_alvo);
+    printf("  --deduplicar           Processa uma vez arquivos de conteúdo idêntico e replica a saída\n");
+    printf("  --quase-duplicatas=MODO  Detecta imagens quase idênticas a uma já vista: pular ou marcar\n");
+    printf("  --hash-perceptual=TIPO Hash das quase duplicatas: dhash (padrão) ou phash\n");
+    printf("  --distancia-hamming=N  Bits diferentes até os quais duas imagens são quase duplicatas (padrão: %d)\n", config.distancia_hamming);
+    printf("  --memoria-max=MB       Orçamento de bytes em voo entre as etapas; os produtores esperam ao\n");
+    printf("                         esgotá-lo (padrão: metade do limite do cgroup; 0 desativa)\n");
+    printf("  --autoajuste=MODO      Move threads entre produtores e consumidores durante a execução: ativo,\n");
+    printf("                         fixo (só registra as decisões) ou desligado (padrão)\n");
+    printf("  --numa=MODO            auto (padrão): com mais de um nó NUMA, fixa as threads por nó, com os\n");
+    printf("                         fragmentos da fila divididos entre os nós; desligado: sem fixar threads\n");
+    printf("  --execucao=MODO        pipeline (padrão): produtores decodificam e consumidores transformam e\n");
+    printf("                         gravam; completa: cada thread leva o arquivo do início ao fim, sem fila\n");
+    printf("  --lote=N               Move até N imagens pequenas por operação da fila (padrão: 1)\n");
+    printf("  --relatorio-json=ARQ   Grava vazão, percentis de latência, tempo de CPU e pico de RSS em JSON\n");
+    printf("  --fragmentos=N         Divide a fila em N filas com roubo de trabalho entre elas, contra a\n");
+    printf("                         contenção com muitas threads (padrão: uma por nó NUMA)\n");
+    printf("  --cpus=N               CPUs usadas para dimensionar as threads (padrão: detectadas pela\n");
+    printf("                         afinidade e pela cota do cgroup)\n");
+    printf("  --agendamento=MODO     Ordem de processamento: fifo (da varredura, padrão) ou lpt (maior custo\n");
+    printf("                         estimado primeiro, para equilibrar o fim da execução)\n");
+    printf("  --variante=NOME:OPS[:FMT]  Gera de cada imagem a variante NOME em <saída>/NOME, com as operações\n");
+    printf("                         OPS (ex: miniatura=256) e o formato FMT; repita para várias variantes,\n");
+    printf("                         todas de uma só decodificação (substitui o pipeline padrão)\n");
+    printf("\nCliente do modo servidor:\n");
+    printf("  %s --cliente=SOCKET [opções] ENTRADA SAIDA\n", programa);
+    printf("  %s --carga=SOCKET [opções] IMAGEM\n", programa);
+    printf("  %s --enviar-quadros=NOME [--requisicoes=N] IMAGEM [SAIDA]\n", programa);
+    printf("  %s --bancada-fila=ITENS [--produtores=N] [--consumidores=N] [--fragmentos=N]\n", programa);
+    printf("  --ops=LISTA            Operações, ex: cinza,inverter,brilho=1.2,contraste=1.3 (padrão), miniatura=256,\n");
+    printf("                         recorte=LxA+X+Y\n");
+    printf("  --formato=FMT          Formato do resultado: png, jpg, bmp ou tga (padrão: %s)\n", config.formato);
+    printf("  --enviar-caminho       Envia o caminho do arquivo em vez do conteúdo\n");
+    printf("  --conexoes=N           Conexões simultâneas do gerador de carga (padrão: %d)\n", config.conexoes);
+    printf("  --requisicoes=N        Total de requisições do gerador de carga (padrão: %d)\n", config.requisicoes);
+    printf("\nBancada de desempenho:\n");
+    printf("  %s --gerar-corpus=DIR [--semente=N] [--corpus-imagens=N] [--corpus-max-mp=MP]\n", programa);
+    printf("  %s --bancada=DIR [--bancada-threads=PxC,...] [--bancada-filas=N,...] [--relatorio-json=ARQ]\n", programa);
+    printf("                         [opções repassadas a cada execução]\n");
+    printf("  %s --comparar=BASE.json NOVO.json\n", programa);
+    printf("  --semente=N            Semente do corpus sintético (padrão: %llu)\n", config.semente);
+    printf("  --corpus-imagens=N     Imagens do corpus sintético (padrão: %d)\n", config.corpus_imagens);
+    printf("  --corpus-max-mp=MP     Megapixels da maior imagem do corpus (padrão: %d)\n", config.corpus_max_mp);
+    printf("  --bancada-threads=LISTA  Produtores x consumidores de cada execução (padrão: %s)\n", config.bancada_threads);
+    printf("  --bancada-filas=LISTA  Capacidades da fila de cada execução (padrão: %s)\n", config.bancada_filas);
+    printf("  -h, --ajuda            Exibe esta mensagem\n");
+}
+
+// Identificadores das opções longas, aceitas na linha de comando e (sem os "--") no
+// arquivo de --config. As que também têm forma curta usam a própria letra; as
+// demais começam depois da faixa de caracteres que o getopt devolve.
+enum {
+    OPCAO_AJUDA = 'h',
+    OPCAO_RECURSIVO = 'r',
+    OPCAO_ES = 256,
+    OPCAO_PROFUNDIDADE_ES,
+    OPCAO_PREFETCH,
+    OPCAO_SEGUIR_LINKS,
+    OPCAO_THREADS_VARREDURA,
+    OPCAO_INCLUIR,
+    OPCAO_EXCLUIR,
+    OPCAO_INCREMENTAL,
+    OPCAO_INDICE,
+    OPCAO_INDICE_CONTEUDO,
+    OPCAO_VIGIAR,
+    OPCAO_JANELA_RAJADA,
+    OPCAO_SERVIDOR,
+    OPCAO_CLIENTE,
+    OPCAO_CARGA,
+    OPCAO_OPS,
+    OPCAO_FORMATO,
+    OPCAO_ENVIAR_CAMINHO,
+    OPCAO_CONEXOES,
+    OPCAO_REQUISICOES,
+    OPCAO_MEMORIA_COMPARTILHADA,
+    OPCAO_QUADROS,
+    OPCAO_TAMANHO_QUADRO,
+    OPCAO_ENVIAR_QUADROS,
+    OPCAO_FLUXO,
+    OPCAO_QUADROS_EM_VOO,
+    OPCAO_ORDENADO,
+    OPCAO_JANELA_REORDENACAO,
+    OPCAO_CACHE,
+    OPCAO_CACHE_MAX,
+    OPCAO_CACHE_ALVO,
+    OPCAO_DEDUPLICAR,
+    OPCAO_QUASE_DUPLICATAS,
+    OPCAO_HASH_PERCEPTUAL,
+    OPCAO_DISTANCIA_HAMMING,
+    OPCAO_VARIANTE,
+    OPCAO_AGENDAMENTO,
+    OPCAO_MEMORIA_MAX,
+    OPCAO_CPUS,
+    OPCAO_AUTOAJUSTE,
+    OPCAO_NUMA,
+    OPCAO_FRAGMENTOS,
+    OPCAO_BANCADA_FILA,
+    OPCAO_LOTE,
+    OPCAO_EXECUCAO,
+    OPCAO_GERAR_CORPUS,
+    OPCAO_SEMENTE,
+    OPCAO_CORPUS_IMAGENS,
+    OPCAO_CORPUS_MAX_MP,
+    OPCAO_BANCADA,
+    OPCAO_BANCADA_THREADS,
+    OPCAO_BANCADA_FILAS,
+    OPCAO_RELATORIO_JSON,
+    OPCAO_COMPARAR,
+    OPCAO_CONFIG,
+    OPCAO_PIPELINE,
+    OPCAO_ENTRADA,
+    OPCAO_SAIDA,
+    OPCAO_PRODUTORES,
+    OPCAO_CONSUMIDORES,
+    OPCAO_CAPACIDADE_FILA,
+};
+
+static struct option opcoes_longas[] = {
+    {"es", required_argument, NULL, OPCAO_ES},
+    {"profundidade-es", required_argument, NULL, OPCAO_PROFUNDIDADE_ES},
+    {"prefetch", required_argument, NULL, OPCAO_PREFETCH},
+    {"recursivo", no_argument, NULL, OPCAO_RECURSIVO},
+    {"seguir-links", no_argument, NULL, OPCAO_SEGUIR_LINKS},
+    {"threads-varredura", required_argument, NULL, OPCAO_THREADS_VARREDURA},
+    {"incluir", required_argument, NULL, OPCAO_INCLUIR},
+    {"excluir", required_argument, NULL, OPCAO_EXCLUIR},
+    {"incremental", no_argument, NULL, OPCAO_INCREMENTAL},
+    {"indice", required_argument, NULL, OPCAO_INDICE},
+    {"indice-conteudo", no_argument, NULL, OPCAO_INDICE_CONTEUDO},
+    {"vigiar", no_argument, NULL, OPCAO_VIGIAR},
+    {"janela-rajada", required_argument, NULL, OPCAO_JANELA_RAJADA},
+    {"servidor", required_argument, NULL, OPCAO_SERVIDOR},
+    {"cliente", required_argument, NULL, OPCAO_CLIENTE},
+    {"carga", required_argument, NULL, OPCAO_CARGA},
+    {"ops", required_argument, NULL, OPCAO_OPS},
+    {"formato", required_argument, NULL, OPCAO_FORMATO},
+    {"enviar-caminho", no_argument, NULL, OPCAO_ENVIAR_CAMINHO},
+    {"conexoes", required_argument, NULL, OPCAO_CONEXOES},
+    {"requisicoes", required_argument, NULL, OPCAO_REQUISICOES},
+    {"memoria-compartilhada", required_argument, NULL, OPCAO_MEMORIA_COMPARTILHADA},
+    {"quadros", required_argument, NULL, OPCAO_QUADROS},
+    {"tamanho-quadro", required_argument, NULL, OPCAO_TAMANHO_QUADRO},
+    {"enviar-quadros", required_argument, NULL, OPCAO_ENVIAR_QUADROS},
+    {"fluxo", required_argument, NULL, OPCAO_FLUXO},
+    {"quadros-em-voo", required_argument, NULL, OPCAO_QUADROS_EM_VOO},
+    {"ordenado", no_argument, NULL, OPCAO_ORDENADO},
+    {"janela-reordenacao", required_argument, NULL, OPCAO_JANELA_REORDENACAO},
+    {"cache", required_argument, NULL, OPCAO_CACHE},
+    {"cache-max", required_argument, NULL, OPCAO_CACHE_MAX},
+    {"cache-alvo", required_argument, NULL, OPCAO_CACHE_ALVO},
+    {"deduplicar", no_argument, NULL, OPCAO_DEDUPLICAR},
+    {"quase-duplicatas", required_argument, NULL, OPCAO_QUASE_DUPLICATAS},
+    {"hash-perceptual", required_argument, NULL, OPCAO_HASH_PERCEPTUAL},
+    {"distancia-hamming", required_argument, NULL, OPCAO_DISTANCIA_HAMMING},
+    {"variante", required_argument, NULL, OPCAO_VARIANTE},
+    {"agendamento", required_argument, NULL, OPCAO_AGENDAMENTO},
+    {"memoria-max", required_argument, NULL, OPCAO_MEMORIA_MAX},
+    {"cpus", required_argument, NULL, OPCAO_CPUS},
+    {"autoajuste", required_argument, NULL, OPCAO_AUTOAJUSTE},
+    {"numa", required_argument, NULL, OPCAO_NUMA},
+    {"fragmentos", required_argument, NULL, OPCAO_FRAGMENTOS},
+    {"bancada-fila", required_argument, NULL, OPCAO_BANCADA_FILA},
+    {"lote", required_argument, NULL, OPCAO_LOTE},
+    {"execucao", required_argument, NULL, OPCAO_EXECUCAO},
+    {"gerar-corpus", required_argument, NULL, OPCAO_GERAR_CORPUS},
+    {"semente", required_argument, NULL, OPCAO_SEMENTE},
+    {"corpus-imagens", required_argument, NULL, OPCAO_CORPUS_IMAGENS},
+    {"corpus-max-mp", required_argument, NULL, OPCAO_CORPUS_MAX_MP},
+    {"bancada", required_argument, NULL, OPCAO_BANCADA},
+    {"bancada-threads", required_argument, NULL, OPCAO_BANCADA_THREADS},
+    {"bancada-filas", required_argument, NULL, OPCAO_BANCADA_FILAS},
+    {"relatorio-json", required_argument, NULL, OPCAO_RELATORIO_JSON},
+    {"comparar", required_argument, NULL, OPCAO_COMPARAR},
+    {"config", required_argument, NULL, OPCAO_CONFIG},
+    {"pipeline", required_argument, NULL, OPCAO_PIPELINE},
+    {"entrada", required_argument, NULL, OPCAO_ENTRADA},
+    {"saida", required_argument, NULL, OPCAO_SAIDA},
+    {"produtores", required_argument, NULL, OPCAO_PRODUTORES},
+    {"consumidores", required_argument, NULL, OPCAO_CONSUMIDORES},
+    {"capacidade-fila", required_argument, NULL, OPCAO_CAPACIDADE_FILA},
+    {"ajuda", no_argument, NULL, OPCAO_AJUDA},
+    {NULL, 0, NULL, 0}
+};
+
+/**
+ * @brief Remove as barras finais de um diretório (ex: "fotos/" vira "fotos")
+ * @param diretorio Diretório como informado
+ * @return Cópia normalizada (nunca liberada: vale até o fim do programa)
+ */
+const char* normalizar_diretorio(const char* diretorio) {
+    char* copia = strdup(diretorio);
+    if (!copia) return diretorio;
+    size_t n = strlen(copia);
+    while (n > 1 && copia[n - 1] == '/') copia[--n] = '\0';
+    return copia;
+}
+
+/**
+ * @brief Interpreta um vetor de opções no formato da linha de comando e preenche a configuração
+ * @param argc Número de elementos de argv
+ * @param argv Opções (argv[0] é o nome do programa)
+ * @return 0 para continuar, 1 para sair com sucesso (ajuda), -1 em caso de erro
+ * 
+ * Chamada para as linhas do arquivo de --config e depois para a linha de
+ * comando, que assim sobrescreve o arquivo.
+ */
+int interpretar_opcoes(int argc, char* argv[]) {
+    int opcao;
+    optind = 0; // Reinicia o getopt a cada vetor
+    while ((opcao = getopt_long(argc, argv, "hr", opcoes_longas, NULL)) != -1) {
+        switch (opcao) {
+            case OPCAO_ES:
+                if (strcmp(optarg, "auto") == 0) {
+                    config.modo_es = MODO_ES_AUTO;
+                } else if (strcmp(optarg, "io_uring") == 0) {
+                    config.modo_es = MODO_ES_IO_URING;
+                } else if (strcmp(optarg, "pread") == 0) {
+                    config.modo_es = MODO_ES_PREAD;
+                } else if (strcmp(optarg, "sincrono") == 0) {
+                    config.modo_es = MODO_ES_SINCRONO;
+                } else {
+                    printf("Motor de E/S desconhecido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_PROFUNDIDADE_ES:
+                config.profundidade_es = atoi(optarg);
+                if (config.profundidade_es < 1 || config.profundidade_es > 4096) {
+                    printf("Profundidade de E/S inválida: %s (use 1 a 4096)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_PREFETCH:
+                config.prefetch_max = atoi(optarg);
+                if (config.prefetch_max < 0) {
+                    printf("Valor de prefetch inválido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_RECURSIVO:
+                config.recursivo = 1;
+                break;
+            case OPCAO_SEGUIR_LINKS:
+                config.seguir_links = 1;
+                break;
+            case OPCAO_THREADS_VARREDURA:
+                config.threads_varredura = atoi(optarg);
+                if (config.threads_varredura < 1 || config.threads_varredura > 256) {
+                    printf("Número de threads de varredura inválido: %s (use 1 a 256)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_INCLUIR:
+            case OPCAO_EXCLUIR:
+                if ((opcao == OPCAO_INCLUIR ? config.num_incluir : config.num_excluir) >= MAX_PADROES) {
+                    printf("Máximo de %d padrões de %s\n", MAX_PADROES, opcao == OPCAO_INCLUIR ? "inclusão" : "exclusão");
+                    return -1;
+                }
+                if (opcao == OPCAO_INCLUIR) {
+                    config.incluir[config.num_incluir++] = optarg;
+                } else {
+                    config.excluir[config.num_excluir++] = optarg;
+                }
+                break;
+            case OPCAO_INCREMENTAL:
+                config.incremental = 1;
+                break;
+            case OPCAO_INDICE:
+                config.caminho_indice = optarg;
+                config.incremental = 1;
+                break;
+            case OPCAO_INDICE_CONTEUDO:
+                config.indice_conteudo = 1;
+                config.incremental = 1;
+                break;
+            case OPCAO_VIGIAR:
+                config.vigiar = 1;
+                break;
+            case OPCAO_JANELA_RAJADA:
+                config.janela_rajada_ms = atoi(optarg);
+                if (config.janela_rajada_ms < 1 || config.janela_rajada_ms > RAJADA_MAX_MS) {
+                    printf("Janela de rajada inválida: %s (use 1 a %d)\n", optarg, RAJADA_MAX_MS);
+                    return -1;
+                }
+                break;
+            case OPCAO_SERVIDOR:
+                config.socket_servidor = optarg;
+                break;
+            case OPCAO_CLIENTE:
+            case OPCAO_CARGA:
+                config.modo_execucao = opcao == OPCAO_CLIENTE ? MODO_CLIENTE : MODO_CARGA;
+                config.socket_cliente = optarg;
+                break;
+            case OPCAO_OPS:
+                config.num_operacoes = interpretar_operacoes(optarg, config.operacoes);
+                if (config.num_operacoes < 0) {
+                    printf("Lista de operações inválida: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_FORMATO:
+                if (!formato_saida_valido(optarg)) {
+                    printf("Formato inválido: %s (use png, jpg, bmp ou tga)\n", optarg);
+                    return -1;
+                }
+                config.formato = optarg;
+                break;
+            case OPCAO_ENVIAR_CAMINHO:
+                config.enviar_caminho = 1;
+                break;
+            case OPCAO_CONEXOES:
+                config.conexoes = atoi(optarg);
+                if (config.conexoes < 1 || config.conexoes > 1024) {
+                    printf("Número de conexões inválido: %s (use 1 a 1024)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_REQUISICOES:
+                config.requisicoes = atoi(optarg);
+                if (config.requisicoes < 1) {
+                    printf("Número de requisições inválido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_MEMORIA_COMPARTILHADA:
+                config.nome_memoria = optarg;
+                break;
+            case OPCAO_ENVIAR_QUADROS:
+                config.modo_execucao = MODO_QUADROS;
+                config.nome_memoria = optarg;
+                break;
+            case OPCAO_QUADROS:
+                config.num_quadros = atoi(optarg);
+                if (config.num_quadros < 1 || config.num_quadros > 1024) {
+                    printf("Número de quadros inválido: %s (use 1 a 1024)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_TAMANHO_QUADRO:
+                if (sscanf(optarg, "%dx%d", &config.largura_max_quadro, &config.altura_max_quadro) != 2 ||
+                    config.largura_max_quadro < 1 || config.altura_max_quadro < 1 ||
+                    (long long)config.largura_max_quadro * config.altura_max_quadro > (1LL << 28)) {
+                    printf("Tamanho de quadro inválido: %s (use LARGURAxALTURA)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_FLUXO:
+                if (strcmp(optarg, "raw") == 0) {
+                    config.fluxo = FLUXO_RAW;
+                } else if (strcmp(optarg, "y4m") == 0) {
+                    config.fluxo = FLUXO_Y4M;
+                } else if (strcmp(optarg, "ppm") == 0) {
+                    config.fluxo = FLUXO_PPM;
+                } else {
+                    printf("Formato de fluxo desconhecido: %s (use raw, y4m ou ppm)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_QUADROS_EM_VOO:
+                config.quadros_em_voo = atoi(optarg);
+                if (config.quadros_em_voo < 1 || config.quadros_em_voo > 4096) {
+                    printf("Número de quadros em voo inválido: %s (use 1 a 4096)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_ORDENADO:
+                config.ordenado = 1;
+                break;
+            case OPCAO_AGENDAMENTO:
+                if (strcmp(optarg, "fifo") == 0) {
+                    config.agendamento = AGENDAMENTO_FIFO;
+                } else if (strcmp(optarg, "lpt") == 0) {
+                    config.agendamento = AGENDAMENTO_LPT;
+                } else {
+                    printf("Agendamento inválido: %s (use fifo ou lpt)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_MEMORIA_MAX:
+                config.memoria_max_mb = atol(optarg);
+                if (config.memoria_max_mb < 0) {
+                    printf("Orçamento de memória inválido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_AUTOAJUSTE:
+                if (strcmp(optarg, "ativo") == 0) {
+                    config.autoajuste = AUTOAJUSTE_ATIVO;
+                } else if (strcmp(optarg, "fixo") == 0) {
+                    config.autoajuste = AUTOAJUSTE_FIXO;
+                } else if (strcmp(optarg, "desligado") == 0) {
+                    config.autoajuste = AUTOAJUSTE_DESLIGADO;
+                } else {
+                    printf("Autoajuste inválido: %s (use ativo, fixo ou desligado)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_NUMA:
+                if (strcmp(optarg, "auto") == 0) {
+                    config.numa = 1;
+                } else if (strcmp(optarg, "desligado") == 0) {
+                    config.numa = 0;
+                } else {
+                    printf("Modo NUMA inválido: %s (use auto ou desligado)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_GERAR_CORPUS:
+                config.modo_execucao = MODO_GERAR_CORPUS;
+                config.diretorio_corpus = normalizar_diretorio(optarg);
+                break;
+            case OPCAO_SEMENTE: {
+                char* fim;
+                errno = 0;
+                config.semente = strtoull(optarg, &fim, 10);
+                if (errno || fim == optarg || *fim != '\0') {
+                    printf("Semente inválida: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case OPCAO_CORPUS_IMAGENS:
+                config.corpus_imagens = atoi(optarg);
+                if (config.corpus_imagens < 1 || config.corpus_imagens > 100000) {
+                    printf("Número de imagens do corpus inválido: %s (use 1 a 100000)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_CORPUS_MAX_MP:
+                config.corpus_max_mp = atoi(optarg);
+                if (config.corpus_max_mp < 1 || config.corpus_max_mp > 1000) {
+                    printf("Tamanho máximo do corpus inválido: %s (use 1 a 1000 MP)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_BANCADA:
+                config.modo_execucao = MODO_BANCADA;
+                config.diretorio_corpus = normalizar_diretorio(optarg);
+                break;
+            case OPCAO_BANCADA_THREADS:
+                config.bancada_threads = optarg;
+                break;
+            case OPCAO_BANCADA_FILAS:
+                config.bancada_filas = optarg;
+                break;
+            case OPCAO_RELATORIO_JSON:
+                config.relatorio_json = optarg;
+                break;
+            case OPCAO_COMPARAR:
+                config.modo_execucao = MODO_COMPARAR;
+                config.relatorio_base = optarg;
+                break;
+            case OPCAO_EXECUCAO:
+                if (strcmp(optarg, "completa") == 0) {
+                    config.execucao_completa = 1;
+                } else if (strcmp(optarg, "pipeline") == 0) {
+                    config.execucao_completa = 0;
+                } else {
+                    printf("Modo de execução inválido: %s (use pipeline ou completa)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_LOTE:
+                config.lote = atoi(optarg);
+                if (config.lote < 1 || config.lote > MAX_LOTE) {
+                    printf("Tamanho de lote inválido: %s (use 1 a %d)\n", optarg, MAX_LOTE);
+                    return -1;
+                }
+                break;
+            case OPCAO_FRAGMENTOS:
+                config.fragmentos = atoi(optarg);
+                if (config.fragmentos < 1 || config.fragmentos > MAX_FRAGMENTOS) {
+                    printf("Número de fragmentos inválido: %s (use 1 a %d)\n", optarg, MAX_FRAGMENTOS);
+                    return -1;
+                }
+                break;
+            case OPCAO_BANCADA_FILA:
+                config.modo_execucao = MODO_BANCADA_FILA;
+                config.itens_bancada = atol(optarg);
+                if (config.itens_bancada < 1) {
+                    printf("Número de itens inválido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_CPUS:
+                config.cpus = atoi(optarg);
+                if (config.cpus < 1 || config.cpus > 4096) {
+                    printf("Número de CPUs inválido: %s (use 1 a 4096)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_JANELA_REORDENACAO:
+                config.janela_reordenacao = atoi(optarg);
+                if (config.janela_reordenacao < 1 || config.janela_reordenacao > 65536) {
+                    printf("Janela de reordenação inválida: %s (use 1 a 65536)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_CACHE:
+                config.diretorio_cache = optarg;
+                break;
+            case OPCAO_CACHE_MAX:
+                config.cache_max_mb = atol(optarg);
+                if (config.cache_max_mb < 1) {
+                    printf("Tamanho de cache inválido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_CACHE_ALVO:
+                config.cache_alvo = atoi(optarg);
+                if (config.cache_alvo < 1 || config.cache_alvo > 100) {
+                    printf("Alvo do cache inválido: %s (use 1 a 100)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_DEDUPLICAR:
+                config.deduplicar = 1;
+                break;
+            case OPCAO_QUASE_DUPLICATAS:
+                if (strcmp(optarg, "pular") == 0) {
+                    config.quase_duplicatas = QUASE_PULAR;
+                } else if (strcmp(optarg, "marcar") == 0) {
+                    config.quase_duplicatas = QUASE_MARCAR;
+                } else {
+                    printf("Modo de quase duplicatas inválido: %s (use pular ou marcar)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_HASH_PERCEPTUAL:
+                if (strcmp(optarg, "dhash") == 0) {
+                    config.hash_perceptual = HASH_DHASH;
+                } else if (strcmp(optarg, "phash") == 0) {
+                    config.hash_perceptual = HASH_PHASH;
+                } else {
+                    printf("Hash perceptual inválido: %s (use dhash ou phash)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_DISTANCIA_HAMMING:
+                config.distancia_hamming = atoi(optarg);
+                if (config.distancia_hamming < 0 || config.distancia_hamming > 32) {
+                    printf("Distância de Hamming inválida: %s (use 0 a 32)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_VARIANTE:
+                if (config.num_variantes >= MAX_VARIANTES) {
+                    printf("Variantes demais (máximo: %d)\n", MAX_VARIANTES);
+                    return -1;
+                }
+                if (interpretar_variante(optarg, &config.variantes[config.num_variantes]) != 0) {
+                    printf("Variante inválida: %s (use NOME:OPERACOES[:png|jpg|bmp|tga])\n", optarg);
+                    return -1;
+                }
+                for (int i = 0; i < config.num_variantes; i++) {
+                    if (strcmp(config.variantes[i].nome, config.variantes[config.num_variantes].nome) == 0) {
+                        printf("Variante repetida: %s\n", config.variantes[i].nome);
+                        return -1;
+                    }
+                }
+                config.num_variantes++;
+                break;
+            case OPCAO_CONFIG:
+                break; // Já carregado por processar_argumentos()
+            case OPCAO_PIPELINE:
+                config.num_pipeline = interpretar_operacoes(optarg, config.pipeline);
+                if (config.num_pipeline < 0) {
+                    printf("Pipeline inválido: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_ENTRADA:
+                config.diretorio_entrada = normalizar_diretorio(optarg);
+                break;
+            case OPCAO_SAIDA:
+                config.diretorio_saida = normalizar_diretorio(optarg);
+                break;
+            case OPCAO_PRODUTORES:
+                config.num_produtores = atoi(optarg);
+                if (config.num_produtores < 1 || config.num_produtores > MAX_PRODUTORES) {
+                    printf("Número de produtores inválido: %s (use 1 a %d)\n", optarg, MAX_PRODUTORES);
+                    return -1;
+                }
+                break;
+            case OPCAO_CONSUMIDORES:
+                config.num_consumidores = atoi(optarg);
+                if (config.num_consumidores < 1 || config.num_consumidores > MAX_CONSUMIDORES) {
+                    printf("Número de consumidores inválido: %s (use 1 a %d)\n", optarg, MAX_CONSUMIDORES);
+                    return -1;
+                }
+                break;
+            case OPCAO_CAPACIDADE_FILA:
+                config.capacidade_fila = atoi(optarg);
+                if (config.capacidade_fila < 1 || config.capacidade_fila > 65536) {
+                    printf("Capacidade da fila inválida: %s (use 1 a 65536)\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPCAO_AJUDA:
+                exibir_uso(argv[0]);
+                return 1;
+            default:
+                exibir_uso(argv[0]);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// Linhas do arquivo de --config: a configuração aponta para elas até o fim do programa
+char** argumentos_config = NULL;
+
+/**
+ * @brief Carrega um arquivo de configuração (--config)
+ * @param caminho Arquivo com uma opção por linha: "nome = valor" ou só "nome"
+ * @param programa Nome do programa (para as mensagens de uso)
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ * 
+ * Os nomes são os das opções longas, sem os "--"; linhas vazias e
+ * iniciadas por '#' são ignoradas. Exemplo:
+ * 
+ *     entrada = fotos
+ *     pipeline = cinza,brilho=1.1,miniatura=512
+ *     produtores = 4
+ *     recursivo
+ */
+int carregar_arquivo_config(const char* caminho, char* programa) {
+    FILE* arquivo = fopen(caminho, "r");
+    if (!arquivo) {
+        printf("Erro ao abrir arquivo de configuração %s: %s\n", caminho, strerror(errno));
+        return -1;
+    }
+
+    int n = 0, capacidade = 2;
+    char** vetor = (char**)malloc(capacidade * sizeof(char*));
+    if (!vetor) {
+        perror("Erro ao carregar arquivo de configuração");
+        fclose(arquivo);
+        return -1;
+    }
+    vetor[n++] = programa;
+
+    char linha[4096];
+    int numero = 0, resultado = 0;
+    while (fgets(linha, sizeof(linha), arquivo)) {
+        numero++;
+        char* inicio = linha;
+        while (isspace((unsigned char)*inicio)) inicio++;
+        char* fim = inicio + strlen(inicio);
+        while (fim > inicio && isspace((unsigned char)fim[-1])) *--fim = '\0';
+        if (*inicio == '\0' || *inicio == '#') continue;
+
+        char* valor = strchr(inicio, '=');
+        if (valor) {
+            char* fim_nome = valor;
+            while (fim_nome > inicio && isspace((unsigned char)fim_nome[-1])) fim_nome--;
+            *fim_nome = '\0';
+            valor++;
+            while (isspace((unsigned char)*valor)) valor++;
+        }
+        if (strcmp(inicio, "config") == 0) {
+            printf("%s:%d: --config não pode ser usado dentro de um arquivo de configuração\n", caminho, numero);
+            resultado = -1;
+            break;
+        }
+
+        // Sempre sobra uma posição para o NULL final
+        if (n + 1 >= capacidade) {
+            int nova_capacidade = capacidade * 2;
+            char** maior = (char**)realloc(vetor, nova_capacidade * sizeof(char*));
+            if (!maior) {
+                perror("Erro ao carregar arquivo de configuração");
+                resultado = -1;
+                break;
+            }
+            vetor = maior;
+            capacidade = nova_capacidade;
+        }
+        size_t tamanho = strlen(inicio) + (valor ? strlen(valor) + 1 : 0) + 3;
+        char* argumento = (char*)malloc(tamanho);
+        if (!argumento) {
+            perror("Erro ao carregar arquivo de configuração");
+            resultado = -1;
+            break;
+        }
+        snprintf(argumento, tamanho, valor ? "--%s=%s" : "--%s", inicio, valor);
+        vetor[n++] = argumento;
+    }
+    fclose(arquivo);
+    vetor[n] = NULL;
+
+    if (resultado == 0) {
+        resultado = interpretar_opcoes(n, vetor);
+        if (resultado == 0 && optind < n) {
+            printf("%s: opção inválida: %s\n", caminho, vetor[optind]);
+            resultado = -1;
+        }
+    }
+
+    // Sem sucesso o programa encerra, e nada mais lê a configuração; o
+    // getopt pode ter permutado o vetor, mas vetor[0] continua sendo o programa
+    if (resultado != 0) {
+        for (int i = 1; i < n; i++) free(vetor[i]);
+        free(vetor);
+        return resultado;
+    }
+    argumentos_config = vetor;
+    return 0;
+}
+
+/**
+ * @brief Interpreta o arquivo de --config e a linha de comando
+ * @param argc Número de argumentos
+ * @param argv Argumentos
+ * @return 0 para continuar, 1 para sair com sucesso (ajuda), -1 em caso de erro
+ * 
+ * Ao final, compila o pipeline e as variantes em planos de execução.
+ */
+int processar_argumentos(int argc, char* argv[]) {
+    // O arquivo vem primeiro, para que a linha de comando possa sobrescrevê-lo
+    for (int i = 1; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        const char* arquivo = NULL;
+        if (strncmp(argv[i], "--config=", 9) == 0) {
+            arquivo = argv[i] + 9;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            arquivo = argv[i + 1];
+        }
+        if (arquivo) {
+            int resultado = carregar_arquivo_config(arquivo, argv[0]);
+            if (resultado != 0) return resultado;
+            break;
+        }
+    }
+
+    int resultado = interpretar_opcoes(argc, argv);
+    if (resultado != 0) return resultado;
+
+    if (config.num_variantes > 0 && (config.ordenado || config.diretorio_cache || config.deduplicar)) {
+        // Essas opções supõem uma única saída por arquivo de entrada
+        printf("--variante não pode ser combinada com --ordenado, --cache ou --deduplicar\n");
+        return -1;
+    }
+
+    if (config.execucao_completa && (config.fluxo || config.socket_servidor || config.nome_memoria ||
+                                     config.autoajuste != AUTOAJUSTE_DESLIGADO)) {
+        // Quadros e conexões chegam por outra thread; sem estágios, não há o que rebalancear
+        printf("--execucao=completa não pode ser combinada com --fluxo, --servidor, --memoria-compartilhada "
+               "ou --autoajuste\n");
+        return -1;
+    }
+
+    if (config.agendamento == AGENDAMENTO_LPT && config.ordenado) {
+        // A janela de reordenação supõe que as imagens saiam na ordem da varredura
+        printf("--agendamento=lpt não pode ser combinado com --ordenado\n");
+        return -1;
+    }
+
+    // --pipeline é compilado uma única vez; as variantes, por imagem (já com as dimensões)
+    compilar_plano(config.pipeline, config.num_pipeline, 0, 0, &plano_pipeline);
+    if (plano_pipeline.altera_dimensoes && (config.fluxo || config.nome_memoria)) {
+        // Quadros são devolvidos no mesmo buffer, com a mesma geometria
+        printf("--pipeline com miniatura ou recorte não se aplica a --fluxo nem a --memoria-compartilhada\n");
+        return -1;
+    }
+
+    config.argumentos = argv + optind;
+    config.num_argumentos = argc - optind;
+    if (config.modo_execucao == MODO_PROCESSAR && config.num_argumentos > 0) {
+        printf("Argumento inesperado: %s\n", config.argumentos[0]);
+        exibir_uso(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+// Bancada de desempenho (--gerar-corpus, --bancada, --comparar): gera um
+// corpus sintético reproduzível, executa o pipeline para cada combinação de
+// threads e capacidade da fila e grava um relatório JSON com uma execução
+// por linha; --comparar mostra a variação entre dois relatórios. Cada
+// execução é um processo filho, para que nenhuma herde o orçamento, os
+// caches em memória nem o pico de RSS da anterior. O page cache do kernel,
+// esse, é compartilhado: uma execução de aquecimento, descartada, lê o
+// corpus antes das medidas, para que todas encontrem o mesmo page cache
+// quente (e a primeira não pague sozinha as leituras do disco).
+#define CORPUS_MAX_MP_FOTO 12        // Fotos do corpus: de 1 a 12 MP (só a primeira imagem chega a --corpus-max-mp)
+#define MAX_EXECUCOES_BANCADA 64     // Combinações de threads e de filas, cada
+#define COMPARACAO_LIMIAR_PCT 5.0    // Variação abaixo da qual a comparação não diz melhor nem pior
+
+/**
+ * @brief Próximo número do gerador pseudoaleatório do corpus (splitmix64)
+ * @param estado Estado do gerador (avança a cada chamada)
+ * @return 64 bits pseudoaleatórios
+ */
+uint64_t aleatorio_proximo(uint64_t* estado) {
+    uint64_t z = (*estado += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Sorteia um inteiro no intervalo [minimo, maximo]
+ * @param estado Estado do gerador
+ * @param minimo Menor valor
+ * @param maximo Maior valor
+ * @return Valor sorteado
+ */
+int aleatorio_entre(uint64_t* estado, int minimo, int maximo) {
+    return minimo + (int)(aleatorio_proximo(estado) % (uint64_t)(maximo - minimo + 1));
+}
+
+/**
+ * @brief Preenche os pixels RGB de uma imagem sintética
+ * @param pixels Buffer de largura * altura * 3 bytes
+ * @param largura Largura da imagem
+ * @param altura Altura da imagem
+ * @param ruido 1: ruído uniforme (o pior caso dos codificadores); 0: gradientes suaves
+ * @param estado Estado do gerador
+ * @return 0 em caso de sucesso, -1 sem memória
+ */
+int corpus_preencher(unsigned char* pixels, int largura, int altura, int ruido, uint64_t* estado) {
+    size_t total = (size_t)largura * altura * 3;
+    if (ruido) {
+        for (size_t i = 0; i < total; i += 8) {
+            uint64_t bits = aleatorio_proximo(estado);
+            memcpy(pixels + i, &bits, total - i < 8 ? total - i : 8);
+        }
+        return 0;
+    }
+
+    // Ondas de baixa frequência separáveis: uma tabela por coluna e outra por linha
+    double frequencia_x = aleatorio_entre(estado, 1, 6) * 2 * M_PI / largura;
+    double frequencia_y = aleatorio_entre(estado, 1, 6) * 2 * M_PI / altura;
+    double fase = aleatorio_entre(estado, 0, 359) * M_PI / 180;
+    unsigned char* colunas = (unsigned char*)malloc(largura);
+    unsigned char* linhas = (unsigned char*)malloc(altura);
+    if (!colunas || !linhas) {
+        free(colunas);
+        free(linhas);
+        return -1;
+    }
+    for (int x = 0; x < largura; x++) colunas[x] = (unsigned char)(127.5 + 127.5 * sin(frequencia_x * x + fase));
+    for (int y = 0; y < altura; y++) linhas[y] = (unsigned char)(127.5 + 127.5 * cos(frequencia_y * y));
+    for (int y = 0; y < altura; y++) {
+        unsigned char* linha = pixels + (size_t)y * largura * 3;
+        for (int x = 0; x < largura; x++) {
+            linha[x * 3] = colunas[x];
+            linha[x * 3 + 1] = linhas[y];
+            linha[x * 3 + 2] = (unsigned char)((colunas[x] + linhas[y]) / 2);
+        }
+    }
+    free(colunas);
+    free(linhas);
+    return 0;
+}
+
+/**
+ * @brief Gera o corpus sintético (--gerar-corpus, ou --bancada com um diretório inexistente)
+ * @param diretorio Diretório onde as imagens são criadas
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ * 
+ * A mesma semente gera os mesmos arquivos, byte a byte: cada imagem tem um
+ * gerador próprio, derivado da semente e do seu índice. A primeira imagem
+ * tem --corpus-max-mp megapixels; as demais são sorteadas entre ícones (16 a
+ * 64 px, 45%), miniaturas (128 a 512 px, 30%) e fotos (1 a 12 MP, 25%), com
+ * ruído ou gradientes suaves e em PNG, JPEG, BMP ou TGA. O nome do arquivo
+ * descreve a imagem (ex: 0007_foto_ruido_2309x1732.jpg).
+ */
+int gerar_corpus(const char* diretorio) {
+    static const char* extensoes[] = { "png", "jpg", "bmp", "tga" };
+    if (criar_diretorios(diretorio, 0755) != 0) {
+        printf("Erro ao criar diretório %s: %s\n", diretorio, strerror(errno));
+        return -1;
+    }
+    printf("Gerando corpus em %s: %d imagens, semente %llu, até %d MP\n", diretorio, config.corpus_imagens,
+           config.semente, config.corpus_max_mp);
+
+    int max_foto = config.corpus_max_mp < CORPUS_MAX_MP_FOTO ? config.corpus_max_mp : CORPUS_MAX_MP_FOTO;
+    double megapixels_total = 0.0;
+    uint64_t bytes_total = 0;
+    for (int i = 0; i < config.corpus_imagens; i++) {
+        uint64_t estado = config.semente ^ (0xD1B54A32D192ED03ULL * (uint64_t)(i + 1));
+        int sorteio = aleatorio_entre(&estado, 0, 99);
+        const char* classe;
+        int largura, altura;
+        if (i == 0 || sorteio >= 75) {
+            // A maior imagem e as fotos, em 4:3 ou 3:4
+            int megapixels = i == 0 ? config.corpus_max_mp : aleatorio_entre(&estado, 1, max_foto);
+            largura = (int)sqrt(megapixels * 1e6 * 4 / 3);
+            altura = largura * 3 / 4;
+            if (aleatorio_entre(&estado, 0, 1)) {
+                int troca = largura;
+                largura = altura;
+                altura = troca;
+            }
+            classe = i == 0 ? "maior" : "foto";
+        } else if (sorteio >= 45) {
+            largura = aleatorio_entre(&estado, 128, 512);
+            altura = aleatorio_entre(&estado, 128, 512);
+            classe = "miniatura";
+        } else {
+            largura = altura = aleatorio_entre(&estado, 16, 64);
+            classe = "icone";
+        }
+        int ruido = aleatorio_entre(&estado, 0, 1);
+        int formato = aleatorio_entre(&estado, 0, 3);
+
+        char caminho[PATH_MAX];
+        snprintf(caminho, sizeof(caminho), "%s/%04d_%s_%s_%dx%d.%s", diretorio, i, classe,
+                 ruido ? "ruido" : "suave", largura, altura, extensoes[formato]);
+        unsigned char* pixels = (unsigned char*)malloc((size_t)largura * altura * 3);
+        if (!pixels || corpus_preencher(pixels, largura, altura, ruido, &estado) != 0) {
+            printf("Sem memória para gerar %s\n", caminho);
+            free(pixels);
+            return -1;
+        }
+        int gravada;
+        switch (formato) {
+            case 0: gravada = stbi_write_png(caminho, largura, altura, 3, pixels, largura * 3); break;
+            case 1: gravada = stbi_write_jpg(caminho, largura, altura, 3, pixels, QUALIDADE_JPG); break;
+            case 2: gravada = stbi_write_bmp(caminho, largura, altura, 3, pixels); break;
+            default: gravada = stbi_write_tga(caminho, largura, altura, 3, pixels); break;
+        }
+        free(pixels);
+        if (!gravada) {
+            printf("Erro ao gravar %s\n", caminho);
+            return -1;
+        }
+
+        struct stat st;
+        if (stat(caminho, &st) == 0) bytes_total += st.st_size;
+        megapixels_total += (double)largura * altura / 1e6;
+        printf("  - %s\n", caminho);
+    }
+    printf("Corpus gerado: %d imagens, %.1f MP, %.2f MB\n", config.corpus_imagens, megapixels_total,
+           bytes_total / (1024.0 * 1024.0));
+    return 0;
+}
+
+/**
+ * @brief Escreve uma string JSON entre aspas, com os escapes necessários
+ * @param arquivo Destino
+ * @param texto String a escrever
+ */
+void escrever_texto_json(FILE* arquivo, const char* texto) {
+    fputc('"', arquivo);
+    for (const unsigned char* c = (const unsigned char*)texto; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(arquivo, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(arquivo, "\\u%04x", *c);
+        } else {
+            fputc(*c, arquivo);
+        }
+    }
+    fputc('"', arquivo);
+}
+
+/**
+ * @brief Percentil de um vetor de latências já ordenado (pelo posto mais próximo)
+ * @param latencias Latências em segundos, em ordem crescente
+ * @param n Número de latências
+ * @param fracao Percentil desejado (ex: 0.99)
+ * @return Latência em milissegundos (0 sem amostras)
+ * 
+ * O percentil p é a menor amostra com pelo menos p das amostras até ela:
+ * a de posição ceil(p * n), contando de 1.
+ */
+double percentil_ms(const double* latencias, size_t n, double fracao) {
+    if (!n) return 0.0;
+    double posto = ceil(fracao * n);
+    size_t indice = posto < 1 ? 0 : (size_t)posto - 1;
+    if (indice >= n) indice = n - 1;
+    return latencias[indice] * 1e3;
+}
+
+/**
+ * @brief Escreve, em uma única linha, o objeto JSON desta execução
+ * @param arquivo Destino
+ * @param tempo_total Duração do processamento em segundos
+ * 
+ * Uma linha por execução é o formato que ler_execucoes_relatorio() e
+ * --comparar leem, sem precisar de um parser JSON completo.
+ */
+void escrever_execucao_json(FILE* arquivo, double tempo_total) {
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    long imagens = 0;
+    for (int i = 0; i < config.num_consumidores; i++) imagens += metricas_consumidores[i].imagens_processadas;
+    size_t n = num_latencias_imagens;
+    if (n) qsort(latencias_imagens, n, sizeof(double), comparar_latencias);
+
+    // Na execução completa, produtores e consumidores são as mesmas threads
+    if (config.execucao_completa) {
+        fprintf(arquivo, "{\"trabalhadores\": %d, ", config.num_produtores);
+    } else {
+        fprintf(arquivo, "{\"produtores\": %d, \"consumidores\": %d, ", config.num_produtores, config.num_consumidores);
+    }
+    fprintf(arquivo, "\"capacidade_fila\": %d, \"execucao\": \"%s\", "
+            "\"lote\": %d, \"imagens\": %ld, \"megapixels\": %.3f, \"tempo_s\": %.4f, \"imagens_por_s\": %.2f, "
+            "\"megapixels_por_s\": %.3f, \"latencia_p50_ms\": %.3f, \"latencia_p90_ms\": %.3f, "
+            "\"latencia_p99_ms\": %.3f, \"latencia_max_ms\": %.3f, \"cpu_usuario_s\": %.3f, "
+            "\"cpu_sistema_s\": %.3f, \"pico_rss_mb\": %.2f}",
+            config.capacidade_fila,
+            config.execucao_completa ? "completa" : "pipeline", config.lote, imagens, megapixels_processados,
+            tempo_total, tempo_total > 0 ? imagens / tempo_total : 0.0,
+            tempo_total > 0 ? megapixels_processados / tempo_total : 0.0,
+            percentil_ms(latencias_imagens, n, 0.50), percentil_ms(latencias_imagens, n, 0.90),
+            percentil_ms(latencias_imagens, n, 0.99), percentil_ms(latencias_imagens, n, 1.0),
+            uso.ru_utime.tv_sec + uso.ru_utime.tv_usec / 1e6, uso.ru_stime.tv_sec + uso.ru_stime.tv_usec / 1e6,
+            uso.ru_maxrss / 1024.0);
+}
+
+/**
+ * @brief Grava o relatório JSON de uma execução (--relatorio-json)
+ * @param caminho Arquivo do relatório
+ * @param tempo_total Duração do processamento em segundos
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int gravar_relatorio_json(const char* caminho, double tempo_total) {
+    FILE* arquivo = fopen(caminho, "w");
+    if (!arquivo) {
+        printf("Erro ao gravar relatório %s: %s\n", caminho, strerror(errno));
+        return -1;
+    }
+    fprintf(arquivo, "{\n  \"corpus\": ");
+    escrever_texto_json(arquivo, config.diretorio_entrada);
+    fprintf(arquivo, ",\n  \"execucoes\": [\n    ");
+    escrever_execucao_json(arquivo, tempo_total);
+    fprintf(arquivo, "\n  ]\n}\n");
+    if (fclose(arquivo) != 0) {
+        printf("Erro ao gravar relatório %s: %s\n", caminho, strerror(errno));
+        return -1;
+    }
+    printf("\nRelatório gravado em %s\n", caminho);
+    return 0;
+}
+
+/**
+ * @brief Lê as execuções de um relatório JSON (uma por linha)
+ * @param caminho Arquivo do relatório
+ * @param linhas Recebe as linhas das execuções (liberar com liberar_execucoes_relatorio())
+ * @return Número de execuções, ou -1 em caso de erro
+ */
+int ler_execucoes_relatorio(const char* caminho, char*** linhas) {
+    FILE* arquivo = fopen(caminho, "r");
+    if (!arquivo) {
+        printf("Erro ao abrir relatório %s: %s\n", caminho, strerror(errno));
+        return -1;
+    }
+    *linhas = NULL;
+    int n = 0;
+    char* linha = NULL;
+    size_t tamanho = 0;
+    while (getline(&linha, &tamanho, arquivo) > 0) {
+        if (!strstr(linha, "\"imagens_por_s\":")) continue;
+        char** maior = (char**)realloc(*linhas, (n + 1) * sizeof(char*));
+        if (!maior) break;
+        *linhas = maior;
+        (*linhas)[n++] = linha;
+        linha = NULL;
+        tamanho = 0;
+    }
+    free(linha);
+    fclose(arquivo);
+    return n;
+}
+
+/**
+ * @brief Libera as linhas lidas por ler_execucoes_relatorio()
+ * @param linhas Linhas das execuções
+ * @param n Número de execuções
+ */
+void liberar_execucoes_relatorio(char** linhas, int n) {
+    for (int i = 0; i < n; i++) free(linhas[i]);
+    free(linhas);
+}
+
+/**
+ * @brief Lê um campo numérico da linha de uma execução
+ * @param linha Objeto JSON da execução
+ * @param campo Nome do campo
+ * @param valor Recebe o valor
+ * @return 1 se o campo existe, 0 caso contrário
+ */
+int json_numero(const char* linha, const char* campo, double* valor) {
+    char padrao[64];
+    snprintf(padrao, sizeof(padrao), "\"%s\":", campo);
+    const char* inicio = strstr(linha, padrao);
+    if (!inicio) return 0;
+    inicio += strlen(padrao);
+    char* fim;
+    *valor = strtod(inicio, &fim);
+    return fim != inicio;
+}
+
+/**
+ * @brief Descreve a configuração de uma execução (ex: "2x2, fila 64, pipeline")
+ * @param linha Objeto JSON da execução
+ * @param destino Buffer do rótulo
+ * @param tamanho Tamanho do buffer
+ * 
+ * A execução completa é descrita pelos trabalhadores (ex: "4 trabalhadores,
+ * fila 64, completa").
+ */
+void rotulo_execucao(const char* linha, char* destino, size_t tamanho) {
+    double produtores = 0, consumidores = 0, trabalhadores = 0, fila = 0, lote = 1;
+    json_numero(linha, "produtores", &produtores);
+    json_numero(linha, "consumidores", &consumidores);
+    json_numero(linha, "capacidade_fila", &fila);
+    json_numero(linha, "lote", &lote);
+    const char* execucao = strstr(linha, "\"execucao\": \"completa\"") ? "completa" : "pipeline";
+    int n;
+    if (json_numero(linha, "trabalhadores", &trabalhadores)) {
+        n = snprintf(destino, tamanho, "%.0f trabalhadores, fila %.0f, %s", trabalhadores, fila, execucao);
+    } else {
+        n = snprintf(destino, tamanho, "%.0fx%.0f, fila %.0f, %s", produtores, consumidores, fila, execucao);
+    }
+    if (lote > 1 && n > 0 && (size_t)n < tamanho) snprintf(destino + n, tamanho - n, ", lote %.0f", lote);
+}
+
+/**
+ * @brief Remove um item da árvore de saída de uma execução (callback de nftw)
+ */
+int remover_item_bancada(const char* caminho, const struct stat* st, int tipo, struct FTW* ftw) {
+    (void)st;
+    (void)tipo;
+    (void)ftw;
+    remove(caminho);
+    return 0;
+}
+
+/**
+ * @brief Executa o pipeline em um processo filho
+ * @param argv Argumentos do filho (terminados em NULL)
+ * @return Código de saída do filho, ou -1 se ele não pôde rodar ou foi interrompido
+ * 
+ * O log do filho vai para /dev/null: só o relatório dele interessa.
+ */
+int executar_filho_bancada(char** argv) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Erro ao criar processo da bancada");
+        return -1;
+    }
+    if (pid == 0) {
+        int nulo = open("/dev/null", O_WRONLY);
+        if (nulo >= 0) {
+            dup2(nulo, STDOUT_FILENO);
+            dup2(nulo, STDERR_FILENO);
+            close(nulo);
+        }
+        execv("/proc/self/exe", argv);
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * @brief Indica se uma opção longa pertence à bancada (e não é repassada às execuções)
+ * @param nome Nome da opção, sem os "--" (pode continuar com "=valor")
+ * @param tamanho Tamanho do nome
+ * @return 1 se a bancada define a opção em cada execução
+ */
+int opcao_da_bancada(const char* nome, size_t tamanho) {
+    // --config também fica: o arquivo poderia trazer a própria --bancada
+    static const char* proprias[] = {
+        "bancada", "bancada-threads", "bancada-filas", "relatorio-json", "gerar-corpus", "semente",
+        "corpus-imagens", "corpus-max-mp", "comparar", "entrada", "saida", "produtores", "consumidores",
+        "capacidade-fila", "config",
+    };
+    for (size_t i = 0; i < sizeof(proprias) / sizeof(proprias[0]); i++) {
+        if (strlen(proprias[i]) == tamanho && strncmp(proprias[i], nome, tamanho) == 0) return 1;
+    }
+    return 0;
 }
 
 /**
- * @brief Destrói uma fila de imagens e libera seus recursos
- * @param fila Ponteiro para a fila a ser destruída
- * 
- * Libera todos os recursos associados à fila, incluindo:
- * - Mutex e semáforos
- * - Array de imagens
- * - Array de futures
- * - Estrutura da fila
+ * @brief Lê uma lista de inteiros separados por vírgula (ex: "4,64")
+ * @param texto Lista
+ * @param valores Recebe os valores
+ * @param maximo Capacidade de valores
+ * @return Número de valores, ou -1 se algum for inválido
  */
-void destruir_fila(FilaImagens* fila) {
-    if (!fila) return;
-
-    // Libera recursos de sincronização
-    pthread_mutex_destroy(&fila->mutex);
-    sem_destroy(&fila->vazio);
-    sem_destroy(&fila->cheio);
-
-    // Libera memória
-    free(fila->imagens);
-    free(fila->futures);
-    free(fila);
+int ler_lista_inteiros(const char* texto, int* valores, int maximo) {
+    int n = 0;
+    const char* c = texto;
+    while (*c) {
+        char* fim;
+        long valor = strtol(c, &fim, 10);
+        if (fim == c || valor < 1 || valor > 65536 || n == maximo || (*fim && *fim != ',')) return -1;
+        valores[n++] = (int)valor;
+        c = *fim ? fim + 1 : fim;
+    }
+    return n;
 }
 
 /**
- * @brief Insere uma imagem na fila
- * @param fila Ponteiro para a fila
- * @param img Ponteiro para a imagem a ser inserida
- * @return 1 se a inserção foi bem-sucedida, 0 caso contrário
+ * @brief Modo bancada: executa o pipeline para cada combinação de threads e fila
+ * @param argc Número de argumentos da linha de comando
+ * @param argv Argumentos (as opções que não são da bancada vão para cada execução)
+ * @return 0 em caso de sucesso, 1 se alguma execução falhou
  * 
- * A função é thread-safe e bloqueia se a fila estiver cheia.
- * Cria um novo Future para a imagem inserida.
+ * Uso: --bancada=DIR [--bancada-threads=PxC,...] [--bancada-filas=N,...] [--relatorio-json=ARQ]
+ * 
+ * Sem DIR, gera antes o corpus sintético com --semente. Uma execução de
+ * aquecimento, fora do relatório, traz o corpus para o page cache. Cada
+ * combinação roda em um processo novo, com a saída em um diretório
+ * temporário apagado em seguida, e contribui uma linha ao relatório (no
+ * stdout, sem --relatorio-json; o progresso vai então para o stderr).
  */
-int inserir_imagem_na_fila(FilaImagens* fila, Imagem* img) {
-    if (!fila || !img) return 0;
-
-    // Espera por um slot vazio
-    sem_wait(&fila->vazio);
-    
-    // Trava o mutex para modificar a fila
-    pthread_mutex_lock(&fila->mutex);
+int executar_bancada(int argc, char* argv[]) {
+    int produtores[MAX_EXECUCOES_BANCADA], consumidores[MAX_EXECUCOES_BANCADA], filas[MAX_EXECUCOES_BANCADA];
+    int num_threads = 0;
+    for (const char* c = config.bancada_threads; *c; ) {
+        int p, consumidores_lidos = 0, lidos = 0;
+        if (sscanf(c, "%dx%d%n", &p, &consumidores_lidos, &lidos) != 2 || p < 1 || p > MAX_PRODUTORES ||
+            consumidores_lidos < 1 || consumidores_lidos > MAX_CONSUMIDORES || num_threads == MAX_EXECUCOES_BANCADA ||
+            (c[lidos] && c[lidos] != ',')) {
+            printf("Lista de threads inválida: %s (use PxC separados por vírgula, ex: 1x1,2x2)\n",
+                   config.bancada_threads);
+            return 1;
+        }
+        produtores[num_threads] = p;
+        consumidores[num_threads++] = consumidores_lidos;
+        c += lidos + (c[lidos] == ',');
+    }
+    int num_filas = ler_lista_inteiros(config.bancada_filas, filas, MAX_EXECUCOES_BANCADA);
+    if (num_threads < 1 || num_filas < 1) {
+        printf("Listas da bancada inválidas: threads %s, filas %s\n", config.bancada_threads, config.bancada_filas);
+        return 1;
+    }
 
-    // Cria um novo future para a imagem
-    Future* future = criar_future();
-    if (!future) {
-        pthread_mutex_unlock(&fila->mutex);
-        sem_post(&fila->vazio);
-        return 0;
+    // Sem arquivo, o relatório usa o stdout e as mensagens passam ao stderr
+    FILE* relatorio;
+    if (config.relatorio_json) {
+        relatorio = fopen(config.relatorio_json, "w");
+    } else {
+        int fd_relatorio = dup(STDOUT_FILENO);
+        relatorio = fd_relatorio >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) >= 0 ? fdopen(fd_relatorio, "w") : NULL;
+    }
+    if (!relatorio) {
+        printf("Erro ao abrir o relatório: %s\n", strerror(errno));
+        return 1;
     }
 
-    printf("Future criado para imagem: %s\n", img->nome);
+    struct stat st;
+    int gerado = 0;
+    if (stat(config.diretorio_corpus, &st) != 0) {
+        if (gerar_corpus(config.diretorio_corpus) != 0) {
+            fclose(relatorio);
+            return 1;
+        }
+        gerado = 1;
+    }
 
-    // Copia a imagem para a fila
-    strncpy(fila->imagens[fila->fim].nome, img->nome, sizeof(fila->imagens[fila->fim].nome) - 1);
-    fila->imagens[fila->fim].largura = img->largura;
-    fila->imagens[fila->fim].altura = img->altura;
-    fila->imagens[fila->fim].canais = img->canais;
-    fila->imagens[fila->fim].produtor_id = img->produtor_id;  // Copia o ID do produtor
-    
-    // Aloca e copia os dados da imagem
-    size_t tamanho_dados = img->largura * img->altura * img->canais;
-    fila->imagens[fila->fim].dados = (unsigned char*)malloc(tamanho_dados);
-    if (fila->imagens[fila->fim].dados) {
-        memcpy(fila->imagens[fila->fim].dados, img->dados, tamanho_dados);
+    char trabalho[] = "/tmp/bancada-XXXXXX";
+    char** filho = (char**)malloc((argc + 8) * sizeof(char*));
+    if (!mkdtemp(trabalho) || !filho) {
+        perror("Erro ao preparar a bancada");
+        free(filho);
+        fclose(relatorio);
+        return 1;
     }
+    char saida[PATH_MAX], arquivo_execucao[PATH_MAX];
+    snprintf(saida, sizeof(saida), "%s/saida", trabalho);
+    snprintf(arquivo_execucao, sizeof(arquivo_execucao), "%s/execucao.json", trabalho);
 
-    // Armazena o future
-    fila->futures[fila->fim] = future;
-    printf("Future armazenado na posição %d da fila\n", fila->fim);
+    // As demais opções da linha de comando valem para todas as execuções
+    int base = 0;
+    filho[base++] = argv[0];
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0 || argv[i][2] == '\0') {
+            if (argv[i][0] == '-' && argv[i][1] != '-') filho[base++] = argv[i]; // -r
+            continue;
+        }
+        const char* nome = argv[i] + 2;
+        size_t tamanho = strcspn(nome, "=");
+        int com_valor = 0;
+        for (const struct option* opcao = opcoes_longas; opcao->name; opcao++) {
+            if (strlen(opcao->name) == tamanho && strncmp(opcao->name, nome, tamanho) == 0) {
+                com_valor = opcao->has_arg == required_argument && nome[tamanho] == '\0' && i + 1 < argc;
+            }
+        }
+        if (!opcao_da_bancada(nome, tamanho)) {
+            filho[base++] = argv[i];
+            if (com_valor) filho[base++] = argv[i + 1];
+        }
+        if (com_valor) i++;
+    }
 
-    // Atualiza índices da fila
-    fila->fim = (fila->fim + 1) % fila->capacidade;
-    fila->tamanho++;
+    char opcao_entrada[PATH_MAX + 16], opcao_saida[PATH_MAX + 16], opcao_relatorio[PATH_MAX + 32];
+    char opcao_produtores[32], opcao_consumidores[32], opcao_fila[32];
+    snprintf(opcao_entrada, sizeof(opcao_entrada), "--entrada=%s", config.diretorio_corpus);
+    snprintf(opcao_saida, sizeof(opcao_saida), "--saida=%s", saida);
+    snprintf(opcao_relatorio, sizeof(opcao_relatorio), "--relatorio-json=%s", arquivo_execucao);
 
-    // Libera o mutex
-    pthread_mutex_unlock(&fila->mutex);
-    
-    // Sinaliza que há um novo item na fila
-    sem_post(&fila->cheio);
+    fprintf(relatorio, "{\n  \"corpus\": ");
+    escrever_texto_json(relatorio, config.diretorio_corpus);
+    if (gerado) fprintf(relatorio, ",\n  \"semente\": %llu", config.semente);
+    fprintf(relatorio, ",\n  \"execucoes\": [");
 
-    return 1;
-}
+    printf("=== Bancada: %d combinações de threads x %d capacidades da fila ===\n", num_threads, num_filas);
+    int execucoes = 0, falhas = 0;
+    // A volta -1 é o aquecimento, com a primeira combinação e fora do relatório
+    for (int t = -1; t < num_threads; t++) {
+        for (int f = 0; f < (t < 0 ? 1 : num_filas); f++) {
+            int combinacao = t < 0 ? 0 : t;
+            snprintf(opcao_produtores, sizeof(opcao_produtores), "--produtores=%d", produtores[combinacao]);
+            snprintf(opcao_consumidores, sizeof(opcao_consumidores), "--consumidores=%d", consumidores[combinacao]);
+            snprintf(opcao_fila, sizeof(opcao_fila), "--capacidade-fila=%d", filas[f]);
+            int n = base;
+            filho[n++] = opcao_entrada;
+            filho[n++] = opcao_saida;
+            filho[n++] = opcao_relatorio;
+            filho[n++] = opcao_produtores;
+            filho[n++] = opcao_consumidores;
+            filho[n++] = opcao_fila;
+            filho[n] = NULL;
 
-/**
- * @brief Remove uma imagem da fila
- * @param fila Ponteiro para a fila
- * @param img Ponteiro para onde a imagem será copiada
- * @return 1 se a remoção foi bem-sucedida, 0 caso contrário
- * 
- * A função é thread-safe e bloqueia se a fila estiver vazia.
- * Copia a imagem e seu Future associado.
- */
-int remover_imagem_da_fila(FilaImagens* fila, Imagem* img) {
-    if (!fila || !img) return 0;
+            if (t < 0) {
+                printf("  - Aquecimento (%dx%d, fila %d)... ", produtores[0], consumidores[0], filas[0]);
+                int codigo = executar_filho_bancada(filho);
+                nftw(saida, remover_item_bancada, 16, FTW_DEPTH | FTW_PHYS);
+                if (codigo == 0) {
+                    printf("ok\n");
+                } else {
+                    printf("falhou (código %d)\n", codigo);
+                }
+                continue;
+            }
 
-    // Espera por um item na fila
-    sem_wait(&fila->cheio);
-    
-    // Trava o mutex para modificar a fila
-    pthread_mutex_lock(&fila->mutex);
+            printf("  - %dx%d, fila %d: ", produtores[t], consumidores[t], filas[f]);
+            unlink(arquivo_execucao);
+            int codigo = executar_filho_bancada(filho);
+            nftw(saida, remover_item_bancada, 16, FTW_DEPTH | FTW_PHYS);
 
-    // Obtém o future da imagem
-    Future* future = fila->futures[fila->inicio];
+            char** linhas = NULL;
+            int lidas = codigo == 0 ? ler_execucoes_relatorio(arquivo_execucao, &linhas) : -1;
+            if (lidas < 1) {
+                printf("falhou (código %d)\n", codigo);
+                if (lidas > 0 || linhas) liberar_execucoes_relatorio(linhas, lidas > 0 ? lidas : 0);
+                falhas++;
+                continue;
+            }
+            char* linha = linhas[0] + strspn(linhas[0], " ");
+            linha[strcspn(linha, "\n")] = '\0';
+            fprintf(relatorio, "%s\n    %s", execucoes ? "," : "", linha);
+            execucoes++;
 
-    // Copia a imagem da fila
-    strncpy(img->nome, fila->imagens[fila->inicio].nome, sizeof(img->nome) - 1);
-    img->largura = fila->imagens[fila->inicio].largura;
-    img->altura = fila->imagens[fila->inicio].altura;
-    img->canais = fila->imagens[fila->inicio].canais;
-    
-    // Aloca e copia os dados da imagem
-    size_t tamanho_dados = img->largura * img->altura * img->canais;
-    img->dados = (unsigned char*)malloc(tamanho_dados);
-    if (img->dados) {
-        memcpy(img->dados, fila->imagens[fila->inicio].dados, tamanho_dados);
+            double vazao = 0, p99 = 0;
+            json_numero(linha, "imagens_por_s", &vazao);
+            json_numero(linha, "latencia_p99_ms", &p99);
+            printf("%.1f imagens/s, latência p99 %.2f ms\n", vazao, p99);
+            liberar_execucoes_relatorio(linhas, lidas);
+        }
     }
+    fprintf(relatorio, "\n  ]\n}\n");
+    fclose(relatorio);
 
-    // Libera os dados da imagem na fila
-    free(fila->imagens[fila->inicio].dados);
-    fila->imagens[fila->inicio].dados = NULL;
-
-    // Limpa o future
-    fila->futures[fila->inicio] = NULL;
+    unlink(arquivo_execucao);
+    rmdir(trabalho);
+    free(filho);
+    if (config.relatorio_json) printf("Relatório gravado em %s\n", config.relatorio_json);
+    if (falhas) printf("%d execuções falharam\n", falhas);
+    return falhas ? 1 : 0;
+}
 
-    // Atualiza índices da fila
-    fila->inicio = (fila->inicio + 1) % fila->capacidade;
-    fila->tamanho--;
+// Métricas mostradas por --comparar: campo do relatório, título, unidade e se maior é melhor
+static const struct {
+    const char* campo;
+    const char* titulo;
+    const char* unidade;
+    int maior_melhor;
+} metricas_comparadas[] = {
+    { "imagens_por_s", "Vazão", "imagens/s", 1 },
+    { "megapixels_por_s", "Vazão", "MP/s", 1 },
+    { "latencia_p50_ms", "Latência p50", "ms", 0 },
+    { "latencia_p90_ms", "Latência p90", "ms", 0 },
+    { "latencia_p99_ms", "Latência p99", "ms", 0 },
+    { "cpu_usuario_s", "CPU (usuário)", "s", 0 },
+    { "cpu_sistema_s", "CPU (sistema)", "s", 0 },
+    { "pico_rss_mb", "Pico de RSS", "MB", 0 },
+};
 
-    // Libera o mutex
-    pthread_mutex_unlock(&fila->mutex);
-    
-    // Sinaliza que há um novo slot vazio
-    sem_post(&fila->vazio);
+/**
+ * @brief Modo comparação: mostra a variação de cada métrica entre dois relatórios
+ * @return 0 em caso de sucesso, 1 em caso de erro
+ * 
+ * Uso: --comparar=BASE.json NOVO.json
+ * 
+ * As execuções são pareadas pela posição, que é a mesma quando os dois
+ * relatórios saem das mesmas listas da bancada (por exemplo, antes e depois
+ * de uma mudança, ou com --execucao=pipeline e --execucao=completa).
+ */
+int executar_comparacao(void) {
+    if (config.num_argumentos != 1) {
+        printf("--comparar espera: BASE.json NOVO.json\n");
+        return 1;
+    }
+    char** base = NULL;
+    char** novo = NULL;
+    int num_base = ler_execucoes_relatorio(config.relatorio_base, &base);
+    int num_novo = num_base < 0 ? -1 : ler_execucoes_relatorio(config.argumentos[0], &novo);
+    if (num_base < 0 || num_novo < 0) {
+        if (num_base > 0) liberar_execucoes_relatorio(base, num_base);
+        return 1;
+    }
+    int pares = num_base < num_novo ? num_base : num_novo;
+    printf("=== Comparação: %s -> %s ===\n", config.relatorio_base, config.argumentos[0]);
+    if (num_base != num_novo) {
+        printf("Os relatórios têm %d e %d execuções; comparando as %d primeiras\n", num_base, num_novo, pares);
+    }
 
-    return 1;
+    for (int i = 0; i < pares; i++) {
+        char rotulo_base[128], rotulo_novo[128];
+        rotulo_execucao(base[i], rotulo_base, sizeof(rotulo_base));
+        rotulo_execucao(novo[i], rotulo_novo, sizeof(rotulo_novo));
+        if (strcmp(rotulo_base, rotulo_novo) == 0) {
+            printf("\n%s:\n", rotulo_base);
+        } else {
+            printf("\n%s -> %s:\n", rotulo_base, rotulo_novo);
+        }
+        for (size_t m = 0; m < sizeof(metricas_comparadas) / sizeof(metricas_comparadas[0]); m++) {
+            double antes, depois;
+            if (!json_numero(base[i], metricas_comparadas[m].campo, &antes) ||
+                !json_numero(novo[i], metricas_comparadas[m].campo, &depois)) continue;
+            double variacao = antes != 0 ? 100.0 * (depois - antes) / antes : 0.0;
+            const char* sentido = fabs(variacao) < COMPARACAO_LIMIAR_PCT ? "" :
+                                  (variacao > 0) == metricas_comparadas[m].maior_melhor ? ", melhor" : ", pior";
+            printf("  - %s: %.2f -> %.2f %s (%+.1f%%%s)\n", metricas_comparadas[m].titulo, antes, depois,
+                   metricas_comparadas[m].unidade, variacao, sentido);
+        }
+    }
+    liberar_execucoes_relatorio(base, num_base);
+    liberar_execucoes_relatorio(novo, num_novo);
+    return 0;
 }
 
 /**
@@ -871,33 +11090,313 @@ int remover_imagem_da_fila(FilaImagens* fila, Imagem* img) {
  * - Entrada: "imagens/entrada"
  * - Saída: "imagens/saida"
  */
-int main() {
+int main(int argc, char* argv[]) {
+    int resultado_argumentos = processar_argumentos(argc, argv);
+    if (resultado_argumentos != 0) {
+        return resultado_argumentos < 0 ? 1 : 0;
+    }
+
+    // Cliente e gerador de carga não processam nada localmente
+    if (config.modo_execucao == MODO_CLIENTE) return executar_cliente();
+    if (config.modo_execucao == MODO_CARGA) return executar_gerador_carga();
+    if (config.modo_execucao == MODO_QUADROS) return executar_envio_quadros();
+    if (config.modo_execucao == MODO_BANCADA_FILA) return executar_bancada_fila();
+    if (config.modo_execucao == MODO_GERAR_CORPUS) return gerar_corpus(config.diretorio_corpus) == 0 ? 0 : 1;
+    if (config.modo_execucao == MODO_BANCADA) return executar_bancada(argc, argv);
+    if (config.modo_execucao == MODO_COMPARAR) return executar_comparacao();
+
+    // Modo fluxo: o stdout carrega os quadros; as mensagens vão para o stderr
+    FILE* saida_fluxo = NULL;
+    if (config.fluxo) {
+        int fd_saida = dup(STDOUT_FILENO);
+        if (fd_saida < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 || !(saida_fluxo = fdopen(fd_saida, "wb"))) {
+            perror("Erro ao preparar a saída do fluxo");
+            return 1;
+        }
+        // Um leitor que fecha o pipe vira erro de escrita, não SIGPIPE
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    // As imagens processadas têm o nome das originais: a saída não pode ser a entrada
+    if (!config.fluxo && verificar_diretorio_saida(config.diretorio_entrada, config.diretorio_saida) != 0) {
+        return 1;
+    }
+
+    // Threads, fila e orçamentos não informados seguem as CPUs e a memória do contêiner
+    dimensionar_pelo_ambiente();
+
+    // Execução completa: as threads dos dois estágios viram trabalhadores que
+    // fazem tudo; as métricas de consumidor de cada um cobrem a transformação,
+    // a codificação e a gravação
+    if (config.execucao_completa) {
+        int trabalhadores = config.num_produtores + config.num_consumidores;
+        if (trabalhadores > MAX_PRODUTORES) trabalhadores = MAX_PRODUTORES;
+        config.num_produtores = trabalhadores;
+        config.num_consumidores = trabalhadores;
+    }
+
+    // Autoajuste: a divisão inicial vira o número de vagas, e cada estágio ganha
+    // threads para qualquer divisão do total (ao menos uma vaga em cada)
+    int autoajuste_ativo = config.autoajuste != AUTOAJUSTE_DESLIGADO && !config.fluxo && !config.socket_servidor &&
+                           !config.nome_memoria;
+    autoajuste.modo = autoajuste_ativo ? config.autoajuste : AUTOAJUSTE_DESLIGADO;
+    autoajuste.produtores_ativos = config.num_produtores;
+    autoajuste.consumidores_ativos = config.num_consumidores;
+    if (autoajuste.modo == AUTOAJUSTE_ATIVO) {
+        int total = config.num_produtores + config.num_consumidores;
+        config.num_produtores = total - 1 < MAX_PRODUTORES ? total - 1 : MAX_PRODUTORES;
+        config.num_consumidores = total - 1 < MAX_CONSUMIDORES ? total - 1 : MAX_CONSUMIDORES;
+    }
+
     printf("Iniciando Processador de Imagens Paralelo\n");
-    printf("Número de produtores: %d\n", NUM_PRODUTORES);
-    printf("Número de consumidores: %d\n", NUM_CONSUMIDORES);
+    printf("Ambiente: %d CPUs (afinidade: %d", recursos_ambiente.cpus, recursos_ambiente.cpus_afinidade);
+    if (recursos_ambiente.cota_cpu > 0) {
+        printf(", cota do cgroup v%d: %.2f", recursos_ambiente.versao_cgroup, recursos_ambiente.cota_cpu);
+    }
+    printf("), memória: ");
+    if (recursos_ambiente.limite_memoria) {
+        printf("%.0f MB (limite do cgroup v%d)\n", recursos_ambiente.limite_memoria / (1024.0 * 1024.0),
+               recursos_ambiente.versao_cgroup);
+    } else {
+        printf("%.0f MB (física)\n", recursos_ambiente.memoria_fisica / (1024.0 * 1024.0));
+    }
+    if (config.cpus > 0) printf("Dimensionado para %d CPUs (--cpus)\n", config.cpus);
+    if (config.execucao_completa) {
+        printf("Execução completa: %d trabalhadores, cada um da leitura à gravação, sem fila\n",
+               config.num_produtores);
+    } else {
+        printf("Número de produtores: %d\n", autoajuste.produtores_ativos);
+        printf("Número de consumidores: %d\n", autoajuste.consumidores_ativos);
+    }
+
+    // Posicionamento NUMA e fila fragmentada valem para o processamento de
+    // diretórios; os demais modos usam a fila única
+    int nos = 1, num_fragmentos = 1;
+    if (!config.fluxo && !config.socket_servidor && !config.nome_memoria) {
+        if (config.numa) {
+            detectar_topologia_numa(&topologia_numa);
+            if (topologia_numa.num_nos > 1) {
+                topologia_numa.ativa = 1;
+                nos = topologia_numa.num_nos;
+            }
+        }
+        num_fragmentos = config.fragmentos > 0 ? config.fragmentos : nos;
+        num_fragmentos = (num_fragmentos + nos - 1) / nos * nos;  // Múltiplo do número de nós
+        if (num_fragmentos > MAX_FRAGMENTOS) num_fragmentos = MAX_FRAGMENTOS / nos * nos;
+    }
+    if (topologia_numa.ativa) {
+        printf("NUMA: %d nós com CPUs utilizáveis; threads fixadas por nó\n", nos);
+    }
+    if (num_fragmentos > 1) {
+        printf("Fila fragmentada: %d fragmentos (%d por nó)\n", num_fragmentos, num_fragmentos / nos);
+    }
+    if (autoajuste.modo == AUTOAJUSTE_ATIVO) {
+        printf("Autoajuste: %d produtores e %d consumidores criados, %d vagas no total\n", config.num_produtores,
+               config.num_consumidores, autoajuste.produtores_ativos + autoajuste.consumidores_ativos);
+    }
+    printf("Threads de varredura: %d, capacidade da fila: %d, orçamento em voo: ", config.threads_varredura,
+           config.capacidade_fila);
+    if (config.memoria_max_mb > 0) {
+        printf("%ld MB\n", config.memoria_max_mb);
+    } else {
+        printf("sem limite\n");
+    }
+    char descricao_plano[512];
+    descrever_plano(&plano_pipeline, descricao_plano, sizeof(descricao_plano));
+    printf("Pipeline: %d operações em %d etapas (%s)\n", plano_pipeline.num_operacoes, plano_pipeline.num_etapas,
+           descricao_plano);
     
     struct timespec inicio_total, fim_total;
     clock_gettime(CLOCK_MONOTONIC, &inicio_total);
     
-    FilaImagens* fila = criar_fila(10);
+    // Fragmentada, a capacidade se divide entre os fragmentos; o primeiro é
+    // também a fila dos modos que usam uma fila única
+    int capacidade_fragmento = config.capacidade_fila;
+    if (num_fragmentos > 1) {
+        capacidade_fragmento = (config.capacidade_fila + num_fragmentos - 1) / num_fragmentos;
+        if (capacidade_fragmento < 2) capacidade_fragmento = 2;
+    }
+    FilaImagens* fila = criar_fila(capacidade_fragmento);
     if (!fila) {
         printf("Erro ao criar fila\n");
         return 1;
     }
+    if (num_fragmentos > 1 && criar_fragmentos(fila, num_fragmentos, nos, capacidade_fragmento) != 0) {
+        printf("Erro ao criar os fragmentos da fila\n");
+        destruir_fila(fila);
+        return 1;
+    }
     
     printf("Fila criada com sucesso!\n");
+
+    // Cria o motor de E/S antes das threads que o utilizam
+    if (config.modo_es != MODO_ES_SINCRONO) {
+        int cpus = config.cpus > 0 ? config.cpus : recursos_ambiente.cpus;
+        motor_es = criar_motor_es(config.modo_es, config.profundidade_es, cpus);
+        if (!motor_es) {
+            printf("Erro ao criar motor de E/S\n");
+            destruir_fila(fila);
+            return 1;
+        }
+    }
+    
+    ListaVarredura* lista = criar_lista_varredura(CAPACIDADE_VARREDURA);
+    if (!lista) {
+        printf("Erro ao criar lista de varredura\n");
+        motor_es_destruir(motor_es);
+        destruir_fila(fila);
+        return 1;
+    }
+
+    // Modo incremental: o índice precisa estar aberto antes da varredura
+    char caminho_indice[PATH_MAX];
+    if (config.incremental) {
+        if (config.caminho_indice) {
+            snprintf(caminho_indice, sizeof(caminho_indice), "%s", config.caminho_indice);
+        } else {
+            criar_diretorios(config.diretorio_saida, 0700);
+            snprintf(caminho_indice, sizeof(caminho_indice), "%s/%s", config.diretorio_saida, NOME_INDICE);
+        }
+        indice_incremental = abrir_indice(caminho_indice, calcular_hash_pipeline(), config.indice_conteudo);
+    }
+
+    // Cache de resultados: consultado pelos produtores antes de decodificar
+    if (config.diretorio_cache && !config.fluxo) {
+        cache_resultados = abrir_cache(config.diretorio_cache, (uint64_t)config.cache_max_mb * 1024 * 1024,
+                                       config.cache_alvo, calcular_hash_pipeline());
+    }
+
+    // Detecção de duplicatas: a varredura compara os arquivos antes de entregá-los
+    if (config.deduplicar && !config.fluxo) {
+        deduplicacao = criar_deduplicacao(config.diretorio_entrada, config.diretorio_saida);
+    }
+
+    // Quase duplicatas: os produtores comparam cada imagem decodificada às já vistas
+    if (config.quase_duplicatas && !config.fluxo) {
+        indice_perceptual = criar_indice_perceptual(config.quase_duplicatas, config.hash_perceptual,
+                                                    config.distancia_hamming);
+    }
+
+    orcamento_memoria.limite = (size_t)config.memoria_max_mb * 1024 * 1024;
+
+    // Modelo de custo: a varredura estima cada arquivo e a lista os ordena do maior ao menor
+    if (config.agendamento == AGENDAMENTO_LPT && !config.fluxo) {
+        modelo_custo = criar_modelo_custo();
+    }
+
+    // Varredura única (e paralela) da árvore de entrada, compartilhada pelos produtores
+    Varredura* varredura = criar_varredura(lista, config.diretorio_entrada);
+    if (!varredura) {
+        printf("Erro ao criar varredura\n");
+        destruir_lista_varredura(lista);
+        motor_es_destruir(motor_es);
+        destruir_fila(fila);
+        return 1;
+    }
+    if (config.seguir_links) {
+        struct stat st_raiz;
+        if (stat(varredura->raiz, &st_raiz) == 0) varredura_marcar_visitado(varredura, &st_raiz);
+    }
+
+    // Saída, cache e índice dentro da árvore de entrada não viram entrada da próxima execução
+    varredura_ignorar(varredura, config.diretorio_saida);
+    if (cache_resultados) varredura_ignorar(varredura, config.diretorio_cache);
+    if (indice_incremental) varredura_ignorar(varredura, caminho_indice);
+
+    // Modo daemon: os varredores registram cada diretório no inotify e
+    // ficam aguardando os diretórios novos até o encerramento
+    Vigilancia* vigilancia = NULL;
+    if (config.vigiar) {
+        vigilancia = criar_vigilancia();
+        if (!vigilancia) {
+            printf("Erro ao criar vigilância\n");
+            destruir_varredura(varredura);
+            destruir_indice(indice_incremental);
+            destruir_lista_varredura(lista);
+            motor_es_destruir(motor_es);
+            destruir_fila(fila);
+            return 1;
+        }
+        varredura->vigilancia = vigilancia;
+        varredura->manter_aberta = 1;
+    }
+
+    // Modos que rodam até SIGINT/SIGTERM encerram de forma ordenada
+    if (config.vigiar || config.socket_servidor || config.nome_memoria) {
+        struct sigaction acao;
+        memset(&acao, 0, sizeof(acao));
+        acao.sa_handler = tratar_sinal_encerramento;
+        sigemptyset(&acao.sa_mask);
+        sigaction(SIGINT, &acao, NULL);
+        sigaction(SIGTERM, &acao, NULL);
+    }
+
+    // O modo fluxo não processa o diretório de entrada
+    pthread_t varredor_threads[config.threads_varredura];
+    int varredores_criados = 0;
+    for (int i = 0; i < (config.fluxo ? 0 : config.threads_varredura); i++) {
+        if (pthread_create(&varredor_threads[i], NULL, varredor, varredura) != 0) {
+            perror("Erro ao criar thread de varredura");
+            break;
+        }
+        varredores_criados++;
+    }
+    if (varredores_criados == 0) {
+        lista_varredura_concluir(lista);
+    }
+
+    pthread_t vigia_thread;
+    int vigia_criado = 0;
+    if (vigilancia && varredores_criados > 0) {
+        vigia_criado = pthread_create(&vigia_thread, NULL, vigia, varredura) == 0;
+        if (!vigia_criado) {
+            perror("Erro ao criar thread de vigilância");
+            pthread_mutex_lock(&varredura->mutex);
+            varredura->manter_aberta = 0;
+            pthread_cond_broadcast(&varredura->cond);
+            pthread_mutex_unlock(&varredura->mutex);
+        }
+    }
+
+    // Pré-carregador que traz os próximos arquivos para o page cache
+    pthread_t pre_carregador_thread;
+    ThreadArgs args_pre_carregador = { fila, lista, config.diretorio_entrada, config.diretorio_saida, 0, 0 };
+    int pre_carregador_criado = 0;
+    if (config.prefetch_max > 0) {
+        pre_carregador_criado = pthread_create(&pre_carregador_thread, NULL, pre_carregador, &args_pre_carregador) == 0;
+        if (!pre_carregador_criado) {
+            perror("Erro ao criar thread de pré-carregamento");
+        }
+    }
     
+    // Saída ordenada: uma thread grava as imagens na ordem em que a varredura as encontrou
+    pthread_t saida_ordenada_thread;
+    int saida_ordenada_criada = 0;
+    if (config.ordenado && !config.fluxo) {
+        reordenacao_saida = criar_reordenacao(config.janela_reordenacao);
+        if (reordenacao_saida) {
+            saida_ordenada_criada = pthread_create(&saida_ordenada_thread, NULL, escrever_saida_ordenada, reordenacao_saida) == 0;
+            if (!saida_ordenada_criada) {
+                perror("Erro ao criar thread da saída ordenada");
+                destruir_reordenacao(reordenacao_saida, NULL);
+                reordenacao_saida = NULL;
+            }
+        }
+    }
+
     // Criar arrays de threads e argumentos
-    pthread_t prod_threads[NUM_PRODUTORES];
-    pthread_t cons_threads[NUM_CONSUMIDORES];
-    ThreadArgs args_prod[NUM_PRODUTORES];
-    ThreadArgs args_cons[NUM_CONSUMIDORES];
+    pthread_t prod_threads[MAX_PRODUTORES];
+    pthread_t cons_threads[MAX_CONSUMIDORES];
+    ThreadArgs args_prod[MAX_PRODUTORES];
+    ThreadArgs args_cons[MAX_CONSUMIDORES];
     
     // Inicializar argumentos e criar threads dos produtores
-    for (int i = 0; i < NUM_PRODUTORES; i++) {
-        args_prod[i].fila = fila;
-        args_prod[i].diretorio_entrada = "imagens/entrada";
-        args_prod[i].diretorio_saida = "imagens/saida";
+    for (int i = 0; i < config.num_produtores; i++) {
+        args_prod[i].fragmento = fragmentos.num > 1 ? i % fragmentos.num : 0;
+        args_prod[i].fila = fragmentos.num > 1 ? fragmentos.filas[args_prod[i].fragmento] : fila;
+        args_prod[i].lista = lista;
+        args_prod[i].diretorio_entrada = config.diretorio_entrada;
+        args_prod[i].diretorio_saida = config.diretorio_saida;
         args_prod[i].thread_id = i;
         
         if (pthread_create(&prod_threads[i], NULL, produtor, &args_prod[i]) != 0) {
@@ -907,11 +11406,13 @@ int main() {
         }
     }
     
-    // Inicializar argumentos e criar threads dos consumidores
-    for (int i = 0; i < NUM_CONSUMIDORES; i++) {
-        args_cons[i].fila = fila;
-        args_cons[i].diretorio_entrada = "imagens/entrada";
-        args_cons[i].diretorio_saida = "imagens/saida";
+    // Inicializar argumentos e criar threads dos consumidores (nenhuma na execução completa)
+    for (int i = 0; i < config.num_consumidores && !config.execucao_completa; i++) {
+        args_cons[i].fragmento = fragmentos.num > 1 ? i % fragmentos.num : 0;
+        args_cons[i].fila = fragmentos.num > 1 ? fragmentos.filas[args_cons[i].fragmento] : fila;
+        args_cons[i].lista = lista;
+        args_cons[i].diretorio_entrada = config.diretorio_entrada;
+        args_cons[i].diretorio_saida = config.diretorio_saida;
         args_cons[i].thread_id = i;
         
         if (pthread_create(&cons_threads[i], NULL, consumidor, &args_cons[i]) != 0) {
@@ -921,6 +11422,53 @@ int main() {
         }
     }
     
+    // Modo servidor: as conexões entram na mesma fila, depois que os consumidores existem
+    Servidor* servidor = NULL;
+    pthread_t servidor_thread;
+    int servidor_criado = 0;
+    if (config.socket_servidor) {
+        servidor = criar_servidor(config.socket_servidor, fila);
+        if (servidor) {
+            servidor_criado = pthread_create(&servidor_thread, NULL, servidor_aceitar, servidor) == 0;
+            if (!servidor_criado) perror("Erro ao criar thread do servidor");
+        }
+    }
+    
+    // Memória compartilhada: quadros de outro processo entram na mesma fila, sem cópias
+    pthread_t quadros_thread;
+    int quadros_criado = 0;
+    if (config.nome_memoria) {
+        memoria_compartilhada = criar_memoria_compartilhada(config.nome_memoria, config.num_quadros,
+                                                            config.largura_max_quadro, config.altura_max_quadro, fila);
+        if (memoria_compartilhada) {
+            quadros_criado = pthread_create(&quadros_thread, NULL, receber_quadros, memoria_compartilhada) == 0;
+            if (!quadros_criado) perror("Erro ao criar thread de recepção de quadros");
+        }
+    }
+    
+    // Modo fluxo: uma thread lê e numera os quadros de stdin, outra os escreve em ordem
+    FluxoQuadros* fluxo = NULL;
+    pthread_t leitor_fluxo_thread, escritor_fluxo_thread;
+    int leitor_fluxo_criado = 0, escritor_fluxo_criado = 0;
+    if (config.fluxo) {
+        fluxo = criar_fluxo(config.fluxo, stdin, saida_fluxo, config.quadros_em_voo, fila);
+        if (fluxo) {
+            escritor_fluxo_criado = pthread_create(&escritor_fluxo_thread, NULL, escrever_fluxo, fluxo) == 0;
+            leitor_fluxo_criado = escritor_fluxo_criado &&
+                                  pthread_create(&leitor_fluxo_thread, NULL, ler_fluxo, fluxo) == 0;
+            if (!leitor_fluxo_criado) {
+                perror("Erro ao criar threads do fluxo");
+                reordenacao_concluir(fluxo->reordenacao, 0);
+            }
+        }
+    }
+    
+    // Controlador do autoajuste (também no modo fixo, que só registra as decisões)
+    pthread_t autoajuste_thread;
+    ThreadArgs args_autoajuste = { .fila = fila, .lista = lista };
+    int autoajuste_criado = autoajuste.modo != AUTOAJUSTE_DESLIGADO &&
+                            pthread_create(&autoajuste_thread, NULL, controlador_autoajuste, &args_autoajuste) == 0;
+
     // Criar thread do monitor
     pthread_t monitor_thread;
     MonitorArgs args_monitor;
@@ -933,23 +11481,56 @@ int main() {
     }
     
     // Aguardar todas as threads dos produtores terminarem
-    for (int i = 0; i < NUM_PRODUTORES; i++) {
+    for (int i = 0; i < config.num_produtores; i++) {
         pthread_join(prod_threads[i], NULL);
     }
+
+    // Todo arquivo retirado da varredura passa pela saída ordenada, gravado ou não
+    if (reordenacao_saida) {
+        pthread_mutex_lock(&lista->mutex);
+        unsigned long long retirados = lista->lidos;
+        pthread_mutex_unlock(&lista->mutex);
+        reordenacao_concluir(reordenacao_saida, retirados);
+    }
+
+    // A varredura e o pré-carregamento terminam antes dos produtores
+    if (vigia_criado) pthread_join(vigia_thread, NULL);
+    for (int i = 0; i < varredores_criados; i++) {
+        pthread_join(varredor_threads[i], NULL);
+    }
+    if (pre_carregador_criado) pthread_join(pre_carregador_thread, NULL);
+
+    // O servidor só termina ao receber SIGINT/SIGTERM, com as conexões respondidas
+    if (servidor_criado) pthread_join(servidor_thread, NULL);
+    if (quadros_criado) pthread_join(quadros_thread, NULL);
+
+    // O fluxo termina quando o último quadro de stdin foi escrito
+    if (leitor_fluxo_criado) pthread_join(leitor_fluxo_thread, NULL);
+    if (escritor_fluxo_criado) pthread_join(escritor_fluxo_thread, NULL);
     
-    // Aguardar um pouco para garantir que todas as imagens sejam processadas
-    sleep(2);
-    
-    // Sinalizar para os consumidores pararem
+    // Sinalizar para os consumidores pararem; eles esvaziam a fila antes de sair
     executando = 0;
+    autoajuste_acordar_todos();
+    if (autoajuste_criado) pthread_join(autoajuste_thread, NULL);
     
     // Aguardar todas as threads dos consumidores terminarem
-    for (int i = 0; i < NUM_CONSUMIDORES; i++) {
+    for (int i = 0; i < config.num_consumidores && !config.execucao_completa; i++) {
         pthread_join(cons_threads[i], NULL);
     }
     
     // Aguardar thread do monitor
     pthread_join(monitor_thread, NULL);
+
+    // A saída ordenada termina depois que o último consumidor entregou sua imagem
+    if (saida_ordenada_criada) pthread_join(saida_ordenada_thread, NULL);
+
+    // Drena as escritas pendentes antes de medir o tempo total
+    motor_es_encerrar(motor_es);
+
+    // Grava o índice só depois que todas as saídas foram escritas
+    if (indice_incremental) {
+        indice_salvar(indice_incremental);
+    }
     
     // Calcular e exibir métricas
     clock_gettime(CLOCK_MONOTONIC, &fim_total);
@@ -959,8 +11540,8 @@ int main() {
     printf("\n=== Métricas de Desempenho ===\n");
     printf("Tempo total de execução: %.2f segundos\n", tempo_total);
     
-    printf("\n=== Produtores (%d threads) ===\n", NUM_PRODUTORES);
-    for (int i = 0; i < NUM_PRODUTORES; i++) {
+    printf("\n=== Produtores (%d threads) ===\n", config.num_produtores);
+    for (int i = 0; i < config.num_produtores; i++) {
         printf("Produtor %d:\n", i);
         printf("  - Imagens carregadas do disco: %d\n", metricas_produtores[i].imagens_processadas);
         printf("  - Tempo médio por imagem: %.3f segundos\n", 
@@ -971,16 +11552,16 @@ int main() {
                metricas_produtores[i].ordem_finalizacao);
     }
     
-    printf("\n=== Consumidores (%d threads) ===\n", NUM_CONSUMIDORES);
-    for (int i = 0; i < NUM_CONSUMIDORES; i++) {
+    printf("\n=== Consumidores (%d threads) ===\n", config.num_consumidores);
+    for (int i = 0; i < config.num_consumidores; i++) {
         printf("Consumidor %d:\n", i);
         printf("  - Imagens processadas: %d\n", metricas_consumidores[i].imagens_processadas);
-        printf("  - Operações por imagem:\n");
-        printf("    * Conversão para escala de cinza\n");
-        printf("    * Inversão de cores\n");
-        printf("    * Ajuste de brilho (+20%%)\n");
-        printf("    * Ajuste de contraste (+30%%)\n");
-        printf("    * Salvamento no disco\n");
+        if (config.num_variantes > 0) {
+            printf("  - Operações por imagem: as da variante de cada ramo, e salvamento no disco\n");
+        } else {
+            printf("  - Operações por imagem: %s, e salvamento no disco\n",
+                   descricao_plano[0] ? descricao_plano : "nenhuma");
+        }
         printf("  - Tempo médio por imagem: %.3f segundos\n", 
                metricas_consumidores[i].tempo_total / metricas_consumidores[i].imagens_processadas);
         printf("  - Tempo total de processamento: %.3f segundos\n", 
@@ -989,10 +11570,256 @@ int main() {
                metricas_consumidores[i].ordem_finalizacao);
     }
     
+    // Dispersão do fim: quanto o último consumidor terminou depois do primeiro
+    double primeiro_termino = 0, ultimo_termino = 0;
+    for (int i = 0; i < config.num_consumidores; i++) {
+        if (metricas_consumidores[i].imagens_processadas == 0) continue;
+        double termino = metricas_consumidores[i].ultimo_termino;
+        if (primeiro_termino == 0 || termino < primeiro_termino) primeiro_termino = termino;
+        if (termino > ultimo_termino) ultimo_termino = termino;
+    }
+    printf("\n=== Agendamento (%s) ===\n", config.agendamento == AGENDAMENTO_LPT ? "lpt" : "fifo");
+    printf("  - Diferença entre o primeiro e o último consumidor a terminar: %.3f segundos\n",
+           ultimo_termino - primeiro_termino);
+    if (modelo_custo) {
+        printf("  - Custo estimado na varredura: %.3f s em %ld arquivos (%ld sem cabeçalho reconhecido)\n",
+               modelo_custo->estimado_varredura / 1e9, modelo_custo->arquivos_estimados,
+               modelo_custo->sem_cabecalho);
+        exibir_amostras_custo("Decodificação", modelo_custo->decodificacao, CUSTO_DECODIFICACAO);
+        exibir_amostras_custo("Transformação e codificação", modelo_custo->processamento, NULL);
+    }
+
+    if (config.execucao_completa) {
+        double total_trabalho = 0, total_processamento = 0;
+        for (int i = 0; i < config.num_produtores; i++) {
+            total_trabalho += metricas_produtores[i].tempo_total;
+            total_processamento += metricas_consumidores[i].tempo_total;
+        }
+        printf("\n=== Execução completa (%d trabalhadores) ===\n", config.num_produtores);
+        printf("  - O tempo de carregamento dos produtores inclui o processamento da mesma imagem\n");
+        printf("  - Leitura e decodificação: %.3f segundos\n", total_trabalho - total_processamento);
+        printf("  - Transformação, codificação e gravação: %.3f segundos\n", total_processamento);
+    }
+
+    if (config.lote > 1) {
+        printf("\n=== Lotes (até %d imagens) ===\n", config.lote);
+        printf("  - Inserções em lote dos produtores: %ld (média de %.1f imagens)\n", lotes_fila.inseridos,
+               lotes_fila.inseridos ? (double)lotes_fila.imagens_inseridas / lotes_fila.inseridos : 0.0);
+        printf("  - Retiradas dos consumidores: %ld (média de %.1f imagens)\n", lotes_fila.retirados,
+               lotes_fila.retirados ? (double)lotes_fila.imagens_retiradas / lotes_fila.retirados : 0.0);
+    }
+
+    if (fragmentos.num > 1) {
+        long total = fragmentos.proprias + fragmentos.roubadas_no + fragmentos.roubadas_remotas;
+        printf("\n=== Fila fragmentada (%d fragmentos em %d nós) ===\n", fragmentos.num, nos);
+        printf("  - Imagens retiradas do próprio fragmento: %ld\n", fragmentos.proprias);
+        printf("  - Roubadas de outro fragmento do mesmo nó: %ld\n", fragmentos.roubadas_no);
+        printf("  - Roubadas de outro nó: %ld (%.1f%%)\n", fragmentos.roubadas_remotas,
+               total ? 100.0 * fragmentos.roubadas_remotas / total : 0.0);
+        printf("  - Pixels que atravessaram entre nós: %.2f MB\n", fragmentos.bytes_remotos / (1024.0 * 1024.0));
+    }
+
+    if (autoajuste.modo != AUTOAJUSTE_DESLIGADO) {
+        printf("\n=== Autoajuste (%s) ===\n", autoajuste.modo == AUTOAJUSTE_ATIVO ? "ativo" : "fixo");
+        if (autoajuste.modo == AUTOAJUSTE_ATIVO) {
+            printf("  - Threads movidas para os consumidores: %ld\n", autoajuste.movidos_para_consumidores);
+            printf("  - Threads movidas para os produtores: %ld\n", autoajuste.movidos_para_produtores);
+            printf("  - Divisão no fim da varredura: %d produtores, %d consumidores\n",
+                   autoajuste.produtores_ativos, autoajuste.consumidores_ativos);
+        } else {
+            printf("  - Decisões registradas e não aplicadas: %ld\n", autoajuste.decisoes_nao_aplicadas);
+        }
+    }
+
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    printf("\n=== Memória ===\n");
+    if (orcamento_memoria.limite) {
+        printf("  - Orçamento em voo: %.2f MB\n", orcamento_memoria.limite / (1024.0 * 1024.0));
+    } else {
+        printf("  - Orçamento em voo: sem limite\n");
+    }
+    printf("  - Pico em voo: %.2f MB\n", orcamento_memoria.pico / (1024.0 * 1024.0));
+    printf("  - Pico de RSS do processo: %.2f MB", uso.ru_maxrss / 1024.0);
+    if (orcamento_memoria.limite) {
+        printf(" (%.0f%% do orçamento)", 100.0 * uso.ru_maxrss * 1024.0 / orcamento_memoria.limite);
+    }
+    printf("\n");
+    printf("  - Esperas dos produtores: %ld (%.3f segundos)\n", orcamento_memoria.esperas,
+           orcamento_memoria.tempo_espera);
+
+    if (motor_es) {
+        printf("\n=== Motor de E/S (%s) ===\n", motor_es->usa_io_uring ? "io_uring" : "pool de pread");
+        printf("  - Leituras: %ld (%.2f MB)\n", motor_es->leituras, motor_es->bytes_lidos / (1024.0 * 1024.0));
+        printf("  - Escritas: %ld (%.2f MB)\n", motor_es->escritas, motor_es->bytes_escritos / (1024.0 * 1024.0));
+        if (motor_es->usa_io_uring) {
+            printf("  - Lotes submetidos: %ld (média de %.1f arquivos por lote)\n", motor_es->lotes,
+                   motor_es->lotes ? (motor_es->leituras + motor_es->escritas) / (double)motor_es->lotes : 0.0);
+        }
+        printf("  - Chamadas de sistema de E/S: %ld\n", motor_es->chamadas_sistema);
+    }
+    
+    printf("\n=== Varredura (%d threads%s) ===\n", varredores_criados, config.recursivo ? ", recursiva" : "");
+    printf("  - Diretórios percorridos: %ld\n", varredura->diretorios);
+    printf("  - Arquivos encontrados: %ld\n", varredura->arquivos);
+    printf("  - Ignorados pelos filtros: %ld\n", varredura->filtrados);
+    if (config.seguir_links) {
+        printf("  - Ciclos de links evitados: %ld\n", varredura->ciclos);
+    }
+    if (varredura->erros) {
+        printf("  - Erros de leitura de diretório: %ld\n", varredura->erros);
+    }
+
+    if (servidor) {
+        printf("\n=== Servidor (%s) ===\n", servidor->caminho);
+        printf("  - Conexões atendidas: %ld\n", servidor->conexoes);
+        printf("  - Requisições: %ld (erros: %ld)\n", servidor->requisicoes, servidor->erros);
+        printf("  - Recebido: %.2f MB, enviado: %.2f MB\n", servidor->bytes_recebidos / (1024.0 * 1024.0),
+               servidor->bytes_enviados / (1024.0 * 1024.0));
+        if (servidor->requisicoes) {
+            printf("  - Tempo médio de atendimento: %.2f ms\n", servidor->tempo_total / servidor->requisicoes * 1e3);
+        }
+    }
+
+    if (fluxo) {
+        const char* nomes_formato[] = { "", "raw", "y4m", "ppm" };
+        printf("\n=== Fluxo de quadros (%s, até %d em voo) ===\n", nomes_formato[fluxo->formato], fluxo->capacidade);
+        printf("  - Quadros escritos: %llu (lidos: %llu)\n", fluxo->escritos, fluxo->lidos);
+        printf("  - Vazão: %.1f quadros/s (%.2f MB/s de entrada)\n", fluxo->escritos / tempo_total,
+               fluxo->bytes_lidos / tempo_total / (1024.0 * 1024.0));
+        if (fluxo->escritos > 0) {
+            printf("  - Latência média: %.2f ms\n", fluxo->latencia_total / fluxo->escritos * 1e3);
+            printf("  - Latência p50: %.2f ms, p99: %.2f ms, máxima: %.2f ms\n",
+                   percentil_latencia_fluxo(fluxo, 0.50) * 1e3, percentil_latencia_fluxo(fluxo, 0.99) * 1e3,
+                   fluxo->latencia_max * 1e3);
+        }
+        printf("  - Máximo de quadros em voo: %d\n", fluxo->em_voo_max);
+        if (fluxo->erro_leitura) printf("  - A entrada terminou corrompida ou no meio de um quadro\n");
+        if (fluxo->erro_escrita) printf("  - A saída foi interrompida por erro de escrita\n");
+    }
+
+    if (reordenacao_saida) {
+        printf("\n=== Saída ordenada (janela de %d imagens) ===\n", reordenacao_saida->capacidade);
+        printf("  - Imagens gravadas em ordem: %llu (sem saída: %llu)\n", saidas_ordenadas_escritas,
+               saidas_ordenadas_descartadas);
+        printf("  - Máximo de imagens prontas esperando a vez: %d\n", reordenacao_saida->aguardando_max);
+    }
+
+    if (memoria_compartilhada) {
+        printf("\n=== Memória compartilhada (%s) ===\n", memoria_compartilhada->nome);
+        printf("  - Quadros recebidos: %ld\n", memoria_compartilhada->recebidos);
+        printf("  - Quadros devolvidos: %ld (inválidos: %ld)\n", memoria_compartilhada->concluidos,
+               memoria_compartilhada->invalidos);
+    }
+
+    if (vigilancia) {
+        printf("\n=== Vigilância (inotify) ===\n");
+        printf("  - Eventos de arquivo recebidos: %ld\n", vigilancia->eventos);
+        printf("  - Eventos repetidos agrupados: %ld\n", vigilancia->coalescidos);
+        printf("  - Arquivos entregues aos produtores: %ld\n", vigilancia->enfileirados);
+        if (vigilancia->transbordamentos) {
+            printf("  - Transbordamentos da fila do inotify: %ld\n", vigilancia->transbordamentos);
+        }
+    }
+
+    if (cache_resultados) {
+        printf("\n=== Cache de resultados (%s) ===\n", cache_resultados->diretorio);
+        printf("  - Consultas: %ld, acertos: %ld (taxa de acerto: %.1f%%)\n", cache_resultados->consultas,
+               cache_resultados->acertos,
+               cache_resultados->consultas ? 100.0 * cache_resultados->acertos / cache_resultados->consultas : 0.0);
+        printf("  - Acertos por link: %ld, reflink: %ld, cópia: %ld (%.2f MB reaproveitados)\n",
+               cache_resultados->por_link, cache_resultados->por_reflink, cache_resultados->por_copia,
+               cache_resultados->bytes_reaproveitados / (1024.0 * 1024.0));
+        printf("  - Resultados guardados: %ld, removidos (LRU): %ld\n", cache_resultados->guardados,
+               cache_resultados->removidos);
+        printf("  - Ocupação: %zu entradas, %.1f de %.0f MB\n", cache_resultados->num_entradas,
+               cache_resultados->bytes / (1024.0 * 1024.0), cache_resultados->limite / (1024.0 * 1024.0));
+    }
+
+    if (deduplicacao) {
+        printf("\n=== Duplicatas ===\n");
+        printf("  - Arquivos com prefixo lido: %ld, com conteúdo inteiro lido: %ld\n", deduplicacao->prefixos,
+               deduplicacao->conteudos);
+        printf("  - Duplicatas encontradas: %ld\n", deduplicacao->duplicatas);
+        printf("  - Decodificações evitadas (saídas replicadas): %ld\n", deduplicacao->atendidas);
+        if (deduplicacao->sem_saida) {
+            printf("  - Duplicatas sem saída (o original falhou): %ld\n", deduplicacao->sem_saida);
+        }
+    }
+
+    if (config.num_variantes > 0) {
+        printf("\n=== Variantes (%d por imagem) ===\n", config.num_variantes);
+        printf("  - Decodificações compartilhadas: %ld\n", estatisticas_variantes.decodificacoes);
+        printf("  - Saídas gravadas: %ld", estatisticas_variantes.gravadas);
+        if (estatisticas_variantes.falhas) printf(" (falhas: %ld)", estatisticas_variantes.falhas);
+        printf("\n");
+        printf("  - Ramos que leram os pixels compartilhados: %ld, que assumiram o buffer: %ld\n",
+               estatisticas_variantes.leituras, estatisticas_variantes.assumidas);
+    }
+
+    if (indice_perceptual) {
+        printf("\n=== Quase duplicatas ===\n");
+        printf("  - Hashes calculados (%s): %ld, em média %.3f ms cada\n",
+               indice_perceptual->tipo_hash == HASH_PHASH ? "phash" : "dhash", indice_perceptual->hashes,
+               indice_perceptual->hashes ? 1000.0 * indice_perceptual->tempo_hash / indice_perceptual->hashes : 0.0);
+        printf("  - Quase duplicatas %s: %ld (distância até %d)\n",
+               indice_perceptual->modo == QUASE_PULAR ? "puladas" : "marcadas", indice_perceptual->quase_duplicatas,
+               indice_perceptual->distancia_maxima);
+        printf("  - Comparações na BK-tree: %ld (%.1f por consulta)\n", indice_perceptual->comparacoes,
+               indice_perceptual->hashes ? (double)indice_perceptual->comparacoes / indice_perceptual->hashes : 0.0);
+    }
+
+    if (indice_incremental) {
+        printf("\n=== Modo incremental ===\n");
+        printf("  - Índice: %s\n", indice_incremental->caminho);
+        printf("  - Arquivos inalterados (pulados antes da leitura): %ld\n", indice_incremental->inalterados);
+        if (config.indice_conteudo) {
+            printf("  - Comparados pelo hash do conteúdo: %ld\n", indice_incremental->verificados_por_conteudo);
+        }
+        printf("  - Arquivos processados e registrados: %ld\n", indice_incremental->registrados);
+    }
+
+    if (pre_carregador_criado) {
+        printf("\n=== Pré-carregador (readahead) ===\n");
+        printf("  - Arquivos pré-carregados: %ld (%.2f MB)\n", metricas_prefetch.arquivos,
+               metricas_prefetch.bytes / (1024.0 * 1024.0));
+        printf("  - Janela final: %d arquivos (máxima: %d)\n", metricas_prefetch.janela_atual,
+               metricas_prefetch.janela_maxima);
+        printf("  - Taxa de decodificação observada: %.1f arquivos/s\n", metricas_prefetch.taxa);
+    }
+
+    int erro_relatorio = config.relatorio_json && gravar_relatorio_json(config.relatorio_json, tempo_total) != 0;
+    // No modo fluxo, quem lê o stdout precisa saber que a saída ficou incompleta
+    int erro_fluxo = fluxo && (fluxo->erro_leitura || fluxo->erro_escrita);
+    
     // Limpeza
+    destruir_indice(indice_incremental);
+    indice_incremental = NULL;
+    destruir_cache(cache_resultados);
+    cache_resultados = NULL;
+    destruir_deduplicacao(deduplicacao);
+    deduplicacao = NULL;
+    destruir_indice_perceptual(indice_perceptual);
+    indice_perceptual = NULL;
+    destruir_modelo_custo(modelo_custo);
+    modelo_custo = NULL;
+    destruir_varredura(varredura);
+    destruir_vigilancia(vigilancia);
+    destruir_servidor(servidor);
+    destruir_memoria_compartilhada(memoria_compartilhada);
+    memoria_compartilhada = NULL;
+    destruir_fluxo(fluxo);
+    destruir_reordenacao(reordenacao_saida, liberar_saida_ordenada);
+    reordenacao_saida = NULL;
+    if (saida_fluxo && fclose(saida_fluxo) != 0) erro_fluxo = 1;
+    destruir_lista_varredura(lista);
+    motor_es_destruir(motor_es);
+    motor_es = NULL;
     pthread_mutex_destroy(&mutex_metricas);
     pthread_mutex_destroy(&mutex_ordem);
+    destruir_fragmentos();
     destruir_fila(fila);
+    free(latencias_imagens);
     
-    return 0;
+    return erro_relatorio || erro_fluxo ? 1 : 0;
 }
@@ -0,0 +1,306 @@
+#!/bin/bash
+# Testes de regressão de ponta a ponta do processador de imagens.
+#
+# Uso: testes/regressao.sh [BINÁRIO]
+#
+# Sem BINÁRIO, compila processador_imagens_paralelo.c em um diretório
+# temporário. Cada teste roda o programa sobre um corpus sintético gerado
+# com --gerar-corpus (sempre o mesmo, pela semente) e compara as saídas com
+# as de uma execução de referência, sequencial e sem otimizações, ou confere
+# as estatísticas impressas no fim da execução. Sai com 1 se algum falhar.
+
+set -u
+
+RAIZ=$(cd "$(dirname "$0")/.." && pwd)
+TEMP=$(mktemp -d)
+trap 'rm -rf "$TEMP"' EXIT
+
+BINARIO=${1:-}
+if [ -z "$BINARIO" ]; then
+    BINARIO="$TEMP/processador_imagens"
+    gcc -O2 -o "$BINARIO" "$RAIZ/processador_imagens_paralelo.c" -pthread -lm || exit 1
+fi
+
+falhas=0
+testes=0
+
+# verificar DESCRIÇÃO COMANDO...: conta o teste e mostra o resultado
+verificar() {
+    local descricao=$1
+    shift
+    testes=$((testes + 1))
+    if "$@"; then
+        echo "ok     - $descricao"
+    else
+        echo "FALHOU - $descricao"
+        falhas=$((falhas + 1))
+    fi
+}
+
+# executar LOG OPÇÕES...: roda o programa com a saída em LOG
+executar() {
+    local log=$1
+    shift
+    "$BINARIO" "$@" > "$log" 2>&1
+}
+
+# estatistica LOG PADRÃO: primeiro número da linha do LOG que contém PADRÃO
+estatistica() {
+    grep -m1 -- "$2" "$1" | sed 's/[^0-9]*\([0-9][0-9]*\).*/\1/'
+}
+
+# soma LOG PADRÃO: soma dos primeiros números de todas as linhas com PADRÃO
+# (as contagens por thread, como "Imagens processadas")
+soma() {
+    grep -- "$2" "$1" | sed 's/[^0-9]*\([0-9][0-9]*\).*/\1/' | awk '{ total += $1 } END { print total + 0 }'
+}
+
+# igual VALOR ESPERADO: compara dois números (vazio nunca é igual)
+igual() {
+    [ -n "$1" ] && [ "$1" -eq "$2" ]
+}
+
+# mesmas_saidas DIR1 DIR2: os dois diretórios têm os mesmos arquivos, byte a byte
+mesmas_saidas() {
+    diff -r "$1" "$2" > /dev/null
+}
+
+# Corpus pequeno (12 imagens, a maior com 1 MP) em PNG, JPEG, BMP e TGA
+CORPUS="$TEMP/corpus"
+executar "$TEMP/corpus.log" --gerar-corpus="$CORPUS" --semente=7 --corpus-imagens=12 --corpus-max-mp=1 || {
+    echo "Erro ao gerar o corpus"
+    exit 1
+}
+NUM_IMAGENS=$(ls "$CORPUS" | wc -l)
+
+# Referência: E/S síncrona, um produtor, um consumidor
+REFERENCIA="$TEMP/referencia"
+executar "$TEMP/referencia.log" --entrada="$CORPUS" --saida="$REFERENCIA" --es=sincrono --produtores=1 \
+    --consumidores=1 --prefetch=0 || {
+    echo "Erro na execução de referência"
+    exit 1
+}
+
+# --ordenado: as gravações seguem a ordem da varredura (a do getdents, com um
+# único varredor), mesmo com vários produtores e consumidores fora de ordem
+teste_saida_ordenada() {
+    local saida="$TEMP/ordenada" log="$TEMP/ordenada.log"
+    executar "$log" --entrada="$CORPUS" --saida="$saida" --ordenado --janela-reordenacao=4 --threads-varredura=1 \
+        --produtores=4 --consumidores=4 || return 1
+    mesmas_saidas "$saida" "$REFERENCIA" || return 1
+    igual "$(estatistica "$log" "Imagens gravadas em ordem")" "$NUM_IMAGENS" || return 1
+    local varredura gravacao
+    varredura=$(ls -U "$CORPUS")
+    gravacao=$(grep "^Imagem salva com sucesso: " "$log" | sed 's|.*/||')
+    [ "$varredura" = "$gravacao" ]
+}
+verificar "saída ordenada: gravações na ordem da varredura e iguais à referência" teste_saida_ordenada
+
+# --saida igual à --entrada (direto ou por um link) é recusada, e nenhuma
+# entrada é sobrescrita por um link físico dentro da saída
+teste_saida_na_entrada() {
+    local entrada="$TEMP/mesma" antes depois
+    cp -r "$CORPUS" "$entrada"
+    ln -s "$entrada" "$TEMP/mesma_link"
+    antes=$(cd "$entrada" && md5sum *)
+    executar "$TEMP/mesma1.log" --entrada="$entrada" --saida="$entrada" && return 1
+    executar "$TEMP/mesma2.log" --entrada="$entrada" --saida="$TEMP/mesma_link/" && return 1
+
+    local saida="$TEMP/mesma_saida" primeiro
+    primeiro=$(ls "$entrada" | head -1)
+    mkdir "$saida"
+    ln "$entrada/$primeiro" "$saida/$primeiro"
+    executar "$TEMP/mesma3.log" --entrada="$entrada" --saida="$saida"
+    depois=$(cd "$entrada" && md5sum *)
+    [ "$antes" = "$depois" ]
+}
+verificar "saída igual à entrada: recusada, sem sobrescrever as originais" teste_saida_na_entrada
+
+# -r com a saída, o cache e o índice dentro da entrada: a varredura não os
+# percorre, e execuções repetidas não processam as próprias saídas
+teste_saida_dentro_da_entrada() {
+    local entrada="$TEMP/arvore" log
+    cp -r "$CORPUS" "$entrada"
+    mkdir "$entrada/sub"
+    mv "$entrada/$(ls "$CORPUS" | head -1)" "$entrada/sub/"
+    local opcoes=(-r --entrada="$entrada" --saida="$entrada/saida" --cache="$entrada/.cache" --incremental
+        --indice="$entrada/indice")
+
+    executar "$TEMP/arvore1.log" "${opcoes[@]}" || return 1
+    igual "$(estatistica "$TEMP/arvore1.log" "Arquivos encontrados")" "$NUM_IMAGENS" || return 1
+    igual "$(estatistica "$TEMP/arvore1.log" "Arquivos processados e registrados")" "$NUM_IMAGENS" || return 1
+    for log in "$TEMP/arvore2.log" "$TEMP/arvore3.log"; do
+        executar "$log" "${opcoes[@]}" || return 1
+        igual "$(estatistica "$log" "Arquivos inalterados")" "$NUM_IMAGENS" || return 1
+        igual "$(estatistica "$log" "Arquivos encontrados")" 0 || return 1
+    done
+    [ ! -e "$entrada/saida/saida" ] && [ ! -e "$entrada/saida/sub/saida" ]
+}
+verificar "saída, cache e índice dentro da entrada: fora da varredura recursiva" teste_saida_dentro_da_entrada
+
+# --incremental: a segunda execução pula tudo; mudar o mtime de um arquivo
+# reprocessa só ele; mudar o pipeline invalida o índice inteiro; com
+# --indice-conteudo, um mtime novo com o mesmo conteúdo não reprocessa nada
+teste_incremental() {
+    local entrada="$TEMP/incremental" saida="$TEMP/incremental_saida" log="$TEMP/incremental.log" primeiro
+    cp -r "$CORPUS" "$entrada"
+    primeiro=$(ls "$entrada" | head -1)
+    local opcoes=(--entrada="$entrada" --saida="$saida" --incremental --indice="$TEMP/incremental.indice")
+
+    executar "$log" "${opcoes[@]}" || return 1
+    igual "$(estatistica "$log" "Arquivos processados e registrados")" "$NUM_IMAGENS" || return 1
+    mesmas_saidas "$saida" "$REFERENCIA" || return 1
+
+    executar "$log" "${opcoes[@]}" || return 1
+    igual "$(estatistica "$log" "Arquivos inalterados")" "$NUM_IMAGENS" || return 1
+    igual "$(soma "$log" "Imagens processadas")" 0 || return 1
+
+    touch -d "+1 hour" "$entrada/$primeiro"
+    executar "$log" "${opcoes[@]}" || return 1
+    igual "$(estatistica "$log" "Arquivos processados e registrados")" 1 || return 1
+    igual "$(estatistica "$log" "Arquivos inalterados")" $((NUM_IMAGENS - 1)) || return 1
+    mesmas_saidas "$saida" "$REFERENCIA" || return 1
+
+    executar "$log" "${opcoes[@]}" --pipeline=cinza --indice-conteudo || return 1
+    igual "$(estatistica "$log" "Arquivos processados e registrados")" "$NUM_IMAGENS" || return 1
+    igual "$(estatistica "$log" "Arquivos inalterados")" 0 || return 1
+
+    touch -d "+2 hours" "$entrada/$primeiro"
+    executar "$log" "${opcoes[@]}" --pipeline=cinza --indice-conteudo || return 1
+    igual "$(estatistica "$log" "Comparados pelo hash do conteúdo")" 1 || return 1
+    igual "$(soma "$log" "Imagens processadas")" 0
+}
+verificar "incremental: pula inalterados e invalida por mtime, conteúdo e pipeline" teste_incremental
+
+# --cache: a segunda execução acerta todas as consultas e grava as mesmas
+# saídas; outro pipeline é outra chave; com um limite menor que o corpus, o
+# LRU remove entradas sem afetar as saídas
+teste_cache() {
+    local cache="$TEMP/cache" log="$TEMP/cache.log"
+
+    executar "$log" --entrada="$CORPUS" --saida="$TEMP/cache1" --cache="$cache" || return 1
+    igual "$(estatistica "$log" "Resultados guardados")" "$NUM_IMAGENS" || return 1
+    mesmas_saidas "$TEMP/cache1" "$REFERENCIA" || return 1
+
+    executar "$log" --entrada="$CORPUS" --saida="$TEMP/cache2" --cache="$cache" || return 1
+    igual "$(grep -o "acertos: [0-9]*" "$log" | sed 's/.* //')" "$NUM_IMAGENS" || return 1
+    mesmas_saidas "$TEMP/cache2" "$REFERENCIA" || return 1
+
+    executar "$log" --entrada="$CORPUS" --saida="$TEMP/cache3" --cache="$cache" --pipeline=cinza || return 1
+    igual "$(grep -o "acertos: [0-9]*" "$log" | sed 's/.* //')" 0 || return 1
+
+    executar "$log" --entrada="$CORPUS" --saida="$TEMP/cache4" --cache="$TEMP/cache_pequeno" --cache-max=1 || return 1
+    [ "$(grep -o "removidos (LRU): [0-9]*" "$log" | sed 's/.* //')" -gt 0 ] || return 1
+    mesmas_saidas "$TEMP/cache4" "$REFERENCIA" || return 1
+    executar "$log" --entrada="$CORPUS" --saida="$TEMP/cache5" --cache="$TEMP/cache_pequeno" --cache-max=1 || return 1
+    mesmas_saidas "$TEMP/cache5" "$REFERENCIA"
+}
+verificar "cache: acertos, chave por pipeline e remoção LRU sem alterar as saídas" teste_cache
+
+# --deduplicar: cópias idênticas (com vários varredores disputando o mesmo
+# grupo) são decodificadas uma vez e recebem a saída do original; um arquivo
+# do mesmo tamanho com um byte diferente não entra no grupo
+teste_deduplicacao() {
+    local entrada="$TEMP/dedup" saida="$TEMP/dedup_saida" log="$TEMP/dedup.log" arquivo quase copias=0 tamanho
+    cp -r "$CORPUS" "$entrada"
+    for arquivo in $(ls "$CORPUS" | head -4); do
+        cp "$CORPUS/$arquivo" "$entrada/copia_$arquivo"
+        copias=$((copias + 1))
+    done
+    quase=quase_$(ls "$CORPUS" | grep '\.bmp$' | tail -1)
+    cp "$CORPUS/${quase#quase_}" "$entrada/$quase"
+    tamanho=$(stat -c %s "$entrada/$quase")
+    printf '\125' | dd of="$entrada/$quase" bs=1 seek=$((tamanho - 1)) conv=notrunc 2> /dev/null
+
+    executar "$log" --entrada="$entrada" --saida="$saida" --deduplicar --threads-varredura=4 --produtores=4 \
+        --consumidores=4 || return 1
+    igual "$(estatistica "$log" "Duplicatas encontradas")" "$copias" || return 1
+    igual "$(soma "$log" "Imagens processadas")" $((NUM_IMAGENS + 1)) || return 1
+    for arquivo in $(ls "$CORPUS" | head -4); do
+        cmp -s "$saida/copia_$arquivo" "$REFERENCIA/$arquivo" || return 1
+        rm "$saida/copia_$arquivo"
+    done
+    rm "$saida/$quase"
+    mesmas_saidas "$saida" "$REFERENCIA"
+}
+verificar "deduplicação: cópias recebem a saída do original e só são decodificadas uma vez" teste_deduplicacao
+
+# Só formatos sem perdas: a cadeia de execuções regrava a imagem a cada passo
+SEM_PERDAS=(--incluir='*.png' --incluir='*.bmp' --incluir='*.tga')
+
+# encadeado SAÍDA OPERAÇÃO...: aplica cada operação em uma execução separada,
+# a saída de uma sendo a entrada da seguinte, e deixa o resultado em SAÍDA
+encadeado() {
+    local saida=$1 entrada="$CORPUS" passo=0 operacao
+    shift
+    for operacao in "$@"; do
+        passo=$((passo + 1))
+        executar "$saida.$passo.log" --entrada="$entrada" --saida="$saida.$passo" "${SEM_PERDAS[@]}" \
+            --pipeline="$operacao" || return 1
+        entrada="$saida.$passo"
+    done
+    mv "$entrada" "$saida"
+}
+
+# fundido_igual_encadeado OPERAÇÃO...: o pipeline inteiro em uma execução (o
+# plano compilado e fundido) grava os mesmos bytes que uma execução por operação
+fundido_igual_encadeado() {
+    local nome="$TEMP/plano$((++planos))" pipeline
+    pipeline=$(IFS=,; echo "$*")
+    executar "$nome.log" --entrada="$CORPUS" --saida="$nome.fundido" "${SEM_PERDAS[@]}" --pipeline="$pipeline" || return 1
+    encadeado "$nome.encadeado" "$@" || return 1
+    [ -n "$(ls "$nome.fundido")" ] && mesmas_saidas "$nome.fundido" "$nome.encadeado"
+}
+planos=0
+
+# Plano compilado: as operações pixel a pixel fundidas em uma tabela e a
+# miniatura equivalem à aplicação sequencial
+teste_plano_fundido() {
+    fundido_igual_encadeado cinza inverter brilho=1.2 contraste=1.3 || return 1
+    fundido_igual_encadeado inverter miniatura=64 brilho=0.8 || return 1
+    fundido_igual_encadeado contraste=0.7 miniatura=128 cinza miniatura=32
+}
+verificar "plano fundido: mesmos bytes que uma execução por operação" teste_plano_fundido
+
+# Recortes como vistas: sozinhos, combinados com as outras operações, um
+# dentro do outro e depois da miniatura, também equivalem à aplicação
+# sequencial; as imagens menores que o recorte são recusadas nos dois casos
+teste_plano_recorte() {
+    fundido_igual_encadeado recorte=200x150+10+20 || return 1
+    fundido_igual_encadeado recorte=200x150+10+20 cinza inverter brilho=1.2 contraste=1.3 miniatura=64 || return 1
+    fundido_igual_encadeado brilho=1.1 recorte=300x300+5+5 recorte=100x80+30+40 inverter || return 1
+    fundido_igual_encadeado miniatura=128 recorte=64x48+16+8 contraste=1.4
+}
+verificar "plano com recortes: mesmos bytes que uma execução por operação" teste_plano_recorte
+
+# --lote: com muitos ícones, os produtores inserem lotes maiores que a
+# capacidade da fila e os consumidores retiram vários por vez, com uma ou
+# várias filas; nenhuma imagem se perde ou se repete e as saídas não mudam
+teste_lotes() {
+    local entrada="$TEMP/lotes" referencia="$TEMP/lotes_referencia" log="$TEMP/lotes.log" i opcoes menor extensao
+    cp -r "$CORPUS" "$entrada"
+    menor=$(ls -S "$CORPUS" | grep -v '\.jpg$' | tail -1)
+    extensao=${menor##*.}
+    for i in $(seq 10 49); do
+        cp "$CORPUS/$menor" "$entrada/icone_$i.$extensao"
+    done
+    local total=$((NUM_IMAGENS + 40))
+    executar "$log" --entrada="$entrada" --saida="$referencia" --es=sincrono --produtores=1 --consumidores=1 \
+        --prefetch=0 || return 1
+
+    for opcoes in "--lote=8 --capacidade-fila=4" \
+        "--lote=16 --capacidade-fila=2 --fragmentos=4 --produtores=4 --consumidores=4" \
+        "--lote=64 --produtores=3 --consumidores=5" \
+        "--lote=8 --capacidade-fila=4 --ordenado --janela-reordenacao=8 --produtores=2 --consumidores=3"; do
+        rm -rf "$TEMP/lotes_saida"
+        executar "$log" --entrada="$entrada" --saida="$TEMP/lotes_saida" $opcoes || return 1
+        igual "$(soma "$log" "Imagens processadas")" "$total" || return 1
+        [ "$(estatistica "$log" "Retiradas dos consumidores")" -gt 0 ] || return 1
+        [[ $opcoes == *--ordenado* ]] || [ "$(estatistica "$log" "Inserções em lote")" -gt 0 ] || return 1
+        mesmas_saidas "$TEMP/lotes_saida" "$referencia" || return 1
+    done
+}
+verificar "lotes: inserção e retirada em lote sem perder imagens nem alterar as saídas" teste_lotes
+
+echo "$((testes - falhas)) de $testes testes passaram"
+[ "$falhas" -eq 0 ]